@@ -0,0 +1,202 @@
+/* Host benchmark and check of the background archiver.
+ *
+ * First the input goes through archiver_compress_file() with the deflate
+ * settings of the firmware build (see main/CMakeLists.txt): compression ratio,
+ * host throughput, the size of the compressor state and the longest time one
+ * chunk kept the CPU. The .gz is inflated again with tinfl and compared with
+ * the input, its gzip header and trailer are checked as well.
+ *
+ * Then the archiver task runs on a scratch directory holding two copies of
+ * the input, the second one reported as in use, with busy() true for the
+ * first half second. The first copy has to end up as .gz with a manifest
+ * line, the second has to stay untouched. Non-zero exit on any mismatch.
+ *
+ * usage: bench_archive <input.pcap> [chunk_size] [probes]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "miniz.h"
+#include "archiver.h"
+
+#define BENCH_DIR           "/tmp/bench_archive"
+#define BENCH_BUSY_MS       500
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    *len = ftell(fp);
+    rewind(fp);
+    uint8_t *data = malloc(*len ? *len : 1);
+    if (data && fread(data, 1, *len, fp) != *len) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    return data;
+}
+
+static bool write_file(const char *path, const uint8_t *data, size_t len)
+{
+    FILE *fp = fopen(path, "wb");
+    bool ok = fp && fwrite(data, 1, len, fp) == len;
+    return fp && fclose(fp) == 0 && ok;
+}
+
+/* Inflate a single member gzip file written by the archiver */
+static bool check_gzip(const char *path, const uint8_t *raw, size_t raw_len, const char *name)
+{
+    size_t len, out_len = 0;
+    uint8_t *gz = read_file(path, &len);
+    bool ok = gz && len > 18 && gz[0] == 0x1f && gz[1] == 0x8b && gz[2] == 8 && gz[3] == 0x08;
+    size_t name_len = strlen(name) + 1;
+
+    ok = ok && len > 10 + name_len + 8 && memcmp(gz + 10, name, name_len) == 0;
+    if (ok) {
+        size_t start = 10 + name_len;
+        void *data = tinfl_decompress_mem_to_heap(gz + start, len - start - 8, &out_len, 0);
+        const uint8_t *t = gz + len - 8;
+        uint32_t crc = t[0] | t[1] << 8 | t[2] << 16 | (uint32_t)t[3] << 24;
+        uint32_t isize = t[4] | t[5] << 8 | t[6] << 16 | (uint32_t)t[7] << 24;
+        ok = data && out_len == raw_len && memcmp(data, raw, raw_len) == 0 &&
+             crc == (uint32_t)mz_crc32(MZ_CRC32_INIT, raw, raw_len) && isize == (uint32_t)raw_len;
+        mz_free(data);
+    }
+    free(gz);
+    return ok;
+}
+
+static uint64_t busy_until_us;
+static uint32_t busy_calls;
+static uint64_t last_call_us;
+static uint64_t max_chunk_us;
+
+/* Also times the gaps between two polls, each one is one chunk of work */
+static bool bench_busy(void)
+{
+    uint64_t now = now_us();
+    if (last_call_us && now - last_call_us > max_chunk_us && now >= busy_until_us) {
+        max_chunk_us = now - last_call_us;
+    }
+    last_call_us = now;
+    busy_calls++;
+    return now < busy_until_us;
+}
+
+static bool bench_in_use(const char *path)
+{
+    return strcmp(path, BENCH_DIR "/file_000001.pcap") == 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <input.pcap> [chunk_size] [probes]\n", argv[0]);
+        return 2;
+    }
+    const char *const extensions[] = {".pcap", ".pcapng"};
+    archiver_config_t config = {
+        .dir = BENCH_DIR,
+        .manifest = BENCH_DIR "/ARCHIVE_MANIFEST.csv",
+        .extensions = extensions,
+        .extension_count = 2,
+        .busy = bench_busy,
+        .in_use = bench_in_use,
+        .chunk_size = argc > 2 ? strtoul(argv[2], NULL, 10) : 4096,
+        .probes = argc > 3 ? strtoul(argv[3], NULL, 10) : 32,
+        .min_saving_pct = 10,
+        .idle_ms = 100,
+        .pause_ms = 20,
+        .stack_size = 4096,
+        .priority = 1,
+        .core = 0,
+    };
+    size_t raw_len;
+    uint8_t *raw = read_file(argv[1], &raw_len);
+    if (raw == NULL) {
+        perror(argv[1]);
+        return 2;
+    }
+    bool ok = true;
+
+    // Single file, no pauses
+    mkdir(BENCH_DIR, 0755);
+    archiver_result_t result;
+    max_chunk_us = last_call_us = 0;
+    uint64_t start = now_us();
+    esp_err_t err = archiver_compress_file(argv[1], BENCH_DIR "/single.gz", &config, NULL, &result);
+    double wall_s = (now_us() - start) / 1e6;
+    if (err != ESP_OK) {
+        fprintf(stderr, "compress failed: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    const char *slash = strrchr(argv[1], '/');
+    bool gz_ok = check_gzip(BENCH_DIR "/single.gz", raw, raw_len, slash ? slash + 1 : argv[1]);
+    printf("compressor state %zu bytes (window %u, code buffer %u), chunk %lu, probes %lu\n", sizeof(tdefl_compressor),
+           (unsigned)TDEFL_LZ_DICT_SIZE, (unsigned)TDEFL_LZ_CODE_BUF_SIZE, (unsigned long)config.chunk_size,
+           (unsigned long)config.probes);
+    printf("%zu -> %llu bytes, ratio %.2f, %.1f MB/s, longest chunk %.2f ms, round trip %s\n", raw_len,
+           (unsigned long long)result.stored_bytes, (double)raw_len / result.stored_bytes, raw_len / wall_s / 1e6,
+           max_chunk_us / 1000.0, gz_ok ? "ok" : "FAILED");
+    ok = ok && gz_ok;
+    unlink(BENCH_DIR "/single.gz");
+
+    // Background task: file 0 is compressed after the busy period, file 1 stays
+    unlink(config.manifest);
+    unlink(BENCH_DIR "/file_000000.pcap.gz");
+    ok = write_file(BENCH_DIR "/file_000000.pcap", raw, raw_len) &&
+         write_file(BENCH_DIR "/file_000001.pcap", raw, raw_len) && ok;
+    busy_until_us = now_us() + BENCH_BUSY_MS * 1000;
+    start = now_us();
+    if (archiver_start(&config) != ESP_OK) {
+        fprintf(stderr, "archiver_start failed\n");
+        return 1;
+    }
+    archiver_stats_t stats = { 0 };
+    while (stats.compressed + stats.kept_raw + stats.aborted == 0 && now_us() - start < 60 * 1000000ull) {
+        usleep(10000);
+        archiver_get_stats(&stats);
+    }
+    bool stopped = archiver_stop(5000);
+    double done_s = (now_us() - start) / 1e6;
+
+    struct stat st;
+    bool task_ok = stopped && stats.compressed == 1 && stats.pauses > 0 &&
+                   access(BENCH_DIR "/file_000000.pcap", F_OK) != 0 &&
+                   check_gzip(BENCH_DIR "/file_000000.pcap.gz", raw, raw_len, "file_000000.pcap") &&
+                   stat(BENCH_DIR "/file_000001.pcap", &st) == 0 && (size_t)st.st_size == raw_len &&
+                   access(BENCH_DIR "/file_000001.pcap.gz", F_OK) != 0;
+    size_t manifest_len = 0;
+    char *manifest = (char *)read_file(config.manifest, &manifest_len);
+    task_ok = task_ok && manifest && memmem(manifest, manifest_len, "file_000000.pcap,gz,", 20) &&
+              !memmem(manifest, manifest_len, "file_000001", 11);
+    printf("task: %lu compressed, %lu pauses over %d ms of load, done after %.2f s, in-use file kept, manifest %s -> %s\n",
+           (unsigned long)stats.compressed, (unsigned long)stats.pauses, BENCH_BUSY_MS, done_s,
+           manifest ? "written" : "missing", task_ok ? "ok" : "FAILED");
+    ok = ok && task_ok;
+
+    free(manifest);
+    free(raw);
+    unlink(BENCH_DIR "/file_000000.pcap.gz");
+    unlink(BENCH_DIR "/file_000001.pcap");
+    unlink(config.manifest);
+    rmdir(BENCH_DIR);
+    return ok ? 0 : 1;
+}
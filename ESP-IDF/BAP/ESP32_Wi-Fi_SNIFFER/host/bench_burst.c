@@ -0,0 +1,179 @@
+/* Host checks and throughput run for the burst coalescer.
+ *
+ * Checks the join rules against instances.py (sequence number step, 12 bit
+ * wrap, IE signature, WPS UUID-E), window expiry and eviction of the least
+ * recently active burst, and the IE walk of probe_record_parse() for probe
+ * requests, beacons and WPS IEs. Exits non-zero on a wrong result, then feeds
+ * bursts of a MAC population through a full table and prints records per
+ * second and the bursts closed by eviction.
+ *
+ * usage: bench_burst [records] [population] [capacity]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "burst_coalescer.h"
+#include "probe_record.h"
+
+#define WINDOW_US       500000
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static probe_record_t record(uint8_t mac, uint16_t seq, uint32_t ie_hash, uint32_t wps_hash, uint64_t t_us)
+{
+    probe_record_t rec = {
+        .timestamp_us = t_us,
+        .ie_hash = ie_hash,
+        .wps_hash = wps_hash,
+        .addr2 = {0x02, 0x00, 0x00, 0x00, 0x00, mac},
+        .seq = seq,
+        .rssi = -60,
+    };
+    return rec;
+}
+
+static bool add(burst_coalescer_t *c, probe_record_t rec, burst_t *evicted, bool *evicted_valid)
+{
+    return burst_coalescer_add(c, &rec, evicted, evicted_valid);
+}
+
+static void check_rules(void)
+{
+    burst_coalescer_t c;
+    burst_t evicted, out[4];
+    bool valid;
+
+    CHECK(burst_coalescer_init(&c, 2, WINDOW_US));
+    // Step of 1 to 4 with the same IEs joins, 5 opens a new burst
+    CHECK(add(&c, record(1, 100, 7, 0, 0), &evicted, &valid));
+    CHECK(!add(&c, record(1, 101, 7, 0, 1000), &evicted, &valid));
+    CHECK(!add(&c, record(1, 105, 7, 0, 2000), &evicted, &valid));
+    CHECK(add(&c, record(1, 110, 7, 0, 3000), &evicted, &valid) && !valid);
+    CHECK(burst_coalescer_expire(&c, UINT64_MAX, out, 4) == 2);
+    // 12 bit wrap, same sequence number and other IEs do not join
+    CHECK(add(&c, record(1, 4094, 7, 0, 0), &evicted, &valid));
+    CHECK(!add(&c, record(1, 1, 7, 0, 1000), &evicted, &valid));
+    CHECK(add(&c, record(1, 1, 7, 0, 2000), &evicted, &valid));
+    CHECK(burst_coalescer_expire(&c, UINT64_MAX, out, 4) == 2);
+    CHECK(add(&c, record(1, 10, 7, 0, 0), &evicted, &valid));
+    CHECK(add(&c, record(1, 11, 8, 0, 1000), &evicted, &valid));
+    CHECK(burst_coalescer_expire(&c, UINT64_MAX, out, 4) == 2);
+    // Same WPS UUID-E joins whatever the sequence number and IEs, another MAC never does
+    CHECK(add(&c, record(1, 10, 7, 0x1234, 0), &evicted, &valid));
+    CHECK(!add(&c, record(1, 900, 8, 0x1234, 1000), &evicted, &valid));
+    CHECK(add(&c, record(2, 901, 8, 0x1234, 2000), &evicted, &valid));
+    CHECK(burst_coalescer_expire(&c, UINT64_MAX, out, 4) == 2 && out[0].count + out[1].count == 3);
+    // Idle for the window: not joined, closed by expire
+    CHECK(add(&c, record(1, 20, 7, 0, 0), &evicted, &valid));
+    CHECK(add(&c, record(1, 21, 7, 0, WINDOW_US + 1), &evicted, &valid));
+    CHECK(burst_coalescer_expire(&c, WINDOW_US + 1, out, 4) == 1 && out[0].last_seq == 20);
+    CHECK(burst_coalescer_expire(&c, UINT64_MAX, out, 4) == 1);
+    // Full table: the least recently active burst is evicted
+    CHECK(add(&c, record(1, 30, 7, 0, 0), &evicted, &valid));
+    CHECK(add(&c, record(2, 30, 7, 0, 1000), &evicted, &valid));
+    CHECK(!add(&c, record(1, 31, 7, 0, 2000), &evicted, &valid));
+    CHECK(add(&c, record(3, 30, 7, 0, 3000), &evicted, &valid) && valid && evicted.first.addr2[5] == 2);
+    burst_coalescer_deinit(&c);
+}
+
+static void check_parse(void)
+{
+    static const uint8_t wps[] = {
+        221, 22, 0x00, 0x50, 0xf2, 0x04,
+        0x10, 0x4a, 0x00, 0x01, 0x10,                   // Version
+        0x10, 0x47, 0x00, 0x04, 0xde, 0xad, 0xbe, 0xef, // UUID-E, shortened
+        0x10, 0x3c, 0x00, 0x01, 0x03,                   // RF bands
+    };
+    uint8_t frame[128] = {0};
+    probe_record_t probe, beacon, data;
+
+    // Probe request: wildcard SSID, then the WPS IE
+    frame[0] = 0x40;
+    frame[24] = PROBE_RECORD_IE_SSID;
+    frame[25] = 0;
+    memcpy(frame + 26, wps, sizeof(wps));
+    CHECK(probe_record_parse(&probe, frame, 26 + sizeof(wps)));
+    CHECK(probe.ie_count == 2 && probe.ssid_len == 0 && probe.wps_hash != 0);
+
+    // Beacon with the same IEs after 12 bytes of fixed fields
+    memmove(frame + 36, frame + 24, 2 + sizeof(wps));
+    memset(frame + 24, 0xff, 12);
+    frame[0] = 0x80;
+    CHECK(probe_record_parse(&beacon, frame, 38 + sizeof(wps)));
+    CHECK(beacon.ie_count == 2 && beacon.ie_hash == probe.ie_hash && beacon.wps_hash == probe.wps_hash);
+
+    // Data frame: no IE list
+    frame[0] = 0x08;
+    CHECK(probe_record_parse(&data, frame, 38 + sizeof(wps)));
+    CHECK(data.ie_count == 0 && data.wps_hash == 0);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t records = argc > 1 ? strtoul(argv[1], NULL, 0) : 2000000;
+    uint32_t population = argc > 2 ? strtoul(argv[2], NULL, 0) : 256;
+    uint16_t capacity = argc > 3 ? strtoul(argv[3], NULL, 0) : 64;
+
+    check_rules();
+    check_parse();
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("rules and parse checks ok\n");
+
+    burst_coalescer_t c;
+    burst_t evicted, out[64];
+    bool valid;
+    uint16_t *seq = calloc(population, sizeof(uint16_t));
+    uint64_t opened = 0, evictions = 0, expired = 0, t_us = 0, next_expire_us = 0;
+
+    if (seq == NULL || !burst_coalescer_init(&c, capacity, WINDOW_US)) {
+        return 1;
+    }
+    srand(1);
+    double start = now_s();
+    for (uint32_t i = 0; i < records; ) {
+        // Bursts of 1 to 8 frames from a random MAC of the population
+        uint32_t mac = rand() % population;
+        uint32_t burst = 1 + rand() % 8;
+        t_us += rand() % 40000;
+        for (uint32_t j = 0; j < burst && i < records; j++, i++) {
+            t_us += 200 + rand() % 2000;
+            probe_record_t rec = record(0, seq[mac]++ & 0x0FFF, mac * 2654435761u, 0, t_us);
+            rec.addr2[4] = mac >> 8;
+            rec.addr2[5] = mac;
+            opened += add(&c, rec, &evicted, &valid);
+            evictions += valid;
+        }
+        // The stats stage expires bursts every 100 ms
+        if (t_us >= next_expire_us) {
+            expired += burst_coalescer_expire(&c, t_us, out, 64);
+            next_expire_us = t_us + 100000;
+        }
+    }
+    double elapsed = now_s() - start;
+    printf("records=%u population=%u capacity=%u: %.1f M records/s, %.1f frames per burst, "
+           "%.1f%% of bursts closed by eviction, %llu by the window\n",
+           records, population, capacity, records / elapsed / 1e6, (double)records / opened,
+           100.0 * evictions / opened, (unsigned long long)expired);
+    burst_coalescer_deinit(&c);
+    free(seq);
+    return 0;
+}
@@ -0,0 +1,123 @@
+/* Host checks and accuracy run for rx_clock.
+ *
+ * Simulates a radio counter running drift_ppm fast against the wall clock and
+ * truncated to 32 bits like rx_ctrl.timestamp, with frames arriving in random
+ * gaps, a few out of order, and one silence longer than two counter wraps.
+ * The clock is soft-synced every sync_s seconds against the true wall time
+ * plus callback jitter. Exits non-zero when the wrap or reorder handling is
+ * wrong, then prints the timestamp error against the true wall time.
+ *
+ * usage: bench_clock [drift_ppm] [sync_s] [hours]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "rx_clock.h"
+
+#define WALL_EPOCH_US   1735693200000000LL
+#define SYNC_JITTER_US  50
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static void check_extend(void)
+{
+    rx_clock_t clock;
+
+    rx_clock_reset(&clock);
+    CHECK(rx_clock_extend(&clock, 0xFFFFFF00u, 1000) == 0xFFFFFF00u);
+    // Wrap between two close frames
+    CHECK(rx_clock_extend(&clock, 0x100, 1512) == 0x100000100ULL);
+    // Reordered frame keeps its own earlier time and does not move the clock back
+    CHECK(rx_clock_extend(&clock, 0xFFFFFFF0u, 1520) == 0xFFFFFFF0ULL);
+    CHECK(rx_clock_extend(&clock, 0x200, 1768) == 0x100000200ULL);
+    // Three wraps of silence, only the monotonic clock can tell
+    uint64_t silence = 3 * (1ULL << 32) + 1000;
+    CHECK(rx_clock_extend(&clock, 0x200 + 1000, 1768 + silence + 7) == 0x100000200ULL + silence);
+
+    // Anchor, conversion and drift
+    CHECK(rx_clock_to_wall(&clock, 0) == 0);
+    rx_clock_sync(&clock, 1000000, WALL_EPOCH_US, true);
+    CHECK(rx_clock_to_wall(&clock, 1500000) == WALL_EPOCH_US + 500000);
+    rx_clock_sync(&clock, 101000000, WALL_EPOCH_US + 100010000, false);   // 100 ppm fast wall clock
+    CHECK(clock.drift_ppb == 100000);
+    rx_clock_sync(&clock, 201000000, WALL_EPOCH_US + 3600000000LL, false); // wall clock set, not drift
+    CHECK(clock.drift_ppb == 100000 && clock.drift_samples == 1);
+    CHECK(rx_clock_to_wall(&clock, 201000000) == WALL_EPOCH_US + 3600000000LL);
+}
+
+static void run(double drift_ppm, uint32_t sync_s, double hours)
+{
+    rx_clock_t clock;
+    uint64_t true_local = 123456789;    // Counter does not start at 0 after boot
+    double wall = WALL_EPOCH_US;
+    uint64_t next_sync = 0;
+    uint64_t frames = 0;
+    int64_t max_error = 0;
+    double sum_error = 0;
+
+    rx_clock_reset(&clock);
+    srand(1);
+
+    while (wall - WALL_EPOCH_US < hours * 3600e6) {
+        uint64_t gap = 100 + rand() % 20000;
+        // One long silence in the middle of the run
+        if (frames == 1000) {
+            gap = 2 * (1ULL << 32) + 12345;
+        }
+        true_local += gap;
+        wall += gap * (1.0 + drift_ppm * 1e-6);
+
+        uint32_t raw = (uint32_t)true_local;
+        bool reordered = rand() % 64 == 0;
+        if (reordered) {
+            raw -= 300;
+        }
+        uint64_t local = rx_clock_extend(&clock, raw, true_local + rand() % 30);
+
+        if (true_local >= next_sync) {
+            rx_clock_sync(&clock, local, (int64_t)wall + rand() % SYNC_JITTER_US, next_sync == 0);
+            next_sync = true_local + (uint64_t)sync_s * 1000000;
+        }
+
+        double expected = reordered ? wall - 300 * (1.0 + drift_ppm * 1e-6) : wall;
+        int64_t error = rx_clock_to_wall(&clock, local) - (int64_t)expected;
+        if (error < 0) {
+            error = -error;
+        }
+        if (error > max_error) {
+            max_error = error;
+        }
+        sum_error += error;
+        frames++;
+    }
+
+    printf("%llu frames over %.1f h, drift %.1f ppm, sync every %lu s: estimate %.1f ppm, "
+           "error mean %.1f us, max %lld us\n",
+           (unsigned long long)frames, hours, drift_ppm, (unsigned long)sync_s, clock.drift_ppb / 1000.0,
+           sum_error / frames, (long long)max_error);
+}
+
+int main(int argc, char **argv)
+{
+    double drift_ppm = argc > 1 ? atof(argv[1]) : 40.0;
+    uint32_t sync_s = argc > 2 ? strtoul(argv[2], NULL, 10) : 60;
+    double hours = argc > 3 ? atof(argv[3]) : 6.0;
+
+    check_extend();
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all clock checks passed\n");
+
+    run(drift_ppm, sync_s, hours);
+    return 0;
+}
@@ -0,0 +1,179 @@
+/* Host benchmark: fopen/fclose per reduced CSV line against the open stream.
+ *
+ * The same probe request lines, formatted as sniffer_write_reduced_data()
+ * does, go to a file under /tmp once through fopen("a"), fwrite and fclose
+ * per line (the old path) and then through a storage stream that stays open
+ * for the whole run, with the flush policies of "csv_flush_records" and
+ * "csv_flush_ms" and one fsync before the close as on capture stop.
+ *
+ * Prints records per second and the speedup over the old path, the fwrite
+ * and fsync calls of the storage task and the FatFs directory walks (one per
+ * fopen) and directory entry updates (one per fclose or fsync). The host
+ * page cache hides what those cost on the card, so the speedup there is
+ * larger than here. All variants must produce the same file (non-zero exit
+ * otherwise).
+ *
+ * usage: bench_csv [records] [flush_ms]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "storage_writer.h"
+
+#define BENCH_FILE          "/tmp/bench_csv.csv"
+
+typedef struct {
+    const char *name;
+    bool reopen;                // fopen/fclose per line
+    uint32_t flush_records;     // csv_flush_records, 0 = by age only
+    double wall_s;
+    uint32_t fwrites;
+    uint32_t syncs;
+    uint32_t dir_walks;
+    uint32_t dir_updates;
+    uint32_t checksum;
+} variant_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Time, MAC, RSSI as in sniffer_write_reduced_data(), the same sequence for every variant */
+static int make_line(uint32_t i, char *line, size_t size)
+{
+    uint32_t seed = i * 2654435761u;
+    time_t when = 1700000000 + i / 500;
+    char str_buf[64];
+
+    strftime(str_buf, sizeof(str_buf), "%c", localtime(&when));
+    return snprintf(line, size, "%s, %02X:%02X:%02X:%02X:%02X:%02X, %d\n", str_buf, 0x02 | (seed & 0xfc),
+                    (seed >> 8) & 0xff, (seed >> 16) & 0xff, seed >> 24, i & 0xff, (i >> 8) & 0xff,
+                    -40 - (int)(seed % 50));
+}
+
+static bool run_reopen(variant_t *v, uint32_t records)
+{
+    char line[96];
+
+    for (uint32_t i = 0; i < records; i++) {
+        int len = make_line(i, line, sizeof(line));
+        FILE *fp = fopen(BENCH_FILE, "a");
+        if (fp == NULL) {
+            return false;
+        }
+        bool ok = fwrite(line, 1, len, fp) == (size_t)len;
+        v->dir_walks++;
+        v->dir_updates++;
+        v->fwrites++;
+        if (fclose(fp) != 0 || !ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool run_stream(variant_t *v, uint32_t records, uint32_t flush_ms)
+{
+    storage_writer_t *writer = storage_writer_default();
+    storage_stream_t stream;
+    char line[96];
+    uint32_t unflushed = 0;
+
+    FILE *fp = fopen(BENCH_FILE, "a");
+    if (writer == NULL || fp == NULL) {
+        return false;
+    }
+    // As in sniffer_start(), the blocks are the only buffer
+    setvbuf(fp, NULL, _IONBF, 0);
+    v->dir_walks++;
+    storage_writer_reset_stats(writer);
+    storage_stream_open(&stream, writer, fp);
+    for (uint32_t i = 0; i < records; i++) {
+        int len = make_line(i, line, sizeof(line));
+        int64_t now_us = esp_timer_get_time();
+        if (storage_stream_write(&stream, line, len, now_us) != ESP_OK) {
+            return false;
+        }
+        // Same policy as sniffer_write_csv() and sniffer_flush_due()
+        if (v->flush_records && ++unflushed >= v->flush_records) {
+            storage_stream_flush(&stream);
+            unflushed = 0;
+        }
+        if (storage_stream_flush_due(&stream, now_us, (int64_t)flush_ms * 1000)) {
+            unflushed = 0;
+        }
+    }
+    storage_stream_sync(&stream);
+    storage_stream_close(&stream);
+    if (!storage_writer_sync(writer, 10000)) {
+        return false;
+    }
+    v->fwrites = writer->writes;
+    v->syncs = writer->syncs;
+    v->dir_updates = writer->syncs + 1;
+    return writer->errors == 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t records = argc > 1 ? strtoul(argv[1], NULL, 10) : 50000;
+    uint32_t flush_ms = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000;
+    variant_t variants[] = {
+        { .name = "reopen", .reopen = true },
+        { .name = "by age" },
+        { .name = "1 record", .flush_records = 1 },
+        { .name = "16", .flush_records = 16 },
+        { .name = "256", .flush_records = 256 },
+    };
+    const int count = sizeof(variants) / sizeof(variants[0]);
+    bool ok = true;
+
+    printf("%lu records, flush after %lu ms or the given number of records\n", (unsigned long)records,
+           (unsigned long)flush_ms);
+    printf("%-10s %12s %9s %10s %8s %10s %12s\n", "flush", "records/s", "speedup", "fwrite", "fsync", "dir walks",
+           "dir updates");
+
+    double base_s = 0;
+    for (int i = 0; i < count; i++) {
+        variant_t *v = &variants[i];
+        unlink(BENCH_FILE);
+        uint64_t start = now_ns();
+        if (!(v->reopen ? run_reopen(v, records) : run_stream(v, records, flush_ms))) {
+            fprintf(stderr, "%s: write failed\n", v->name);
+            return 1;
+        }
+        v->wall_s = (now_ns() - start) / 1e9;
+        if (i == 0) {
+            base_s = v->wall_s;
+        }
+
+        // FNV-1a over the file, every variant has to match the first
+        FILE *in = fopen(BENCH_FILE, "rb");
+        int c;
+        v->checksum = 2166136261u;
+        while (in && (c = fgetc(in)) != EOF) {
+            v->checksum = (v->checksum ^ (uint8_t)c) * 16777619u;
+        }
+        if (in) {
+            fclose(in);
+        }
+
+        printf("%-10s %12.0f %8.2fx %10lu %8lu %10lu %12lu\n", v->name, records / v->wall_s, base_s / v->wall_s,
+               (unsigned long)v->fwrites, (unsigned long)v->syncs, (unsigned long)v->dir_walks,
+               (unsigned long)v->dir_updates);
+        if (v->checksum != variants[0].checksum) {
+            fprintf(stderr, "%s: file differs from the reopen one\n", v->name);
+            ok = false;
+        }
+    }
+    unlink(BENCH_FILE);
+    return ok ? 0 : 1;
+}
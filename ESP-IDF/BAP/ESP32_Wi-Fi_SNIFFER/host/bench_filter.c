@@ -0,0 +1,225 @@
+/* Host checks and benchmark for packet_filter.
+ *
+ * First runs every rule against hand-built frames and exits non-zero on a wrong
+ * verdict or hit count, then measures packet_filter_accept() per frame on a
+ * random mix of probe requests with full allow/deny lists, the worst case the
+ * Wi-Fi callback has to absorb.
+ *
+ * usage: bench_filter [frames]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "packet_filter.h"
+
+#define FRAME_LEN 128
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Probe request from addr2 with an SSID element followed by a rates element */
+static uint32_t build_probe(uint8_t *frame, const uint8_t *addr2, const char *ssid)
+{
+    static const uint8_t rates[] = {1, 4, 0x02, 0x04, 0x0b, 0x16};
+    size_t ssid_len = strlen(ssid);
+
+    memset(frame, 0, FRAME_LEN);
+    frame[0] = 0x40;
+    memset(frame + 4, 0xff, 6);
+    memcpy(frame + 10, addr2, 6);
+    memset(frame + 16, 0xff, 6);
+    frame[24] = 0;
+    frame[25] = ssid_len;
+    memcpy(frame + 26, ssid, ssid_len);
+    memcpy(frame + 26 + ssid_len, rates, sizeof(rates));
+    return 26 + ssid_len + sizeof(rates);
+}
+
+static void check_rules(void)
+{
+    static packet_filter_t filter;
+    uint8_t frame[FRAME_LEN];
+    uint8_t addr[6];
+    bool oui;
+    const uint8_t phone[6] = {0x58, 0xbf, 0x25, 0x82, 0xf2, 0x74};
+    const uint8_t random[6] = {0xda, 0xa1, 0x19, 0x00, 0x00, 0x01};
+    const uint8_t other[6] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+    uint32_t len;
+
+    CHECK(packet_filter_parse_addr("58:BF:25:82:F2:74", addr, &oui) && !oui && memcmp(addr, phone, 6) == 0);
+    CHECK(packet_filter_parse_addr("58-bf-25", addr, &oui) && oui && addr[2] == 0x25 && addr[3] == 0);
+    CHECK(!packet_filter_parse_addr("58:BF:2", addr, &oui));
+    CHECK(!packet_filter_parse_addr("58:BF:25:82", addr, &oui));
+    CHECK(!packet_filter_parse_addr("58:BF:25:82:F2:74:00", addr, &oui));
+
+    // Default: probe requests only
+    packet_filter_reset(&filter);
+    packet_filter_compile(&filter);
+    len = build_probe(frame, phone, "");
+    CHECK(packet_filter_accept(&filter, frame, len, -50));
+    frame[0] = 0x80;  // beacon
+    CHECK(!packet_filter_accept(&filter, frame, len, -50));
+    frame[0] = 0x40;
+    CHECK(!packet_filter_accept(&filter, frame, 20, -50));
+    CHECK(filter.hits[PACKET_FILTER_RULE_SUBTYPE] == 1 && filter.hits[PACKET_FILTER_RULE_SHORT] == 1 && filter.passed == 1);
+
+    // RSSI floor
+    filter.rssi_floor = -70;
+    CHECK(packet_filter_accept(&filter, frame, len, -70));
+    CHECK(!packet_filter_accept(&filter, frame, len, -71));
+    CHECK(filter.hits[PACKET_FILTER_RULE_RSSI] == 1);
+    filter.rssi_floor = PACKET_FILTER_RSSI_OFF;
+
+    // Deny wins over allow, OUI lists match the first 3 bytes
+    packet_filter_add(&filter, phone, true, true);
+    packet_filter_add(&filter, other, false, false);
+    packet_filter_compile(&filter);
+    CHECK(packet_filter_accept(&filter, frame, len, -50));
+    len = build_probe(frame, other, "");
+    CHECK(!packet_filter_accept(&filter, frame, len, -50));
+    CHECK(filter.hits[PACKET_FILTER_RULE_DENY_MAC] == 1);
+    len = build_probe(frame, random, "");
+    CHECK(!packet_filter_accept(&filter, frame, len, -50));
+    CHECK(filter.hits[PACKET_FILTER_RULE_ALLOW] == 1);
+
+    // Locally administered bit
+    packet_filter_reset(&filter);
+    filter.random_mac = PACKET_FILTER_RANDOM_EXCLUDE;
+    CHECK(!packet_filter_accept(&filter, frame, len, -50));
+    filter.random_mac = PACKET_FILTER_RANDOM_ONLY;
+    CHECK(packet_filter_accept(&filter, frame, len, -50));
+    len = build_probe(frame, phone, "");
+    CHECK(!packet_filter_accept(&filter, frame, len, -50));
+    CHECK(filter.hits[PACKET_FILTER_RULE_RANDOM_MAC] == 2);
+    filter.random_mac = PACKET_FILTER_RANDOM_ANY;
+
+    // SSID, wildcard probes do not match
+    CHECK(packet_filter_set_ssid(&filter, "eduroam"));
+    CHECK(!packet_filter_accept(&filter, frame, len, -50));
+    len = build_probe(frame, phone, "eduroam");
+    CHECK(packet_filter_accept(&filter, frame, len, -50));
+    len = build_probe(frame, phone, "eduroa");
+    CHECK(!packet_filter_accept(&filter, frame, len, -50));
+    CHECK(!packet_filter_accept(&filter, frame, 27, -50));  // SSID element cut short
+    CHECK(filter.hits[PACKET_FILTER_RULE_SSID] == 3);
+    // Beacons and frames with HT control have the SSID after their fixed fields
+    filter.subtype_mask[PACKET_FILTER_TYPE_MGMT] |= 1 << 8;
+    len = build_probe(frame, phone, "eduroam");
+    memmove(frame + 36, frame + 24, len - 24);
+    memset(frame + 24, 0, 12);
+    frame[0] = 0x80;
+    CHECK(packet_filter_accept(&filter, frame, len + 12, -50));
+    len = build_probe(frame, phone, "eduroam");
+    memmove(frame + 28, frame + 24, len - 24);
+    memset(frame + 24, 0, 4);
+    frame[1] = 0x80;
+    CHECK(packet_filter_accept(&filter, frame, len + 4, -50));
+    filter.subtype_mask[PACKET_FILTER_TYPE_MGMT] &= ~(1 << 8);
+    CHECK(!packet_filter_set_ssid(&filter, "0123456789abcdef0123456789abcdefX"));
+
+    // Full lists stay sorted and searchable
+    packet_filter_reset(&filter);
+    for (int i = 0; i < PACKET_FILTER_MAX_MACS; i++) {
+        uint8_t mac[6] = {0x02, 0, 0, 0, (uint8_t)(i * 37), (uint8_t)i};
+        CHECK(packet_filter_add(&filter, mac, false, true));
+    }
+    CHECK(!packet_filter_add(&filter, phone, false, true));
+    packet_filter_compile(&filter);
+    for (int i = 0; i < PACKET_FILTER_MAX_MACS; i++) {
+        uint8_t mac[6] = {0x02, 0, 0, 0, (uint8_t)(i * 37), (uint8_t)i};
+        len = build_probe(frame, mac, "");
+        CHECK(packet_filter_accept(&filter, frame, len, -50));
+    }
+    len = build_probe(frame, phone, "");
+    CHECK(!packet_filter_accept(&filter, frame, len, -50));
+}
+
+static void bench(uint32_t frames)
+{
+    static packet_filter_t filter;
+    static uint8_t frames_buf[256][FRAME_LEN];
+    uint32_t lens[256];
+    int8_t rssi[256];
+
+    packet_filter_reset(&filter);
+    srand(1);
+    for (int i = 0; i < PACKET_FILTER_MAX_MACS; i++) {
+        uint8_t mac[6];
+        for (int b = 0; b < 6; b++) {
+            mac[b] = rand();
+        }
+        packet_filter_add(&filter, mac, false, true);
+        mac[5] ^= 0x55;
+        packet_filter_add(&filter, mac, false, false);
+    }
+    for (int i = 0; i < PACKET_FILTER_MAX_OUIS; i++) {
+        uint8_t oui[6] = {rand(), rand(), rand()};
+        packet_filter_add(&filter, oui, true, true);
+        oui[2] ^= 0x55;
+        packet_filter_add(&filter, oui, true, false);
+    }
+    filter.rssi_floor = -90;
+    packet_filter_set_ssid(&filter, "eduroam");
+    packet_filter_compile(&filter);
+
+    for (int i = 0; i < 256; i++) {
+        uint8_t mac[6];
+        for (int b = 0; b < 6; b++) {
+            mac[b] = rand();
+        }
+        // Every fourth frame comes from an allowed MAC so the SSID walk runs too
+        if (i % 4 == 0) {
+            uint64_t key = filter.allow_mac[i % PACKET_FILTER_MAX_MACS];
+            for (int b = 0; b < 6; b++) {
+                mac[b] = key >> (40 - 8 * b);
+            }
+        }
+        lens[i] = build_probe(frames_buf[i], mac, i % 8 ? "eduroam" : "HomeNetwork");
+        rssi[i] = -40 - rand() % 60;
+    }
+
+    uint32_t passed = 0;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < frames; i++) {
+        passed += packet_filter_accept(&filter, frames_buf[i & 255], lens[i & 255], rssi[i & 255]);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    printf("%lu frames, %d+%d allow and deny MACs, %d+%d OUIs: %.1f ns/frame, %lu passed\n",
+           (unsigned long)frames, PACKET_FILTER_MAX_MACS, PACKET_FILTER_MAX_MACS, PACKET_FILTER_MAX_OUIS,
+           PACKET_FILTER_MAX_OUIS, (double)elapsed / frames, (unsigned long)passed);
+    for (int i = 0; i < PACKET_FILTER_RULE_COUNT; i++) {
+        printf("  rule %d hits %u\n", i, atomic_load(&filter.hits[i]));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t frames = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+
+    check_rules();
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all filter checks passed\n");
+
+    bench(frames);
+    return 0;
+}
@@ -0,0 +1,224 @@
+/* Host benchmark: snprintf/strftime against the cached time and table driven text formatting.
+ *
+ * Reduced CSV lines, burst lines and the MAC strings of the top request displays
+ * are formatted for the same probe request stream once the old way, with
+ * localtime + strftime("%c") and snprintf per record, and once with
+ * text_format.h: the time text is only rendered when the second changes, MACs
+ * come from a 256 entry hex table and numbers from integer math. The stream
+ * runs at the given rate from just before a daylight saving change in a
+ * CET/CEST zone, so cached texts have to follow the offset change.
+ *
+ * Prints ns per record and the speedup for each kind of text. Both paths
+ * must produce the same bytes (non-zero exit otherwise).
+ *
+ * usage: bench_format [records] [rate_fps]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "text_format.h"
+
+#define BENCH_TZ            "CET-1CEST,M3.5.0,M10.5.0/3"
+#define BENCH_START_S       1711846740      // 2024-03-31 00:59:00 UTC, a minute before CEST starts
+
+typedef struct {
+    uint64_t timestamp_us;
+    uint64_t last_us;
+    uint8_t mac[6];
+    int8_t rssi;
+    int8_t rssi_min;
+    uint16_t count;
+} bench_record_t;
+
+typedef struct {
+    const char *name;
+    size_t (*old_path)(const bench_record_t *record, char *out);
+    size_t (*new_path)(const bench_record_t *record, char *out);
+    double old_ns;
+    double new_ns;
+} bench_kind_t;
+
+static text_time_cache_t cache;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* As sniffer_write_reduced_data() was */
+static size_t old_csv(const bench_record_t *record, char *out)
+{
+    const uint8_t *mac = record->mac;
+    time_t current_time = record->timestamp_us / 1000000;
+    char str_buf[64];
+
+    strftime(str_buf, sizeof(str_buf), "%c", localtime(&current_time));
+    return snprintf(out, 96, "%s, %02X:%02X:%02X:%02X:%02X:%02X, %d\n", str_buf, mac[0], mac[1], mac[2], mac[3],
+                    mac[4], mac[5], record->rssi);
+}
+
+static size_t new_csv(const bench_record_t *record, char *out)
+{
+    size_t len = text_format_time(&cache, record->timestamp_us, 0, out);
+    out[len++] = ',';
+    out[len++] = ' ';
+    len += text_format_mac(out + len, record->mac);
+    out[len++] = ',';
+    out[len++] = ' ';
+    len += text_format_int(out + len, record->rssi);
+    out[len++] = '\n';
+    return len;
+}
+
+/* As sniffer_write_burst_data() was */
+static size_t old_burst(const bench_record_t *record, char *out)
+{
+    const uint8_t *mac = record->mac;
+    time_t first_time = record->timestamp_us / 1000000;
+    char str_buf[64];
+
+    strftime(str_buf, sizeof(str_buf), "%c", localtime(&first_time));
+    return snprintf(out, 160, "%s, %02X:%02X:%02X:%02X:%02X:%02X, %d, %u, %d, %llu.%06lu, %llu.%06lu\n", str_buf,
+                    mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], record->rssi, record->count, record->rssi_min,
+                    (unsigned long long)(record->timestamp_us / 1000000),
+                    (unsigned long)(record->timestamp_us % 1000000),
+                    (unsigned long long)(record->last_us / 1000000), (unsigned long)(record->last_us % 1000000));
+}
+
+static size_t new_burst(const bench_record_t *record, char *out)
+{
+    static const char sep[2] = {',', ' '};
+    size_t len = text_format_time(&cache, record->timestamp_us, 0, out);
+
+    memcpy(out + len, sep, 2);
+    len += 2;
+    len += text_format_mac(out + len, record->mac);
+    memcpy(out + len, sep, 2);
+    len += 2;
+    len += text_format_int(out + len, record->rssi);
+    memcpy(out + len, sep, 2);
+    len += 2;
+    len += text_format_int(out + len, record->count);
+    memcpy(out + len, sep, 2);
+    len += 2;
+    len += text_format_int(out + len, record->rssi_min);
+    memcpy(out + len, sep, 2);
+    len += 2;
+    len += text_format_epoch_us(out + len, record->timestamp_us);
+    memcpy(out + len, sep, 2);
+    len += 2;
+    len += text_format_epoch_us(out + len, record->last_us);
+    out[len++] = '\n';
+    return len;
+}
+
+/* As update_top_requests() formatted every frame, now only the displays do */
+static size_t old_mac(const bench_record_t *record, char *out)
+{
+    const uint8_t *mac = record->mac;
+    return snprintf(out, 18, "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+static size_t new_mac(const bench_record_t *record, char *out)
+{
+    size_t len = text_format_mac(out, record->mac);
+    out[len] = '\0';
+    return len;
+}
+
+/* Local time with 3 decimals against strftime plus integer math done by hand */
+static size_t old_time_ms(const bench_record_t *record, char *out)
+{
+    time_t second = record->timestamp_us / 1000000;
+    char str_buf[64];
+
+    strftime(str_buf, sizeof(str_buf), "%c", localtime(&second));
+    return snprintf(out, 64, "%s.%03lu", str_buf, (unsigned long)(record->timestamp_us % 1000000 / 1000));
+}
+
+static size_t new_time_ms(const bench_record_t *record, char *out)
+{
+    return text_format_time(&cache, record->timestamp_us, 3, out);
+}
+
+static void make_records(bench_record_t *records, uint32_t count, double rate)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t seed = i * 2654435761u;
+        bench_record_t *r = &records[i];
+        r->timestamp_us = (uint64_t)BENCH_START_S * 1000000 + (uint64_t)(i * 1e6 / rate) + seed % 1000;
+        r->last_us = r->timestamp_us + seed % 3000000;
+        r->mac[0] = 0x02 | (seed & 0xfc);
+        r->mac[1] = seed >> 8;
+        r->mac[2] = seed >> 16;
+        r->mac[3] = seed >> 24;
+        r->mac[4] = i;
+        r->mac[5] = i >> 8;
+        r->rssi = -30 - (int)(seed % 70);
+        r->rssi_min = r->rssi - (int)(seed % 20);
+        r->count = 1 + seed % 40;
+    }
+}
+
+static double run_path(size_t (*path)(const bench_record_t *, char *), const bench_record_t *records, uint32_t count,
+                       uint32_t *checksum)
+{
+    char out[192];
+    uint32_t sum = 2166136261u;
+
+    text_time_cache_init(&cache);
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < count; i++) {
+        size_t len = path(&records[i], out);
+        // FNV-1a over every text, both paths have to match
+        for (size_t b = 0; b < len; b++) {
+            sum = (sum ^ (uint8_t)out[b]) * 16777619u;
+        }
+    }
+    double ns = (double)(now_ns() - start) / count;
+    *checksum = sum;
+    return ns;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 500000;
+    double rate = argc > 2 ? atof(argv[2]) : 500;
+    bench_kind_t kinds[] = {
+        { "csv line", old_csv, new_csv },
+        { "burst line", old_burst, new_burst },
+        { "mac", old_mac, new_mac },
+        { "time .ms", old_time_ms, new_time_ms },
+    };
+    bool ok = true;
+
+    setenv("TZ", BENCH_TZ, 1);
+    tzset();
+    bench_record_t *records = malloc(count * sizeof(*records));
+    if (records == NULL || count == 0) {
+        return 2;
+    }
+    make_records(records, count, rate);
+
+    printf("%lu records at %.0f fps over %.0f s, TZ %s across the CEST change\n", (unsigned long)count, rate,
+           count / rate, BENCH_TZ);
+    printf("%-12s %14s %14s %9s\n", "text", "old ns/record", "new ns/record", "speedup");
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+        bench_kind_t *kind = &kinds[k];
+        uint32_t old_sum, new_sum;
+        kind->old_ns = run_path(kind->old_path, records, count, &old_sum);
+        kind->new_ns = run_path(kind->new_path, records, count, &new_sum);
+        printf("%-12s %14.1f %14.1f %8.2fx\n", kind->name, kind->old_ns, kind->new_ns, kind->old_ns / kind->new_ns);
+        if (old_sum != new_sum) {
+            fprintf(stderr, "%s: texts differ from the snprintf/strftime ones\n", kind->name);
+            ok = false;
+        }
+    }
+    free(records);
+    return ok ? 0 : 1;
+}
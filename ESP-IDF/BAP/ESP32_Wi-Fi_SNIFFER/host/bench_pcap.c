@@ -0,0 +1,253 @@
+/* Host benchmark: per-record fflush against the block-buffered pcap writer.
+ *
+ * The same probe request stream goes through pcap_capture_packet() with each
+ * buffer size, 0 being the old path of four fwrites and an fflush per record
+ * behind newlib's 128 byte stdio buffer. A flush timer runs on simulated time
+ * at the given frame rate like packet_capture_flush_due() in the writer task.
+ *
+ * Writes land in a file under /tmp and, at the same time, in a model of the
+ * FatFs write path: a one-sector window that is written back when a write
+ * moves to another sector, and sector aligned runs that go to the card as one
+ * multi-block command. From it come card commands, sectors written, write
+ * amplification (bytes written to the card per byte of file) and an estimated
+ * card time. FAT and directory updates are the same for every variant and left
+ * out. All variants must produce the same file (non-zero exit otherwise).
+ *
+ * usage: bench_pcap [records] [rate_fps] [flush_ms] [cmd_us] [sector_us]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "esp_wifi_types.h"
+#include "pcap.h"
+
+#define SECTOR_SIZE         512
+#define NEWLIB_STDIO_BUF    128     // st_blksize reported by the ESP-IDF FAT VFS falls back to BUFSIZ
+#define BENCH_FILE          "/tmp/bench_pcap.pcap"
+#define MAX_FRAME           400
+
+typedef struct {
+    int fd;
+    uint64_t pos;
+    uint64_t size;
+    int64_t win_sector;         // Sector held in the FatFs window, -1 for none
+    bool win_dirty;
+    uint32_t write_calls;       // write() calls reaching the VFS
+    uint32_t card_writes;       // Write commands sent to the card
+    uint32_t card_reads;
+    uint64_t sectors_written;
+} fat_sink_t;
+
+static void fat_window_flush(fat_sink_t *sink)
+{
+    if (sink->win_dirty) {
+        sink->card_writes++;
+        sink->sectors_written++;
+        sink->win_dirty = false;
+    }
+}
+
+/* f_write without FF_FS_TINY: partial sectors go through the window, aligned runs straight to the card */
+static void fat_model_write(fat_sink_t *sink, uint64_t pos, size_t len)
+{
+    while (len) {
+        int64_t sector = pos / SECTOR_SIZE;
+        uint32_t offset = pos % SECTOR_SIZE;
+        if (offset == 0 && len >= SECTOR_SIZE) {
+            uint32_t count = len / SECTOR_SIZE;
+            sink->card_writes++;
+            sink->sectors_written += count;
+            if (sink->win_sector >= sector && sink->win_sector < sector + count) {
+                // FatFs refreshes the window from the new data
+                sink->win_dirty = false;
+            }
+            pos += (uint64_t)count * SECTOR_SIZE;
+            len -= (size_t)count * SECTOR_SIZE;
+            continue;
+        }
+        if (sink->win_sector != sector) {
+            fat_window_flush(sink);
+            if (pos < sink->size) {
+                sink->card_reads++;
+            }
+            sink->win_sector = sector;
+        }
+        size_t chunk = SECTOR_SIZE - offset < len ? SECTOR_SIZE - offset : len;
+        sink->win_dirty = true;
+        pos += chunk;
+        len -= chunk;
+    }
+}
+
+static ssize_t sink_write(void *cookie, const char *buf, size_t len)
+{
+    fat_sink_t *sink = cookie;
+    sink->write_calls++;
+    fat_model_write(sink, sink->pos, len);
+    if (pwrite(sink->fd, buf, len, sink->pos) != (ssize_t)len) {
+        return -1;
+    }
+    sink->pos += len;
+    if (sink->pos > sink->size) {
+        sink->size = sink->pos;
+    }
+    return len;
+}
+
+static int sink_close(void *cookie)
+{
+    fat_sink_t *sink = cookie;
+    fat_window_flush(sink);
+    return close(sink->fd);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Probe requests of 60-360 bytes, the same sequence for every variant */
+static uint16_t make_frame(uint32_t i, wifi_promiscuous_pkt_t *pkt)
+{
+    uint32_t seed = i * 2654435761u;
+    uint16_t len = 60 + seed % 300;
+    memset(&pkt->rx_ctrl, 0, sizeof(pkt->rx_ctrl));
+    pkt->rx_ctrl.rssi = -40 - (int)(seed % 50);
+    pkt->rx_ctrl.channel = 1 + seed % 12;
+    pkt->rx_ctrl.sig_len = len + 4;
+    for (uint16_t b = 0; b < len; b++) {
+        pkt->payload[b] = (uint8_t)(seed >> (b % 24)) ^ b;
+    }
+    pkt->payload[0] = 0x40;
+    return len;
+}
+
+typedef struct {
+    uint32_t buffer_size;
+    fat_sink_t sink;
+    uint32_t pcap_fwrites;
+    double wall_s;
+    uint64_t file_size;
+    uint32_t checksum;
+} variant_t;
+
+static bool run_variant(variant_t *v, uint32_t records, double rate, uint32_t flush_ms)
+{
+    static uint8_t buffer[sizeof(wifi_promiscuous_pkt_t) + MAX_FRAME];
+    wifi_promiscuous_pkt_t *pkt = (wifi_promiscuous_pkt_t *)buffer;
+    cookie_io_functions_t io = { .write = sink_write, .close = sink_close };
+
+    memset(&v->sink, 0, sizeof(v->sink));
+    v->sink.win_sector = -1;
+    v->sink.fd = open(BENCH_FILE, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (v->sink.fd < 0) {
+        perror(BENCH_FILE);
+        return false;
+    }
+    FILE *fp = fopencookie(&v->sink, "wb", io);
+    setvbuf(fp, NULL, _IOFBF, NEWLIB_STDIO_BUF);
+
+    pcap_config_t config = {
+        .fp = fp,
+        .major_version = PCAP_DEFAULT_VERSION_MAJOR,
+        .minor_version = PCAP_DEFAULT_VERSION_MINOR,
+        .time_zone = PCAP_DEFAULT_TIME_ZONE_GMT,
+        .buffer_size = v->buffer_size,
+    };
+    pcap_file_handle_t pcap;
+    if (pcap_new_session(&config, &pcap) != ESP_OK) {
+        fclose(fp);
+        return false;
+    }
+
+    uint64_t start = now_ns();
+    pcap_write_header(pcap, PCAP_LINK_TYPE_802_11_RADIOTAP);
+    double next_flush_s = flush_ms / 1000.0;
+    for (uint32_t i = 0; i < records; i++) {
+        double t = i / rate;
+        if (flush_ms && t >= next_flush_s) {
+            // The writer flushes at most every flush_ms, and only when records wait
+            if (pcap_get_buffered_bytes(pcap)) {
+                pcap_flush(pcap);
+            }
+            next_flush_s = t + flush_ms / 1000.0;
+        }
+        make_frame(i, pkt);
+        if (pcap_capture_packet(pcap, pkt, 0, (uint32_t)t, (uint32_t)((t - (uint32_t)t) * 1e6)) != ESP_OK) {
+            pcap_del_session(pcap);
+            return false;
+        }
+    }
+    v->pcap_fwrites = pcap_get_file_writes(pcap);
+    v->file_size = pcap_get_bytes_written(pcap);
+    pcap_del_session(pcap);
+    v->wall_s = (now_ns() - start) / 1e9;
+
+    // FNV-1a over the file, every variant has to match the first
+    FILE *in = fopen(BENCH_FILE, "rb");
+    int c;
+    v->checksum = 2166136261u;
+    while (in && (c = fgetc(in)) != EOF) {
+        v->checksum = (v->checksum ^ (uint8_t)c) * 16777619u;
+    }
+    if (in) {
+        fclose(in);
+    }
+    return v->sink.size == v->file_size;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t records = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+    double rate = argc > 2 ? atof(argv[2]) : 500;
+    uint32_t flush_ms = argc > 3 ? strtoul(argv[3], NULL, 10) : 1000;
+    double cmd_us = argc > 4 ? atof(argv[4]) : 500;
+    double sector_us = argc > 5 ? atof(argv[5]) : 205;
+    variant_t variants[] = {
+        { .buffer_size = 0 },
+        { .buffer_size = 4 * 1024 },
+        { .buffer_size = 16 * 1024 },
+        { .buffer_size = 32 * 1024 },
+    };
+    const int count = sizeof(variants) / sizeof(variants[0]);
+    bool ok = true;
+
+    printf("%lu records at %.0f fps, flush every %lu ms, card cost %.0f us per command + %.0f us per sector\n",
+           (unsigned long)records, rate, (unsigned long)flush_ms, cmd_us, sector_us);
+    printf("%-10s %10s %10s %10s %10s %8s %10s %10s %9s\n", "buffer", "fwrite", "write()", "card cmds",
+           "sectors", "amplif", "card s", "host MB/s", "speedup");
+
+    double base_card_s = 0;
+    for (int i = 0; i < count; i++) {
+        variant_t *v = &variants[i];
+        if (!run_variant(v, records, rate, flush_ms)) {
+            fprintf(stderr, "buffer %lu: write failed\n", (unsigned long)v->buffer_size);
+            return 1;
+        }
+        double card_s = (v->sink.card_writes * cmd_us + v->sink.sectors_written * sector_us) / 1e6;
+        if (i == 0) {
+            base_card_s = card_s;
+        }
+        char name[16];
+        snprintf(name, sizeof(name), v->buffer_size ? "%lu KB" : "per record", (unsigned long)v->buffer_size / 1024);
+        printf("%-10s %10lu %10lu %10lu %10llu %8.3f %10.2f %10.1f %8.2fx\n", name,
+               (unsigned long)v->pcap_fwrites, (unsigned long)v->sink.write_calls, (unsigned long)v->sink.card_writes,
+               (unsigned long long)v->sink.sectors_written,
+               (double)v->sink.sectors_written * SECTOR_SIZE / v->file_size, card_s,
+               v->file_size / v->wall_s / 1e6, base_card_s / card_s);
+        if (v->checksum != variants[0].checksum) {
+            fprintf(stderr, "buffer %lu: file differs from the per record one\n", (unsigned long)v->buffer_size);
+            ok = false;
+        }
+    }
+    unlink(BENCH_FILE);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,219 @@
+/* Host benchmark: blocking FreeRTOS-style queue vs spsc_ring between callback and sniffer task.
+ *
+ * The producer plays wifi_sniffer_cb during a probe storm: bursts of back-to-back
+ * frames separated by idle gaps. The consumer plays sniffer_task with a fixed
+ * processing cost per packet. The queue variant blocks the producer for up to
+ * 100 ms like xQueueSend() did and wakes the consumer per packet, the ring variant
+ * never blocks, drops when full and drains in batches.
+ *
+ * usage: bench_ring [burst] [gap_us] [cost_ns]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include "spsc_ring.h"
+
+#define BENCH_PACKETS       500000
+#define BENCH_QUEUE_LEN     128
+#define BENCH_DRAIN_BATCH   16
+#define QUEUE_TIMEOUT_MS    100
+
+typedef struct {
+    void *payload;
+    uint32_t length;
+    uint32_t seconds;
+    uint32_t microseconds;
+} packet_desc_t;
+
+/* Minimal bounded queue with xQueueSend()/xQueueReceive() semantics */
+typedef struct {
+    packet_desc_t items[BENCH_QUEUE_LEN];
+    uint32_t head;
+    uint32_t count;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} blocking_queue_t;
+
+static blocking_queue_t queue;
+static spsc_ring_t ring;
+static atomic_bool producer_done;
+static atomic_uint consumed;
+static uint32_t cost_ns = 2000;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void busy_wait_ns(uint64_t ns)
+{
+    uint64_t end = now_ns() + ns;
+    while (now_ns() < end) {
+    }
+}
+
+static bool queue_send(const packet_desc_t *item, uint32_t timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)timeout_ms * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+
+    pthread_mutex_lock(&queue.lock);
+    while (queue.count == BENCH_QUEUE_LEN) {
+        if (pthread_cond_timedwait(&queue.not_full, &queue.lock, &deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&queue.lock);
+            return false;
+        }
+    }
+    queue.items[(queue.head + queue.count) % BENCH_QUEUE_LEN] = *item;
+    queue.count++;
+    pthread_cond_signal(&queue.not_empty);
+    pthread_mutex_unlock(&queue.lock);
+    return true;
+}
+
+static bool queue_receive(packet_desc_t *item)
+{
+    pthread_mutex_lock(&queue.lock);
+    while (queue.count == 0) {
+        if (atomic_load(&producer_done)) {
+            pthread_mutex_unlock(&queue.lock);
+            return false;
+        }
+        pthread_cond_wait(&queue.not_empty, &queue.lock);
+    }
+    *item = queue.items[queue.head];
+    queue.head = (queue.head + 1) % BENCH_QUEUE_LEN;
+    queue.count--;
+    pthread_cond_signal(&queue.not_full);
+    pthread_mutex_unlock(&queue.lock);
+    return true;
+}
+
+static void *queue_consumer(void *arg)
+{
+    (void)arg;
+    packet_desc_t item;
+    while (queue_receive(&item)) {
+        busy_wait_ns(cost_ns);
+        atomic_fetch_add(&consumed, 1);
+    }
+    return NULL;
+}
+
+static void *ring_consumer(void *arg)
+{
+    (void)arg;
+    packet_desc_t batch[BENCH_DRAIN_BATCH];
+    while (1) {
+        uint32_t count = spsc_ring_pop_batch(&ring, batch, BENCH_DRAIN_BATCH);
+        if (count == 0) {
+            if (atomic_load(&producer_done)) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            busy_wait_ns(cost_ns);
+        }
+        atomic_fetch_add(&consumed, count);
+    }
+    return NULL;
+}
+
+static void run(bool use_ring, uint32_t burst, uint32_t gap_us)
+{
+    pthread_t thread;
+    packet_desc_t item = { .payload = NULL, .length = 200 };
+    uint32_t dropped = 0;
+    uint64_t max_block_ns = 0;
+
+    atomic_store(&producer_done, false);
+    atomic_store(&consumed, 0);
+    if (use_ring) {
+        spsc_ring_init(&ring, BENCH_QUEUE_LEN, sizeof(packet_desc_t));
+        pthread_create(&thread, NULL, ring_consumer, NULL);
+    } else {
+        memset(&queue, 0, sizeof(queue));
+        pthread_mutex_init(&queue.lock, NULL);
+        pthread_cond_init(&queue.not_empty, NULL);
+        pthread_cond_init(&queue.not_full, NULL);
+        pthread_create(&thread, NULL, queue_consumer, NULL);
+    }
+
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < BENCH_PACKETS; i++) {
+        if (burst && i % burst == 0 && i) {
+            // The driver task sleeps between bursts, which is when the consumer gets the CPU
+            struct timespec gap = { .tv_sec = gap_us / 1000000, .tv_nsec = (long)(gap_us % 1000000) * 1000 };
+            nanosleep(&gap, NULL);
+        }
+
+        bool sent;
+        if (use_ring) {
+            sent = spsc_ring_push(&ring, &item, NULL) != 0;
+        } else {
+            // Only the queue waits, timing the ring push would measure preemption of the producer thread
+            uint64_t t0 = now_ns();
+            sent = queue_send(&item, QUEUE_TIMEOUT_MS);
+            uint64_t blocked = now_ns() - t0;
+            if (blocked > max_block_ns) {
+                max_block_ns = blocked;
+            }
+        }
+        if (!sent) {
+            dropped++;
+        }
+    }
+    uint64_t produce_ns = now_ns() - start;
+
+    atomic_store(&producer_done, true);
+    if (!use_ring) {
+        pthread_mutex_lock(&queue.lock);
+        pthread_cond_broadcast(&queue.not_empty);
+        pthread_mutex_unlock(&queue.lock);
+    }
+    pthread_join(thread, NULL);
+    uint64_t total_ns = now_ns() - start;
+
+    printf("%-6s offered %9.0f pkt/s  processed %9.0f pkt/s  dropped %6.2f %%  ",
+           use_ring ? "ring" : "queue",
+           BENCH_PACKETS / (produce_ns / 1e9),
+           atomic_load(&consumed) / (total_ns / 1e9),
+           100.0 * dropped / BENCH_PACKETS);
+    if (use_ring) {
+        printf("producer never blocks\n");
+    } else {
+        printf("producer max block %9.1f us\n", max_block_ns / 1e3);
+    }
+
+    if (use_ring) {
+        spsc_ring_deinit(&ring);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t burst = argc > 1 ? strtoul(argv[1], NULL, 10) : 64;
+    uint32_t gap_us = argc > 2 ? strtoul(argv[2], NULL, 10) : 100;
+    cost_ns = argc > 3 ? strtoul(argv[3], NULL, 10) : cost_ns;
+
+    printf("%d packets, bursts of %lu every %lu us, %lu ns per packet, depth %d\n",
+           BENCH_PACKETS, (unsigned long)burst, (unsigned long)gap_us, (unsigned long)cost_ns, BENCH_QUEUE_LEN);
+    run(false, burst, gap_us);
+    run(true, burst, gap_us);
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "pcap_lib.h"
+#include "config.h"
+#include "capture_host.h"
+
+#define FCS_LEN             4
+#define MAX_FRAME_LEN       (4095 - FCS_LEN)    // sig_len is 12 bits
+#define DRAIN_TIMEOUT_US    (30 * 1000000LL)
+
+bool capture_host_enter(const char *out_dir)
+{
+    if (mkdir(out_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "cannot create %s: %s\n", out_dir, strerror(errno));
+        return false;
+    }
+    if (chdir(out_dir) != 0) {
+        fprintf(stderr, "cannot enter %s: %s\n", out_dir, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool capture_host_start(capture_host_t *host)
+{
+    memset(host, 0, sizeof(*host));
+    host->pkt = calloc(1, sizeof(wifi_promiscuous_pkt_t) + MAX_FRAME_LEN + FCS_LEN);
+    if (host->pkt == NULL) {
+        return false;
+    }
+
+    // The reduced CSV is appended to, start every run with an empty one
+    unlink(CONFIG_SD_MOUNT_POINT "/" CONFIG_OUTPUT_FILE);
+    initialize_sniffer();
+    if (pcap_open(0) != ESP_OK) {
+        fprintf(stderr, "pcap open failed\n");
+        return false;
+    }
+    if (sniffer_start() != ESP_OK) {
+        fprintf(stderr, "sniffer start failed\n");
+        pcap_close();
+        return false;
+    }
+    host->start_us = esp_timer_get_time();
+    return true;
+}
+
+bool capture_host_inject(capture_host_t *host, const uint8_t *frame, uint16_t len, int8_t rssi, uint8_t channel)
+{
+    wifi_promiscuous_pkt_t *pkt = host->pkt;
+
+    if (len > MAX_FRAME_LEN) {
+        return false;
+    }
+    memset(&pkt->rx_ctrl, 0, sizeof(pkt->rx_ctrl));
+    pkt->rx_ctrl.rssi = rssi;
+    pkt->rx_ctrl.channel = channel ? channel : host_wifi_channel();
+    pkt->rx_ctrl.sig_len = len + FCS_LEN;
+    memcpy(pkt->payload, frame, len);
+
+    // The radio counter is the local microsecond clock at reception, as on the chip
+    int64_t cb_start = esp_timer_get_time();
+    pkt->rx_ctrl.timestamp = (uint32_t)cb_start;
+    if (!host_wifi_inject(pkt, len ? (frame[0] >> 2) & 0x3 : WIFI_PKT_MISC)) {
+        return false;
+    }
+    int64_t cb_us = esp_timer_get_time() - cb_start;
+    host->cb_total_us += cb_us;
+    if (cb_us > host->cb_max_us) {
+        host->cb_max_us = cb_us;
+    }
+    host->injected++;
+    return true;
+}
+
+void capture_host_stop(capture_host_t *host)
+{
+    // sniffer_stop() drops whatever is still queued
+    int64_t drain_start = esp_timer_get_time();
+    do {
+        usleep(1000);
+        sniffer_get_stage_stats(host->stages);
+    } while ((host->stages[SNIFFER_STAGE_STATS].depth || host->stages[SNIFFER_STAGE_WRITER].depth) &&
+             esp_timer_get_time() - drain_start < DRAIN_TIMEOUT_US);
+    host->stop_us = esp_timer_get_time();
+
+    sniffer_stop();
+    pcap_close();
+    sniffer_get_capture_stats(&host->stats);
+    // Storage counters include the blocks written on close
+    sniffer_get_stage_stats(host->stages);
+    free(host->pkt);
+    host->pkt = NULL;
+}
+
+void capture_host_sleep_until(int64_t target_us)
+{
+    int64_t now = esp_timer_get_time();
+    if (target_us > now) {
+        struct timespec ts = { .tv_sec = (target_us - now) / 1000000, .tv_nsec = (target_us - now) % 1000000 * 1000 };
+        nanosleep(&ts, NULL);
+    }
+}
@@ -0,0 +1,50 @@
+/* Runs the firmware capture path on the host for replay and storm.
+ *
+ * The current directory is the SD card (CONFIG_SD_MOUNT_POINT is "." in the
+ * host build), capture_host_enter() switches to the output directory once.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_wifi.h"
+#include "sniffer.h"
+
+typedef struct {
+    wifi_promiscuous_pkt_t *pkt;    /* Frame buffer handed to the rx callback */
+    int64_t start_us;
+    int64_t stop_us;                /* After both stages drained */
+    uint32_t injected;              /* Frames passed to wifi_sniffer_cb */
+    int64_t cb_total_us;
+    int64_t cb_max_us;
+    capture_stats_t stats;          /* Filled by capture_host_stop() */
+    sniffer_stage_stats_t stages[SNIFFER_STAGE_COUNT];
+} capture_host_t;
+
+/**
+ * @brief Create the output directory if needed and make it the SD card
+ */
+bool capture_host_enter(const char *out_dir);
+
+/**
+ * @brief Open file_000000.pcap, start a fresh CSV and start the sniffer
+ */
+bool capture_host_start(capture_host_t *host);
+
+/**
+ * @brief Hand one 802.11 frame without FCS to wifi_sniffer_cb, like the Wi-Fi driver task
+ *
+ * @param channel 0 for the channel the sniffer is tuned to
+ * @return false when the promiscuous filter drops the frame type
+ */
+bool capture_host_inject(capture_host_t *host, const uint8_t *frame, uint16_t len, int8_t rssi, uint8_t channel);
+
+/**
+ * @brief Wait for both stages to drain, stop the sniffer and close the pcap file
+ */
+void capture_host_stop(capture_host_t *host);
+
+/**
+ * @brief Block until the CLOCK_MONOTONIC time target_us, as returned by esp_timer_get_time()
+ */
+void capture_host_sleep_until(int64_t target_us);
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "probe_storm.h"
+
+#define PROBE_REQ_FRAME_CTRL    0x40
+#define IE_SSID                 0
+#define IE_RATES                1
+#define IE_HT_CAP               45
+#define IE_EXT_RATES            50
+#define IE_VENDOR_SPECIFIC      221
+#define IE_VENDOR_MAX_DATA      (255 - 4)   // OUI and type come first
+#define RSSI_JITTER_DB          3
+
+static const uint8_t rates[] = {0x82, 0x84, 0x8b, 0x96, 0x0c, 0x12, 0x18, 0x24};
+static const uint8_t ext_rates[] = {0x30, 0x48, 0x60, 0x6c};
+static const uint8_t vendor_oui[] = {0x00, 0x17, 0xf2, 0x0a};   // Apple-like OUI and type, not the stats IE
+
+static uint64_t next_u64(probe_storm_t *storm)
+{
+    // xorshift64*
+    storm->rng ^= storm->rng >> 12;
+    storm->rng ^= storm->rng << 25;
+    storm->rng ^= storm->rng >> 27;
+    return storm->rng * 0x2545F4914F6CDD1DULL;
+}
+
+double probe_storm_uniform(probe_storm_t *storm)
+{
+    return (next_u64(storm) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint32_t uniform_range(probe_storm_t *storm, uint32_t lo, uint32_t hi)
+{
+    return hi > lo ? lo + next_u64(storm) % (hi - lo + 1) : lo;
+}
+
+static int clamp_rssi(double rssi)
+{
+    return rssi < -100 ? -100 : rssi > -10 ? -10 : (int)lround(rssi);
+}
+
+static void new_mac(probe_storm_t *storm, probe_storm_device_t *device)
+{
+    uint64_t bits = next_u64(storm);
+    for (int i = 0; i < 6; i++) {
+        device->mac[i] = bits >> (8 * i);
+    }
+    // Unicast, and locally administered only for randomized addresses
+    device->mac[0] &= 0xFC;
+    if (device->random_mac) {
+        device->mac[0] |= 0x02;
+    }
+}
+
+bool probe_storm_init(probe_storm_t *storm, const probe_storm_config_t *config)
+{
+    memset(storm, 0, sizeof(*storm));
+    storm->config = *config;
+    storm->rng = config->seed ? config->seed : 1;
+    if (storm->config.population == 0) {
+        storm->config.population = 1;
+    }
+    if (storm->config.burst_max == 0) {
+        storm->config.burst_max = 1;
+    }
+    if (storm->config.ssid_count > PROBE_STORM_MAX_SSIDS) {
+        storm->config.ssid_count = PROBE_STORM_MAX_SSIDS;
+    }
+
+    storm->devices = calloc(storm->config.population, sizeof(probe_storm_device_t));
+    if (storm->devices == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0; i < storm->config.population; i++) {
+        probe_storm_device_t *device = &storm->devices[i];
+        device->random_mac = uniform_range(storm, 0, 99) < storm->config.random_pct;
+        new_mac(storm, device);
+        // Half of the devices with a list ask for one of its networks
+        device->ssid = storm->config.ssid_count && (next_u64(storm) & 1) ?
+                       (int8_t)uniform_range(storm, 0, storm->config.ssid_count - 1) : -1;
+        // Box-Muller, one normal sample per device
+        double u1 = probe_storm_uniform(storm);
+        double u2 = probe_storm_uniform(storm);
+        double normal = sqrt(-2.0 * log(u1 > 0 ? u1 : 1e-12)) * cos(2 * M_PI * u2);
+        device->rssi = clamp_rssi(storm->config.rssi_mean + normal * storm->config.rssi_sd);
+        device->seq = next_u64(storm) & 0xFFF;
+    }
+    return true;
+}
+
+void probe_storm_deinit(probe_storm_t *storm)
+{
+    free(storm->devices);
+    storm->devices = NULL;
+}
+
+static uint8_t *put_ie(uint8_t *p, uint8_t id, const void *data, uint8_t len)
+{
+    p[0] = id;
+    p[1] = len;
+    memcpy(p + 2, data, len);
+    return p + 2 + len;
+}
+
+uint16_t probe_storm_next(probe_storm_t *storm, uint8_t *frame, int8_t *rssi)
+{
+    if (storm->burst_left == 0) {
+        storm->current = &storm->devices[uniform_range(storm, 0, storm->config.population - 1)];
+        storm->burst_left = uniform_range(storm, 1, storm->config.burst_max);
+        if (storm->current->random_mac) {
+            new_mac(storm, storm->current);
+        }
+    }
+    storm->burst_left--;
+    probe_storm_device_t *device = storm->current;
+
+    // Header: probe request to broadcast, addr2 is the device
+    uint8_t *p = frame;
+    memset(p, 0, 24);
+    p[0] = PROBE_REQ_FRAME_CTRL;
+    memset(p + 4, 0xFF, 6);
+    memcpy(p + 10, device->mac, 6);
+    memset(p + 16, 0xFF, 6);
+    device->seq = (device->seq + 1) & 0xFFF;
+    p[22] = device->seq << 4;
+    p[23] = device->seq >> 4;
+    p += 24;
+
+    const char *ssid = device->ssid >= 0 ? storm->config.ssids[device->ssid] : "";
+    size_t ssid_len = strlen(ssid);
+    p = put_ie(p, IE_SSID, ssid, ssid_len > 32 ? 32 : ssid_len);
+    p = put_ie(p, IE_RATES, rates, sizeof(rates));
+    p = put_ie(p, IE_EXT_RATES, ext_rates, sizeof(ext_rates));
+    uint8_t ht_cap[26] = {0x2d, 0x01, 0x1b, 0xff};
+    p = put_ie(p, IE_HT_CAP, ht_cap, sizeof(ht_cap));
+
+    // Vendor IE padding, split over several elements when it does not fit one
+    uint32_t pad = uniform_range(storm, storm->config.ie_min, storm->config.ie_max);
+    uint32_t room = PROBE_STORM_MAX_FRAME - (p - frame);
+    while (pad > 0 && room > 6) {
+        uint32_t chunk = pad < IE_VENDOR_MAX_DATA ? pad : IE_VENDOR_MAX_DATA;
+        if (chunk + 6 > room) {
+            chunk = room - 6;
+        }
+        p[0] = IE_VENDOR_SPECIFIC;
+        p[1] = 4 + chunk;
+        memcpy(p + 2, vendor_oui, sizeof(vendor_oui));
+        for (uint32_t i = 0; i < chunk; i += 8) {
+            uint64_t bits = next_u64(storm);
+            memcpy(p + 6 + i, &bits, chunk - i < 8 ? chunk - i : 8);
+        }
+        p += 6 + chunk;
+        room -= 6 + chunk;
+        pad -= chunk;
+    }
+
+    *rssi = clamp_rssi(device->rssi + (int)uniform_range(storm, 0, 2 * RSSI_JITTER_DB) - RSSI_JITTER_DB);
+    return p - frame;
+}
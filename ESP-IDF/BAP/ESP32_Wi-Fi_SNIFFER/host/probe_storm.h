@@ -0,0 +1,66 @@
+/* Synthetic probe request source for the host capture benchmarks.
+ *
+ * A population of devices sends bursts of probe requests. Devices with a
+ * randomized MAC pick a new locally administered address for every burst,
+ * the others keep theirs. Each device asks for one SSID of the list or for
+ * any network, has its own mean RSSI drawn from a normal distribution, and
+ * pads its frames with a vendor IE of random size.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PROBE_STORM_MAX_SSIDS   16
+#define PROBE_STORM_MAX_FRAME   1024
+
+typedef struct {
+    uint32_t population;        /* Distinct devices */
+    uint8_t random_pct;         /* Devices with a randomized MAC */
+    uint16_t ie_min;            /* Vendor IE payload bytes per frame, uniform in [ie_min, ie_max] */
+    uint16_t ie_max;
+    const char *ssids[PROBE_STORM_MAX_SSIDS];
+    uint8_t ssid_count;         /* 0 sends wildcard probes only */
+    int8_t rssi_mean;           /* Mean RSSI of the devices */
+    uint8_t rssi_sd;            /* Spread of the device means, frames add +-3 dB */
+    uint8_t burst_max;          /* Frames per burst, uniform in [1, burst_max] */
+    uint64_t seed;
+} probe_storm_config_t;
+
+typedef struct {
+    uint8_t mac[6];
+    int8_t ssid;                /* Index into ssids, -1 for wildcard */
+    int8_t rssi;
+    uint16_t seq;
+    bool random_mac;
+} probe_storm_device_t;
+
+typedef struct {
+    probe_storm_config_t config;
+    probe_storm_device_t *devices;
+    probe_storm_device_t *current;
+    uint32_t burst_left;
+    uint64_t rng;
+} probe_storm_t;
+
+/**
+ * @brief Create the device population
+ */
+bool probe_storm_init(probe_storm_t *storm, const probe_storm_config_t *config);
+
+void probe_storm_deinit(probe_storm_t *storm);
+
+/**
+ * @brief Build the next probe request, 802.11 header and IEs without FCS
+ *
+ * @param frame buffer of at least PROBE_STORM_MAX_FRAME bytes
+ * @param rssi RSSI the frame is received with
+ * @return frame length
+ */
+uint16_t probe_storm_next(probe_storm_t *storm, uint8_t *frame, int8_t *rssi);
+
+/**
+ * @brief Uniform random number in [0, 1) from the storm generator state
+ */
+double probe_storm_uniform(probe_storm_t *storm);
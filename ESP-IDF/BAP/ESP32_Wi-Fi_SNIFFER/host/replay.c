@@ -0,0 +1,650 @@
+/* Host replay of a capture through the whole sniffer pipeline.
+ *
+ * sniffer.c, pcap.c and pcap_lib.c are built against the stubs in stubs/,
+ * tasks run as threads and the SD card is the output directory. Frames of
+ * a pcap or pcapng file (radiotap or plain 802.11) are handed to
+ * wifi_sniffer_cb at the recorded pace, a multiple of it, or as fast as
+ * possible. Heartbeat and marker frames of the input are skipped, the sniffer
+ * writes its own.
+ *
+ * Reported are the offered and written rates, the capture counters, the
+ * stage load, and whether the output pcap and CSV hold the replayed frames
+ * in order with every missing one accounted for by a drop, filter or shed
+ * counter. With pcapng output the last Interface Statistics Block has to
+ * carry the final capture counters, the binary reduced file a valid header
+ * and whole records, the index sidecar entries that point at the records.
+ * With burst coalescing the frame counts of the bursts have to add up to the
+ * accepted frames and the pcap has to hold the first frame of each burst.
+ * Exits non-zero when they do not, or when frames were accepted and nothing
+ * was written.
+ *
+ * usage: replay <input.pcap> [out_dir] [speed] [pcap|pcapng] [csv|bin] [burst]
+ *        speed 1 replays at the recorded pace (default), 10 ten times faster, 0 as fast as possible
+ *        the output format defaults to classic pcap, the reduced one to CSV, burst turns on coalescing
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "pcap_lib.h"
+#include "config.h"
+#include "capture_host.h"
+#include "reduced_record.h"
+#include "pcap_index.h"
+
+#define PCAP_MAGIC_US           0xA1B2C3D4
+#define PCAPNG_SHB              0x0A0D0D0A
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_IDB              1
+#define PCAPNG_ISB              5
+#define PCAPNG_EPB              6
+#define PCAPNG_CUSTOM           0x00000BAD
+#define PCAPNG_OPT_CUSTOM_BIN   2989
+#define PCAPNG_ISB_COUNTERS     5   // isb_ifrecv .. isb_usrdeliv, option codes 4..8
+#define RTAP_PRESENT_EXT        (1u << 31)
+#define RTAP_FLAGS_FCS          0x10
+#define FCS_LEN                 4
+#define MAX_FRAME_LEN           (4095 - FCS_LEN)    // sig_len is 12 bits
+#define DEFAULT_RSSI            (-50)
+
+typedef struct {
+    uint64_t ts_us;
+    int8_t rssi;
+    uint8_t channel;            // 0 when the input has no radiotap channel
+    uint16_t len;
+    const uint8_t *frame;
+    uint32_t offset;            // start of the record or block in the file
+} replay_frame_t;
+
+typedef struct {
+    uint8_t *data;
+    long size;
+    replay_frame_t *frames;
+    uint32_t count;
+    uint32_t notes;             // pcapng Custom Blocks
+    uint32_t stats_blocks;      // pcapng Interface Statistics Blocks
+    uint64_t last_stats[PCAPNG_ISB_COUNTERS];
+} capture_t;
+
+/* Alignment and size of radiotap fields 0..14, enough to reach flags, channel and signal */
+static const uint8_t rtap_align[] = {8, 1, 1, 2, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 2};
+static const uint8_t rtap_size[]  = {8, 1, 1, 4, 2, 1, 1, 2, 2, 2, 1, 1, 1, 1, 2};
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint8_t freq_to_channel(uint16_t mhz)
+{
+    if (mhz == 2484) {
+        return 14;
+    }
+    if (mhz >= 2412 && mhz <= 2472) {
+        return (mhz - 2407) / 5;
+    }
+    return 0;
+}
+
+/* Fill rssi, channel and the 802.11 frame of one record, false when the radiotap header is unusable */
+static bool parse_radiotap(const uint8_t *rec, uint32_t len, replay_frame_t *frame)
+{
+    if (len < 8) {
+        return false;
+    }
+    uint16_t rtap_len = get_le16(rec + 2);
+    if (rtap_len < 8 || rtap_len > len) {
+        return false;
+    }
+
+    // Fields follow the last present word
+    uint32_t present = get_le32(rec + 4);
+    uint32_t off = 8;
+    for (uint32_t word = present; word & RTAP_PRESENT_EXT; off += 4) {
+        if (off + 4 > rtap_len) {
+            return false;
+        }
+        word = get_le32(rec + off);
+    }
+
+    bool fcs = false;
+    for (uint32_t bit = 0; bit < sizeof(rtap_size); bit++) {
+        if (!(present & (1u << bit))) {
+            continue;
+        }
+        off = (off + rtap_align[bit] - 1) & ~(uint32_t)(rtap_align[bit] - 1);
+        if (off + rtap_size[bit] > rtap_len) {
+            break;
+        }
+        if (bit == 1) {
+            fcs = rec[off] & RTAP_FLAGS_FCS;
+        } else if (bit == 3) {
+            frame->channel = freq_to_channel(get_le16(rec + off));
+        } else if (bit == 5) {
+            frame->rssi = (int8_t)rec[off];
+        }
+        off += rtap_size[bit];
+    }
+
+    frame->frame = rec + rtap_len;
+    frame->len = len - rtap_len;
+    if (fcs && frame->len >= FCS_LEN) {
+        frame->len -= FCS_LEN;
+    }
+    return true;
+}
+
+/* Heartbeats and mode markers are probe requests from the all zero MAC */
+static bool is_sniffer_marker(const replay_frame_t *frame)
+{
+    static const uint8_t zero_mac[6] = {0};
+    return frame->len >= 16 && frame->frame[0] == 0x40 && memcmp(frame->frame + 10, zero_mac, 6) == 0;
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+    return get_le32(p) | (uint64_t)get_le32(p + 4) << 32;
+}
+
+/* Channel and RSSI of the sniffer's custom option, which wins over the radiotap fields */
+static void parse_epb_options(const uint8_t *opt, const uint8_t *end, replay_frame_t *frame)
+{
+    while (opt + 4 <= end) {
+        uint16_t code = get_le16(opt);
+        uint16_t len = get_le16(opt + 2);
+        if (code == 0 || opt + 4 + len > end) {
+            return;
+        }
+        if (code == PCAPNG_OPT_CUSTOM_BIN && len >= 7 && get_le32(opt + 4) == PCAPNG_PEN &&
+            opt[8] == PCAPNG_OPT_RX_INFO) {
+            frame->channel = opt[9];
+            frame->rssi = (int8_t)opt[10];
+        }
+        opt += 4 + ((len + 3) & ~3u);
+    }
+}
+
+/* Counters of an Interface Statistics Block, missing options stay 0 */
+static void parse_isb(const uint8_t *opt, const uint8_t *end, uint64_t counters[PCAPNG_ISB_COUNTERS])
+{
+    memset(counters, 0, PCAPNG_ISB_COUNTERS * sizeof(uint64_t));
+    while (opt + 4 <= end) {
+        uint16_t code = get_le16(opt);
+        uint16_t len = get_le16(opt + 2);
+        if (code == 0 || opt + 4 + len > end) {
+            return;
+        }
+        if (code >= 4 && code < 4 + PCAPNG_ISB_COUNTERS && len == 8) {
+            counters[code - 4] = get_le64(opt + 4);
+        }
+        opt += 4 + ((len + 3) & ~3u);
+    }
+}
+
+static void add_frame(capture_t *capture, replay_frame_t *frame, uint32_t link_type, bool keep_markers)
+{
+    if (link_type == PCAP_LINK_TYPE_802_11_RADIOTAP) {
+        // Values of the custom option survive the radiotap parse
+        replay_frame_t radiotap = *frame;
+        if (!parse_radiotap(frame->frame, frame->len, &radiotap)) {
+            return;
+        }
+        if (frame->channel) {
+            radiotap.channel = frame->channel;
+            radiotap.rssi = frame->rssi;
+        }
+        *frame = radiotap;
+    } else if (link_type != PCAP_LINK_TYPE_802_11) {
+        return;
+    }
+    if (frame->len > MAX_FRAME_LEN || (!keep_markers && is_sniffer_marker(frame))) {
+        return;
+    }
+    capture->frames[capture->count++] = *frame;
+}
+
+/* Little endian pcapng, sections may follow each other as in appended segment files */
+static void load_pcapng(const char *path, capture_t *capture, long size, bool keep_markers)
+{
+    uint32_t link_type = 0;
+    long off = 0;
+
+    while (off + 12 <= size) {
+        const uint8_t *block = capture->data + off;
+        uint32_t type = get_le32(block);
+        uint32_t length = get_le32(block + 4);
+        if (length < 12 || length % 4 || off + length > size) {
+            fprintf(stderr, "%s: truncated block at offset %ld, stopping there\n", path, off);
+            break;
+        }
+        const uint8_t *end = block + length - 4;
+        off += length;
+        if (type == PCAPNG_SHB) {
+            link_type = 0;
+        } else if (type == PCAPNG_IDB && length >= 20 && link_type == 0) {
+            link_type = get_le16(block + 8);
+        } else if (type == PCAPNG_EPB && length >= 32) {
+            uint32_t caplen = get_le32(block + 20);
+            if (block + 28 + caplen > end) {
+                continue;
+            }
+            replay_frame_t frame = {
+                .ts_us = (uint64_t)get_le32(block + 12) << 32 | get_le32(block + 16),
+                .rssi = DEFAULT_RSSI,
+                .frame = block + 28,
+                .len = caplen,
+                .offset = block - capture->data,
+            };
+            parse_epb_options(block + 28 + ((caplen + 3) & ~3u), end, &frame);
+            add_frame(capture, &frame, link_type, keep_markers);
+        } else if (type == PCAPNG_ISB && length >= 24) {
+            parse_isb(block + 20, end, capture->last_stats);
+            capture->stats_blocks++;
+        } else if (type == PCAPNG_CUSTOM) {
+            capture->notes++;
+        }
+    }
+}
+
+static bool load_capture(const char *path, capture_t *capture, bool keep_markers)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    memset(capture, 0, sizeof(*capture));
+    capture->size = size;
+    capture->data = malloc(size > 0 ? size : 1);
+    bool ok = capture->data && size >= 24 && fread(capture->data, 1, size, fp) == (size_t)size;
+    fclose(fp);
+    if (!ok) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return false;
+    }
+
+    // Upper bound of the record count, each record has a 16 byte header
+    capture->frames = malloc((size / 16 + 1) * sizeof(replay_frame_t));
+    if (capture->frames == NULL) {
+        return false;
+    }
+
+    const uint8_t *hdr = capture->data;
+    if (get_le32(hdr) == PCAPNG_SHB && get_le32(hdr + 8) == PCAPNG_BYTE_ORDER_MAGIC) {
+        load_pcapng(path, capture, size, keep_markers);
+        return true;
+    }
+    uint32_t link_type = get_le32(hdr + 20);
+    if (get_le32(hdr) != PCAP_MAGIC_US ||
+        (link_type != PCAP_LINK_TYPE_802_11_RADIOTAP && link_type != PCAP_LINK_TYPE_802_11)) {
+        fprintf(stderr, "%s: only little endian microsecond pcap or pcapng with 802.11 or radiotap link type\n", path);
+        return false;
+    }
+
+    long off = 24;
+    while (off + 16 <= size) {
+        const uint8_t *rec = capture->data + off;
+        uint32_t caplen = get_le32(rec + 8);
+        if (off + 16 + caplen > (uint64_t)size) {
+            fprintf(stderr, "%s: truncated record at offset %ld, stopping there\n", path, off);
+            break;
+        }
+        replay_frame_t frame = {
+            .ts_us = (uint64_t)get_le32(rec) * 1000000 + get_le32(rec + 4),
+            .rssi = DEFAULT_RSSI,
+            .frame = rec + 16,
+            .len = caplen,
+            .offset = off,
+        };
+        off += 16 + caplen;
+        add_frame(capture, &frame, link_type, keep_markers);
+    }
+    return true;
+}
+
+static void free_capture(capture_t *capture)
+{
+    free(capture->frames);
+    free(capture->data);
+}
+
+/* Frames of the output pcap must be the replayed ones, in order, some of them missing */
+static void compare_pcap(const capture_t *in, const capture_t *out, uint32_t *matched, uint32_t *unmatched,
+                         uint32_t *radiotap_diffs)
+{
+    uint32_t next = 0;
+
+    *matched = *unmatched = *radiotap_diffs = 0;
+    for (uint32_t i = 0; i < out->count; i++) {
+        const replay_frame_t *o = &out->frames[i];
+        if (is_sniffer_marker(o)) {
+            continue;
+        }
+        uint32_t j = next;
+        while (j < in->count && (in->frames[j].len != o->len || memcmp(in->frames[j].frame, o->frame, o->len))) {
+            j++;
+        }
+        if (j == in->count) {
+            (*unmatched)++;
+            continue;
+        }
+        if (in->frames[j].rssi != o->rssi || (in->frames[j].channel && in->frames[j].channel != o->channel)) {
+            (*radiotap_diffs)++;
+        }
+        (*matched)++;
+        next = j + 1;
+    }
+}
+
+/* Next replayed frame from next on with this MAC and RSSI, in->count if none */
+static uint32_t find_frame(const capture_t *in, uint32_t next, const unsigned int mac[6], int rssi)
+{
+    uint32_t j = next;
+    for (; j < in->count; j++) {
+        const replay_frame_t *f = &in->frames[j];
+        bool same = f->len >= 16 && f->rssi == rssi;
+        for (int k = 0; same && k < 6; k++) {
+            same = f->frame[10 + k] == mac[k];
+        }
+        if (same) {
+            break;
+        }
+    }
+    return j;
+}
+
+typedef struct {
+    uint32_t matched;           // Records of a replayed frame, in order
+    uint32_t unmatched;
+    uint32_t bursts;            // Burst records, they close out of frame order and are only counted
+    uint32_t saturated;         // Binary burst records whose count stopped at 255
+    uint64_t burst_frames;      // Sum of the burst frame counts
+} reduced_check_t;
+
+/* Reduced CSV lines must carry the MAC and RSSI of replayed frames, in order */
+static bool compare_csv(const char *path, const capture_t *in, reduced_check_t *check)
+{
+    char line[256];
+    uint32_t next = 0;
+    FILE *fp = fopen(path, "r");
+
+    memset(check, 0, sizeof(*check));
+    if (fp == NULL) {
+        return false;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned int mac[6];
+        int rssi;
+        unsigned int count;
+        // Time, MAC, RSSI, strftime("%c") puts no comma into the time, burst lines go on with the frame count
+        char *fields = strchr(line, ',');
+        if (fields == NULL || strchr(line, '[')) {
+            continue;
+        }
+        int parsed = sscanf(fields, ", %x:%x:%x:%x:%x:%x, %d, %u", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5],
+                            &rssi, &count);
+        if (parsed == 8) {
+            check->bursts++;
+            check->burst_frames += count;
+            continue;
+        }
+        if (parsed != 7) {
+            check->unmatched++;
+            continue;
+        }
+        uint32_t j = find_frame(in, next, mac, rssi);
+        if (j == in->count) {
+            check->unmatched++;
+            continue;
+        }
+        check->matched++;
+        next = j + 1;
+    }
+    fclose(fp);
+    return true;
+}
+
+/* Same for the binary reduced file, whose header and length have to be valid as well */
+static bool compare_bin(const char *path, const capture_t *in, reduced_check_t *check)
+{
+    reduced_file_header_t header;
+    reduced_record_t record;
+    uint32_t next = 0;
+    FILE *fp = fopen(path, "rb");
+
+    memset(check, 0, sizeof(*check));
+    if (fp == NULL) {
+        return false;
+    }
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1 && memcmp(header.magic, REDUCED_RECORD_MAGIC, 4) == 0 &&
+              header.version == REDUCED_RECORD_VERSION && header.header_size == sizeof(header) &&
+              header.record_size == sizeof(record);
+    while (ok && fread(&record, sizeof(record), 1, fp) == 1) {
+        unsigned int mac[6];
+        if (record.type == REDUCED_RECORD_BURST) {
+            check->bursts++;
+            check->saturated += record.count == UINT8_MAX;
+            check->burst_frames += record.count;
+            continue;
+        }
+        if (record.type != REDUCED_RECORD_PROBE) {
+            continue;
+        }
+        for (int k = 0; k < 6; k++) {
+            mac[k] = record.mac[k];
+        }
+        uint32_t j = find_frame(in, next, mac, record.rssi);
+        if (j == in->count) {
+            check->unmatched++;
+            continue;
+        }
+        check->matched++;
+        next = j + 1;
+    }
+    // A cut off record would misalign everything appended after it
+    ok = ok && feof(fp) && (ftell(fp) - sizeof(header)) % sizeof(record) == 0;
+    fclose(fp);
+    return ok;
+}
+
+/* Index entries must point at records with their running count and time, the last one at the end of the file,
+ * and a lookup of the middle third of the capture has to cover every record in it */
+static bool check_index(const char *pcap_path, const capture_t *out, uint32_t *entries)
+{
+    char index_path[64];
+    pcap_index_header_t header;
+    pcap_index_entry_t entry = {0};
+    uint64_t latest_us = 0;
+    uint32_t next = 0;
+
+    *entries = 0;
+    pcap_index_path(index_path, sizeof(index_path), pcap_path);
+    FILE *fp = fopen(index_path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1 && memcmp(header.magic, PCAP_INDEX_MAGIC, 4) == 0 &&
+              header.version == PCAP_INDEX_VERSION && header.entry_size == sizeof(entry) &&
+              (header.flags & PCAP_INDEX_FLAG_PCAPNG) == (pcapng ? PCAP_INDEX_FLAG_PCAPNG : 0);
+    while (ok && fread(&entry, sizeof(entry), 1, fp) == 1) {
+        (*entries)++;
+        if (entry.count == out->count) {
+            break;
+        }
+        for (; next <= entry.count && next < out->count; next++) {
+            if (out->frames[next].ts_us > latest_us) {
+                latest_us = out->frames[next].ts_us;
+            }
+        }
+        ok = entry.count < out->count && out->frames[entry.count].offset == entry.offset &&
+             entry.timestamp_us == latest_us;
+    }
+    ok = ok && entry.count == out->count && entry.offset == out->size && fread(&entry, 1, 1, fp) == 0;
+    fclose(fp);
+    if (!ok || out->count < 3) {
+        return ok;
+    }
+
+    pcap_index_range_t range;
+    uint64_t from_us = out->frames[out->count / 3].ts_us;
+    uint64_t to_us = out->frames[out->count * 2 / 3].ts_us;
+    if (pcap_index_lookup(index_path, out->size, from_us, to_us, &range) != ESP_OK) {
+        return false;
+    }
+    for (uint32_t i = 0; ok && i < out->count; i++) {
+        const replay_frame_t *f = &out->frames[i];
+        if (f->ts_us >= from_us && f->ts_us <= to_us) {
+            ok = f->offset >= range.start && f->offset < range.end;
+        }
+    }
+    return ok && range.header_len == out->frames[0].offset;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <input.pcap> [out_dir] [speed] [pcap|pcapng] [csv|bin]\n", argv[0]);
+        return 2;
+    }
+    const char *out_dir = argc > 2 ? argv[2] : "replay_out";
+    double speed = argc > 3 ? atof(argv[3]) : 1.0;
+    pcapng = argc > 4 && strcmp(argv[4], "pcapng") == 0;
+    reduced_binary = argc > 5 && strcmp(argv[5], "bin") == 0;
+    coalesce_bursts = argc > 6 && strcmp(argv[6], "burst") == 0;
+
+    capture_t in;
+    if (!load_capture(argv[1], &in, false) || in.count == 0) {
+        fprintf(stderr, "nothing to replay in %s\n", argv[1]);
+        return 2;
+    }
+
+    if (!capture_host_enter(out_dir)) {
+        return 2;
+    }
+    char pcap_path[64];
+    snprintf(pcap_path, sizeof(pcap_path), pcapng ? CONFIG_SD_MOUNT_POINT "/" CONFIG_PCAPNG_FILENAME_MASK :
+             CONFIG_SD_MOUNT_POINT "/" CONFIG_PCAP_FILENAME_MASK, 0UL);
+
+    capture_host_t host;
+    if (!capture_host_start(&host)) {
+        return 2;
+    }
+    for (uint32_t i = 0; i < in.count; i++) {
+        const replay_frame_t *f = &in.frames[i];
+        if (speed > 0) {
+            capture_host_sleep_until(host.start_us + (int64_t)((f->ts_us - in.frames[0].ts_us) / speed));
+        }
+        capture_host_inject(&host, f->frame, f->len, f->rssi, f->channel);
+    }
+    int64_t inject_us = esp_timer_get_time() - host.start_us;
+    capture_host_stop(&host);
+
+    const capture_stats_t *stats = &host.stats;
+    int64_t total_us = host.stop_us - host.start_us;
+    char stats_line[512];
+    capture_stats_format(stats, stats_line, sizeof(stats_line));
+
+    double inject_s = inject_us / 1e6;
+    double total_s = total_us / 1e6;
+    printf("replayed %lu of %lu frames in %.2f s (speed %g), %.0f frames/s offered\n",
+           (unsigned long)host.injected, (unsigned long)in.count, inject_s, speed, host.injected / inject_s);
+    printf("written in %.2f s with drain: %.0f pcap records/s, %.0f CSV records/s\n",
+           total_s, stats->pcap_records / total_s, stats->csv_records / total_s);
+    printf("callback: mean %.2f us, max %lld us\n",
+           host.injected ? (double)host.cb_total_us / host.injected : 0.0, (long long)host.cb_max_us);
+    for (int i = 0; i < SNIFFER_STAGE_COUNT; i++) {
+        const sniffer_stage_stats_t *stage = &host.stages[i];
+        printf("stage %-8s %8lu items, %.2f us per item, %.1f%% busy\n", stage->name, (unsigned long)stage->items,
+               stage->items ? (double)stage->busy_us / stage->items : 0.0, 100.0 * stage->busy_us / total_us);
+    }
+    printf("%s\n", stats_line);
+
+    // Every replayed frame not in the pcap has to show up in one of the counters
+    capture_t out;
+    uint32_t matched = 0, unmatched = 0, radiotap_diffs = 0;
+    if (!load_capture(pcap_path, &out, true)) {
+        free_capture(&in);
+        return 1;
+    }
+    compare_pcap(&in, &out, &matched, &unmatched, &radiotap_diffs);
+    uint32_t missing = host.injected - matched;
+    uint32_t accounted = stats->filtered + stats->queue_drops + stats->alloc_failures + stats->pcap_shed + stats->write_errors;
+
+    // Reduced output first, while coalescing the pcap holds the first frame of each burst
+    reduced_check_t reduced;
+    bool csv_ok = reduced_binary ? compare_bin(CONFIG_SD_MOUNT_POINT "/" CONFIG_REDUCED_BIN_FILE, &in, &reduced) :
+                                   compare_csv(CONFIG_SD_MOUNT_POINT "/" CONFIG_OUTPUT_FILE, &in, &reduced);
+    // Frames lost to the work ring and those of the stats only mode never reach the coalescer,
+    // a frame without pool slot still does. Lost writes and saturated counts leave a bound
+    uint32_t coalesced = stats->accepted - stats->queue_drops - stats->csv_shed;
+    if (coalesce_bursts) {
+        bool exact = stats->write_errors == 0 && reduced.saturated == 0;
+        csv_ok = csv_ok && reduced.unmatched == 0 && reduced.matched == 0 && reduced.bursts == stats->csv_records &&
+                 (exact ? reduced.burst_frames == coalesced : reduced.burst_frames <= coalesced);
+        accounted += coalesced - reduced.bursts;
+    } else {
+        csv_ok = csv_ok && reduced.unmatched == 0 && reduced.matched == stats->csv_records;
+    }
+
+    // Joined frames are not saved to pcap, shed ones and those without pool slot may have been counted twice then
+    bool pcap_ok = unmatched == 0 && (!save_pcap || missing == accounted ||
+                                      (coalesce_bursts && (stats->pcap_shed || stats->alloc_failures) &&
+                                       missing <= accounted));
+    printf("pcap: %lu frames match the input in order, %lu not in the input, %lu missing (%lu accounted for), "
+           "%lu with different radiotap rssi/channel -> %s\n",
+           (unsigned long)matched, (unsigned long)unmatched, (unsigned long)missing, (unsigned long)accounted,
+           (unsigned long)radiotap_diffs, pcap_ok ? "ok" : "MISMATCH");
+
+    // The closing statistics block carries the final counters, heartbeats went into notes
+    bool stats_ok = true;
+    if (pcapng && save_pcap) {
+        const uint64_t *isb = out.last_stats;
+        stats_ok = out.stats_blocks > 0 && isb[0] == stats->frames_seen &&
+                   isb[1] == (uint64_t)stats->queue_drops + stats->alloc_failures && isb[2] == stats->accepted &&
+                   isb[3] == stats->pcap_shed && isb[4] == stats->pcap_records;
+        printf("pcapng: %lu notes, %lu statistics blocks, last one recv=%llu drop=%llu accept=%llu shed=%llu "
+               "deliv=%llu -> %s\n", (unsigned long)out.notes, (unsigned long)out.stats_blocks,
+               (unsigned long long)isb[0], (unsigned long long)isb[1], (unsigned long long)isb[2],
+               (unsigned long long)isb[3], (unsigned long long)isb[4], stats_ok ? "ok" : "MISMATCH");
+    }
+
+    bool index_ok = true;
+    if (pcap_index && save_pcap) {
+        uint32_t entries;
+        index_ok = check_index(pcap_path, &out, &entries);
+        printf("index: %lu entries for %lu records -> %s\n", (unsigned long)entries, (unsigned long)out.count,
+               index_ok ? "ok" : "MISMATCH");
+    }
+
+    if (coalesce_bursts) {
+        printf("%s: %lu bursts of %llu frames, %lu frames reached the coalescer -> %s\n",
+               reduced_binary ? "bin" : "csv", (unsigned long)reduced.bursts, (unsigned long long)reduced.burst_frames,
+               (unsigned long)coalesced, csv_ok ? "ok" : "MISMATCH");
+    } else {
+        printf("%s: %lu %s match the input in order, %lu do not -> %s\n", reduced_binary ? "bin" : "csv",
+               (unsigned long)reduced.matched, reduced_binary ? "records" : "lines", (unsigned long)reduced.unmatched,
+               csv_ok ? "ok" : "MISMATCH");
+    }
+
+    // Dropping every frame is not a passing run, e.g. speed 0 on a slow host
+    bool written_ok = stats->accepted == 0 || stats->csv_records + stats->pcap_records > 0;
+    if (!written_ok) {
+        printf("nothing written for %lu accepted frames -> MISMATCH\n", (unsigned long)stats->accepted);
+    }
+
+    free_capture(&out);
+    free_capture(&in);
+    return pcap_ok && csv_ok && stats_ok && index_ok && written_ok ? 0 : 1;
+}
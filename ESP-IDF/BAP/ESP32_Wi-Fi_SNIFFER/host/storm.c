@@ -0,0 +1,200 @@
+/* Saturation benchmark of the capture path with synthetic probe storms.
+ *
+ * Frames from probe_storm are handed to wifi_sniffer_cb with Poisson
+ * arrivals at a rate that grows by a factor every step, each step a fresh
+ * capture of a few seconds. For every step one CSV row is printed: offered
+ * and achieved load, frames that reached the stats stage, drops, records
+ * written per second and the load of each stage. The ramp ends after the
+ * first step whose drops exceed the threshold, or when the host can no
+ * longer offer the rate. A comment line with the build configuration comes
+ * first, so curves of different builds can be told apart.
+ *
+ * usage: storm [-t step_s] [-r start_fps] [-R max_fps] [-f factor] [-x drop_pct]
+ *              [-p population] [-m random_mac_pct] [-i ie_min] [-I ie_max]
+ *              [-s ssid,ssid,...] [-S rssi_mean] [-D rssi_sd] [-b burst_max]
+ *              [-P] (no pcap) [-c] (coalesce bursts) [-k sink,sink,...] [-o out_dir]
+ *        -k opens the given sinks like the "sinks" list of settings.json, e.g. csv,stats,live
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <math.h>
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "config.h"
+#include "variables.h"
+#include "load_shed.h"
+#include "record_sink.h"
+#include "capture_host.h"
+#include "probe_storm.h"
+
+#define SLEEP_AHEAD_US  200     // Sleep only when this far ahead of the arrival schedule
+#define MIN_ACHIEVED    0.9     // Below this share of the offered rate the host is the limit
+
+typedef struct {
+    double step_s;
+    double start_fps;
+    double max_fps;
+    double factor;
+    double drop_pct;
+    const char *out_dir;
+    char *sinks;                // NULL for the ones save_pcap and reduced_binary stand for
+} storm_options_t;
+
+static void select_sinks(char *list)
+{
+    const char *names[RECORD_SINK_MAX];
+    uint32_t count = 0;
+
+    for (char *name = strtok(list, ","); name && count < RECORD_SINK_MAX; name = strtok(NULL, ",")) {
+        names[count++] = name;
+    }
+    record_sink_select(names, count);
+}
+
+static void split_ssids(char *list, probe_storm_config_t *config)
+{
+    for (char *ssid = strtok(list, ","); ssid && config->ssid_count < PROBE_STORM_MAX_SSIDS; ssid = strtok(NULL, ",")) {
+        config->ssids[config->ssid_count++] = ssid;
+    }
+}
+
+/* One capture at a constant offered rate, false when the sniffer could not start */
+static bool run_step(probe_storm_t *storm, double fps, double step_s, capture_host_t *host, double *achieved_fps)
+{
+    static uint8_t frame[PROBE_STORM_MAX_FRAME];
+    uint64_t offered = 0;
+
+    if (!capture_host_start(host)) {
+        return false;
+    }
+    int64_t end_us = host->start_us + (int64_t)(step_s * 1e6);
+    double due_us = host->start_us;
+    int64_t now;
+    while ((now = esp_timer_get_time()) < end_us) {
+        if (due_us > now + SLEEP_AHEAD_US) {
+            capture_host_sleep_until((int64_t)due_us);
+            continue;
+        }
+        int8_t rssi;
+        uint16_t len = probe_storm_next(storm, frame, &rssi);
+        capture_host_inject(host, frame, len, rssi, 0);
+        offered++;
+        // Poisson arrivals
+        due_us += -log(1.0 - probe_storm_uniform(storm)) * 1e6 / fps;
+    }
+    *achieved_fps = offered / ((esp_timer_get_time() - host->start_us) / 1e6);
+    capture_host_stop(host);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    storm_options_t options = {
+        .step_s = 2,
+        .start_fps = 1000,
+        .max_fps = 500000,
+        .factor = 1.5,
+        .drop_pct = 1,
+        .out_dir = "storm_out",
+    };
+    probe_storm_config_t config = {
+        .population = 500,
+        .random_pct = 60,
+        .ie_min = 0,
+        .ie_max = 64,
+        .rssi_mean = -65,
+        .rssi_sd = 10,
+        .burst_max = 4,
+        .seed = 1,
+    };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:r:R:f:x:p:m:i:I:s:S:D:b:Pck:o:")) != -1) {
+        switch (opt) {
+            case 't': options.step_s = atof(optarg); break;
+            case 'r': options.start_fps = atof(optarg); break;
+            case 'R': options.max_fps = atof(optarg); break;
+            case 'f': options.factor = atof(optarg); break;
+            case 'x': options.drop_pct = atof(optarg); break;
+            case 'p': config.population = strtoul(optarg, NULL, 10); break;
+            case 'm': config.random_pct = atoi(optarg); break;
+            case 'i': config.ie_min = atoi(optarg); break;
+            case 'I': config.ie_max = atoi(optarg); break;
+            case 's': split_ssids(optarg, &config); break;
+            case 'S': config.rssi_mean = atoi(optarg); break;
+            case 'D': config.rssi_sd = atoi(optarg); break;
+            case 'b': config.burst_max = atoi(optarg); break;
+            case 'P': save_pcap = false; break;
+            case 'c': coalesce_bursts = true; break;
+            case 'k': options.sinks = optarg; break;
+            case 'o': options.out_dir = optarg; break;
+            default:
+                fprintf(stderr, "see the usage at the top of storm.c\n");
+                return 2;
+        }
+    }
+    if (options.factor <= 1 || options.start_fps <= 0 || config.ie_max < config.ie_min) {
+        fprintf(stderr, "need factor > 1, start_fps > 0 and ie_max >= ie_min\n");
+        return 2;
+    }
+
+    probe_storm_t storm;
+    if (!probe_storm_init(&storm, &config) || !capture_host_enter(options.out_dir)) {
+        return 2;
+    }
+
+    printf("# work_queue=%u record_queue=%u pool_slot=%u large_slots=%ux%u drain_batch=%u write_queue=%u hot_log=%u "
+           "load_shedding=%u pcap=%u coalesce=%u sinks=%s population=%lu random_mac=%u%% ie=%u-%u ssids=%u burst_max=%u\n",
+           CONFIG_SNIFFER_WORK_QUEUE_LEN, CONFIG_SNIFFER_RECORD_QUEUE_LEN, CONFIG_SNIFFER_POOL_SLOT_SIZE,
+           CONFIG_SNIFFER_POOL_LARGE_SLOTS, CONFIG_SNIFFER_POOL_LARGE_SLOT_SIZE,
+           CONFIG_SNIFFER_DRAIN_BATCH, CONFIG_SNIFFER_WRITE_QUEUE_LEN, CONFIG_SNIFFER_HOT_LOG_LEVEL,
+           CONFIG_SNIFFER_LOAD_SHEDDING, save_pcap, coalesce_bursts, options.sinks ? options.sinks : "default",
+           (unsigned long)config.population, config.random_pct, config.ie_min, config.ie_max, config.ssid_count,
+           config.burst_max);
+    if (options.sinks) {
+        select_sinks(options.sinks);
+    }
+    printf("offered_fps,achieved_fps,seen,captured,drop_pct,csv_per_s,pcap_per_s,bytes_per_s,"
+           "shed_mode,callback_mean_us,callback_max_us,stats_busy_pct,writer_busy_pct,storage_busy_pct,"
+           "storage_stalls,storage_blocked_ms\n");
+
+    for (double fps = options.start_fps; fps <= options.max_fps; fps *= options.factor) {
+        capture_host_t host;
+        double achieved;
+        if (!run_step(&storm, fps, options.step_s, &host, &achieved)) {
+            probe_storm_deinit(&storm);
+            return 1;
+        }
+
+        const capture_stats_t *stats = &host.stats;
+        double total_s = (host.stop_us - host.start_us) / 1e6;
+        uint32_t lost = stats->queue_drops;
+        uint32_t captured = stats->accepted - lost;
+        double drop_pct = stats->accepted ? 100.0 * lost / stats->accepted : 0;
+        printf("%.0f,%.0f,%lu,%lu,%.2f,%.0f,%.0f,%.0f,%s,%.2f,%lld,%.1f,%.1f,%.1f,%lu,%llu\n",
+               fps, achieved, (unsigned long)stats->frames_seen, (unsigned long)captured, drop_pct,
+               stats->csv_records / total_s, stats->pcap_records / total_s, stats->bytes_written / total_s,
+               load_shed_mode_name(stats->shed_mode),
+               host.injected ? (double)host.cb_total_us / host.injected : 0.0, (long long)host.cb_max_us,
+               100.0 * host.stages[SNIFFER_STAGE_STATS].busy_us / (total_s * 1e6),
+               100.0 * host.stages[SNIFFER_STAGE_WRITER].busy_us / (total_s * 1e6),
+               100.0 * host.stages[SNIFFER_STAGE_STORAGE].busy_us / (total_s * 1e6),
+               (unsigned long)stats->storage_stalls, (unsigned long long)(stats->storage_blocked_us / 1000));
+        fflush(stdout);
+
+        if (drop_pct > options.drop_pct) {
+            break;
+        }
+        if (achieved < fps * MIN_ACHIEVED) {
+            fprintf(stderr, "the host offers only %.0f of %.0f frames/s, stopping the ramp\n", achieved, fps);
+            break;
+        }
+    }
+
+    probe_storm_deinit(&storm);
+    return 0;
+}
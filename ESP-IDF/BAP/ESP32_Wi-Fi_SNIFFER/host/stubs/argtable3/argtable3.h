@@ -0,0 +1,2 @@
+/* Host stub, the capture path does not register console commands */
+#pragma once
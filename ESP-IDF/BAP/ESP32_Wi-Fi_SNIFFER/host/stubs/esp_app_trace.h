@@ -0,0 +1,2 @@
+/* Host stub, app trace is not used by the capture path */
+#pragma once
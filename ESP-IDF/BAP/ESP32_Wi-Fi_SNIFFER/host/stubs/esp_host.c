@@ -0,0 +1,125 @@
+/* ESP-IDF services used by the capture path, and the firmware globals it
+ * reads from modules that are not built on the host (OLED, buttons, battery).
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "esp_vfs_fat.h"
+#include "driver/gpio.h"
+#include "config.h"
+
+/* Firmware globals, the OLED is never initialized so nothing is drawn */
+bool oled_initialized = false;
+bool enter_deep_sleep_flag = false;
+bool powering_down = false;
+int delay_state = 0;
+int short_oled_period = CONFIG_SHORT_OLED_PERIOD;
+int medium_oled_period = CONFIG_MEDIUM_OLED_PERIOD;
+int long_oled_period = CONFIG_LONG_OLED_PERIOD;
+uint16_t volts = 0;
+int16_t current = 0;
+
+static wifi_promiscuous_cb_t rx_cb;
+static wifi_promiscuous_filter_t rx_filter = { .filter_mask = WIFI_PROMIS_FILTER_MASK_ALL };
+static volatile bool promiscuous;
+static uint8_t channel = 1;
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK:                return "ESP_OK";
+        case ESP_FAIL:              return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:        return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:   return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:  return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:     return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:       return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+        default:                    return "UNKNOWN ERROR";
+    }
+}
+
+esp_err_t esp_wifi_set_promiscuous(bool en)
+{
+    promiscuous = en;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb)
+{
+    rx_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter)
+{
+    rx_filter = *filter;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second)
+{
+    (void)second;
+    channel = primary;
+    return ESP_OK;
+}
+
+bool host_wifi_inject(wifi_promiscuous_pkt_t *pkt, wifi_promiscuous_pkt_type_t type)
+{
+    // Same bit order as WIFI_PROMIS_FILTER_MASK_*
+    if (!promiscuous || rx_cb == NULL || !(rx_filter.filter_mask & (1u << type))) {
+        return false;
+    }
+    rx_cb(pkt, type);
+    return true;
+}
+
+uint8_t host_wifi_channel(void)
+{
+    return channel;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    (void)gpio_num;
+    (void)level;
+    return ESP_OK;
+}
+
+/* display_queue.h, the OLED and battery gauge are not present */
+void i2c_task_send_display_text(const char *text)
+{
+    (void)text;
+}
+
+void i2c_task_send_battery_status(void)
+{
+}
+
+/* The file gets its full size at once, like f_expand() on the card */
+esp_err_t esp_vfs_fat_create_contiguous_file(const char *base_path, const char *full_path, uint64_t size, bool alloc_now)
+{
+    (void)base_path;
+    (void)alloc_now;
+    int fd = open(full_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    int err = posix_fallocate(fd, 0, size);
+    close(fd);
+    return err == 0 ? ESP_OK : ESP_FAIL;
+}
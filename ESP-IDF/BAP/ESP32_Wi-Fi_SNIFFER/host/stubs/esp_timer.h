@@ -0,0 +1,5 @@
+/* Host stub, esp_timer_get_time() reads CLOCK_MONOTONIC */
+#pragma once
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
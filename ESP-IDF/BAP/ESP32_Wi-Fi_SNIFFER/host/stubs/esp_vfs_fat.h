@@ -0,0 +1,7 @@
+/* Host stub, contiguous files are preallocated with posix_fallocate() */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+esp_err_t esp_vfs_fat_create_contiguous_file(const char *base_path, const char *full_path, uint64_t size, bool alloc_now);
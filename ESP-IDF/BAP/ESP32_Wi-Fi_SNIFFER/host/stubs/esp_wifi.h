@@ -0,0 +1,25 @@
+/* Host stub of the promiscuous mode API, frames are injected with host_wifi_inject() */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_wifi_types.h"
+
+typedef void (*wifi_promiscuous_cb_t)(void *buf, wifi_promiscuous_pkt_type_t type);
+
+esp_err_t esp_wifi_set_promiscuous(bool en);
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb);
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter);
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second);
+
+/**
+ * @brief Hand one frame to the registered rx callback, like the Wi-Fi driver task
+ *
+ * @return false when promiscuous mode is off or the filter mask drops the frame type
+ */
+bool host_wifi_inject(wifi_promiscuous_pkt_t *pkt, wifi_promiscuous_pkt_type_t type);
+
+/**
+ * @brief Channel last set with esp_wifi_set_channel()
+ */
+uint8_t host_wifi_channel(void);
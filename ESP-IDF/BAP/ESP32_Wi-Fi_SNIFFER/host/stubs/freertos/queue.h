@@ -0,0 +1,5 @@
+/* Host stub, only the handle type used by semaphores */
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue *QueueHandle_t;
@@ -0,0 +1,4 @@
+/* Host stub, the values the firmware sdkconfig uses for the capture path */
+#pragma once
+#define CONFIG_FATFS_MAX_LFN 255
+#define CONFIG_FREERTOS_HZ 100
@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "miniz.h"
+#include "archiver.h"
+
+#define ARCHIVER_TMP_EXTENSION      ARCHIVER_EXTENSION ".tmp"
+// Directory, '/', file name and the longest extension added to it
+#define ARCHIVER_PATH_LEN           (2 * CONFIG_FATFS_MAX_LFN + sizeof(ARCHIVER_TMP_EXTENSION))
+#define ARCHIVER_GZIP_FNAME         0x08
+#define ARCHIVER_GZIP_OS_UNIX       3
+
+static const char *ARCHIVER_TAG = "archiver";
+
+static struct {
+    archiver_config_t config;
+    TaskHandle_t task;
+    atomic_bool running;
+    atomic_bool stop;
+    archiver_stats_t stats;
+    char name[CONFIG_FATFS_MAX_LFN];    // Oldest file left to compress
+    char src[ARCHIVER_PATH_LEN];
+    char dst[ARCHIVER_PATH_LEN];
+    char tmp[ARCHIVER_PATH_LEN];
+} archiver_rt;
+
+typedef struct {
+    FILE *out;
+    uint64_t stored;
+} archiver_output_t;
+
+static mz_bool archiver_put(const void *buf, int len, void *user)
+{
+    archiver_output_t *output = user;
+    if (fwrite(buf, 1, len, output->out) != (size_t)len) {
+        return MZ_FALSE;
+    }
+    output->stored += len;
+    return MZ_TRUE;
+}
+
+/* RFC 1952 member header with the raw file name, so gunzip -N restores it */
+static bool archiver_write_gzip_header(archiver_output_t *output, const char *src)
+{
+    struct stat st;
+    uint32_t mtime = stat(src, &st) == 0 ? (uint32_t)st.st_mtime : 0;
+    const char *slash = strrchr(src, '/');
+    const char *name = slash ? slash + 1 : src;
+    const uint8_t header[10] = {
+        0x1f, 0x8b, 8, ARCHIVER_GZIP_FNAME,
+        mtime, mtime >> 8, mtime >> 16, mtime >> 24,
+        0, ARCHIVER_GZIP_OS_UNIX,
+    };
+
+    return archiver_put(header, sizeof(header), output) && archiver_put(name, strlen(name) + 1, output);
+}
+
+static bool archiver_write_gzip_trailer(archiver_output_t *output, uint32_t crc, uint64_t raw_bytes)
+{
+    const uint8_t trailer[8] = {
+        crc, crc >> 8, crc >> 16, crc >> 24,
+        raw_bytes, raw_bytes >> 8, raw_bytes >> 16, raw_bytes >> 24,
+    };
+    return archiver_put(trailer, sizeof(trailer), output);
+}
+
+esp_err_t archiver_compress_file(const char *src, const char *dst, const archiver_config_t *config,
+                                 bool (*abort)(void), archiver_result_t *result)
+{
+    esp_err_t ret = ESP_OK;
+    archiver_output_t output = { 0 };
+    tdefl_compressor *comp = NULL;
+    uint8_t *chunk = NULL;
+    mz_ulong crc = MZ_CRC32_INIT;
+    tdefl_status status = TDEFL_STATUS_OKAY;
+
+    memset(result, 0, sizeof(*result));
+    FILE *in = fopen(src, "rb");
+    ESP_RETURN_ON_FALSE(in, ESP_ERR_NOT_FOUND, ARCHIVER_TAG, "cannot open %s", src);
+    // Only held for the job, the heap is shared with the Wi-Fi buffers
+    comp = malloc(sizeof(tdefl_compressor));
+    chunk = malloc(config->chunk_size);
+    ESP_GOTO_ON_FALSE(comp && chunk, ESP_ERR_NO_MEM, err, ARCHIVER_TAG, "no memory for a %u byte compressor",
+                      (unsigned)sizeof(tdefl_compressor));
+    output.out = fopen(dst, "wb");
+    ESP_GOTO_ON_FALSE(output.out, ESP_FAIL, err, ARCHIVER_TAG, "cannot create %s", dst);
+    ESP_GOTO_ON_FALSE(archiver_write_gzip_header(&output, src), ESP_FAIL, err, ARCHIVER_TAG, "write failed");
+    tdefl_init(comp, archiver_put, &output, config->probes & TDEFL_MAX_PROBES_MASK);
+
+    while (status == TDEFL_STATUS_OKAY) {
+        while (config->busy && config->busy()) {
+            ESP_GOTO_ON_FALSE(!abort || !abort(), ESP_ERR_INVALID_STATE, err, ARCHIVER_TAG, "stopped");
+            result->pauses++;
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(config->pause_ms));
+        }
+        ESP_GOTO_ON_FALSE(!abort || !abort(), ESP_ERR_INVALID_STATE, err, ARCHIVER_TAG, "stopped");
+
+        int64_t start_us = esp_timer_get_time();
+        size_t len = fread(chunk, 1, config->chunk_size, in);
+        ESP_GOTO_ON_FALSE(!ferror(in), ESP_FAIL, err, ARCHIVER_TAG, "read of %s failed", src);
+        crc = mz_crc32(crc, chunk, len);
+        result->raw_bytes += len;
+        // A short read is the end of a closed file
+        status = tdefl_compress_buffer(comp, chunk, len, len < config->chunk_size ? TDEFL_FINISH : TDEFL_NO_FLUSH);
+        result->busy_us += esp_timer_get_time() - start_us;
+    }
+    ESP_GOTO_ON_FALSE(status == TDEFL_STATUS_DONE, ESP_FAIL, err, ARCHIVER_TAG, "deflate of %s failed", src);
+    ESP_GOTO_ON_FALSE(archiver_write_gzip_trailer(&output, crc, result->raw_bytes), ESP_FAIL, err, ARCHIVER_TAG,
+                      "write failed");
+    // On the card before the raw file may be removed
+    fflush(output.out);
+    fsync(fileno(output.out));
+    FILE *out = output.out;
+    output.out = NULL;
+    ESP_GOTO_ON_FALSE(fclose(out) == 0, ESP_FAIL, err, ARCHIVER_TAG, "close of %s failed", dst);
+    result->stored_bytes = output.stored;
+    result->crc32 = crc;
+
+err:
+    if (output.out) {
+        fclose(output.out);
+    }
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FOUND) {
+        remove(dst);
+    }
+    free(chunk);
+    free(comp);
+    fclose(in);
+    return ret;
+}
+
+static bool archiver_should_stop(void)
+{
+    return atomic_load(&archiver_rt.stop);
+}
+
+static bool archiver_has_extension(const char *name, const char *extension)
+{
+    size_t name_len = strlen(name);
+    size_t ext_len = strlen(extension);
+    return name_len > ext_len && strcmp(name + name_len - ext_len, extension) == 0;
+}
+
+/* Whether the manifest already lists name as kept raw */
+static bool archiver_kept_raw(const char *name)
+{
+    char line[CONFIG_FATFS_MAX_LFN + 64];
+    size_t name_len = strlen(name);
+    bool found = false;
+
+    FILE *fp = fopen(archiver_rt.config.manifest, "r");
+    if (fp == NULL) {
+        return false;
+    }
+    while (!found && fgets(line, sizeof(line), fp)) {
+        found = strncmp(line, name, name_len) == 0 && strncmp(line + name_len, ",raw,", 5) == 0;
+    }
+    fclose(fp);
+    return found;
+}
+
+static void archiver_manifest_add(const char *name, const char *status, const archiver_result_t *result,
+                                  const char *stored_name)
+{
+    FILE *fp = fopen(archiver_rt.config.manifest, "a");
+    if (fp == NULL) {
+        ESP_LOGW(ARCHIVER_TAG, "Cannot open %s", archiver_rt.config.manifest);
+        return;
+    }
+    if (ftell(fp) == 0) {
+        fprintf(fp, "file,status,raw_bytes,stored_file,stored_bytes,crc32\n");
+    }
+    fprintf(fp, "%s,%s,%" PRIu64 ",%s,%" PRIu64 ",%08" PRIx32 "\n", name, status, result->raw_bytes, stored_name,
+            result->stored_bytes, result->crc32);
+    fclose(fp);
+}
+
+/* dir/name followed by extension into path, false when it does not fit */
+static bool archiver_path(char *path, const char *dir, const char *name, const char *extension)
+{
+    int len = snprintf(path, ARCHIVER_PATH_LEN, "%s/%s%s", dir, name, extension);
+    return len >= 0 && len < (int)ARCHIVER_PATH_LEN;
+}
+
+/* Oldest closed file still to compress into archiver_rt.name, leftovers of an interrupted job are removed */
+static bool archiver_next(void)
+{
+    const archiver_config_t *config = &archiver_rt.config;
+    bool found = false;
+
+    DIR *d = opendir(config->dir);
+    if (d == NULL) {
+        return false;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        const char *name = entry->d_name;
+        // A name too long for its .gz.tmp path is never compressed, nor removed in place of another file
+        if (!archiver_path(archiver_rt.tmp, config->dir, name, ARCHIVER_TMP_EXTENSION) ||
+            !archiver_path(archiver_rt.src, config->dir, name, "")) {
+            ESP_LOGW(ARCHIVER_TAG, "Path too long, skipping %s", name);
+            continue;
+        }
+        if (archiver_has_extension(name, ARCHIVER_TMP_EXTENSION)) {
+            remove(archiver_rt.src);
+            continue;
+        }
+        bool match = false;
+        for (uint32_t i = 0; i < config->extension_count && !match; i++) {
+            match = archiver_has_extension(name, config->extensions[i]);
+        }
+        if (!match || (found && strcmp(name, archiver_rt.name) >= 0) ||
+            (config->in_use && config->in_use(archiver_rt.src)) || archiver_kept_raw(name)) {
+            continue;
+        }
+        if (snprintf(archiver_rt.name, sizeof(archiver_rt.name), "%s", name) >= (int)sizeof(archiver_rt.name)) {
+            continue;
+        }
+        found = true;
+    }
+    closedir(d);
+    return found;
+}
+
+static void archiver_run_job(void)
+{
+    const archiver_config_t *config = &archiver_rt.config;
+    archiver_stats_t *stats = &archiver_rt.stats;
+    archiver_result_t result;
+
+    // archiver_next() only picks names whose longest path fits
+    if (!archiver_path(archiver_rt.src, config->dir, archiver_rt.name, "") ||
+        !archiver_path(archiver_rt.dst, config->dir, archiver_rt.name, ARCHIVER_EXTENSION) ||
+        !archiver_path(archiver_rt.tmp, config->dir, archiver_rt.name, ARCHIVER_TMP_EXTENSION)) {
+        stats->aborted++;
+        return;
+    }
+
+    esp_err_t ret = archiver_compress_file(archiver_rt.src, archiver_rt.tmp, config, archiver_should_stop, &result);
+    stats->pauses += result.pauses;
+    stats->busy_us += result.busy_us;
+    if (ret != ESP_OK) {
+        stats->aborted++;
+        if (ret != ESP_ERR_INVALID_STATE) {
+            // Out of memory or a card error, try again after the next idle period
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(config->idle_ms));
+        }
+        return;
+    }
+
+    if (result.stored_bytes * 100 > result.raw_bytes * (100 - config->min_saving_pct)) {
+        remove(archiver_rt.tmp);
+        archiver_manifest_add(archiver_rt.name, "raw", &result, archiver_rt.name);
+        stats->kept_raw++;
+        return;
+    }
+    // A .gz left from a job cut short between rename and remove is replaced
+    remove(archiver_rt.dst);
+    if (rename(archiver_rt.tmp, archiver_rt.dst) != 0) {
+        ESP_LOGW(ARCHIVER_TAG, "Cannot rename %s", archiver_rt.tmp);
+        remove(archiver_rt.tmp);
+        stats->aborted++;
+        return;
+    }
+    archiver_manifest_add(archiver_rt.name, "gz", &result, strrchr(archiver_rt.dst, '/') + 1);
+    remove(archiver_rt.src);
+    stats->compressed++;
+    stats->raw_bytes += result.raw_bytes;
+    stats->stored_bytes += result.stored_bytes;
+    ESP_LOGI(ARCHIVER_TAG, "%s: %" PRIu64 " -> %" PRIu64 " bytes in %" PRIu64 " ms, %" PRIu32 " pauses",
+             archiver_rt.name, result.raw_bytes, result.stored_bytes, result.busy_us / 1000, result.pauses);
+}
+
+static void archiver_task(void *parameters)
+{
+    (void)parameters;
+    while (!atomic_load(&archiver_rt.stop)) {
+        if (archiver_next()) {
+            archiver_run_job();
+        } else {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(archiver_rt.config.idle_ms));
+        }
+    }
+    atomic_store(&archiver_rt.running, false);
+    vTaskDelete(NULL);
+}
+
+esp_err_t archiver_start(const archiver_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(config && config->dir && config->manifest && config->chunk_size, ESP_ERR_INVALID_ARG,
+                        ARCHIVER_TAG, "invalid config");
+    ESP_RETURN_ON_FALSE(!atomic_load(&archiver_rt.running), ESP_ERR_INVALID_STATE, ARCHIVER_TAG, "already running");
+
+    archiver_rt.config = *config;
+    memset(&archiver_rt.stats, 0, sizeof(archiver_rt.stats));
+    atomic_store(&archiver_rt.stop, false);
+    atomic_store(&archiver_rt.running, true);
+    if (xTaskCreatePinnedToCore(archiver_task, "archiverT", config->stack_size, NULL, config->priority,
+                                &archiver_rt.task, config->core) != pdPASS) {
+        atomic_store(&archiver_rt.running, false);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool archiver_stop(uint32_t timeout_ms)
+{
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+
+    if (!atomic_load(&archiver_rt.running)) {
+        return true;
+    }
+    atomic_store(&archiver_rt.stop, true);
+    xTaskNotifyGive(archiver_rt.task);
+    while (atomic_load(&archiver_rt.running)) {
+        if (esp_timer_get_time() >= deadline_us) {
+            return false;
+        }
+        vTaskDelay(1);
+    }
+    return true;
+}
+
+void archiver_get_stats(archiver_stats_t *stats)
+{
+    *stats = archiver_rt.stats;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARCHIVER_EXTENSION ".gz"
+
+/**
+ * @brief Whether the archiver has to hold off, polled between chunks
+ */
+typedef bool (*archiver_busy_t)(void);
+
+/**
+ * @brief Whether a file in the directory is still written or otherwise not closed
+ */
+typedef bool (*archiver_in_use_t)(const char *path);
+
+/**
+ * @brief Where and when the archiver compresses
+ */
+typedef struct {
+    const char *dir;                    /*!< Directory holding the capture files */
+    const char *manifest;               /*!< Path of the CSV listing every file handled */
+    const char *const *extensions;      /*!< Files to compress, e.g. {".pcap", ".pcapng"} */
+    uint32_t extension_count;
+    archiver_busy_t busy;               /*!< NULL to never pause */
+    archiver_in_use_t in_use;           /*!< NULL when every matching file is closed */
+    uint32_t chunk_size;                /*!< Bytes read and compressed between two busy checks */
+    uint32_t probes;                    /*!< tdefl dictionary probes per match search */
+    uint32_t min_saving_pct;            /*!< A file saving less is kept raw */
+    uint32_t idle_ms;                   /*!< Directory rescan while nothing is left to compress */
+    uint32_t pause_ms;                  /*!< Recheck of busy while paused */
+    uint32_t stack_size;
+    UBaseType_t priority;
+    BaseType_t core;
+} archiver_config_t;
+
+/**
+ * @brief Outcome of one file
+ */
+typedef struct {
+    uint64_t raw_bytes;
+    uint64_t stored_bytes;              /*!< Size of the .gz */
+    uint32_t crc32;                     /*!< Of the raw data, as in the gzip trailer */
+    uint32_t pauses;                    /*!< Times busy held the file up */
+    uint64_t busy_us;                   /*!< Time spent compressing and writing */
+} archiver_result_t;
+
+/**
+ * @brief Counters since archiver_start()
+ */
+typedef struct {
+    uint32_t compressed;                /*!< Files replaced by their .gz */
+    uint32_t kept_raw;                  /*!< Files that did not compress well enough */
+    uint32_t aborted;                   /*!< Jobs given up on an error or archiver_stop() */
+    uint32_t pauses;
+    uint64_t raw_bytes;                 /*!< Input of the compressed files */
+    uint64_t stored_bytes;              /*!< Their .gz sizes */
+    uint64_t busy_us;
+} archiver_stats_t;
+
+/**
+ * @brief Compress src into a gzip file dst
+ *
+ * Streams the file through tdefl in chunk_size pieces, the compressor state
+ * is allocated for the job only. While busy() is true the job waits between
+ * chunks, abort() (may be NULL) being true ends it with ESP_ERR_INVALID_STATE
+ * and dst removed.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM, ESP_ERR_NOT_FOUND for a missing src, ESP_FAIL on a write error
+ */
+esp_err_t archiver_compress_file(const char *src, const char *dst, const archiver_config_t *config,
+                                 bool (*abort)(void), archiver_result_t *result);
+
+/**
+ * @brief Start the background task that replaces closed capture files by .gz files
+ *
+ * The task picks one closed file with a listed extension at a time, writes
+ * name.gz next to it under a temporary name, renames it once complete and
+ * removes the raw file. A line per file goes into the manifest, files that
+ * would not shrink by min_saving_pct are kept and listed as raw. Everything
+ * happens at the lowest useful priority and the job pauses whenever busy()
+ * reports load on the capture path.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE when already running
+ */
+esp_err_t archiver_start(const archiver_config_t *config);
+
+/**
+ * @brief Give up the file in progress and stop before the card goes away
+ *
+ * Nothing is left open afterwards, a partly written .gz is removed and the
+ * raw file stays. archiver_start() may be called again later.
+ *
+ * @return true once stopped, false on timeout
+ */
+bool archiver_stop(uint32_t timeout_ms);
+
+/**
+ * @brief Copy the counters
+ */
+void archiver_get_stats(archiver_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <string.h>
+#include "burst_coalescer.h"
+
+#define SEQ_MASK 0x0FFF
+
+bool burst_coalescer_init(burst_coalescer_t *coalescer, uint16_t capacity, uint32_t window_us)
+{
+    if (coalescer == NULL || capacity == 0) {
+        return false;
+    }
+
+    memset(coalescer, 0, sizeof(*coalescer));
+    coalescer->bursts = calloc(capacity, sizeof(burst_t));
+    if (coalescer->bursts == NULL) {
+        return false;
+    }
+
+    coalescer->capacity = capacity;
+    coalescer->window_us = window_us;
+    return true;
+}
+
+void burst_coalescer_deinit(burst_coalescer_t *coalescer)
+{
+    if (coalescer == NULL) {
+        return;
+    }
+    free(coalescer->bursts);
+    coalescer->bursts = NULL;
+    coalescer->capacity = 0;
+}
+
+static bool joins_burst(const burst_coalescer_t *coalescer, const burst_t *burst, const probe_record_t *record)
+{
+    // Sequence numbers are 12 bits and wrap, the difference is taken modulo 4096
+    uint16_t seq_step = (record->seq - burst->last_seq) & SEQ_MASK;
+
+    bool same_wps = record->wps_hash != 0 && record->wps_hash == burst->first.wps_hash;
+    bool next_seq = seq_step > 0 && seq_step < BURST_SEQ_SPAN && record->ie_hash == burst->first.ie_hash;
+
+    return (same_wps || next_seq) &&
+           memcmp(record->addr2, burst->first.addr2, sizeof(record->addr2)) == 0 &&
+           record->timestamp_us - burst->last_us <= coalescer->window_us;
+}
+
+bool burst_coalescer_add(burst_coalescer_t *coalescer, const probe_record_t *record,
+                         burst_t *evicted, bool *evicted_valid)
+{
+    burst_t *slot = NULL;
+
+    *evicted_valid = false;
+
+    for (uint16_t i = 0; i < coalescer->capacity; i++) {
+        burst_t *burst = &coalescer->bursts[i];
+        if (!burst->in_use) {
+            if (slot == NULL || slot->in_use) {
+                slot = burst;
+            }
+            continue;
+        }
+        if (joins_burst(coalescer, burst, record)) {
+            burst->last_us = record->timestamp_us;
+            burst->last_seq = record->seq;
+            burst->count++;
+            if (record->rssi < burst->rssi_min) {
+                burst->rssi_min = record->rssi;
+            }
+            if (record->rssi > burst->rssi_max) {
+                burst->rssi_max = record->rssi;
+            }
+            return false;
+        }
+        // Remember the least recently active burst in case there is no free slot
+        if (slot == NULL || (slot->in_use && burst->last_us < slot->last_us)) {
+            slot = burst;
+        }
+    }
+
+    if (slot->in_use) {
+        *evicted = *slot;
+        *evicted_valid = true;
+    }
+
+    slot->first = *record;
+    slot->last_us = record->timestamp_us;
+    slot->last_seq = record->seq;
+    slot->count = 1;
+    slot->rssi_min = record->rssi;
+    slot->rssi_max = record->rssi;
+    slot->in_use = true;
+    return true;
+}
+
+uint32_t burst_coalescer_expire(burst_coalescer_t *coalescer, uint64_t now_us, burst_t *out, uint32_t max)
+{
+    uint32_t closed = 0;
+
+    for (uint16_t i = 0; i < coalescer->capacity && closed < max; i++) {
+        burst_t *burst = &coalescer->bursts[i];
+        if (burst->in_use && (now_us == UINT64_MAX || now_us - burst->last_us > coalescer->window_us)) {
+            out[closed++] = *burst;
+            burst->in_use = false;
+        }
+    }
+
+    return closed;
+}
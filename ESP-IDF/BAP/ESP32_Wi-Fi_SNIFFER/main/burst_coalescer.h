@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "probe_record.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BURST_SEQ_SPAN  5   /*!< Next frame of a burst has sn in (last_sn, last_sn + 5), as in instances.py */
+
+/**
+ * @brief One burst of probe requests from the same scan
+ */
+typedef struct {
+    probe_record_t first;   /*!< Record of the first frame, identity and first timestamp */
+    uint64_t last_us;       /*!< Timestamp of the latest frame */
+    uint16_t last_seq;      /*!< Sequence number of the latest frame */
+    uint16_t count;         /*!< Frames in the burst */
+    int8_t rssi_min;        /*!< Weakest RSSI in the burst */
+    int8_t rssi_max;        /*!< Strongest RSSI in the burst */
+    bool in_use;            /*!< Slot holds an open burst */
+} burst_t;
+
+/**
+ * @brief Groups consecutive probe requests into bursts
+ *
+ * A frame joins a burst with the same transmitter address within window_us
+ * of its last frame when either both carry a WPS IE with the same UUID-E, or
+ * the IE signatures match and the sequence number follows the last one of the
+ * burst by 1 to 4, the two rules of is_same_instance() in instances.py.
+ * instances.py also takes two frames without WPS as the same instance, their
+ * empty UUID-E columns being equal; that would join every frame of a MAC
+ * within the window, so frames without WPS only follow the sequence number
+ * rule. A burst is closed when no frame joined it for window_us, or when its
+ * slot is needed for a new burst.
+ */
+typedef struct {
+    burst_t *bursts;        /*!< capacity open bursts */
+    uint16_t capacity;      /*!< Number of bursts tracked at once */
+    uint32_t window_us;     /*!< Idle time after which a burst is closed */
+} burst_coalescer_t;
+
+/**
+ * @brief Allocate the burst table
+ *
+ * @return true on success, false if out of memory or arguments are invalid
+ */
+bool burst_coalescer_init(burst_coalescer_t *coalescer, uint16_t capacity, uint32_t window_us);
+
+/**
+ * @brief Free the burst table, open bursts are discarded
+ */
+void burst_coalescer_deinit(burst_coalescer_t *coalescer);
+
+/**
+ * @brief Add a record to its burst or open a new one
+ *
+ * @param coalescer coalescer object
+ * @param record record of the received frame
+ * @param[out] evicted receives the oldest burst when its slot was reused
+ * @param[out] evicted_valid set to true when evicted was filled
+ * @return true if the record opened a new burst, false if it joined one
+ */
+bool burst_coalescer_add(burst_coalescer_t *coalescer, const probe_record_t *record,
+                         burst_t *evicted, bool *evicted_valid);
+
+/**
+ * @brief Close bursts that have been idle for the window
+ *
+ * @param coalescer coalescer object
+ * @param now_us current time on the clock of the record timestamps, UINT64_MAX closes every burst
+ * @param out receives the closed bursts
+ * @param max size of out
+ * @return number of bursts closed
+ */
+uint32_t burst_coalescer_expire(burst_coalescer_t *coalescer, uint64_t now_us, burst_t *out, uint32_t max);
+
+#ifdef __cplusplus
+}
+#endif
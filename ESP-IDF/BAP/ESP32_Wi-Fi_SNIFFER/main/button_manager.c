@@ -147,7 +147,7 @@ static void button_s1_single_callback(void *arg) {
         if (!powering_down && oled_initialized) {
             request_index++;
             if (request_index > max_request_rank) {
-                request_index = 1;
+                request_index = SNIFFER_FIRST_PAGE_INDEX;
             }
             printf("Request index: %d\n", request_index);
         }
@@ -225,7 +225,7 @@ static void button_s1_double_callback(void *arg) {
         printf("Button S1 double click detected!\n");
         if (!powering_down && oled_initialized) {
             request_index--;
-            if (request_index < 1) {
+            if (request_index < SNIFFER_FIRST_PAGE_INDEX) {
                 request_index = max_request_rank;
             }
             printf("Request index: %d\n", request_index);
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include "capture_stats.h"
+#include "load_shed.h"
+
+void latency_histogram_add(latency_histogram_t *hist, uint32_t latency_us)
+{
+    int bucket = 0;
+    while (bucket < CAPTURE_STATS_LATENCY_BUCKETS - 1 && latency_us >= latency_histogram_bound_us(bucket)) {
+        bucket++;
+    }
+
+    hist->counts[bucket]++;
+    hist->samples++;
+    hist->total_us += latency_us;
+    if (latency_us > hist->max_us) {
+        hist->max_us = latency_us;
+    }
+}
+
+uint32_t latency_histogram_bound_us(int bucket)
+{
+    if (bucket >= CAPTURE_STATS_LATENCY_BUCKETS - 1) {
+        return UINT32_MAX;
+    }
+    return (uint32_t)CAPTURE_STATS_LATENCY_FIRST_US << bucket;
+}
+
+uint32_t latency_histogram_percentile(const latency_histogram_t *hist, uint32_t permille)
+{
+    if (hist->samples == 0) {
+        return 0;
+    }
+
+    // Rank of the sample at the percentile, rounded up so p100 is the last sample
+    uint64_t rank = ((uint64_t)hist->samples * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (int i = 0; i < CAPTURE_STATS_LATENCY_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank && seen > 0) {
+            uint32_t bound = latency_histogram_bound_us(i);
+            return bound < hist->max_us ? bound : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
+
+int capture_stats_format(const capture_stats_t *stats, char *buf, size_t size)
+{
+    return snprintf(buf, size,
+                    "t=%" PRIu32 "s seen=%" PRIu32 " filtered=%" PRIu32 " qdrop=%" PRIu32 " alloc=%" PRIu32
+                    " csv=%" PRIu32 " pcap=%" PRIu32 " err=%" PRIu32 " bytes=%" PRIu64
+                    " maxq=%" PRIu32 "/%" PRIu32 " maxw=%" PRIu32 "/%" PRIu32 " stall=%" PRIu32
+                    " p50=%" PRIu32 "us p99=%" PRIu32 "us max=%" PRIu32 "us"
+                    " mode=%s shifts=%" PRIu32 " pshed=%" PRIu32 " cshed=%" PRIu32
+                    " sstall=%" PRIu32 " sblock=%" PRIu64 "ms",
+                    stats->duration_s, stats->frames_seen, stats->filtered, stats->queue_drops,
+                    stats->alloc_failures, stats->csv_records, stats->pcap_records, stats->write_errors,
+                    stats->bytes_written, stats->work_queue_max_depth, stats->work_queue_capacity,
+                    stats->write_queue_max_depth, stats->write_queue_capacity, stats->write_stalls,
+                    latency_histogram_percentile(&stats->sd_latency, 500),
+                    latency_histogram_percentile(&stats->sd_latency, 990),
+                    stats->sd_latency.max_us, load_shed_mode_name(stats->shed_mode),
+                    stats->shed_transitions, stats->pcap_shed, stats->csv_shed, stats->storage_stalls,
+                    stats->storage_blocked_us / 1000);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAPTURE_STATS_LATENCY_BUCKETS   10      /*!< Histogram buckets, the last one is open ended */
+#define CAPTURE_STATS_LATENCY_FIRST_US  250     /*!< Upper bound of bucket 0, each next bound doubles */
+
+/**
+ * @brief Log2 histogram of SD write latencies
+ *
+ * Bucket i counts writes faster than CAPTURE_STATS_LATENCY_FIRST_US << i,
+ * 250 us up to 64 ms, the last bucket everything slower.
+ */
+typedef struct {
+    uint32_t counts[CAPTURE_STATS_LATENCY_BUCKETS];
+    uint32_t samples;
+    uint32_t max_us;
+    uint64_t total_us;
+} latency_histogram_t;
+
+/**
+ * @brief Counters of the capture pipeline, from the radio to the SD card
+ */
+typedef struct {
+    uint32_t duration_s;            /*!< Time since the sniffer started */
+    uint32_t frames_seen;           /*!< Frames delivered to the Wi-Fi callback */
+    uint32_t filtered;              /*!< Frames rejected by the packet filter */
+    uint32_t accepted;              /*!< Frames that passed the filter */
+    uint32_t queue_drops;           /*!< Frames lost because the work ring was full */
+    uint32_t alloc_failures;        /*!< Frames missing from the pcap because no pool slot was free or large enough, their record is kept */
+    uint32_t csv_records;           /*!< Reduced CSV lines written, one per frame or per burst */
+    uint32_t pcap_records;          /*!< pcap records written */
+    uint32_t write_errors;          /*!< Failed CSV or pcap writes */
+    uint64_t bytes_written;         /*!< CSV and pcap bytes handed to the file system */
+    uint32_t work_queue_max_depth;  /*!< High water of the callback -> stats ring */
+    uint32_t work_queue_capacity;
+    uint32_t write_queue_max_depth; /*!< High water of the stats -> writer ring */
+    uint32_t write_queue_capacity;
+    uint32_t write_stalls;          /*!< Waits of the stats stage on a full write ring */
+    latency_histogram_t sd_latency; /*!< Latency of each block write of the storage task */
+    uint32_t storage_stalls;        /*!< Waits of the writer task for a free block or storage queue slot */
+    uint64_t storage_blocked_us;    /*!< Time the writer task spent in those waits */
+    uint8_t shed_mode;              /*!< Current load_shed_mode_t */
+    uint32_t shed_transitions;      /*!< Output mode changes */
+    uint32_t pcap_shed;             /*!< Queued frames not saved to pcap because of load shedding */
+    uint32_t csv_shed;              /*!< Queued frames without a reduced CSV line because of load shedding */
+} capture_stats_t;
+
+/**
+ * @brief Count one write that took latency_us
+ */
+void latency_histogram_add(latency_histogram_t *hist, uint32_t latency_us);
+
+/**
+ * @brief Upper bound of a bucket in microseconds, UINT32_MAX for the last one
+ */
+uint32_t latency_histogram_bound_us(int bucket);
+
+/**
+ * @brief Upper bound of the bucket holding the given percentile
+ *
+ * @param hist histogram
+ * @param permille percentile in 1/1000, 990 for p99
+ * @return bucket bound in microseconds, max_us when it falls in the last bucket, 0 without samples
+ */
+uint32_t latency_histogram_percentile(const latency_histogram_t *hist, uint32_t permille);
+
+/**
+ * @brief One line summary, "seen=... filtered=... ..." without a trailing newline
+ *
+ * @return length written, as snprintf
+ */
+int capture_stats_format(const capture_stats_t *stats, char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -36,17 +36,76 @@
 
 #define ESP_AP_IP "192.168.4.1"
 
-#define CONFIG_SD_MOUNT_POINT "/sdcard"
+#ifndef CONFIG_SD_MOUNT_POINT
+#define CONFIG_SD_MOUNT_POINT "/sdcard" // host builds point it at a local directory
+#endif
 #define CONFIG_SD_1_LINE true
 
 #define CONFIG_PCAP_FILENAME_MASK "file_%06lu.pcap"
+#define CONFIG_PCAPNG_FILENAME_MASK "file_%06lu.pcapng"
 #define CONFIG_OUTPUT_FILE "REDUCED_DATA.csv"
+#define CONFIG_REDUCED_BINARY 0 // default for "reduced_binary" in settings.json, 24 byte records in CONFIG_REDUCED_BIN_FILE instead of CSV lines
+#define CONFIG_REDUCED_BIN_FILE "REDUCED_DATA.bin"
+#define CONFIG_CSV_FLUSH_RECORDS 0 // default for "csv_flush_records" in settings.json, hand the reduced file to the storage task every this many records, 0 = by age only
+#define CONFIG_CSV_FLUSH_MS 1000 // default for "csv_flush_ms" in settings.json, longest a reduced record stays in RAM
+#define CONFIG_LIVE_MAX_PER_S 20 // default for "live_max_per_s" in settings.json, console lines a second of the live sink, 0 = no limit
 #define CONFIG_BATTERY_FILE "BATTERY_DATA.csv"
+#define CONFIG_PCAP_SNAPLEN 0 // default for "pcap_snaplen" in settings.json, bytes per record with radiotap, 0 = whole frame, at least the radiotap and 802.11 header
+#define CONFIG_PCAP_IES_ONLY 0 // default for "pcap_ies_only", cut vendor IEs (except WPS) down to OUI and type
+#define CONFIG_PCAPNG 0 // default for "pcapng" in settings.json, pcapng blocks with statistics and heartbeat notes instead of classic pcap
+#define CONFIG_PCAP_SEGMENT_MB 0 // default for "pcap_segment_mb" in settings.json, preallocate pcap files as contiguous segments of this size, 0 = grow as written
+#define CONFIG_PCAP_SEGMENT_COMMIT_MS 10000 // sync the open pcap file and record its length in the sidecar this often, bounds the recovery scan at boot
+#define CONFIG_PCAP_SEGMENT_HEADROOM (256 * 1024) // start the next file when this little of the segment is left
+#define CONFIG_PCAP_INDEX 1 // default for "pcap_index" in settings.json, file_XXXXXX.idx with time -> offset entries next to each pcap file
+#define CONFIG_PCAP_INDEX_EVERY_RECORDS 256 // an index entry at least every this many records
+#define CONFIG_PCAP_INDEX_EVERY_MS 1000 // and every second of capture time
+#define CONFIG_ARCHIVE_PCAP 0 // default for "archive_pcap" in settings.json, gzip closed pcap files in the background
+#define CONFIG_ARCHIVE_MANIFEST "ARCHIVE_MANIFEST.csv" // one line per file compressed or kept raw
+#define CONFIG_ARCHIVE_CHUNK_SIZE 4096 // bytes compressed between two checks of the capture load
+#define CONFIG_ARCHIVE_PROBES 32 // tdefl match probes, 4 is ~1.6x faster for ~5 % larger files
+#define CONFIG_ARCHIVE_MIN_SAVING_PCT 10 // files shrinking less are kept raw
+#define CONFIG_ARCHIVE_BUSY_QUEUE_PCT 10 // capture queue occupancy that pauses the compression
+#define CONFIG_ARCHIVE_IDLE_MS 10000 // directory rescan while nothing is left to compress
+#define CONFIG_ARCHIVE_PAUSE_MS 200 // recheck of the capture load while paused
+#define CONFIG_ARCHIVE_TASK_STACK_SIZE 4096
+#define CONFIG_ARCHIVE_TASK_PRIORITY 1 // below every capture task
+#define CONFIG_ARCHIVE_TASK_CORE 0
+#define CONFIG_PCAP_FLUSH_INTERVAL_MS 1000 // default for "pcap_flush_ms" in settings.json, longest a pcap record stays in RAM
 
 #define CONFIG_SNIFFER_TASK_STACK_SIZE 4096
 #define CONFIG_SNIFFER_TASK_PRIORITY 2
+#define CONFIG_SNIFFER_TASK_CORE 0 // stats stage: top requests, RSSI ranges, bursts, display
+#define CONFIG_SNIFFER_WRITER_TASK_STACK_SIZE 4096
+#define CONFIG_SNIFFER_WRITER_TASK_PRIORITY 2
+#define CONFIG_SNIFFER_WRITER_TASK_CORE 1 // storage stage: every SD write of the capture
+#define CONFIG_SNIFFER_WRITE_QUEUE_LEN 128 // jobs between the stats and storage stages
 #define CONFIG_SNIFFER_WORK_QUEUE_LEN 128
+#define CONFIG_SNIFFER_POOL_SLOT_SIZE 512 // rx_ctrl header + a typical probe request, longer frames take a large slot
+#define CONFIG_SNIFFER_POOL_LARGE_SLOT_SIZE 1600 // rx_ctrl header + frames with many vendor or WPS IEs, longer ones lose only their pcap copy
+#define CONFIG_SNIFFER_POOL_LARGE_SLOTS 8 // slots of that size, 0 drops the pcap copy of every frame over CONFIG_SNIFFER_POOL_SLOT_SIZE
+#define CONFIG_SNIFFER_DRAIN_BATCH 16 // packets handled per sniffer task wakeup
+#define CONFIG_SNIFFER_SAVE_PCAP 1 // default for "save_pcap" in settings.json, 0 queues compact records only
+#define CONFIG_SNIFFER_RECORD_QUEUE_LEN 1024 // ring depth when pcap is disabled
+#define CONFIG_SNIFFER_COALESCE_BURSTS 0 // default for "coalesce_bursts" in settings.json, one CSV line and pcap frame per burst
+#define CONFIG_SNIFFER_COALESCE_SLOTS 32 // bursts tracked at once
+#define CONFIG_SNIFFER_COALESCE_WINDOW_MS 200 // a burst closes after this long without a new frame
 #define CONFIG_SNIFFER_DEFAULT_CHANNEL 2
+#define CONFIG_SNIFFER_HOT_LOG_LEVEL 0 // per packet logs: 0 compiled out, 1 warnings, 2 warnings and info
+#define CONFIG_SNIFFER_STATS_OLED_PAGE 0 // adds a capture stats page before the top requests on the OLED
+#define CONFIG_SNIFFER_CLOCK_SYNC_INTERVAL_MS 60000 // packet clock drift sample against the wall clock
+#define CONFIG_SNIFFER_LOAD_SHEDDING 1 // drop pcap, then CSV output while the capture queues are backed up
+#define CONFIG_SNIFFER_SHED_CSV_ONLY_PCT 50 // queue occupancy that stops copying frames for pcap
+#define CONFIG_SNIFFER_SHED_STATS_ONLY_PCT 85 // queue occupancy that also stops the reduced CSV
+#define CONFIG_SNIFFER_SHED_RESUME_PCT 10 // occupancy the queues must stay below to step back up
+#define CONFIG_SNIFFER_SHED_HOLD_MS 5000 // time below the resume occupancy per step up
+#define CONFIG_STORAGE_BLOCK_SIZE (16 * 1024) // RAM block files are written in, matches the FAT allocation unit
+#define CONFIG_STORAGE_BLOCK_COUNT 4 // blocks shared by the pcap and CSV files, two each for ping-pong
+#define CONFIG_STORAGE_QUEUE_LEN 16 // block writes queued for the storage task
+#define CONFIG_STORAGE_TASK_STACK_SIZE 3072
+#define CONFIG_STORAGE_TASK_PRIORITY 2
+#define CONFIG_STORAGE_TASK_CORE 1 // every fwrite of the capture files, next to the writer task
+#define CONFIG_STORAGE_SYNC_TIMEOUT_MS 5000 // wait for queued writes when a file is closed
+#define CONFIG_SNIFFER_TRACE_LEN 512 // binary trace events kept in RAM, 0 disables tracing
 
 #define CONFIG_SNIFFER_USE_MAC_FILTER 0
 #define CONFIG_SNIFFER_MAC_FILTER_B1 0x58
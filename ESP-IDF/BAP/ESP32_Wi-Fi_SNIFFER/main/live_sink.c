@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "config.h"
+#include "text_format.h"
+#include "live_sink.h"
+
+#define LIVE_LINE_MAX       64
+
+typedef struct {
+    int64_t second_us;          // Start of the second lines are counted in
+    uint32_t lines;             // Printed in that second
+    uint32_t skipped;           // Over live_max_per_s in that second
+} live_sink_state_t;
+
+uint32_t live_max_per_s = CONFIG_LIVE_MAX_PER_S;
+
+static live_sink_state_t live_state;
+
+static void live_sink_report_skipped(live_sink_state_t *state)
+{
+    if (state->skipped) {
+        printf("LIVE skipped %lu\n", (unsigned long)state->skipped);
+        state->skipped = 0;
+    }
+}
+
+static void live_sink_next_second(live_sink_state_t *state, int64_t now_us)
+{
+    if (now_us - state->second_us >= 1000000) {
+        live_sink_report_skipped(state);
+        state->second_us = now_us;
+        state->lines = 0;
+    }
+}
+
+static esp_err_t live_sink_open(record_sink_t *sink)
+{
+    live_sink_state_t *state = sink->ctx;
+
+    state->second_us = esp_timer_get_time();
+    state->lines = 0;
+    state->skipped = 0;
+    return ESP_OK;
+}
+
+static uint32_t live_sink_write_batch(record_sink_t *sink, const record_sink_item_t *items, uint32_t count)
+{
+    live_sink_state_t *state = sink->ctx;
+    char line[LIVE_LINE_MAX];
+
+    live_sink_next_second(state, esp_timer_get_time());
+    for (uint32_t i = 0; i < count; i++) {
+        if (items[i].type != RECORD_SINK_ITEM_PACKET) {
+            continue;
+        }
+        const probe_record_t *record = items[i].packet.record;
+        if (live_max_per_s && state->lines >= live_max_per_s) {
+            state->skipped++;
+            continue;
+        }
+        size_t len = 5;
+        memcpy(line, "LIVE ", len);
+        len += text_format_epoch_us(line + len, record->timestamp_us);
+        line[len++] = ',';
+        line[len++] = ' ';
+        len += text_format_mac(line + len, record->addr2);
+        line[len++] = ',';
+        line[len++] = ' ';
+        len += text_format_int(line + len, record->rssi);
+        line[len++] = ',';
+        line[len++] = ' ';
+        len += text_format_int(line + len, record->channel);
+        line[len++] = '\n';
+        fwrite(line, 1, len, stdout);
+        state->lines++;
+    }
+    return count;
+}
+
+static void live_sink_flush(record_sink_t *sink, int64_t now_us)
+{
+    live_sink_next_second(sink->ctx, now_us);
+}
+
+static void live_sink_close(record_sink_t *sink)
+{
+    live_sink_report_skipped(sink->ctx);
+    fflush(stdout);
+}
+
+static const record_sink_ops_t live_sink_ops = {
+    .open = live_sink_open,
+    .write_batch = live_sink_write_batch,
+    .flush = live_sink_flush,
+    .close = live_sink_close,
+};
+
+static record_sink_t live = {
+    .name = "live",
+    .caps = 0,
+    .ops = &live_sink_ops,
+    .ctx = &live_state,
+};
+
+record_sink_t *live_sink(void)
+{
+    return &live;
+}
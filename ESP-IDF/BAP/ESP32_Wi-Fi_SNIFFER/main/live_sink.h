@@ -0,0 +1,23 @@
+#pragma once
+
+#include "record_sink.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Record stream on the serial console, "live" in the "sinks" list of settings.json
+ *
+ * The captive portal and the capture never run at the same time, so the
+ * stream goes to the console: one "LIVE <epoch s.us>, <MAC>, <RSSI>, <channel>"
+ * line per accepted record, on the stats stage and whatever the output mode.
+ * At most live_max_per_s lines a second are printed so a busy channel cannot
+ * stall the stats stage on the UART, a "LIVE skipped <n>" line counts the rest
+ * once the second is over.
+ */
+record_sink_t *live_sink(void);
+
+#ifdef __cplusplus
+}
+#endif
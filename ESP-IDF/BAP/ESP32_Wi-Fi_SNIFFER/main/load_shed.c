@@ -0,0 +1,64 @@
+#include <string.h>
+#include "load_shed.h"
+
+void load_shed_init(load_shed_t *shed, const load_shed_config_t *config)
+{
+    memset(shed, 0, sizeof(*shed));
+    shed->config = *config;
+    atomic_store(&shed->mode, LOAD_SHED_FULL);
+}
+
+bool load_shed_update(load_shed_t *shed, uint32_t depth, uint32_t capacity, uint64_t now_us)
+{
+    if (capacity == 0) {
+        return false;
+    }
+
+    uint32_t pct = (uint64_t)depth * 100 / capacity;
+    load_shed_mode_t mode = load_shed_mode(shed);
+    load_shed_mode_t target = LOAD_SHED_FULL;
+
+    if (pct >= shed->config.stats_only_pct) {
+        target = LOAD_SHED_STATS_ONLY;
+    } else if (pct >= shed->config.csv_only_pct) {
+        target = LOAD_SHED_CSV_ONLY;
+    }
+
+    if (target > mode) {
+        atomic_store(&shed->mode, target);
+        shed->drained = false;
+        shed->transitions++;
+        return true;
+    }
+
+    // Between resume_pct and the threshold of the current level the mode is kept
+    if (mode == LOAD_SHED_FULL || pct >= shed->config.resume_pct) {
+        shed->drained = false;
+        return false;
+    }
+
+    if (!shed->drained) {
+        shed->drained = true;
+        shed->drained_since_us = now_us;
+        return false;
+    }
+    if (now_us - shed->drained_since_us < shed->config.hold_us) {
+        return false;
+    }
+
+    // One level up, the next one needs another full hold time
+    atomic_store(&shed->mode, mode - 1);
+    shed->drained_since_us = now_us;
+    shed->transitions++;
+    return true;
+}
+
+const char *load_shed_mode_name(load_shed_mode_t mode)
+{
+    switch (mode) {
+        case LOAD_SHED_FULL:        return "full";
+        case LOAD_SHED_CSV_ONLY:    return "csv_only";
+        case LOAD_SHED_STATS_ONLY:  return "stats_only";
+        default:                    return "unknown";
+    }
+}
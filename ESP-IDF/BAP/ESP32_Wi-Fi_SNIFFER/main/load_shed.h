@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Output levels, from everything to the bare minimum
+ */
+typedef enum {
+    LOAD_SHED_FULL = 0,         /*!< pcap and reduced CSV */
+    LOAD_SHED_CSV_ONLY,         /*!< Reduced CSV, no frame is copied for pcap */
+    LOAD_SHED_STATS_ONLY,       /*!< Top requests and counters, nothing is written per frame */
+    LOAD_SHED_MODE_COUNT
+} load_shed_mode_t;
+
+/**
+ * @brief Queue occupancy thresholds in percent of the capacity
+ */
+typedef struct {
+    uint8_t csv_only_pct;       /*!< Step down to CSV only at or above this occupancy */
+    uint8_t stats_only_pct;     /*!< Step down to stats only at or above this occupancy */
+    uint8_t resume_pct;         /*!< Step up one level after staying below this occupancy for hold_us */
+    uint32_t hold_us;           /*!< Time below resume_pct needed for each step up */
+} load_shed_config_t;
+
+/**
+ * @brief Degradation policy with hysteresis
+ *
+ * Stepping down is immediate and may skip a level, stepping up goes one
+ * level at a time and only after the queue stayed drained for hold_us, so a
+ * burst at the edge of a threshold does not flip the mode on every batch.
+ * Updated by one task, the mode may be read from anywhere.
+ */
+typedef struct {
+    load_shed_config_t config;
+    atomic_int mode;            /*!< load_shed_mode_t */
+    bool drained;               /*!< Occupancy has been below resume_pct since drained_since_us */
+    uint64_t drained_since_us;
+    uint32_t transitions;       /*!< Mode changes so far */
+} load_shed_t;
+
+/**
+ * @brief Start in LOAD_SHED_FULL with the given thresholds
+ */
+void load_shed_init(load_shed_t *shed, const load_shed_config_t *config);
+
+/**
+ * @brief Feed the current queue occupancy
+ *
+ * @param shed policy object
+ * @param depth items waiting in the queue
+ * @param capacity queue size
+ * @param now_us monotonic time in microseconds
+ * @return true if the mode changed
+ */
+bool load_shed_update(load_shed_t *shed, uint32_t depth, uint32_t capacity, uint64_t now_us);
+
+/**
+ * @brief Current mode
+ */
+static inline load_shed_mode_t load_shed_mode(load_shed_t *shed)
+{
+    return (load_shed_mode_t)atomic_load_explicit(&shed->mode, memory_order_relaxed);
+}
+
+/**
+ * @brief Name of a mode for logs and marker records
+ */
+const char *load_shed_mode_name(load_shed_mode_t mode);
+
+#ifdef __cplusplus
+}
+#endif
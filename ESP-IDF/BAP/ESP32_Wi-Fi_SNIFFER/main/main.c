@@ -34,6 +34,7 @@
 #include "lwip/netdb.h"
 #include "display_queue.h"
 #include "battery.h"
+#include "archiver.h"
 #include "esp_timer.h"
 #include "esp_pm.h"
 #include "driver/rtc_io.h"
@@ -72,6 +73,8 @@ bool enter_deep_sleep_flag = false;
 
 bool flip_oled = FLIP_OLED;
 
+bool archive_pcap = CONFIG_ARCHIVE_PCAP;
+
 char wifi_ssid[64] = CONFIG_WIFI_SSID;
 char wifi_password[64] = CONFIG_WIFI_PASSWORD;
 
@@ -88,6 +91,7 @@ static void initialize_sntp(void);
 static void initialize_wifi(void);
 static bool mount_sd(void);
 static bool unmount_sd(void);
+static void update_archiver(void);
 static uint32_t get_file_index(uint32_t max_files);
 void set_default_time(void);
 void enter_deep_sleep(void);
@@ -296,6 +300,7 @@ void app_main(void)
         initialize_sniffer();
         ESP_ERROR_CHECK(sniffer_start());
         sniffer_running = true;
+        update_archiver();
 
         const char *text_sniff = "Sniffing...";
         i2c_task_send_display_text(text_sniff);
@@ -429,6 +434,13 @@ void app_main(void)
                 ESP_ERROR_CHECK(sniffer_start());
                 sniffer_running = true;
             }
+            // "archive_pcap" may have been changed on the server
+            update_archiver();
+        }
+
+        // A preallocated segment that fills up ends the file early
+        if (sniffer_running && packet_capture_segment_full()) {
+            change_file = true;
         }
 
         if (change_file) {
@@ -554,6 +566,7 @@ void set_default_time(void)
 {
     struct timeval tv = { .tv_sec = 1735693200, .tv_usec = 0 };
     settimeofday(&tv, NULL);
+    sniffer_clock_resync(true);
 }
 
 static void save_task(void* arg)
@@ -621,6 +634,7 @@ static void time_sync_notification_cb(struct timeval *tv)
 {
     ESP_LOGI("SNTP", "Time synchronization event triggered! Waiting for system update...");
     vTaskDelay(2000 / portTICK_PERIOD_MS);
+    sniffer_clock_resync(true);
 }
 
 static void initialize_sntp(void)
@@ -817,6 +831,10 @@ static bool mount_sd(void)
 
 static bool unmount_sd(void)
 {
+    // A file being compressed is given up, the raw one stays
+    if (!archiver_stop(CONFIG_STORAGE_SYNC_TIMEOUT_MS)) {
+        ESP_LOGW(TAG, "Archiver still busy");
+    }
     if (esp_vfs_fat_sdmmc_unmount() != ESP_OK) {
         ESP_LOGE(TAG, "Card unmount failed");
         return sd_mounted;
@@ -828,17 +846,98 @@ static bool unmount_sd(void)
 
 static uint32_t get_file_index(uint32_t max_files)
 {
+    static bool recovered = false;
     uint32_t idx;
     char filename[CONFIG_FATFS_MAX_LFN];
 
+    // Files left open by a reset or power loss are cut down before their index is counted
+    if (!recovered)
+    {
+        uint32_t count = pcap_recover_segments();
+        if (count)
+        {
+            ESP_LOGW(TAG, "Recovered %lu unclosed pcap files", count);
+        }
+        recovered = true;
+    }
+
+    // An index is taken by a file of either format, raw or compressed by the archiver
+    static const char *const masks[] = {
+        CONFIG_SD_MOUNT_POINT"/"CONFIG_PCAP_FILENAME_MASK,
+        CONFIG_SD_MOUNT_POINT"/"CONFIG_PCAPNG_FILENAME_MASK,
+        CONFIG_SD_MOUNT_POINT"/"CONFIG_PCAP_FILENAME_MASK ARCHIVER_EXTENSION,
+        CONFIG_SD_MOUNT_POINT"/"CONFIG_PCAPNG_FILENAME_MASK ARCHIVER_EXTENSION,
+    };
     for(idx = 0; idx < max_files; idx++)
     {
-        sprintf(filename, CONFIG_SD_MOUNT_POINT"/"CONFIG_PCAP_FILENAME_MASK, idx);
-        if (access(filename, F_OK) != 0)
+        bool taken = false;
+        for (int i = 0; i < sizeof(masks) / sizeof(masks[0]) && !taken; i++)
+        {
+            sprintf(filename, masks[i], idx);
+            taken = access(filename, F_OK) == 0;
+        }
+        if (!taken)
         {
             break;
         }
     }
 
     return idx;
+}
+
+/* Pause the archiver while frames queue up or the card is about to be used otherwise */
+static bool archive_busy(void)
+{
+    // The web server lists and serves the files, a stop or sleep unmounts the card
+    if (server_running || start_server || stop_sniffer || enter_deep_sleep_flag || change_file)
+    {
+        return true;
+    }
+    if (!sniffer_running)
+    {
+        return false;
+    }
+    sniffer_stage_stats_t stages[SNIFFER_STAGE_COUNT];
+    sniffer_get_stage_stats(stages);
+    for (int i = 0; i < SNIFFER_STAGE_COUNT; i++)
+    {
+        if (stages[i].capacity && stages[i].depth * 100 >= stages[i].capacity * CONFIG_ARCHIVE_BUSY_QUEUE_PCT)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Background gzip of closed pcap files, follows "archive_pcap" */
+static void update_archiver(void)
+{
+    static const char *const extensions[] = {".pcap", ".pcapng"};
+    static const archiver_config_t config = {
+        .dir = CONFIG_SD_MOUNT_POINT,
+        .manifest = CONFIG_SD_MOUNT_POINT"/"CONFIG_ARCHIVE_MANIFEST,
+        .extensions = extensions,
+        .extension_count = sizeof(extensions) / sizeof(extensions[0]),
+        .busy = archive_busy,
+        .in_use = packet_capture_file_in_use,
+        .chunk_size = CONFIG_ARCHIVE_CHUNK_SIZE,
+        .probes = CONFIG_ARCHIVE_PROBES,
+        .min_saving_pct = CONFIG_ARCHIVE_MIN_SAVING_PCT,
+        .idle_ms = CONFIG_ARCHIVE_IDLE_MS,
+        .pause_ms = CONFIG_ARCHIVE_PAUSE_MS,
+        .stack_size = CONFIG_ARCHIVE_TASK_STACK_SIZE,
+        .priority = CONFIG_ARCHIVE_TASK_PRIORITY,
+        .core = CONFIG_ARCHIVE_TASK_CORE,
+    };
+
+    if (!archive_pcap)
+    {
+        archiver_stop(CONFIG_STORAGE_SYNC_TIMEOUT_MS);
+        return;
+    }
+    esp_err_t err = archiver_start(&config);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+    {
+        ESP_LOGW(TAG, "Archiver not started: %s", esp_err_to_name(err));
+    }
 }
\ No newline at end of file
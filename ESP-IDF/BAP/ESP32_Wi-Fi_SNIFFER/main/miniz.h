@@ -640,7 +640,14 @@ extern "C" {
 /* ------------------- Low-level Compression API Definitions */
 
 /* Set TDEFL_LESS_MEMORY to 1 to use less memory (compression will be slightly slower, and raw/dynamic blocks will be output more frequently). */
+#ifndef TDEFL_LESS_MEMORY
 #define TDEFL_LESS_MEMORY 0
+#endif
+
+/* Set TDEFL_LZ_DICT_BITS below 15 to search a smaller window (9 at least), tdefl_compressor shrinks by 3 bytes per window byte. The output stays standard deflate. */
+#ifndef TDEFL_LZ_DICT_BITS
+#define TDEFL_LZ_DICT_BITS 15
+#endif
 
 /* tdefl_init() compression flags logically OR'd together (low 12 bits contain the max. number of probes per dictionary search): */
 /* TDEFL_DEFAULT_MAX_PROBES: The compressor defaults to 128 dictionary probes per dictionary search. 0=Huffman only, 1=Huffman+LZ (fastest/crap compression), 4095=Huffman+LZ (slowest/best compression). */
@@ -712,7 +719,7 @@ enum
     TDEFL_MAX_HUFF_SYMBOLS_0 = 288,
     TDEFL_MAX_HUFF_SYMBOLS_1 = 32,
     TDEFL_MAX_HUFF_SYMBOLS_2 = 19,
-    TDEFL_LZ_DICT_SIZE = 32768,
+    TDEFL_LZ_DICT_SIZE = 1 << TDEFL_LZ_DICT_BITS,
     TDEFL_LZ_DICT_SIZE_MASK = TDEFL_LZ_DICT_SIZE - 1,
     TDEFL_MIN_MATCH_LEN = 3,
     TDEFL_MAX_MATCH_LEN = 258
@@ -720,9 +727,13 @@ enum
 
 /* TDEFL_OUT_BUF_SIZE MUST be large enough to hold a single entire compressed output block (using static/fixed Huffman codes). */
 #if TDEFL_LESS_MEMORY
+/* LZ codes buffered per deflate block, tdefl_compressor shrinks by 2.3 bytes per byte taken off */
+#ifndef TDEFL_LESS_MEMORY_CODE_BUF_SIZE
+#define TDEFL_LESS_MEMORY_CODE_BUF_SIZE (24 * 1024)
+#endif
 enum
 {
-    TDEFL_LZ_CODE_BUF_SIZE = 24 * 1024,
+    TDEFL_LZ_CODE_BUF_SIZE = TDEFL_LESS_MEMORY_CODE_BUF_SIZE,
     TDEFL_OUT_BUF_SIZE = (TDEFL_LZ_CODE_BUF_SIZE * 13) / 10,
     TDEFL_MAX_HUFF_SYMBOLS = 288,
     TDEFL_LZ_HASH_BITS = 12,
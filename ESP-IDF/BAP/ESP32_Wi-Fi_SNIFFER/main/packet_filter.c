@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "packet_filter.h"
+#include "probe_record.h"
+
+#define FRAME_HEADER_LEN    24
+#define FRAME_ADDR2_OFFSET  10
+#define IE_SSID             0
+#define PROBE_REQ_SUBTYPE   4
+
+static inline uint64_t mac_key(const uint8_t *addr)
+{
+    return ((uint64_t)addr[0] << 40) | ((uint64_t)addr[1] << 32) | ((uint64_t)addr[2] << 24) |
+           ((uint64_t)addr[3] << 16) | ((uint64_t)addr[4] << 8) | addr[5];
+}
+
+static inline uint32_t oui_key(const uint8_t *addr)
+{
+    return ((uint32_t)addr[0] << 16) | ((uint32_t)addr[1] << 8) | addr[2];
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static bool find_u64(const uint64_t *list, uint16_t count, uint64_t key)
+{
+    uint16_t lo = 0, hi = count;
+    while (lo < hi) {
+        uint16_t mid = (lo + hi) / 2;
+        if (list[mid] < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < count && list[lo] == key;
+}
+
+static bool find_u32(const uint32_t *list, uint16_t count, uint32_t key)
+{
+    uint16_t lo = 0, hi = count;
+    while (lo < hi) {
+        uint16_t mid = (lo + hi) / 2;
+        if (list[mid] < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < count && list[lo] == key;
+}
+
+static bool ssid_matches(const packet_filter_t *filter, const uint8_t *frame, uint32_t frame_len)
+{
+    // Same IE offset as the record, beacons and (re)association frames have fixed fields first
+    int32_t ies = probe_record_ie_offset(frame);
+    if (ies < 0) {
+        return false;
+    }
+    uint32_t pos = ies;
+    while (pos + 2 <= frame_len) {
+        uint8_t id = frame[pos];
+        uint8_t len = frame[pos + 1];
+        if (id == IE_SSID) {
+            return len == filter->ssid_len && pos + 2 + len <= frame_len &&
+                   memcmp(frame + pos + 2, filter->ssid, len) == 0;
+        }
+        pos += 2 + len;
+    }
+    return false;
+}
+
+void packet_filter_reset(packet_filter_t *filter)
+{
+    memset(filter, 0, sizeof(*filter));
+    filter->subtype_mask[PACKET_FILTER_TYPE_MGMT] = 1 << PROBE_REQ_SUBTYPE;
+    filter->rssi_floor = PACKET_FILTER_RSSI_OFF;
+    filter->random_mac = PACKET_FILTER_RANDOM_ANY;
+}
+
+bool packet_filter_add(packet_filter_t *filter, const uint8_t *addr, bool oui, bool allow)
+{
+    if (oui) {
+        uint32_t *list = allow ? filter->allow_oui : filter->deny_oui;
+        uint16_t *count = allow ? &filter->allow_oui_count : &filter->deny_oui_count;
+        if (*count >= PACKET_FILTER_MAX_OUIS) {
+            return false;
+        }
+        list[(*count)++] = oui_key(addr);
+    } else {
+        uint64_t *list = allow ? filter->allow_mac : filter->deny_mac;
+        uint16_t *count = allow ? &filter->allow_mac_count : &filter->deny_mac_count;
+        if (*count >= PACKET_FILTER_MAX_MACS) {
+            return false;
+        }
+        list[(*count)++] = mac_key(addr);
+    }
+    return true;
+}
+
+bool packet_filter_set_ssid(packet_filter_t *filter, const char *ssid)
+{
+    size_t len = ssid ? strlen(ssid) : 0;
+    if (len > PACKET_FILTER_MAX_SSID_LEN) {
+        return false;
+    }
+    memcpy(filter->ssid, ssid, len);
+    filter->ssid_len = len;
+    return true;
+}
+
+void packet_filter_compile(packet_filter_t *filter)
+{
+    qsort(filter->allow_mac, filter->allow_mac_count, sizeof(uint64_t), compare_u64);
+    qsort(filter->deny_mac, filter->deny_mac_count, sizeof(uint64_t), compare_u64);
+    qsort(filter->allow_oui, filter->allow_oui_count, sizeof(uint32_t), compare_u32);
+    qsort(filter->deny_oui, filter->deny_oui_count, sizeof(uint32_t), compare_u32);
+}
+
+bool packet_filter_parse_addr(const char *str, uint8_t *addr, bool *oui)
+{
+    int count = 0;
+
+    memset(addr, 0, 6);
+    while (count < 6) {
+        if (!isxdigit((unsigned char)str[0]) || !isxdigit((unsigned char)str[1])) {
+            return false;
+        }
+        char byte[3] = {str[0], str[1], '\0'};
+        addr[count++] = strtoul(byte, NULL, 16);
+        str += 2;
+        if (*str == '\0') {
+            break;
+        }
+        if (*str != ':' && *str != '-') {
+            return false;
+        }
+        str++;
+    }
+
+    if (*str != '\0' || (count != 3 && count != 6)) {
+        return false;
+    }
+    *oui = count == 3;
+    return true;
+}
+
+bool packet_filter_accept(packet_filter_t *filter, const uint8_t *frame, uint32_t frame_len, int8_t rssi)
+{
+    packet_filter_rule_t rule;
+
+    // Cheapest checks first, the address lists and the SSID walk only run on survivors
+    if (frame_len < 2 || !(filter->subtype_mask[(frame[0] >> 2) & 0x3] & (1 << (frame[0] >> 4)))) {
+        rule = PACKET_FILTER_RULE_SUBTYPE;
+        goto drop;
+    }
+    if (frame_len < FRAME_HEADER_LEN) {
+        rule = PACKET_FILTER_RULE_SHORT;
+        goto drop;
+    }
+    if (rssi < filter->rssi_floor) {
+        rule = PACKET_FILTER_RULE_RSSI;
+        goto drop;
+    }
+
+    const uint8_t *addr2 = frame + FRAME_ADDR2_OFFSET;
+    uint64_t mac = mac_key(addr2);
+    uint32_t oui = oui_key(addr2);
+
+    if (filter->deny_mac_count && find_u64(filter->deny_mac, filter->deny_mac_count, mac)) {
+        rule = PACKET_FILTER_RULE_DENY_MAC;
+        goto drop;
+    }
+    if (filter->deny_oui_count && find_u32(filter->deny_oui, filter->deny_oui_count, oui)) {
+        rule = PACKET_FILTER_RULE_DENY_OUI;
+        goto drop;
+    }
+    if ((filter->allow_mac_count || filter->allow_oui_count) &&
+        !find_u64(filter->allow_mac, filter->allow_mac_count, mac) &&
+        !find_u32(filter->allow_oui, filter->allow_oui_count, oui)) {
+        rule = PACKET_FILTER_RULE_ALLOW;
+        goto drop;
+    }
+
+    bool random = addr2[0] & 0x02;
+    if ((filter->random_mac == PACKET_FILTER_RANDOM_ONLY && !random) ||
+        (filter->random_mac == PACKET_FILTER_RANDOM_EXCLUDE && random)) {
+        rule = PACKET_FILTER_RULE_RANDOM_MAC;
+        goto drop;
+    }
+    if (filter->ssid_len && !ssid_matches(filter, frame, frame_len)) {
+        rule = PACKET_FILTER_RULE_SSID;
+        goto drop;
+    }
+
+    atomic_fetch_add_explicit(&filter->passed, 1, memory_order_relaxed);
+    return true;
+
+drop:
+    atomic_fetch_add_explicit(&filter->hits[rule], 1, memory_order_relaxed);
+    return false;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PACKET_FILTER_MAX_MACS      64   /*!< Entries per MAC list */
+#define PACKET_FILTER_MAX_OUIS      32   /*!< Entries per OUI list */
+#define PACKET_FILTER_MAX_SSID_LEN  32
+#define PACKET_FILTER_RSSI_OFF      INT8_MIN
+
+#define PACKET_FILTER_TYPE_MGMT     0
+#define PACKET_FILTER_TYPE_CTRL     1
+#define PACKET_FILTER_TYPE_DATA     2
+#define PACKET_FILTER_TYPE_EXT      3
+
+/**
+ * @brief Filter rules in the order they are evaluated, also indexes hits[]
+ */
+typedef enum {
+    PACKET_FILTER_RULE_SUBTYPE = 0, /*!< Frame type/subtype not in the accepted masks */
+    PACKET_FILTER_RULE_SHORT,       /*!< Frame too short to hold a management header */
+    PACKET_FILTER_RULE_RSSI,        /*!< RSSI below the floor */
+    PACKET_FILTER_RULE_DENY_MAC,    /*!< addr2 in the MAC deny list */
+    PACKET_FILTER_RULE_DENY_OUI,    /*!< addr2 OUI in the OUI deny list */
+    PACKET_FILTER_RULE_ALLOW,       /*!< Allow lists are set and addr2 matches neither */
+    PACKET_FILTER_RULE_RANDOM_MAC,  /*!< Locally administered bit does not match the requested mode */
+    PACKET_FILTER_RULE_SSID,        /*!< SSID element missing or different */
+    PACKET_FILTER_RULE_COUNT
+} packet_filter_rule_t;
+
+/**
+ * @brief Handling of locally administered (randomized) addr2
+ */
+typedef enum {
+    PACKET_FILTER_RANDOM_ANY = 0,   /*!< Ignore the bit */
+    PACKET_FILTER_RANDOM_ONLY,      /*!< Keep only randomized addresses */
+    PACKET_FILTER_RANDOM_EXCLUDE,   /*!< Keep only globally unique addresses */
+} packet_filter_random_t;
+
+/**
+ * @brief Frame filter evaluated in the Wi-Fi driver callback
+ *
+ * Built once from settings.json while the sniffer is stopped, then only read
+ * by packet_filter_accept(). MACs and OUIs are kept as sorted integers so a
+ * lookup is a binary search, and nothing in the accept path allocates or
+ * walks more than the frame itself.
+ */
+typedef struct {
+    uint64_t allow_mac[PACKET_FILTER_MAX_MACS];
+    uint64_t deny_mac[PACKET_FILTER_MAX_MACS];
+    uint32_t allow_oui[PACKET_FILTER_MAX_OUIS];
+    uint32_t deny_oui[PACKET_FILTER_MAX_OUIS];
+    uint16_t allow_mac_count;
+    uint16_t deny_mac_count;
+    uint16_t allow_oui_count;
+    uint16_t deny_oui_count;
+    uint16_t subtype_mask[4];               /*!< Accepted subtypes per frame type, bit n = subtype n */
+    int8_t rssi_floor;                      /*!< Lowest accepted RSSI, PACKET_FILTER_RSSI_OFF disables */
+    uint8_t random_mac;                     /*!< packet_filter_random_t */
+    uint8_t ssid_len;                       /*!< 0 disables the SSID rule */
+    uint8_t ssid[PACKET_FILTER_MAX_SSID_LEN];
+    atomic_uint hits[PACKET_FILTER_RULE_COUNT]; /*!< Frames dropped per rule */
+    atomic_uint passed;                     /*!< Frames accepted */
+} packet_filter_t;
+
+/**
+ * @brief Reset to the default filter: probe requests only, no other rule
+ */
+void packet_filter_reset(packet_filter_t *filter);
+
+/**
+ * @brief Add an address to the allow or deny list
+ *
+ * @param filter filter object
+ * @param addr MAC address, only the first 3 bytes are used when oui is true
+ * @param oui add to the OUI list instead of the MAC list
+ * @param allow add to the allow list instead of the deny list
+ * @return false if the list is full
+ */
+bool packet_filter_add(packet_filter_t *filter, const uint8_t *addr, bool oui, bool allow);
+
+/**
+ * @brief Set the SSID rule, an empty SSID disables it
+ *
+ * @return false if ssid is longer than PACKET_FILTER_MAX_SSID_LEN
+ */
+bool packet_filter_set_ssid(packet_filter_t *filter, const char *ssid);
+
+/**
+ * @brief Sort the address lists, call after the last packet_filter_add()
+ */
+void packet_filter_compile(packet_filter_t *filter);
+
+/**
+ * @brief Parse "AA:BB:CC:DD:EE:FF" or "AA:BB:CC" (also with '-' separators)
+ *
+ * @param str text to parse
+ * @param addr receives 6 bytes, the last 3 are zero for an OUI
+ * @param oui set to true when str held an OUI
+ * @return true on success
+ */
+bool packet_filter_parse_addr(const char *str, uint8_t *addr, bool *oui);
+
+/**
+ * @brief Decide whether a received frame is kept
+ *
+ * Safe to call from the Wi-Fi driver callback, counts the verdict in hits/passed.
+ *
+ * @param filter compiled filter
+ * @param frame 802.11 frame starting with frame control, without FCS
+ * @param frame_len length of frame in bytes
+ * @param rssi RSSI of the frame in dBm
+ * @return true if the frame passes every rule
+ */
+bool packet_filter_accept(packet_filter_t *filter, const uint8_t *frame, uint32_t frame_len, int8_t rssi);
+
+#ifdef __cplusplus
+}
+#endif
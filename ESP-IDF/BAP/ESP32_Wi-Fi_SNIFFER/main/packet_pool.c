@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <string.h>
+#include "packet_pool.h"
+
+bool packet_pool_init(packet_pool_t *pool, uint16_t slot_count, uint16_t slot_size)
+{
+    if (pool == NULL || slot_count == 0 || slot_size == 0) {
+        return false;
+    }
+
+    memset(pool, 0, sizeof(*pool));
+
+    // Keep every slot 4-byte aligned, wifi_promiscuous_pkt_t starts with bitfields
+    slot_size = (slot_size + 3) & ~3;
+
+    pool->storage = malloc((size_t)slot_count * slot_size);
+    if (pool->storage == NULL || !spsc_ring_init(&pool->free_slots, slot_count, sizeof(uint16_t))) {
+        packet_pool_deinit(pool);
+        return false;
+    }
+
+    pool->slot_size = slot_size;
+    pool->slot_count = slot_count;
+
+    for (uint16_t i = 0; i < slot_count; i++) {
+        spsc_ring_push(&pool->free_slots, &i, NULL);
+    }
+    atomic_store(&pool->free_slots.high_water, 0);
+
+    return true;
+}
+
+void packet_pool_deinit(packet_pool_t *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+    free(pool->storage);
+    pool->storage = NULL;
+    spsc_ring_deinit(&pool->free_slots);
+    pool->slot_count = 0;
+}
+
+void *packet_pool_claim(packet_pool_t *pool, size_t length)
+{
+    uint16_t idx;
+
+    if (length > pool->slot_size) {
+        atomic_fetch_add_explicit(&pool->oversize, 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    if (spsc_ring_pop_batch(&pool->free_slots, &idx, 1) == 0) {
+        atomic_fetch_add_explicit(&pool->exhausted, 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    // Only the claiming side raises the peak, so a plain compare is enough
+    uint32_t in_use = packet_pool_in_use(pool);
+    if (in_use > atomic_load_explicit(&pool->in_use_peak, memory_order_relaxed)) {
+        atomic_store_explicit(&pool->in_use_peak, in_use, memory_order_relaxed);
+    }
+
+    return pool->storage + (size_t)idx * pool->slot_size;
+}
+
+void packet_pool_release(packet_pool_t *pool, void *slot)
+{
+    if (slot == NULL) {
+        return;
+    }
+
+    uint16_t idx = ((uint8_t *)slot - pool->storage) / pool->slot_size;
+    spsc_ring_push(&pool->free_slots, &idx, NULL);
+}
+
+bool packet_pool_owns(const packet_pool_t *pool, const void *slot)
+{
+    const uint8_t *p = slot;
+    return pool->storage && p >= pool->storage && p < pool->storage + (size_t)pool->slot_count * pool->slot_size;
+}
+
+uint32_t packet_pool_in_use(packet_pool_t *pool)
+{
+    return pool->slot_count - spsc_ring_count(&pool->free_slots);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "spsc_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Fixed-size packet slot pool
+ *
+ * All slots are allocated once in packet_pool_init(). Free slot indexes are kept
+ * in an SPSC ring where the only producer is the releasing side (sniffer task)
+ * and the only consumer is the claiming side (Wi-Fi driver callback), so both
+ * claim and release are O(1) and never block or touch the heap.
+ */
+typedef struct {
+    uint8_t *storage;           /*!< slot_count * slot_size bytes */
+    spsc_ring_t free_slots;     /*!< uint16_t indexes of free slots */
+    uint16_t slot_size;         /*!< Size of one slot in bytes */
+    uint16_t slot_count;        /*!< Number of slots */
+    atomic_uint exhausted;      /*!< Claims that failed because no slot was free */
+    atomic_uint oversize;       /*!< Claims that failed because the frame did not fit a slot */
+    atomic_uint in_use_peak;    /*!< Highest number of slots claimed at once */
+} packet_pool_t;
+
+/**
+ * @brief Allocate slots and fill the free ring
+ *
+ * @param pool pool object
+ * @param slot_count number of slots, normally CONFIG_SNIFFER_WORK_QUEUE_LEN
+ * @param slot_size size of one slot, the largest frame the pool accepts
+ * @return true on success, false if out of memory or arguments are invalid
+ */
+bool packet_pool_init(packet_pool_t *pool, uint16_t slot_count, uint16_t slot_size);
+
+/**
+ * @brief Free the slot storage, all slots must be released before
+ */
+void packet_pool_deinit(packet_pool_t *pool);
+
+/**
+ * @brief Claim one slot for a frame of the given length
+ *
+ * Safe to call from the Wi-Fi driver callback.
+ *
+ * @return pointer to the slot, NULL if the pool is exhausted or length is too large
+ */
+void *packet_pool_claim(packet_pool_t *pool, size_t length);
+
+/**
+ * @brief Return a slot obtained from packet_pool_claim() to the pool
+ */
+void packet_pool_release(packet_pool_t *pool, void *slot);
+
+/**
+ * @brief Whether slot points into the storage of this pool
+ */
+bool packet_pool_owns(const packet_pool_t *pool, const void *slot);
+
+/**
+ * @brief Number of slots currently claimed
+ */
+uint32_t packet_pool_in_use(packet_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 #include "esp_log.h"
 #include "esp_check.h"
 #include "esp_wifi_types.h"
@@ -18,23 +19,86 @@ static const char *TAG = "pcap";
 #define PCAP_MAGIC_LITTLE_ENDIAN 0xD4C3B2A1 /*!< Little-Endian */
 
 #define SNIFFER_PAYLOAD_FCS_LEN             (4)
+#define PCAP_DEFAULT_SNAPLEN                0x40000
+#define PCAP_SCAN_MAX_STEP_BACK_S           10  /*!< Records found by a recovery scan may go back this much, rx clock reordering */
+#define PCAP_SCAN_MAX_STEP_S                86400
+#define PCAP_MIN_SNAPLEN                    (sizeof(pcap_radiotap_ht_t) + PROBE_REQ_HEADER_LEN) /*!< Radiotap and 802.11 header always fit */
 
-#define RTAP_IT_PRESENT 0b00000000000000000000100000101000
-#define RTAP_CHANNEL_FLAGS 0b0000000010000000
-
-const uint16_t channels[] =  { 2412,
-                               2417,
-                               2422,
-                               2427,
-                               2432,
-                               2437,
-                               2442,
-                               2447,
-                               2452,
-                               2457,
-                               2462,
-                               2467,
-                               2472};
+#define PROBE_REQ_FRAME_CTRL                0x40
+#define PROBE_REQ_HEADER_LEN                24
+#define IE_VENDOR_SPECIFIC                  221
+#define IE_VENDOR_KEEP_LEN                  4   /*!< OUI + OUI type */
+
+#define PCAPNG_BLOCK_SHB                    0x0A0D0D0A
+#define PCAPNG_BLOCK_IDB                    0x00000001
+#define PCAPNG_BLOCK_ISB                    0x00000005
+#define PCAPNG_BLOCK_EPB                    0x00000006
+#define PCAPNG_BLOCK_CUSTOM                 0x00000BAD  /*!< Custom Block, copied along when a tool rewrites the file */
+#define PCAPNG_BYTE_ORDER_MAGIC             0x1A2B3C4D
+#define PCAPNG_SECTION_LENGTH_UNKNOWN       0xFFFFFFFFFFFFFFFFull
+
+#define PCAPNG_OPT_ENDOFOPT                 0
+#define PCAPNG_OPT_CUSTOM_BINARY            2989        /*!< Custom option, copied along when a tool rewrites the file */
+#define PCAPNG_OPT_SHB_HARDWARE             2
+#define PCAPNG_OPT_SHB_USERAPPL             4
+#define PCAPNG_OPT_IF_NAME                  2
+#define PCAPNG_OPT_ISB_STARTTIME            2
+#define PCAPNG_OPT_ISB_ENDTIME              3
+#define PCAPNG_OPT_ISB_IFRECV               4
+#define PCAPNG_OPT_ISB_IFDROP               5
+#define PCAPNG_OPT_ISB_FILTERACCEPT         6
+#define PCAPNG_OPT_ISB_OSDROP               7
+#define PCAPNG_OPT_ISB_USRDELIV             8
+
+#define PCAPNG_SHB_HARDWARE                 "ESP32"
+#define PCAPNG_SHB_USERAPPL                 "ESP32 Wi-Fi sniffer"
+#define PCAPNG_IF_NAME                      "wlan0"
+#define PCAPNG_PAD(len)                     (((len) + 3) & ~3u)
+
+#define RTAP_TSFT                           (1u << 0)
+#define RTAP_FLAGS                          (1u << 1)
+#define RTAP_RATE                           (1u << 2)
+#define RTAP_CHANNEL                        (1u << 3)
+#define RTAP_DBM_ANTSIGNAL                  (1u << 5)
+#define RTAP_DBM_ANTNOISE                   (1u << 6)
+#define RTAP_ANTENNA                        (1u << 11)
+#define RTAP_MCS                            (1u << 19)
+#define RTAP_PRESENT_LEGACY                 (RTAP_TSFT | RTAP_FLAGS | RTAP_RATE | RTAP_CHANNEL | RTAP_DBM_ANTSIGNAL | \
+                                             RTAP_DBM_ANTNOISE | RTAP_ANTENNA)
+#define RTAP_PRESENT_HT                     (RTAP_TSFT | RTAP_FLAGS | RTAP_CHANNEL | RTAP_DBM_ANTSIGNAL | \
+                                             RTAP_DBM_ANTNOISE | RTAP_ANTENNA | RTAP_MCS)
+
+#define RTAP_FLAGS_SHORT_PREAMBLE           0x02
+#define RTAP_CHANNEL_CCK                    0x0020
+#define RTAP_CHANNEL_OFDM                   0x0040
+#define RTAP_CHANNEL_2GHZ                   0x0080
+#define RTAP_MCS_KNOWN                      0x37    /*!< Bandwidth, MCS index, guard interval, FEC type and STBC */
+#define RTAP_MCS_BW_40                      0x01
+#define RTAP_MCS_SGI                        0x04
+#define RTAP_MCS_FEC_LDPC                   0x10
+#define RTAP_MCS_STBC_SHIFT                 5
+
+#define PCAP_CHANNEL_COUNT                  14
+#define SIG_MODE_NON_HT                     0
+
+/* Centre frequency in MHz of channels 1-14, index channel - 1 */
+static const uint16_t channels[PCAP_CHANNEL_COUNT] = { 2412,
+                                                       2417,
+                                                       2422,
+                                                       2427,
+                                                       2432,
+                                                       2437,
+                                                       2442,
+                                                       2447,
+                                                       2452,
+                                                       2457,
+                                                       2462,
+                                                       2467,
+                                                       2472,
+                                                       2484};
+
+/* Legacy rx_ctrl.rate (wifi_phy_rate_t) in 500 kbps units, 0 for codes the PHY does not use */
+static const uint8_t legacy_rates[32] = {2, 4, 11, 22, 0, 4, 11, 22, 96, 48, 24, 12, 108, 72, 36, 18};
 
 typedef struct pcap_file_t pcap_file_t;
 
@@ -65,16 +129,41 @@ typedef struct
 } pcap_radiotap_header_t;
 
 /**
- * @brief Rtap data Structure
+ * @brief RadioTap header of a DSSS/CCK or OFDM frame, fields in the order of their present bits
  * 
  */
-typedef struct
+typedef struct __attribute__((packed))
 {
+    pcap_radiotap_header_t header;
+    uint64_t tsft;          /*!< rx_ctrl.timestamp, microseconds */
+    uint8_t flags;
+    uint8_t rate;           /*!< 500 kbps units */
     uint16_t channel_frequency;
     uint16_t channel_flags;
-    uint8_t antsignal;
+    int8_t antsignal;
+    int8_t antnoise;
     uint8_t antenna;
-} pcap_radiotap_data_t;
+} pcap_radiotap_legacy_t;
+
+/**
+ * @brief RadioTap header of an HT frame, MCS instead of rate
+ * 
+ */
+typedef struct __attribute__((packed))
+{
+    pcap_radiotap_header_t header;
+    uint64_t tsft;
+    uint8_t flags;
+    uint8_t pad;            /*!< channel is 16 bit aligned */
+    uint16_t channel_frequency;
+    uint16_t channel_flags;
+    int8_t antsignal;
+    int8_t antnoise;
+    uint8_t antenna;
+    uint8_t mcs_known;
+    uint8_t mcs_flags;
+    uint8_t mcs_index;
+} pcap_radiotap_ht_t;
 
 /**
  * @brief Pcap Packet Header
@@ -87,6 +176,71 @@ typedef struct {
     uint32_t packet_length;  /*!< Actual length of current packet */
 } pcap_packet_header_t;
 
+/**
+ * @brief pcapng block header, followed by the body and the total length again
+ *
+ */
+typedef struct {
+    uint32_t type;
+    uint32_t total_length;
+} pcapng_block_header_t;
+
+/**
+ * @brief pcapng option header, followed by the value padded to 32 bits
+ *
+ */
+typedef struct {
+    uint16_t code;
+    uint16_t length;
+} pcapng_option_header_t;
+
+/**
+ * @brief Fixed part of the Section Header Block
+ *
+ */
+typedef struct {
+    uint32_t byte_order_magic;
+    uint16_t major;
+    uint16_t minor;
+    uint64_t section_length;
+} __attribute__((packed)) pcapng_shb_t;
+
+/**
+ * @brief Fixed part of the Interface Description Block
+ *
+ */
+typedef struct {
+    uint16_t link_type;
+    uint16_t reserved;
+    uint32_t snaplen;
+} pcapng_idb_t;
+
+/**
+ * @brief Fixed part of the Enhanced Packet Block
+ *
+ */
+typedef struct {
+    uint32_t interface_id;
+    uint32_t timestamp_high;
+    uint32_t timestamp_low;
+    uint32_t capture_length;
+    uint32_t packet_length;
+} pcapng_epb_t;
+
+/**
+ * @brief PCAPNG_OPT_RX_INFO custom option of an Enhanced Packet Block, then opt_endofopt
+ *
+ */
+typedef struct {
+    pcapng_option_header_t header;
+    uint32_t pen;
+    uint8_t type;               /*!< PCAPNG_OPT_RX_INFO */
+    uint8_t channel;
+    int8_t rssi;
+    uint8_t reserved;
+    pcapng_option_header_t end;
+} pcapng_epb_options_t;
+
 /**
  * @brief Pcap Runtime Handle
  *
@@ -98,8 +252,208 @@ struct pcap_file_t {
     unsigned int minor_version; /*!< Pcap version: minor */
     unsigned int time_zone;     /*!< Pcap timezone code */
     uint32_t endian_magic;      /*!< Magic value related to endian format */
+    uint32_t snaplen;           /*!< Max bytes stored per packet including the radiotap header */
+    bool ies_only;              /*!< Trim vendor specific IEs */
+    bool pcapng;                /*!< Blocks instead of classic records */
+    uint64_t bytes_written;     /*!< Header and records written so far, buffered ones included */
+    uint8_t *buffer;            /*!< Records are assembled here and leave in buffer_size blocks, NULL writes through */
+    uint32_t buffer_size;
+    uint32_t buffered;          /*!< Bytes in buffer */
+    uint32_t flushed;           /*!< Leading bytes of buffer already written by pcap_flush() */
+    uint32_t file_writes;       /*!< fwrite calls made on the file */
+    pcap_output_t output;       /*!< Takes the place of file when write is set */
+    uint32_t tsft_high;         /*!< Wraps of the 32 bit rx timestamp so far */
+    uint32_t tsft_last;
+    /* Index 0 for a channel outside 1-14, the rest by channel number */
+    pcap_radiotap_legacy_t rtap_legacy[PCAP_CHANNEL_COUNT + 1];
+    pcap_radiotap_ht_t rtap_ht[PCAP_CHANNEL_COUNT + 1];
 };
 
+/**
+ * @brief Write buffer bytes not on the file yet
+ *
+ * After a full buffer the file ends on a buffer_size boundary, so only the
+ * tail of a partially flushed buffer starts mid-block.
+ */
+static esp_err_t pcap_write_buffer(pcap_file_t *pcap)
+{
+    uint32_t len = pcap->buffered - pcap->flushed;
+    if (len == 0) {
+        return ESP_OK;
+    }
+    pcap->file_writes++;
+    size_t real_write = fwrite(pcap->buffer + pcap->flushed, 1, len, pcap->file);
+    ESP_RETURN_ON_FALSE(real_write == len, ESP_FAIL, TAG, "write pcap buffer failed");
+    if (pcap->buffered == pcap->buffer_size) {
+        pcap->buffered = 0;
+        pcap->flushed = 0;
+    } else {
+        pcap->flushed = pcap->buffered;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Append bytes to the file, through the buffer when there is one
+ */
+static esp_err_t pcap_put(pcap_file_t *pcap, const void *data, uint32_t len)
+{
+    if (pcap->output.write) {
+        return pcap->output.write(pcap->output.ctx, data, len);
+    }
+    if (!pcap->buffer) {
+        pcap->file_writes++;
+        return fwrite(data, 1, len, pcap->file) == len ? ESP_OK : ESP_FAIL;
+    }
+
+    const uint8_t *src = data;
+    while (len) {
+        uint32_t chunk = pcap->buffer_size - pcap->buffered;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(pcap->buffer + pcap->buffered, src, chunk);
+        pcap->buffered += chunk;
+        src += chunk;
+        len -= chunk;
+        if (pcap->buffered == pcap->buffer_size) {
+            ESP_RETURN_ON_ERROR(pcap_write_buffer(pcap), TAG, "flush full buffer failed");
+        }
+    }
+    return ESP_OK;
+}
+
+/* WPS is kept whole, relevant_data.py reads UUID-E from it, and so are the heartbeat stats */
+static bool is_kept_ie(const uint8_t *ie)
+{
+    if (ie[1] < IE_VENDOR_KEEP_LEN) {
+        return false;
+    }
+    return (ie[2] == 0x00 && ie[3] == 0x50 && ie[4] == 0xF2 && ie[5] == 0x04) ||
+           (ie[2] == PCAP_STATS_IE_OUI_0 && ie[3] == PCAP_STATS_IE_OUI_1 && ie[4] == PCAP_STATS_IE_OUI_2 &&
+            ie[5] == PCAP_STATS_IE_TYPE);
+}
+
+/**
+ * @brief Cut vendor specific IEs of a probe request down to OUI and type
+ *
+ * The frame is compacted in place and every trimmed element gets its length
+ * byte rewritten, so the IE chain stays valid for Wireshark and scapy.
+ *
+ * @return new frame length
+ */
+static uint32_t pcap_trim_vendor_ies(uint8_t *frame, uint32_t len)
+{
+    if (len < PROBE_REQ_HEADER_LEN || frame[0] != PROBE_REQ_FRAME_CTRL) {
+        return len;
+    }
+
+    uint32_t in = PROBE_REQ_HEADER_LEN;
+    uint32_t out = PROBE_REQ_HEADER_LEN;
+    while (in + 2 <= len) {
+        uint32_t ie_len = frame[in + 1];
+        if (in + 2 + ie_len > len) {
+            // Malformed tail, keep it as it is
+            ie_len = len - in - 2;
+        }
+        uint32_t keep = ie_len;
+        if (frame[in] == IE_VENDOR_SPECIFIC && ie_len > IE_VENDOR_KEEP_LEN && !is_kept_ie(frame + in)) {
+            keep = IE_VENDOR_KEEP_LEN;
+        }
+        memmove(frame + out, frame + in, 2 + keep);
+        if (keep != ie_len) {
+            frame[out + 1] = keep;
+        }
+        in += 2 + ie_len;
+        out += 2 + keep;
+    }
+    // A single stray byte after the last element
+    memmove(frame + out, frame + in, len - in);
+
+    return out + (len - in);
+}
+
+/**
+ * @brief Radiotap headers with every per-channel field set, a packet only patches in its own values
+ */
+static void pcap_build_radiotap_templates(pcap_file_t *pcap)
+{
+    for (int ch = 0; ch <= PCAP_CHANNEL_COUNT; ch++) {
+        uint16_t frequency = ch ? channels[ch - 1] : 0;
+        pcap->rtap_legacy[ch] = (pcap_radiotap_legacy_t) {
+            .header = {
+                .it_len = sizeof(pcap_radiotap_legacy_t),
+                .it_present = RTAP_PRESENT_LEGACY,
+            },
+            .channel_frequency = frequency,
+            .channel_flags = RTAP_CHANNEL_2GHZ,
+        };
+        pcap->rtap_ht[ch] = (pcap_radiotap_ht_t) {
+            .header = {
+                .it_len = sizeof(pcap_radiotap_ht_t),
+                .it_present = RTAP_PRESENT_HT,
+            },
+            .channel_frequency = frequency,
+            .channel_flags = RTAP_CHANNEL_2GHZ | RTAP_CHANNEL_OFDM,
+            .mcs_known = RTAP_MCS_KNOWN,
+        };
+    }
+}
+
+/**
+ * @brief 64 bit TSFT from the 32 bit microsecond rx timestamp
+ *
+ * Frames are written about in the order they were received, a step back by
+ * more than half the range is a wrap. Synthetic frames have timestamp 0 and
+ * are left out of the tracking.
+ */
+static uint64_t pcap_tsft(pcap_file_t *pcap, uint32_t timestamp)
+{
+    if (timestamp == 0) {
+        return 0;
+    }
+    if (timestamp < pcap->tsft_last && pcap->tsft_last - timestamp > UINT32_MAX / 2) {
+        pcap->tsft_high++;
+    }
+    pcap->tsft_last = timestamp;
+    return (uint64_t)pcap->tsft_high << 32 | timestamp;
+}
+
+/**
+ * @brief Fill the radiotap header of one packet from the template of its channel
+ *
+ * @return header length
+ */
+static uint32_t pcap_fill_radiotap(pcap_file_t *pcap, const wifi_pkt_rx_ctrl_t *rx_ctrl, void *rtap)
+{
+    uint32_t ch = rx_ctrl->channel <= PCAP_CHANNEL_COUNT ? rx_ctrl->channel : 0;
+
+    if (rx_ctrl->sig_mode == SIG_MODE_NON_HT) {
+        pcap_radiotap_legacy_t *legacy = rtap;
+        bool cck = rx_ctrl->rate < 8;
+        *legacy = pcap->rtap_legacy[ch];
+        legacy->tsft = pcap_tsft(pcap, rx_ctrl->timestamp);
+        legacy->flags = rx_ctrl->rate >= 5 && rx_ctrl->rate <= 7 ? RTAP_FLAGS_SHORT_PREAMBLE : 0;
+        legacy->rate = legacy_rates[rx_ctrl->rate];
+        legacy->channel_flags |= cck ? RTAP_CHANNEL_CCK : RTAP_CHANNEL_OFDM;
+        legacy->antsignal = rx_ctrl->rssi;
+        legacy->antnoise = rx_ctrl->noise_floor;
+        legacy->antenna = rx_ctrl->ant;
+        return sizeof(*legacy);
+    }
+
+    pcap_radiotap_ht_t *ht = rtap;
+    *ht = pcap->rtap_ht[ch];
+    ht->tsft = pcap_tsft(pcap, rx_ctrl->timestamp);
+    ht->antsignal = rx_ctrl->rssi;
+    ht->antnoise = rx_ctrl->noise_floor;
+    ht->antenna = rx_ctrl->ant;
+    ht->mcs_flags = (rx_ctrl->cwb ? RTAP_MCS_BW_40 : 0) | (rx_ctrl->sgi ? RTAP_MCS_SGI : 0) |
+                    (rx_ctrl->fec_coding ? RTAP_MCS_FEC_LDPC : 0) | (rx_ctrl->stbc << RTAP_MCS_STBC_SHIFT);
+    ht->mcs_index = rx_ctrl->mcs;
+    return sizeof(*ht);
+}
+
 esp_err_t pcap_new_session(const pcap_config_t *config, pcap_file_handle_t *ret_pcap)
 {
     esp_err_t ret = ESP_OK;
@@ -113,6 +467,23 @@ esp_err_t pcap_new_session(const pcap_config_t *config, pcap_file_handle_t *ret_
     pcap->minor_version = config->minor_version;
     pcap->endian_magic = config->flags.little_endian ? PCAP_MAGIC_LITTLE_ENDIAN : PCAP_MAGIC_BIG_ENDIAN;
     pcap->time_zone = config->time_zone;
+    pcap->snaplen = config->snaplen ? config->snaplen : PCAP_DEFAULT_SNAPLEN;
+    if (pcap->snaplen < PCAP_MIN_SNAPLEN) {
+        /* A shorter snaplen would store records longer than the file header allows */
+        ESP_LOGW(TAG, "snaplen %lu raised to %lu", pcap->snaplen, (uint32_t)PCAP_MIN_SNAPLEN);
+        pcap->snaplen = PCAP_MIN_SNAPLEN;
+    }
+    pcap->ies_only = config->flags.ies_only;
+    pcap->pcapng = config->flags.pcapng;
+    pcap->output = config->output;
+    pcap_build_radiotap_templates(pcap);
+    if (config->buffer_size && !pcap->output.write) {
+        pcap->buffer = malloc(config->buffer_size);
+        ESP_GOTO_ON_FALSE(pcap->buffer, ESP_ERR_NO_MEM, err, TAG, "no mem for pcap write buffer");
+        pcap->buffer_size = config->buffer_size;
+        // Whole blocks are handed to fwrite already, skip the stdio copy
+        setvbuf(pcap->file, NULL, _IONBF, 0);
+    }
     *ret_pcap = pcap;
     return ret;
 err:
@@ -124,18 +495,129 @@ err:
 
 esp_err_t pcap_del_session(pcap_file_handle_t pcap)
 {
+    esp_err_t ret = ESP_OK;
     ESP_RETURN_ON_FALSE(pcap, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (pcap->output.write) {
+        ret = pcap->output.close(pcap->output.ctx);
+        pcap->file = NULL;
+    }
     if (pcap->file) {
+        if (pcap->buffer && pcap_write_buffer(pcap) != ESP_OK) {
+            ESP_LOGE(TAG, "buffered records lost on close");
+            ret = ESP_FAIL;
+        }
         fclose(pcap->file);
         pcap->file = NULL;
     }
+    free(pcap->buffer);
     free(pcap);
+    return ret;
+}
+
+esp_err_t pcap_flush(pcap_file_handle_t pcap)
+{
+    ESP_RETURN_ON_FALSE(pcap, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (pcap->output.write) {
+        return pcap->output.flush(pcap->output.ctx);
+    }
+    if (pcap->buffer) {
+        ESP_RETURN_ON_ERROR(pcap_write_buffer(pcap), TAG, "flush pcap buffer failed");
+    }
+    fflush(pcap->file);
+    return ESP_OK;
+}
+
+/**
+ * @brief Append one option, value padded to 32 bits
+ */
+static esp_err_t pcapng_put_option(pcap_file_t *pcap, uint16_t code, const void *value, uint16_t len)
+{
+    static const uint8_t zeros[3] = {0};
+    pcapng_option_header_t header = {
+        .code = code,
+        .length = len,
+    };
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &header, sizeof(header)), TAG, "write option header failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, value, len), TAG, "write option value failed");
+    return pcap_put(pcap, zeros, PCAPNG_PAD(len) - len);
+}
+
+/* Size of an option as appended by pcapng_put_option() */
+static uint32_t pcapng_option_size(uint32_t len)
+{
+    return sizeof(pcapng_option_header_t) + PCAPNG_PAD(len);
+}
+
+/* Timestamp as the two words of an Enhanced Packet Block, microseconds since the epoch */
+static void pcapng_timestamp(uint64_t us, uint32_t words[2])
+{
+    words[0] = us >> 32;
+    words[1] = (uint32_t)us;
+}
+
+/**
+ * @brief Section Header Block of unknown length and the one interface, no packet before them
+ *
+ * Every file starts its own section, so segment files appended to each other
+ * are still a valid pcapng file.
+ */
+static esp_err_t pcapng_write_header(pcap_file_t *pcap, pcap_link_type_t link_type)
+{
+    const pcapng_option_header_t end = { .code = PCAPNG_OPT_ENDOFOPT };
+    uint32_t shb_length = sizeof(pcapng_block_header_t) + sizeof(pcapng_shb_t) +
+                          pcapng_option_size(strlen(PCAPNG_SHB_HARDWARE)) +
+                          pcapng_option_size(strlen(PCAPNG_SHB_USERAPPL)) + sizeof(end) + sizeof(uint32_t);
+    pcapng_block_header_t shb_header = {
+        .type = PCAPNG_BLOCK_SHB,
+        .total_length = shb_length,
+    };
+    pcapng_shb_t shb = {
+        .byte_order_magic = PCAPNG_BYTE_ORDER_MAGIC,
+        .major = 1,
+        .minor = 0,
+        .section_length = PCAPNG_SECTION_LENGTH_UNKNOWN,
+    };
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &shb_header, sizeof(shb_header)), TAG, "write section header failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &shb, sizeof(shb)), TAG, "write section header failed");
+    ESP_RETURN_ON_ERROR(pcapng_put_option(pcap, PCAPNG_OPT_SHB_HARDWARE, PCAPNG_SHB_HARDWARE,
+                                          strlen(PCAPNG_SHB_HARDWARE)), TAG, "write section header failed");
+    ESP_RETURN_ON_ERROR(pcapng_put_option(pcap, PCAPNG_OPT_SHB_USERAPPL, PCAPNG_SHB_USERAPPL,
+                                          strlen(PCAPNG_SHB_USERAPPL)), TAG, "write section header failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &end, sizeof(end)), TAG, "write section header failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &shb_length, sizeof(shb_length)), TAG, "write section header failed");
+
+    /* Timestamps stay in the default microsecond resolution, no if_tsresol */
+    uint32_t idb_length = sizeof(pcapng_block_header_t) + sizeof(pcapng_idb_t) +
+                          pcapng_option_size(strlen(PCAPNG_IF_NAME)) + sizeof(end) + sizeof(uint32_t);
+    pcapng_block_header_t idb_header = {
+        .type = PCAPNG_BLOCK_IDB,
+        .total_length = idb_length,
+    };
+    pcapng_idb_t idb = {
+        .link_type = link_type,
+        .snaplen = pcap->snaplen,
+    };
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &idb_header, sizeof(idb_header)), TAG, "write interface block failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &idb, sizeof(idb)), TAG, "write interface block failed");
+    ESP_RETURN_ON_ERROR(pcapng_put_option(pcap, PCAPNG_OPT_IF_NAME, PCAPNG_IF_NAME, strlen(PCAPNG_IF_NAME)),
+                        TAG, "write interface block failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &end, sizeof(end)), TAG, "write interface block failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &idb_length, sizeof(idb_length)), TAG, "write interface block failed");
+    pcap->bytes_written += shb_length + idb_length;
     return ESP_OK;
 }
 
 esp_err_t pcap_write_header(pcap_file_handle_t pcap, pcap_link_type_t link_type)
 {
     ESP_RETURN_ON_FALSE(pcap, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (pcap->pcapng) {
+        ESP_RETURN_ON_ERROR(pcapng_write_header(pcap, link_type), TAG, "write pcapng header failed");
+        pcap->link_type = link_type;
+        if (!pcap->buffer && !pcap->output.write) {
+            fflush(pcap->file);
+        }
+        return ESP_OK;
+    }
     /* Write Pcap File header */
     pcap_file_header_t header = {
         .magic = pcap->endian_magic,
@@ -143,15 +625,17 @@ esp_err_t pcap_write_header(pcap_file_handle_t pcap, pcap_link_type_t link_type)
         .minor = pcap->minor_version,
         .zone = pcap->time_zone,
         .sigfigs = 0,
-        .snaplen = 0x40000,
+        .snaplen = pcap->snaplen,
         .link_type = link_type,
     };
-    size_t real_write = fwrite(&header, sizeof(header), 1, pcap->file);
-    ESP_RETURN_ON_FALSE(real_write == 1, ESP_FAIL, TAG, "write pcap file header failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &header, sizeof(header)), TAG, "write pcap file header failed");
+    pcap->bytes_written += sizeof(header);
     /* Save the link type to pcap file object */
     pcap->link_type = link_type;
-    /* Flush content in the buffer into device */
-    fflush(pcap->file);
+    /* Without a buffer flush content into device, otherwise it goes with the first full block */
+    if (!pcap->buffer && !pcap->output.write) {
+        fflush(pcap->file);
+    }
     return ESP_OK;
 }
 
@@ -160,48 +644,271 @@ esp_err_t pcap_capture_packet(pcap_file_handle_t pcap, void *payload, uint32_t l
     ESP_RETURN_ON_FALSE(pcap && payload, ESP_ERR_INVALID_ARG, TAG, "invalid argumnet");
 
     wifi_promiscuous_pkt_t *pkt = (wifi_promiscuous_pkt_t *)payload;
+    union {
+        pcap_radiotap_legacy_t legacy;
+        pcap_radiotap_ht_t ht;
+    } rtap;
+    uint32_t rtap_len = pcap_fill_radiotap(pcap, &pkt->rx_ctrl, &rtap);
+    uint32_t frame_len = pkt->rx_ctrl.sig_len - SNIFFER_PAYLOAD_FCS_LEN;
+
+    /* packet_length keeps the length on air, capture_length is what is stored */
+    uint32_t stored_len = pcap->ies_only ? pcap_trim_vendor_ies(pkt->payload, frame_len) : frame_len;
+    if (stored_len + rtap_len > pcap->snaplen) {
+        stored_len = pcap->snaplen > rtap_len ? pcap->snaplen - rtap_len : 0;
+    }
+
+    if (pcap->pcapng) {
+        static const uint8_t zeros[3] = {0};
+        uint32_t data_len = rtap_len + stored_len;
+        pcapng_epb_options_t options = {
+            .header = { .code = PCAPNG_OPT_CUSTOM_BINARY, .length = 4 + 4 },
+            .pen = PCAPNG_PEN,
+            .type = PCAPNG_OPT_RX_INFO,
+            .channel = pkt->rx_ctrl.channel,
+            .rssi = pkt->rx_ctrl.rssi,
+            .end = { .code = PCAPNG_OPT_ENDOFOPT },
+        };
+        uint32_t block_length = sizeof(pcapng_block_header_t) + sizeof(pcapng_epb_t) + PCAPNG_PAD(data_len) +
+                                sizeof(options) + sizeof(uint32_t);
+        pcapng_block_header_t block = {
+            .type = PCAPNG_BLOCK_EPB,
+            .total_length = block_length,
+        };
+        pcapng_epb_t epb = {
+            .interface_id = 0,
+            .capture_length = data_len,
+            .packet_length = frame_len + rtap_len,
+        };
+        uint32_t timestamp[2];
+        pcapng_timestamp((uint64_t)seconds * 1000000 + microseconds, timestamp);
+        epb.timestamp_high = timestamp[0];
+        epb.timestamp_low = timestamp[1];
+
+        ESP_RETURN_ON_ERROR(pcap_put(pcap, &block, sizeof(block)), TAG, "write packet block failed");
+        ESP_RETURN_ON_ERROR(pcap_put(pcap, &epb, sizeof(epb)), TAG, "write packet block failed");
+        ESP_RETURN_ON_ERROR(pcap_put(pcap, &rtap, rtap_len), TAG, "write packet radiotap failed");
+        ESP_RETURN_ON_ERROR(pcap_put(pcap, pkt->payload, stored_len), TAG, "write packet payload failed");
+        ESP_RETURN_ON_ERROR(pcap_put(pcap, zeros, PCAPNG_PAD(data_len) - data_len), TAG, "write packet padding failed");
+        ESP_RETURN_ON_ERROR(pcap_put(pcap, &options, sizeof(options)), TAG, "write packet options failed");
+        ESP_RETURN_ON_ERROR(pcap_put(pcap, &block_length, sizeof(block_length)), TAG, "write packet block failed");
+        pcap->bytes_written += block_length;
+        if (!pcap->buffer && !pcap->output.write) {
+            fflush(pcap->file);
+        }
+        return ESP_OK;
+    }
 
-    size_t real_write = 0;
     pcap_packet_header_t header = {
         .seconds = seconds,
         .microseconds = microseconds,
-        .capture_length = pkt->rx_ctrl.sig_len - SNIFFER_PAYLOAD_FCS_LEN + sizeof(pcap_radiotap_header_t) + sizeof(pcap_radiotap_data_t),
-        .packet_length = pkt->rx_ctrl.sig_len - SNIFFER_PAYLOAD_FCS_LEN + sizeof(pcap_radiotap_header_t) + sizeof(pcap_radiotap_data_t)
+        .capture_length = stored_len + rtap_len,
+        .packet_length = frame_len + rtap_len
+    };
+
+    /* With a buffer the record is assembled in one piece there */
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &header, sizeof(header)), TAG, "write packet header failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &rtap, rtap_len), TAG, "write packet radiotap failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, pkt->payload, stored_len), TAG, "write packet payload failed");
+    pcap->bytes_written += sizeof(header) + rtap_len + stored_len;
+    /* Without a buffer flush content into device per packet */
+    if (!pcap->buffer && !pcap->output.write) {
+        fflush(pcap->file);
+    }
+    return ESP_OK;
+}
+
+esp_err_t pcap_write_if_stats(pcap_file_handle_t pcap, const pcap_if_stats_t *stats, uint32_t seconds, uint32_t microseconds)
+{
+    ESP_RETURN_ON_FALSE(pcap && stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(pcap->pcapng, ESP_ERR_NOT_SUPPORTED, TAG, "statistics need pcapng");
+
+    const struct {
+        uint16_t code;
+        uint64_t value;
+    } counters[] = {
+        { PCAPNG_OPT_ISB_IFRECV, stats->received },
+        { PCAPNG_OPT_ISB_IFDROP, stats->dropped },
+        { PCAPNG_OPT_ISB_FILTERACCEPT, stats->accepted },
+        { PCAPNG_OPT_ISB_OSDROP, stats->shed },
+        { PCAPNG_OPT_ISB_USRDELIV, stats->delivered },
     };
-    pcap_radiotap_header_t rtap_header = {
-        .it_version = 0,
-        .it_pad = 0,
-        .it_len = sizeof(pcap_radiotap_header_t) + sizeof(pcap_radiotap_data_t),
-        .it_present = RTAP_IT_PRESENT
+    const int counter_count = sizeof(counters) / sizeof(counters[0]);
+    const pcapng_option_header_t end = { .code = PCAPNG_OPT_ENDOFOPT };
+    uint32_t block_length = sizeof(pcapng_block_header_t) + 3 * sizeof(uint32_t) +
+                            (2 + counter_count) * pcapng_option_size(sizeof(uint64_t)) + sizeof(end) + sizeof(uint32_t);
+    pcapng_block_header_t block = {
+        .type = PCAPNG_BLOCK_ISB,
+        .total_length = block_length,
     };
-    pcap_radiotap_data_t rtap_data = {
-        .channel_frequency = channels[pkt->rx_ctrl.channel],
-        .channel_flags = RTAP_CHANNEL_FLAGS,
-        .antenna = pkt->rx_ctrl.ant,
-        .antsignal = pkt->rx_ctrl.rssi
+    uint32_t body[3] = {0};     // Interface id, timestamp high and low
+    uint32_t start[2];
+    pcapng_timestamp((uint64_t)seconds * 1000000 + microseconds, &body[1]);
+    pcapng_timestamp(stats->start_us, start);
+
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &block, sizeof(block)), TAG, "write statistics block failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, body, sizeof(body)), TAG, "write statistics block failed");
+    ESP_RETURN_ON_ERROR(pcapng_put_option(pcap, PCAPNG_OPT_ISB_STARTTIME, start, sizeof(start)),
+                        TAG, "write statistics block failed");
+    ESP_RETURN_ON_ERROR(pcapng_put_option(pcap, PCAPNG_OPT_ISB_ENDTIME, &body[1], 2 * sizeof(uint32_t)),
+                        TAG, "write statistics block failed");
+    for (int i = 0; i < counter_count; i++) {
+        ESP_RETURN_ON_ERROR(pcapng_put_option(pcap, counters[i].code, &counters[i].value, sizeof(uint64_t)),
+                            TAG, "write statistics block failed");
+    }
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &end, sizeof(end)), TAG, "write statistics block failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &block_length, sizeof(block_length)), TAG, "write statistics block failed");
+    pcap->bytes_written += block_length;
+    if (!pcap->buffer && !pcap->output.write) {
+        fflush(pcap->file);
+    }
+    return ESP_OK;
+}
+
+esp_err_t pcap_write_note(pcap_file_handle_t pcap, const char *text, uint32_t seconds, uint32_t microseconds)
+{
+    static const uint8_t zeros[3] = {0};
+    ESP_RETURN_ON_FALSE(pcap && text, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(pcap->pcapng, ESP_ERR_NOT_SUPPORTED, TAG, "notes need pcapng");
+
+    uint32_t text_len = strlen(text);
+    uint32_t body[3] = { PCAPNG_PEN };  // PEN, timestamp high and low
+    pcapng_timestamp((uint64_t)seconds * 1000000 + microseconds, &body[1]);
+    uint32_t block_length = sizeof(pcapng_block_header_t) + sizeof(body) + PCAPNG_PAD(text_len) + sizeof(uint32_t);
+    pcapng_block_header_t block = {
+        .type = PCAPNG_BLOCK_CUSTOM,
+        .total_length = block_length,
     };
 
-    real_write = fwrite(&header, sizeof(header), 1, pcap->file);
-    ESP_RETURN_ON_FALSE(real_write == 1, ESP_FAIL, TAG, "write packet header failed");
-
-    real_write = fwrite(&rtap_header, sizeof(rtap_header), 1, pcap->file);
-    ESP_RETURN_ON_FALSE(real_write == 1, ESP_FAIL, TAG, "write packet rtap_header failed");
-    real_write = fwrite(&rtap_data, sizeof(rtap_data), 1, pcap->file);
-    ESP_RETURN_ON_FALSE(real_write == 1, ESP_FAIL, TAG, "write packet rtap_data failed");
-    
-    real_write = fwrite(pkt->payload, sizeof(uint8_t), pkt->rx_ctrl.sig_len - SNIFFER_PAYLOAD_FCS_LEN, pcap->file);
-    ESP_RETURN_ON_FALSE(real_write == pkt->rx_ctrl.sig_len - SNIFFER_PAYLOAD_FCS_LEN, ESP_FAIL, TAG, "write packet payload failed");
-    /* Flush content in the buffer into device */
-    fflush(pcap->file);
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &block, sizeof(block)), TAG, "write custom block failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, body, sizeof(body)), TAG, "write custom block failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, text, text_len), TAG, "write custom block failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, zeros, PCAPNG_PAD(text_len) - text_len), TAG, "write custom block failed");
+    ESP_RETURN_ON_ERROR(pcap_put(pcap, &block_length, sizeof(block_length)), TAG, "write custom block failed");
+    pcap->bytes_written += block_length;
+    if (!pcap->buffer && !pcap->output.write) {
+        fflush(pcap->file);
+    }
     return ESP_OK;
 }
 
+bool pcap_is_pcapng(pcap_file_handle_t pcap)
+{
+    return pcap ? pcap->pcapng : false;
+}
+
+uint64_t pcap_get_bytes_written(pcap_file_handle_t pcap)
+{
+    return pcap ? pcap->bytes_written : 0;
+}
+
+uint32_t pcap_get_buffered_bytes(pcap_file_handle_t pcap)
+{
+    return pcap ? pcap->buffered - pcap->flushed : 0;
+}
+
+uint32_t pcap_get_file_writes(pcap_file_handle_t pcap)
+{
+    return pcap ? pcap->file_writes : 0;
+}
+
+/* Block types written by this file, anything else ends a recovery scan */
+static bool pcapng_is_known_block(uint32_t type)
+{
+    return type == PCAPNG_BLOCK_SHB || type == PCAPNG_BLOCK_IDB || type == PCAPNG_BLOCK_ISB ||
+           type == PCAPNG_BLOCK_EPB || type == PCAPNG_BLOCK_CUSTOM;
+}
+
+/* Whether a record time follows the previous one, old captures left in a reused preallocation do not */
+static bool pcap_scan_time_follows(uint64_t last_us, uint64_t time_us)
+{
+    return last_us == 0 || (time_us + PCAP_SCAN_MAX_STEP_BACK_S * 1000000ULL >= last_us &&
+                            time_us <= last_us + PCAP_SCAN_MAX_STEP_S * 1000000ULL);
+}
+
+static uint64_t pcapng_scan_valid_length(FILE *fp, uint64_t off, uint64_t size)
+{
+    pcapng_block_header_t block;
+    uint32_t trailer;
+    uint32_t body[3];           // Interface id, timestamp high and low of EPB and ISB
+    uint64_t last_us = 0;
+
+    while (off + sizeof(block) + sizeof(trailer) <= size) {
+        if (fseek(fp, off, SEEK_SET) != 0 || fread(&block, sizeof(block), 1, fp) != 1 ||
+            !pcapng_is_known_block(block.type) || (block.type == PCAPNG_BLOCK_SHB && off != 0) ||
+            block.total_length < sizeof(block) + sizeof(trailer) ||
+            block.total_length % 4 || off + block.total_length > size) {
+            break;
+        }
+        if (block.type == PCAPNG_BLOCK_EPB || block.type == PCAPNG_BLOCK_ISB) {
+            if (block.total_length < sizeof(block) + sizeof(body) + sizeof(trailer) ||
+                fread(body, sizeof(body), 1, fp) != 1) {
+                break;
+            }
+            uint64_t time_us = (uint64_t)body[1] << 32 | body[2];
+            if (!pcap_scan_time_follows(last_us, time_us)) {
+                break;
+            }
+            last_us = time_us;
+        }
+        if (fseek(fp, off + block.total_length - sizeof(trailer), SEEK_SET) != 0 ||
+            fread(&trailer, sizeof(trailer), 1, fp) != 1 || trailer != block.total_length) {
+            break;
+        }
+        off += block.total_length;
+    }
+    return off;
+}
+
+uint64_t pcap_scan_valid_length(FILE *fp, uint64_t from, uint64_t size)
+{
+    pcap_file_header_t file_header;
+    pcap_packet_header_t header;
+    pcap_radiotap_header_t rtap;
+    uint64_t last_us = 0;
+
+    if (fp == NULL || size < sizeof(uint32_t) || fseek(fp, 0, SEEK_SET) != 0 ||
+        fread(&file_header.magic, sizeof(file_header.magic), 1, fp) != 1) {
+        return 0;
+    }
+    if (file_header.magic == PCAPNG_BLOCK_SHB) {
+        return pcapng_scan_valid_length(fp, from, size);
+    }
+    if (size < sizeof(file_header) || fseek(fp, 0, SEEK_SET) != 0 || fread(&file_header, sizeof(file_header), 1, fp) != 1 ||
+        (file_header.magic != PCAP_MAGIC_BIG_ENDIAN && file_header.magic != PCAP_MAGIC_LITTLE_ENDIAN)) {
+        return 0;
+    }
+
+    /* Unused parts of a preallocated file hold zeros or whatever was deleted there before,
+     * segment_file_commit() zeroes the header after the committed length */
+    uint64_t off = from > sizeof(file_header) ? from : sizeof(file_header);
+    while (off + sizeof(header) <= size) {
+        if (fseek(fp, off, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, fp) != 1 ||
+            header.capture_length == 0 || header.capture_length > file_header.snaplen ||
+            header.capture_length > header.packet_length || header.microseconds >= 1000000 ||
+            off + sizeof(header) + header.capture_length > size ||
+            !pcap_scan_time_follows(last_us, (uint64_t)header.seconds * 1000000 + header.microseconds)) {
+            break;
+        }
+        if (file_header.link_type == PCAP_LINK_TYPE_802_11_RADIOTAP &&
+            (header.capture_length < sizeof(rtap) || fread(&rtap, sizeof(rtap), 1, fp) != 1 ||
+             rtap.it_version != 0 || rtap.it_len > header.capture_length)) {
+            break;
+        }
+        last_us = (uint64_t)header.seconds * 1000000 + header.microseconds;
+        off += sizeof(header) + header.capture_length;
+    }
+    return off;
+}
+
 esp_err_t pcap_print_summary(pcap_file_handle_t pcap, FILE *print_file)
 {
     esp_err_t ret = ESP_OK;
     long size = 0;
     char *packet_payload = NULL;
     ESP_RETURN_ON_FALSE(pcap && print_file, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(!pcap->output.write, ESP_ERR_NOT_SUPPORTED, TAG, "file is written through an output");
+    ESP_RETURN_ON_FALSE(!pcap->pcapng, ESP_ERR_NOT_SUPPORTED, TAG, "summary reads classic pcap only");
+    ESP_RETURN_ON_ERROR(pcap_flush(pcap), TAG, "flush before summary failed");
     // get file size
     fseek(pcap->file, 0L, SEEK_END);
     size = ftell(pcap->file);
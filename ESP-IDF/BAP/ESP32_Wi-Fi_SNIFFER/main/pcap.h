@@ -6,6 +6,8 @@
 #pragma once
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -16,6 +18,16 @@ extern "C" {
 #define PCAP_DEFAULT_VERSION_MINOR 0x04 /*!< Minor Version */
 #define PCAP_DEFAULT_TIME_ZONE_GMT 0x00 /*!< Time Zone */
 
+/* Vendor specific element kept whole by the ies_only trim, the sniffer's heartbeat frame carries its capture stats in it */
+#define PCAP_STATS_IE_OUI_0 0x02
+#define PCAP_STATS_IE_OUI_1 0x00
+#define PCAP_STATS_IE_OUI_2 0x00
+#define PCAP_STATS_IE_TYPE  0x01
+
+/* Private Enterprise Number of the pcapng custom blocks and options, 32473 is the IANA number for documentation until one is registered */
+#define PCAPNG_PEN          32473
+#define PCAPNG_OPT_RX_INFO  1   /*!< Custom option of every packet: channel, RSSI */
+
 /**
  * @brief Type of pcap file handle
  *
@@ -45,6 +57,30 @@ typedef enum {
     PCAP_LINK_TYPE_802_11_RADIOTAP = 127    /*!< 802.11 with RadioTap*/
 } pcap_link_type_t;
 
+/**
+* @brief Replacement for the File Stream, e.g. a buffered stream written by another task
+*
+*/
+typedef struct {
+    esp_err_t (*write)(void *ctx, const void *data, uint32_t len);  /*!< Append bytes */
+    esp_err_t (*flush)(void *ctx);                                   /*!< Called by `pcap_flush()` */
+    esp_err_t (*close)(void *ctx);                                   /*!< Called instead of fclose by `pcap_del_session()` */
+    void *ctx;
+} pcap_output_t;
+
+/**
+* @brief Interface counters of a pcapng Interface Statistics Block
+*
+*/
+typedef struct {
+    uint64_t start_us;          /*!< Start of the counting period, microseconds since the epoch */
+    uint64_t received;          /*!< isb_ifrecv: frames handed over by the Wi-Fi driver */
+    uint64_t dropped;           /*!< isb_ifdrop: frames lost for lack of a buffer or queue slot */
+    uint64_t accepted;          /*!< isb_filteraccept: frames that passed the filter */
+    uint64_t shed;              /*!< isb_osdrop: frames left out of the file to keep up */
+    uint64_t delivered;         /*!< isb_usrdeliv: packets written to the file */
+} pcap_if_stats_t;
+
 /**
 * @brief Pcap configuration Type Definition
 *
@@ -54,8 +90,13 @@ typedef struct {
     unsigned int major_version; /*!< Pcap version: major */
     unsigned int minor_version; /*!< Pcap version: minor */
     unsigned int time_zone;     /*!< Pcap timezone code */
+    uint32_t snaplen;           /*!< Max bytes stored per packet including the radiotap header, 0 for no limit, at least radiotap + 802.11 header */
+    uint32_t buffer_size;       /*!< RAM buffer records are assembled in and written from in whole blocks, 0 writes and flushes every record */
+    pcap_output_t output;       /*!< When write is set all output goes there and fp is only passed through, buffer_size is ignored */
     struct {
         unsigned int little_endian: 1; /*!< Whether the pcap file is recored in little endian format */
+        unsigned int ies_only: 1;      /*!< Cut vendor specific IEs of probe requests down to OUI and type, WPS is kept */
+        unsigned int pcapng: 1;        /*!< Write pcapng blocks in host byte order instead of classic pcap records */
     } flags;
 } pcap_config_t;
 
@@ -77,17 +118,33 @@ esp_err_t pcap_new_session(const pcap_config_t *config, pcap_file_handle_t *ret_
 /**
  * @brief Delete the pcap session, and close the File Stream
  *
+ * @note Records still in the write buffer are written first.
+ *
  * @param[in] pcap pcap file handle created by `pcap_new_session()`
  * @return
  *      - ESP_OK: Delete pcap session successfully
  *      - ESP_ERR_INVALID_ARG: Delete pcap session failed because of invalid argument
- *      - ESP_FAIL: Delete pcap session failed
+ *      - ESP_FAIL: Buffered records could not be written, the session is deleted anyway
  */
 esp_err_t pcap_del_session(pcap_file_handle_t pcap);
 
+/**
+ * @brief Write the buffered records into the file and flush the File Stream
+ *
+ * @param[in] pcap pcap file handle created by `pcap_new_session()`
+ * @return
+ *      - ESP_OK: Flush pcap file successfully
+ *      - ESP_ERR_INVALID_ARG: Flush pcap file failed because of invalid argument
+ *      - ESP_FAIL: Flush pcap file failed
+ */
+esp_err_t pcap_flush(pcap_file_handle_t pcap);
+
 /**
  * @brief Write pcap file header
  *
+ * @note With pcapng this is a Section Header Block of unspecified length and the
+ *       Interface Description Block, so files can be concatenated as they are.
+ *
  * @param[in] pcap pcap file handle created by `pcap_new_session()`
  * @param[in] link_type Network link layer type
  * @return
@@ -100,6 +157,10 @@ esp_err_t pcap_write_header(pcap_file_handle_t pcap, pcap_link_type_t link_type)
 /**
  * @brief Capture one packet into pcap file
  *
+ * @note With the ies_only flag the frame in payload is trimmed in place.
+ * @note With pcapng the packet goes into an Enhanced Packet Block that also
+ *       carries channel and RSSI in a PCAPNG_OPT_RX_INFO custom option.
+ *
  * @param[in] pcap pcap file handle created by `pcap_new_session()`
  * @param[in] payload pointer of the captured data buffer
  * @param[in] length length of captured data buffer
@@ -112,9 +173,91 @@ esp_err_t pcap_write_header(pcap_file_handle_t pcap, pcap_link_type_t link_type)
  */
 esp_err_t pcap_capture_packet(pcap_file_handle_t pcap, void *payload, uint32_t length, uint32_t seconds, uint32_t microseconds);
 
+/**
+ * @brief Write a pcapng Interface Statistics Block
+ *
+ * @param[in] pcap pcap file handle created by `pcap_new_session()`
+ * @param[in] stats counters since stats->start_us
+ * @param[in] seconds second of the end of the counting period
+ * @param[in] microseconds microsecond of the end of the counting period
+ * @return
+ *      - ESP_OK: Write statistics successfully
+ *      - ESP_ERR_INVALID_ARG: Write statistics failed because of invalid argument
+ *      - ESP_ERR_NOT_SUPPORTED: The session writes classic pcap
+ *      - ESP_FAIL: Write statistics failed
+ */
+esp_err_t pcap_write_if_stats(pcap_file_handle_t pcap, const pcap_if_stats_t *stats, uint32_t seconds, uint32_t microseconds);
+
+/**
+ * @brief Write a text note as a pcapng Custom Block
+ *
+ * The block carries PCAPNG_PEN, the 64 bit time in microseconds as two 32 bit
+ * words like an Enhanced Packet Block, and the text without terminator.
+ *
+ * @param[in] pcap pcap file handle created by `pcap_new_session()`
+ * @param[in] text note, e.g. a heartbeat with the capture counters
+ * @param[in] seconds second of the note
+ * @param[in] microseconds microsecond of the note
+ * @return
+ *      - ESP_OK: Write note successfully
+ *      - ESP_ERR_INVALID_ARG: Write note failed because of invalid argument
+ *      - ESP_ERR_NOT_SUPPORTED: The session writes classic pcap
+ *      - ESP_FAIL: Write note failed
+ */
+esp_err_t pcap_write_note(pcap_file_handle_t pcap, const char *text, uint32_t seconds, uint32_t microseconds);
+
+/**
+ * @brief Whether the session writes pcapng
+ *
+ * @param[in] pcap pcap file handle created by `pcap_new_session()`
+ * @return true for pcapng, false for classic pcap or an invalid handle
+ */
+bool pcap_is_pcapng(pcap_file_handle_t pcap);
+
+/**
+ * @brief Bytes written into the file so far, file header and buffered records included
+ *
+ * @param[in] pcap pcap file handle created by `pcap_new_session()`
+ * @return byte count, 0 for an invalid handle
+ */
+uint64_t pcap_get_bytes_written(pcap_file_handle_t pcap);
+
+/**
+ * @brief Bytes in the write buffer that are not in the file yet
+ *
+ * @param[in] pcap pcap file handle created by `pcap_new_session()`
+ * @return byte count, 0 for an invalid handle or without a buffer
+ */
+uint32_t pcap_get_buffered_bytes(pcap_file_handle_t pcap);
+
+/**
+ * @brief fwrite calls made on the File Stream so far
+ *
+ * @param[in] pcap pcap file handle created by `pcap_new_session()`
+ * @return call count, 0 for an invalid handle
+ */
+uint32_t pcap_get_file_writes(pcap_file_handle_t pcap);
+
+/**
+ * @brief Length of the complete records in a pcap or pcapng file that was never closed
+ *
+ * Records from offset from on are checked one by one, the first one that is
+ * cut off, does not look like a record of this file or is not in time order
+ * with the one before ends the scan. Used to cut preallocated segments down
+ * after a reset.
+ *
+ * @param[in] fp file opened for reading
+ * @param[in] from offset known to end a record, 0 to start after the file header
+ * @param[in] size bytes in the file
+ * @return offset after the last complete record, 0 without a valid file header
+ */
+uint64_t pcap_scan_valid_length(FILE *fp, uint64_t from, uint64_t size);
+
 /**
  * @brief Print the summary of pcap file into stream
  *
+ * @note Not available with an output set in the configuration or for pcapng
+ *
  * @param[in] pcap pcap file handle created by `pcap_new_session()`
  * @param[in] print_file the file stream to save the summary
  * @return
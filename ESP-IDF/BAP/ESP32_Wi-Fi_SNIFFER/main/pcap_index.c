@@ -0,0 +1,249 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "pcap_index.h"
+
+static const char *INDEX_TAG = "pcap_index";
+
+void pcap_index_path(char *index_path, size_t size, const char *capture_path)
+{
+    // file_000001.pcap and its archive file_000001.pcap.gz share file_000001.idx
+    const char *slash = strrchr(capture_path, '/');
+    const char *dot = strchr(slash ? slash : capture_path, '.');
+    size_t stem = dot ? (size_t)(dot - capture_path) : strlen(capture_path);
+
+    snprintf(index_path, size, "%.*s%s", (int)stem, capture_path, PCAP_INDEX_EXT);
+}
+
+/* Run on the storage task after the capture records the entries point at */
+static void pcap_index_write(void *ctx, FILE *capture)
+{
+    pcap_index_batch_t *batch = ctx;
+
+    if (batch->close) {
+        long end = ftell(capture);
+        batch->entries[batch->count - 1].offset = end > 0 ? (uint32_t)end : 0;
+    }
+    if (fwrite(batch->entries, sizeof(batch->entries[0]), batch->count, batch->file) != batch->count) {
+        atomic_fetch_add(batch->errors, 1);
+    }
+    if (batch->close && fclose(batch->file) != 0) {
+        atomic_fetch_add(batch->errors, 1);
+    }
+    batch->count = 0;
+    batch->close = false;
+    atomic_store(&batch->queued, false);
+}
+
+esp_err_t pcap_index_open(pcap_index_t *index, const char *capture_path, storage_stream_t *stream,
+                          uint32_t every_records, uint32_t every_ms, bool pcapng)
+{
+    char path[CONFIG_FATFS_MAX_LFN];
+    pcap_index_header_t header = {
+        .magic = PCAP_INDEX_MAGIC,
+        .version = PCAP_INDEX_VERSION,
+        .header_size = sizeof(pcap_index_header_t),
+        .entry_size = sizeof(pcap_index_entry_t),
+        .flags = pcapng ? PCAP_INDEX_FLAG_PCAPNG : 0,
+        .every_records = every_records,
+        .every_ms = every_ms,
+    };
+
+    // Batches of the previous file are done, its close waited for the storage task
+    memset(index, 0, sizeof(*index));
+    pcap_index_path(path, sizeof(path), capture_path);
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        ESP_LOGW(INDEX_TAG, "Cannot create %s, %s is written without an index", path, capture_path);
+        return ESP_FAIL;
+    }
+    setvbuf(fp, NULL, _IONBF, 0);
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        remove(path);
+        return ESP_FAIL;
+    }
+    index->file = fp;
+    index->stream = stream;
+    index->every_records = every_records ? every_records : 1;
+    index->every_us = (uint64_t)every_ms * 1000;
+    for (int i = 0; i < 2; i++) {
+        index->batches[i].file = fp;
+        index->batches[i].errors = &index->errors;
+    }
+    return ESP_OK;
+}
+
+static pcap_index_batch_t *pcap_index_batch(pcap_index_t *index)
+{
+    pcap_index_batch_t *batch = &index->batches[index->current];
+
+    // Written long ago unless the card stalls, wait for the storage task rather than drop entries
+    while (atomic_load(&batch->queued)) {
+        vTaskDelay(1);
+    }
+    return batch;
+}
+
+static void pcap_index_add(pcap_index_t *index, uint64_t timestamp_us, uint64_t offset, uint32_t count)
+{
+    pcap_index_batch_t *batch = pcap_index_batch(index);
+
+    batch->entries[batch->count++] = (pcap_index_entry_t) {
+        .timestamp_us = timestamp_us,
+        .offset = (uint32_t)offset,
+        .count = count,
+    };
+    if (batch->count == PCAP_INDEX_BATCH) {
+        pcap_index_flush(index);
+    }
+}
+
+void pcap_index_record(pcap_index_t *index, uint64_t timestamp_us, uint64_t offset)
+{
+    if (index->file == NULL) {
+        return;
+    }
+    if (timestamp_us > index->latest_us) {
+        index->latest_us = timestamp_us;
+    }
+    if (index->records == 0 || index->since_entry >= index->every_records ||
+        index->latest_us - index->entry_us >= index->every_us) {
+        pcap_index_add(index, index->latest_us, offset, index->records);
+        index->entry_us = index->latest_us;
+        index->since_entry = 0;
+    }
+    index->records++;
+    index->since_entry++;
+}
+
+void pcap_index_flush(pcap_index_t *index)
+{
+    pcap_index_batch_t *batch = &index->batches[index->current];
+
+    if (index->file == NULL || batch->count == 0 || atomic_load(&batch->queued)) {
+        return;
+    }
+    atomic_store(&batch->queued, true);
+    storage_stream_call(index->stream, pcap_index_write, batch);
+    index->current ^= 1;
+}
+
+void pcap_index_close(pcap_index_t *index)
+{
+    if (index->file == NULL) {
+        return;
+    }
+    // The storage task fills in the offset, the end of everything written before
+    pcap_index_batch_t *batch = pcap_index_batch(index);
+    if (batch->count == PCAP_INDEX_BATCH) {
+        pcap_index_flush(index);
+        batch = pcap_index_batch(index);
+    }
+    batch->entries[batch->count++] = (pcap_index_entry_t) {
+        .timestamp_us = index->latest_us,
+        .count = index->records,
+    };
+    batch->close = true;
+    atomic_store(&batch->queued, true);
+    storage_stream_call(index->stream, pcap_index_write, batch);
+    if (atomic_load(&index->errors)) {
+        ESP_LOGW(INDEX_TAG, "%u index writes failed", atomic_load(&index->errors));
+    }
+    index->file = NULL;
+}
+
+static bool read_entry(FILE *fp, uint32_t i, pcap_index_entry_t *entry)
+{
+    return fseek(fp, sizeof(pcap_index_header_t) + (long)i * sizeof(*entry), SEEK_SET) == 0 &&
+           fread(entry, sizeof(*entry), 1, fp) == 1;
+}
+
+static bool past_size(const pcap_index_entry_t *entry, uint64_t size)
+{
+    return entry->offset > size;
+}
+
+static bool not_before(const pcap_index_entry_t *entry, uint64_t timestamp_us)
+{
+    return entry->timestamp_us >= timestamp_us;
+}
+
+static bool after(const pcap_index_entry_t *entry, uint64_t timestamp_us)
+{
+    return entry->timestamp_us > timestamp_us;
+}
+
+/* First entry in [lo, hi) matching, hi if none. Entries grow in offset and time, an unreadable one ends the search */
+static uint32_t search(FILE *fp, uint32_t lo, uint32_t hi, bool (*match)(const pcap_index_entry_t *, uint64_t),
+                       uint64_t value)
+{
+    pcap_index_entry_t entry;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (!read_entry(fp, mid, &entry) || match(&entry, value)) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+esp_err_t pcap_index_lookup(const char *index_path, uint64_t size, uint64_t from_us, uint64_t to_us,
+                            pcap_index_range_t *range)
+{
+    pcap_index_header_t header;
+    pcap_index_entry_t entry, first, last;
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    FILE *fp = fopen(index_path, "rb");
+
+    if (fp == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, PCAP_INDEX_MAGIC, 4) != 0) {
+        goto out;
+    }
+    if (header.version != PCAP_INDEX_VERSION || header.header_size != sizeof(header) ||
+        header.entry_size != sizeof(entry)) {
+        ret = ESP_ERR_INVALID_VERSION;
+        goto out;
+    }
+    fseek(fp, 0, SEEK_END);
+    long index_size = ftell(fp);
+    uint32_t count = index_size > (long)sizeof(header) ? (index_size - sizeof(header)) / sizeof(entry) : 0;
+
+    // Entries past the capture file are left over from records lost in a reset
+    count = search(fp, 0, count, past_size, size);
+    if (count == 0 || !read_entry(fp, 0, &first) || !read_entry(fp, count - 1, &last)) {
+        goto out;
+    }
+    // Without the end entry of a closed file later records may follow the last entry
+    bool closed = last.offset == size;
+    if (to_us < first.timestamp_us || (closed && from_us > last.timestamp_us)) {
+        goto out;
+    }
+
+    // Every record before an entry older than from_us is older as well
+    uint32_t start = search(fp, 0, count, not_before, from_us);
+    start = start ? start - 1 : 0;
+    uint32_t end = search(fp, start, count, after, to_us);
+    if (!read_entry(fp, start, &entry)) {
+        goto out;
+    }
+    range->header_len = first.offset;
+    range->start = entry.offset;
+    range->first_record = entry.count;
+    range->end = size;
+    if (end < count && read_entry(fp, end, &entry)) {
+        range->end = entry.offset;
+    }
+    range->first_us = first.timestamp_us;
+    range->last_us = last.timestamp_us;
+    ret = ESP_OK;
+out:
+    fclose(fp);
+    return ret;
+}
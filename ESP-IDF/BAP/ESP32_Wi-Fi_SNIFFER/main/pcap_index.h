@@ -0,0 +1,147 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "storage_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PCAP_INDEX_MAGIC            "PIDX"
+#define PCAP_INDEX_VERSION          1
+#define PCAP_INDEX_EXT              ".idx"
+#define PCAP_INDEX_FLAG_PCAPNG      0x0001
+#define PCAP_INDEX_BATCH            32      /*!< Entries handed to the storage task at once */
+
+/**
+ * @brief Index file header, little endian
+ */
+typedef struct {
+    char magic[4];                  /*!< PCAP_INDEX_MAGIC */
+    uint16_t version;               /*!< PCAP_INDEX_VERSION */
+    uint16_t header_size;           /*!< sizeof(pcap_index_header_t), entries start here */
+    uint16_t entry_size;            /*!< sizeof(pcap_index_entry_t) */
+    uint16_t flags;                 /*!< PCAP_INDEX_FLAG_PCAPNG */
+    uint32_t every_records;         /*!< An entry at least every this many records */
+    uint32_t every_ms;              /*!< and at least every this much capture time */
+    uint32_t reserved;
+} pcap_index_header_t;
+
+/**
+ * @brief Where a record starts in the capture file
+ *
+ * timestamp_us is the latest record time up to and including this record,
+ * so the entries never go back in time even when the wall clock does. The
+ * last entry of a closed file points at its end and holds the record total.
+ */
+typedef struct {
+    uint64_t timestamp_us;          /*!< Microseconds since epoch */
+    uint32_t offset;                /*!< Start of the record in the capture file */
+    uint32_t count;                 /*!< Records before it */
+} pcap_index_entry_t;
+
+_Static_assert(sizeof(pcap_index_header_t) == 24, "pcap index header layout");
+_Static_assert(sizeof(pcap_index_entry_t) == 16, "pcap index entry layout");
+
+/**
+ * @brief Entries on their way to the storage task
+ */
+typedef struct {
+    FILE *file;                     /*!< Index file they go to */
+    pcap_index_entry_t entries[PCAP_INDEX_BATCH];
+    uint32_t count;
+    bool close;                     /*!< Last entry is the end of the capture file, close the index after it */
+    atomic_bool queued;             /*!< Handed over and not written yet */
+    atomic_uint *errors;
+} pcap_index_batch_t;
+
+/**
+ * @brief Sparse time to offset index written next to one capture file
+ *
+ * The entries travel with the capture stream, the storage task appends them
+ * to the index file right after the records they point at, so an entry never
+ * refers to data that did not reach the card. After a reset the index may
+ * point past the recovered length, readers ignore those entries.
+ */
+typedef struct {
+    FILE *file;                     /*!< NULL while no index is written */
+    storage_stream_t *stream;       /*!< Stream of the capture file */
+    pcap_index_batch_t batches[2];
+    uint8_t current;
+    uint32_t every_records;
+    uint64_t every_us;
+    uint32_t records;               /*!< Records written to the capture file */
+    uint32_t since_entry;           /*!< Records since the last entry */
+    uint64_t entry_us;              /*!< Time of the last entry */
+    uint64_t latest_us;             /*!< Latest record time */
+    atomic_uint errors;             /*!< Short writes on the storage task */
+} pcap_index_t;
+
+/**
+ * @brief Range of a capture file holding the records of a time window
+ */
+typedef struct {
+    uint64_t header_len;            /*!< File header, the bytes before the first record */
+    uint64_t start;                 /*!< First byte to read */
+    uint64_t end;                   /*!< End of the range, the start of a record or the end of the file */
+    uint32_t first_record;          /*!< Records before start */
+    uint64_t first_us;              /*!< Time span of the whole file as far as indexed */
+    uint64_t last_us;
+} pcap_index_range_t;
+
+/**
+ * @brief Index path of a capture file: same name, extensions replaced by PCAP_INDEX_EXT
+ */
+void pcap_index_path(char *index_path, size_t size, const char *capture_path);
+
+/**
+ * @brief Create the index of a capture file that is about to be written
+ *
+ * @param stream stream of the capture file, the index file is closed with the last batch before it
+ * @return ESP_OK, ESP_FAIL when the index file cannot be created (capture goes on without one)
+ */
+esp_err_t pcap_index_open(pcap_index_t *index, const char *capture_path, storage_stream_t *stream,
+                          uint32_t every_records, uint32_t every_ms, bool pcapng);
+
+/**
+ * @brief Account for a record written at offset, adds an entry when one is due
+ *
+ * Call after the record went into the stream, on the task writing the stream.
+ */
+void pcap_index_record(pcap_index_t *index, uint64_t timestamp_us, uint64_t offset);
+
+/**
+ * @brief Hand the entries collected so far to the storage task
+ */
+void pcap_index_flush(pcap_index_t *index);
+
+/**
+ * @brief Add the end entry and close the index file after the last capture write
+ *
+ * Call before the capture stream is closed.
+ */
+void pcap_index_close(pcap_index_t *index);
+
+/**
+ * @brief Find the part of a capture file covering [from_us, to_us]
+ *
+ * Binary search over the index file, only a few entries are read. The range
+ * starts at a record and ends at one or at the end of the file, with the
+ * file header in front it is a valid capture file again. It may hold up to
+ * one index interval of records outside the window on either side.
+ *
+ * @param size length of the capture file, entries beyond it are ignored
+ * @return ESP_OK, ESP_ERR_NOT_FOUND without a usable index or when the file has nothing in the window,
+ *         ESP_ERR_INVALID_VERSION for an index of another format
+ */
+esp_err_t pcap_index_lookup(const char *index_path, uint64_t size, uint64_t from_us, uint64_t to_us,
+                            pcap_index_range_t *range);
+
+#ifdef __cplusplus
+}
+#endif
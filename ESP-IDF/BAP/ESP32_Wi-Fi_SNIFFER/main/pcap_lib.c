@@ -14,16 +14,20 @@
 #include "freertos/semphr.h"
 #include <sys/unistd.h>
 #include <sys/fcntl.h>
+#include <sys/stat.h>
 #include "esp_log.h"
 #include "esp_wifi.h"
 #include "esp_console.h"
 #include "esp_app_trace.h"
 #include "esp_check.h"
+#include "esp_timer.h"
 #include "sniffer.h"
 #include "pcap.h"
 #include "sdkconfig.h"
 #include "config.h"
 #include "pcap_lib.h"
+#include "storage_writer.h"
+#include "pcap_index.h"
 
 static const char *PCAP_TAG = "pcap";
 
@@ -34,11 +38,69 @@ static const char *PCAP_TAG = "pcap";
 
 static pcap_cmd_runtime_t pcap_rt = {0};
 
+uint32_t pcap_snaplen = CONFIG_PCAP_SNAPLEN;
+bool pcap_ies_only = CONFIG_PCAP_IES_ONLY;
+uint32_t pcap_flush_ms = CONFIG_PCAP_FLUSH_INTERVAL_MS;
+bool pcapng = CONFIG_PCAPNG;
+uint32_t pcap_segment_mb = CONFIG_PCAP_SEGMENT_MB;
+bool pcap_index = CONFIG_PCAP_INDEX;
+
+/* pcap.c writes into a block stream, the storage task does the fwrite */
+static esp_err_t pcap_stream_write(void *ctx, const void *data, uint32_t len)
+{
+    return storage_stream_write(ctx, data, len, esp_timer_get_time());
+}
+
+static esp_err_t pcap_stream_flush(void *ctx)
+{
+    storage_stream_flush(ctx);
+    return ESP_OK;
+}
+
+/* Run on the storage task, in order with the writes of the file */
+static void pcap_segment_commit(void *ctx, FILE *file)
+{
+    segment_file_commit(ctx, file);
+}
+
+static void pcap_segment_finish(void *ctx, FILE *file)
+{
+    segment_file_finish(ctx, file);
+}
+
+static esp_err_t pcap_stream_close(void *ctx)
+{
+    /* The end entry takes the length before the segment is cut down, the same bytes */
+    pcap_index_close(&pcap_rt.index);
+    if (pcap_rt.segment.size)
+    {
+        storage_stream_call(ctx, pcap_segment_finish, &pcap_rt.segment);
+    }
+    /* On rotation and stop, a failed sync shows up in the storage errors instead of a silent fclose */
+    storage_stream_sync(ctx);
+    storage_stream_close(ctx);
+    return ESP_OK;
+}
+
 esp_err_t pcap_close(void)
 {
     esp_err_t ret = ESP_OK;
     ESP_GOTO_ON_FALSE(pcap_rt.is_opened, ESP_ERR_INVALID_STATE, err, PCAP_TAG, ".pcap file is already closed");
-    ESP_GOTO_ON_ERROR(pcap_del_session(pcap_rt.pcap_handle) != ESP_OK, err, PCAP_TAG, "stop pcap session failed");
+    if (pcap_del_session(pcap_rt.pcap_handle) != ESP_OK)
+    {
+        // The session is gone either way, callers treat a failed close as fatal
+        ESP_LOGW(PCAP_TAG, "buffered records of %s were not written", pcap_rt.filename);
+    }
+    /* The file is complete once the storage task closed it */
+    if (!storage_writer_sync(storage_writer_default(), CONFIG_STORAGE_SYNC_TIMEOUT_MS))
+    {
+        ESP_LOGW(PCAP_TAG, "%s is still being written", pcap_rt.filename);
+    }
+    else
+    {
+        /* Cut down and closed, nothing left to recover */
+        segment_file_remove_sidecar(&pcap_rt.segment);
+    }
     pcap_rt.is_opened = false;
     pcap_rt.link_type_set = false;
     pcap_rt.pcap_handle = NULL;
@@ -49,33 +111,131 @@ err:
 esp_err_t pcap_open(uint32_t idx)
 {
     esp_err_t ret = ESP_OK;
+    storage_writer_t *storage = storage_writer_default();
+    ESP_RETURN_ON_FALSE(storage, ESP_ERR_NO_MEM, PCAP_TAG, "no storage task");
 
     /* Create file to write, binary format */
-    snprintf(pcap_rt.filename, sizeof(pcap_rt.filename), CONFIG_SD_MOUNT_POINT"/"CONFIG_PCAP_FILENAME_MASK, idx);
-    FILE *fp = NULL;
-    fp = fopen(pcap_rt.filename, "wb+");
+    snprintf(pcap_rt.filename, sizeof(pcap_rt.filename), pcapng ? CONFIG_SD_MOUNT_POINT"/"CONFIG_PCAPNG_FILENAME_MASK :
+             CONFIG_SD_MOUNT_POINT"/"CONFIG_PCAP_FILENAME_MASK, idx);
+    FILE *fp = segment_file_open(&pcap_rt.segment, CONFIG_SD_MOUNT_POINT, pcap_rt.filename,
+                                 (uint64_t)pcap_segment_mb << 20);
     ESP_GOTO_ON_FALSE(fp, ESP_FAIL, err, PCAP_TAG, "open file failed");
+    pcap_rt.committed_us = esp_timer_get_time();
+    /* Whole blocks are handed to fwrite, skip the stdio copy */
+    setvbuf(fp, NULL, _IONBF, 0);
+    storage_stream_open(&pcap_rt.stream, storage, fp);
     pcap_config_t pcap_config = {
         .fp = fp,
         .major_version = PCAP_DEFAULT_VERSION_MAJOR,
         .minor_version = PCAP_DEFAULT_VERSION_MINOR,
         .time_zone = PCAP_DEFAULT_TIME_ZONE_GMT,
+        .snaplen = pcap_snaplen,
+        .output = {
+            .write = pcap_stream_write,
+            .flush = pcap_stream_flush,
+            .close = pcap_stream_close,
+            .ctx = &pcap_rt.stream,
+        },
+        .flags.ies_only = pcap_ies_only,
+        .flags.pcapng = pcapng,
     };
     ESP_GOTO_ON_ERROR(pcap_new_session(&pcap_config, &pcap_rt.pcap_handle), err, PCAP_TAG, "pcap init failed");
+    if (pcap_index)
+    {
+        pcap_index_open(&pcap_rt.index, pcap_rt.filename, &pcap_rt.stream, CONFIG_PCAP_INDEX_EVERY_RECORDS,
+                        CONFIG_PCAP_INDEX_EVERY_MS, pcapng);
+    }
     pcap_rt.is_opened = true;
     ESP_LOGI(PCAP_TAG, "open file successfully");
     return ret;
 err:
     if (fp) 
     {
+        memset(&pcap_rt.stream, 0, sizeof(pcap_rt.stream));
         fclose(fp);
+        segment_file_remove_sidecar(&pcap_rt.segment);
     }
     return ret;
 }
 
 esp_err_t packet_capture(void *payload, uint32_t length, uint32_t seconds, uint32_t microseconds)
 {
-    return pcap_capture_packet(pcap_rt.pcap_handle, payload, length, seconds, microseconds);
+    uint64_t offset = pcap_get_bytes_written(pcap_rt.pcap_handle);
+    esp_err_t ret = pcap_capture_packet(pcap_rt.pcap_handle, payload, length, seconds, microseconds);
+    if (ret == ESP_OK)
+    {
+        pcap_index_record(&pcap_rt.index, (uint64_t)seconds * 1000000 + microseconds, offset);
+    }
+    return ret;
+}
+
+esp_err_t packet_capture_stats(const pcap_if_stats_t *stats, uint32_t seconds, uint32_t microseconds)
+{
+    return pcap_write_if_stats(pcap_rt.pcap_handle, stats, seconds, microseconds);
+}
+
+esp_err_t packet_capture_note(const char *text, uint32_t seconds, uint32_t microseconds)
+{
+    return pcap_write_note(pcap_rt.pcap_handle, text, seconds, microseconds);
+}
+
+bool packet_capture_is_pcapng(void)
+{
+    return pcap_rt.is_opened && pcap_is_pcapng(pcap_rt.pcap_handle);
+}
+
+void packet_capture_flush_due(int64_t now_us)
+{
+    if (pcap_rt.is_opened)
+    {
+        storage_stream_flush_due(&pcap_rt.stream, now_us, (int64_t)pcap_flush_ms * 1000);
+        /* What a reset would keep without scanning, the records since are checked at boot */
+        if (now_us - pcap_rt.committed_us >= (int64_t)CONFIG_PCAP_SEGMENT_COMMIT_MS * 1000)
+        {
+            if (pcap_rt.segment.tracked)
+            {
+                storage_stream_call(&pcap_rt.stream, pcap_segment_commit, &pcap_rt.segment);
+            }
+            pcap_index_flush(&pcap_rt.index);
+            pcap_rt.committed_us = now_us;
+        }
+    }
+}
+
+bool packet_capture_segment_full(void)
+{
+    return pcap_rt.is_opened &&
+           segment_file_full(&pcap_rt.segment, pcap_get_bytes_written(pcap_rt.pcap_handle), CONFIG_PCAP_SEGMENT_HEADROOM);
+}
+
+bool packet_capture_file_in_use(const char *path)
+{
+    return strcmp(path, pcap_rt.filename) == 0 || segment_file_has_sidecar(path);
+}
+
+esp_err_t packet_capture_find_range(const char *path, uint64_t from_us, uint64_t to_us, pcap_index_range_t *range)
+{
+    char index_path[CONFIG_FATFS_MAX_LFN];
+    struct stat st;
+
+    /* A preallocated file is longer than its records until it is closed */
+    ESP_RETURN_ON_FALSE(!(pcap_rt.is_opened && strcmp(path, pcap_rt.filename) == 0), ESP_ERR_INVALID_STATE,
+                        PCAP_TAG, "%s is still written", path);
+    ESP_RETURN_ON_FALSE(stat(path, &st) == 0, ESP_ERR_NOT_FOUND, PCAP_TAG, "no %s", path);
+    pcap_index_path(index_path, sizeof(index_path), path);
+    return pcap_index_lookup(index_path, st.st_size, from_us, to_us, range);
+}
+
+uint32_t pcap_recover_segments(void)
+{
+    static const char *const extensions[] = {".pcap", ".pcapng"};
+    return segment_file_recover(CONFIG_SD_MOUNT_POINT, extensions, sizeof(extensions) / sizeof(extensions[0]),
+                                pcap_scan_valid_length);
+}
+
+uint64_t packet_capture_bytes(void)
+{
+    return pcap_rt.is_opened ? pcap_get_bytes_written(pcap_rt.pcap_handle) : 0;
 }
 
 esp_err_t sniff_packet_start(pcap_link_type_t link_type)
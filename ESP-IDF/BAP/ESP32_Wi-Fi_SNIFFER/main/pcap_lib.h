@@ -9,6 +9,9 @@
 #pragma once
 
 #include "pcap.h"
+#include "storage_writer.h"
+#include "segment_file.h"
+#include "pcap_index.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,6 +24,10 @@ typedef struct {
     char filename[CONFIG_FATFS_MAX_LFN];
     pcap_file_handle_t pcap_handle;
     pcap_link_type_t link_type;
+    storage_stream_t stream;    // Blocks of the open file on their way to the storage task
+    segment_file_t segment;     // Preallocation of the open file, size 0 for a growing one
+    int64_t committed_us;       // Last length recorded in the sidecar
+    pcap_index_t index;         // Time to offset index of the open file
 } pcap_cmd_runtime_t;
 
 /**
@@ -36,6 +43,76 @@ typedef struct {
  */
 esp_err_t packet_capture(void *payload, uint32_t length, uint32_t seconds, uint32_t microseconds);
 
+/**
+ * @brief Write an Interface Statistics Block into the open pcapng file
+ *
+ * @return esp_err_t
+ *      - ESP_OK on success
+ *      - ESP_ERR_NOT_SUPPORTED when the file is classic pcap
+ *      - ESP_FAIL on error
+ */
+esp_err_t packet_capture_stats(const pcap_if_stats_t *stats, uint32_t seconds, uint32_t microseconds);
+
+/**
+ * @brief Write a text note as a Custom Block into the open pcapng file
+ *
+ * @return esp_err_t
+ *      - ESP_OK on success
+ *      - ESP_ERR_NOT_SUPPORTED when the file is classic pcap
+ *      - ESP_FAIL on error
+ */
+esp_err_t packet_capture_note(const char *text, uint32_t seconds, uint32_t microseconds);
+
+/**
+ * @brief Whether the open file is pcapng, false when no file is open
+ */
+bool packet_capture_is_pcapng(void);
+
+/**
+ * @brief Bytes written into the open pcap file, 0 when no file is open
+ */
+uint64_t packet_capture_bytes(void);
+
+/**
+ * @brief Hand buffered records to the storage task once the oldest is pcap_flush_ms old
+ *
+ * @param now_us esp_timer time
+ */
+void packet_capture_flush_due(int64_t now_us);
+
+/**
+ * @brief Whether the preallocated segment of the open file is about to run out
+ *
+ * @return true when less than CONFIG_PCAP_SEGMENT_HEADROOM is left, always false for a growing file
+ */
+bool packet_capture_segment_full(void);
+
+/**
+ * @brief Whether path is the pcap file written last or one not closed yet
+ *
+ * The file written last counts as in use until the next one is opened.
+ */
+bool packet_capture_file_in_use(const char *path);
+
+/**
+ * @brief Byte range of a pcap file holding the records of a time window, from its index
+ *
+ * @param path capture file, its index is the same name with PCAP_INDEX_EXT
+ * @return ESP_OK, ESP_ERR_NOT_FOUND without an index or records in the window, ESP_ERR_INVALID_STATE for the open file
+ */
+esp_err_t packet_capture_find_range(const char *path, uint64_t from_us, uint64_t to_us, pcap_index_range_t *range);
+
+/**
+ * @brief Cut pcap files that were not closed before a reset down to their complete records
+ *
+ * Every open file keeps a sidecar with its last committed length, only the
+ * records written after it are read. Call once after mounting the card,
+ * before the next file index is looked up.
+ *
+ * @return number of files recovered
+ */
+uint32_t pcap_recover_segments(void);
+
 /**
  * @brief Tell the pcap component to start sniff and write
  *
@@ -0,0 +1,104 @@
+#include <string.h>
+#include "probe_record.h"
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME        16777619u
+
+static inline uint32_t fnv1a_byte(uint32_t hash, uint8_t byte)
+{
+    return (hash ^ byte) * FNV_PRIME;
+}
+
+/* Fixed fields between the header and the IEs by management subtype, -1 for frames without IEs */
+static const int8_t mgmt_fixed_len[16] = {
+    [0] = 4,    // Association request: capability, listen interval
+    [1] = 6,    // Association response: capability, status, AID
+    [2] = 10,   // Reassociation request: capability, listen interval, current AP
+    [3] = 6,    // Reassociation response
+    [4] = 0,    // Probe request
+    [5] = 12,   // Probe response: timestamp, beacon interval, capability
+    [6] = -1, [7] = -1,
+    [8] = 12,   // Beacon
+    [9] = -1,   // ATIM, no body
+    [10] = 2,   // Disassociation: reason
+    [11] = 6,   // Authentication: algorithm, sequence, status
+    [12] = 2,   // Deauthentication: reason
+    [13] = -1, [14] = -1, [15] = -1,    // Action frames carry no IE list
+};
+
+/* FNV-1a of the UUID-E attribute of a WPS IE (OUI 00:50:F2 type 4), as relevant_data.py extracts it */
+static uint32_t wps_uuid_hash(const uint8_t *data, uint8_t len)
+{
+    uint32_t hash = FNV_OFFSET_BASIS;
+
+    for (uint32_t pos = 4; pos + 4 <= len; ) {
+        uint16_t type = data[pos] << 8 | data[pos + 1];
+        uint16_t attr_len = data[pos + 2] << 8 | data[pos + 3];
+        if (type == PROBE_RECORD_WPS_UUID_E && pos + 4 + attr_len <= len) {
+            for (uint16_t i = 0; i < attr_len; i++) {
+                hash = fnv1a_byte(hash, data[pos + 4 + i]);
+            }
+        }
+        pos += 4 + attr_len;
+    }
+    return hash;
+}
+
+int32_t probe_record_ie_offset(const uint8_t *frame)
+{
+    // Only management frames have IEs, after the fixed fields of their subtype and an HT control field
+    if ((frame[0] & 0x0c) != 0 || mgmt_fixed_len[frame[0] >> 4] < 0) {
+        return -1;
+    }
+    return PROBE_RECORD_HEADER_LEN + mgmt_fixed_len[frame[0] >> 4] + ((frame[1] & 0x80) ? 4 : 0);
+}
+
+bool probe_record_parse(probe_record_t *rec, const uint8_t *frame, uint32_t frame_len)
+{
+    if (frame_len < PROBE_RECORD_HEADER_LEN) {
+        return false;
+    }
+
+    memcpy(rec->addr2, frame + 10, 6);
+    rec->seq = (frame[22] | (frame[23] << 8)) >> 4;
+    rec->ie_hash = FNV_OFFSET_BASIS;
+    rec->ssid_hash = 0;
+    rec->wps_hash = 0;
+    rec->ssid_len = 0;
+    rec->ie_count = 0;
+
+    int32_t ies = probe_record_ie_offset(frame);
+    if (ies < 0) {
+        return true;
+    }
+    uint32_t pos = ies;
+
+    // Walk the IEs, a truncated last element still counts with its declared length
+    while (pos + 2 <= frame_len) {
+        uint8_t id = frame[pos];
+        uint8_t len = frame[pos + 1];
+        const uint8_t *data = frame + pos + 2;
+        uint32_t available = frame_len - pos - 2;
+
+        rec->ie_hash = fnv1a_byte(fnv1a_byte(rec->ie_hash, id), len);
+        rec->ie_count++;
+
+        if (id == PROBE_RECORD_IE_SSID && len > 0 && len <= available) {
+            uint32_t ssid_hash = FNV_OFFSET_BASIS;
+            for (uint8_t i = 0; i < len; i++) {
+                ssid_hash = fnv1a_byte(ssid_hash, data[i]);
+            }
+            rec->ssid_hash = ssid_hash;
+            rec->ssid_len = len;
+        }
+
+        if (id == PROBE_RECORD_IE_VENDOR && len >= 4 && len <= available &&
+            data[0] == 0x00 && data[1] == 0x50 && data[2] == 0xf2 && data[3] == 0x04) {
+            rec->wps_hash = wps_uuid_hash(data, len);
+        }
+
+        pos += 2 + len;
+    }
+
+    return true;
+}
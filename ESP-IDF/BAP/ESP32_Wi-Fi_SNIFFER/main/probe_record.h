@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROBE_RECORD_HEADER_LEN     24   /*!< 802.11 management header without HT control */
+#define PROBE_RECORD_IE_SSID        0
+#define PROBE_RECORD_IE_VENDOR      221
+#define PROBE_RECORD_WPS_UUID_E     0x1047  /*!< WPS attribute holding the UUID of the enrollee */
+
+/**
+ * @brief Compact probe request record extracted in the Wi-Fi callback
+ *
+ * Holds everything the reduced CSV, the statistics and the OLED need, so the
+ * full frame only has to be copied when it is saved to pcap.
+ */
+typedef struct {
+    uint64_t timestamp_us;  /*!< Wall clock time of reception, microseconds since epoch */
+    uint32_t rx_timestamp;  /*!< rx_ctrl.timestamp, local microsecond counter of the radio */
+    uint32_t ie_hash;       /*!< Hash of the IE id/length sequence, same signature as the IE column of relevant_data.py */
+    uint32_t ssid_hash;     /*!< Hash of the SSID bytes, 0 for wildcard */
+    uint32_t wps_hash;      /*!< Hash of the WPS UUID-E, 0 without a WPS IE, the empty hash for WPS without UUID-E */
+    uint8_t addr2[6];       /*!< Transmitter MAC address */
+    uint16_t seq;           /*!< 802.11 sequence number */
+    int8_t rssi;            /*!< RSSI in dBm */
+    uint8_t channel;        /*!< Primary channel */
+    uint8_t ssid_len;       /*!< SSID length, 0 for wildcard */
+    uint8_t ie_count;       /*!< Number of information elements */
+} probe_record_t;
+
+/**
+ * @brief Fill addr2, sequence number and the IE signature from a raw probe request
+ *
+ * Radio fields (timestamps, RSSI, channel) are left to the caller. Other
+ * management frames the filter lets through have their IEs read after the
+ * fixed fields of their subtype, frames without IEs keep an empty signature.
+ *
+ * @param rec record to fill
+ * @param frame 802.11 frame starting with frame control, without FCS
+ * @param frame_len length of frame in bytes
+ * @return true if the frame was long enough to contain a management header
+ */
+bool probe_record_parse(probe_record_t *rec, const uint8_t *frame, uint32_t frame_len);
+
+/**
+ * @brief Offset of the first IE of a management frame
+ *
+ * Skips the header, an HT control field and the fixed fields of the subtype.
+ *
+ * @param frame 802.11 frame starting with frame control, at least PROBE_RECORD_HEADER_LEN bytes
+ * @return offset of the IE list, -1 for frames without one (control, data, action, ATIM)
+ */
+int32_t probe_record_ie_offset(const uint8_t *frame);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,133 @@
+#include <string.h>
+#include "esp_log.h"
+#include "record_sink.h"
+
+static const char *TAG = "record_sink";
+
+static record_sink_t *sinks[RECORD_SINK_MAX];
+static uint32_t sink_count;
+static char selection[RECORD_SINK_MAX][RECORD_SINK_NAME_MAX];
+static uint32_t selection_count;
+
+esp_err_t record_sink_register(record_sink_t *sink)
+{
+    if (record_sink_bit(sink->name)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (sink_count == RECORD_SINK_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    sinks[sink_count++] = sink;
+    return ESP_OK;
+}
+
+record_sink_t *record_sink_get(uint32_t id)
+{
+    return id < sink_count ? sinks[id] : NULL;
+}
+
+uint32_t record_sink_bit(const char *name)
+{
+    for (uint32_t i = 0; i < sink_count; i++) {
+        if (strcmp(sinks[i]->name, name) == 0) {
+            return 1u << i;
+        }
+    }
+    return 0;
+}
+
+void record_sink_select(const char *const *names, uint32_t count)
+{
+    selection_count = 0;
+    for (uint32_t i = 0; i < count && selection_count < RECORD_SINK_MAX; i++) {
+        strncpy(selection[selection_count], names[i], RECORD_SINK_NAME_MAX - 1);
+        selection[selection_count][RECORD_SINK_NAME_MAX - 1] = '\0';
+        selection_count++;
+    }
+}
+
+uint32_t record_sink_selection(const char **names, uint32_t max)
+{
+    uint32_t count = selection_count < max ? selection_count : max;
+
+    for (uint32_t i = 0; i < count; i++) {
+        names[i] = selection[i];
+    }
+    return count;
+}
+
+bool record_sink_selected(uint32_t *mask)
+{
+    if (selection_count == 0) {
+        return false;
+    }
+    *mask = 0;
+    for (uint32_t i = 0; i < selection_count; i++) {
+        uint32_t bit = record_sink_bit(selection[i]);
+        if (bit == 0) {
+            ESP_LOGW(TAG, "No sink named %s", selection[i]);
+        }
+        *mask |= bit;
+    }
+    return true;
+}
+
+uint32_t record_sink_filter(uint32_t mask, uint32_t with, uint32_t without)
+{
+    uint32_t result = 0;
+
+    for (uint32_t i = 0; i < sink_count; i++) {
+        uint32_t caps = sinks[i]->caps;
+        if ((mask & 1u << i) && (caps & with) == with && !(caps & without)) {
+            result |= 1u << i;
+        }
+    }
+    return result;
+}
+
+esp_err_t record_sink_open(uint32_t mask)
+{
+    for (uint32_t i = 0; i < sink_count; i++) {
+        record_sink_t *sink = sinks[i];
+        if (!(mask & 1u << i)) {
+            continue;
+        }
+        sink->items = 0;
+        sink->errors = 0;
+        esp_err_t err = sink->ops->open ? sink->ops->open(sink) : ESP_OK;
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Open sink %s failed", sink->name);
+            record_sink_close(mask & ((1u << i) - 1));
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+void record_sink_write(record_sink_t *sink, const record_sink_item_t *items, uint32_t count)
+{
+    if (count == 0) {
+        return;
+    }
+    uint32_t written = sink->ops->write_batch(sink, items, count);
+    sink->items += written;
+    sink->errors += count - written;
+}
+
+void record_sink_flush(uint32_t mask, int64_t now_us)
+{
+    for (uint32_t i = 0; i < sink_count; i++) {
+        if ((mask & 1u << i) && sinks[i]->ops->flush) {
+            sinks[i]->ops->flush(sinks[i], now_us);
+        }
+    }
+}
+
+void record_sink_close(uint32_t mask)
+{
+    for (uint32_t i = 0; i < sink_count; i++) {
+        if ((mask & 1u << i) && sinks[i]->ops->close) {
+            sinks[i]->ops->close(sinks[i]);
+        }
+    }
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "probe_record.h"
+#include "burst_coalescer.h"
+#include "capture_stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RECORD_SINK_MAX             8       /*!< Registered sinks, one bit each in a sink mask */
+#define RECORD_SINK_NAME_MAX        16      /*!< Longest name in the "sinks" list of settings.json, NUL included */
+
+/**
+ * @brief What a sink needs from the capture path
+ *
+ * Only the capabilities of the sinks a capture opened are paid for: no frame
+ * is copied into the packet pool without a RECORD_SINK_CAP_PAYLOAD sink, no
+ * write job is queued without a RECORD_SINK_CAP_STORAGE one.
+ */
+typedef enum {
+    RECORD_SINK_CAP_PAYLOAD = 1 << 0,   /*!< Needs the full frame copied into the packet pool, storage sinks only */
+    RECORD_SINK_CAP_STORAGE = 1 << 1,   /*!< Writes to the SD card: runs on the writer task and is shed under load */
+    RECORD_SINK_CAP_BURSTS  = 1 << 2,   /*!< Takes one item per closed burst instead of the frames while coalescing */
+    RECORD_SINK_CAP_MARKERS = 1 << 3,   /*!< Takes heartbeats and output mode changes, storage sinks only */
+} record_sink_cap_t;
+
+typedef enum {
+    RECORD_SINK_ITEM_PACKET = 0,        /*!< One accepted frame */
+    RECORD_SINK_ITEM_BURST,             /*!< One closed burst, RECORD_SINK_CAP_BURSTS sinks only */
+    RECORD_SINK_ITEM_MARKER,            /*!< Heartbeat or output mode change, RECORD_SINK_CAP_MARKERS sinks only */
+} record_sink_item_type_t;
+
+/**
+ * @brief Heartbeat or output mode change, written from the heartbeat MAC
+ */
+typedef struct {
+    const char *label;                  /*!< Next to the -1 RSSI in the CSV, "HEARTBEAT" or "MODE x" */
+    const char *text;                   /*!< Vendor IE of the pcap frame or text of the pcapng note */
+    uint8_t type;                       /*!< reduced_record_type_t of the binary record */
+    uint16_t arg;                       /*!< Argument of the binary record */
+    uint64_t timestamp_us;              /*!< Wall clock time of the marker */
+    const capture_stats_t *stats;       /*!< Counters of a heartbeat, NULL for other markers */
+} record_sink_marker_t;
+
+/**
+ * @brief One entry of a batch, parsed once by the callback and shared by every sink
+ */
+typedef struct {
+    uint8_t type;                       /*!< record_sink_item_type_t */
+    union {
+        struct {
+            const probe_record_t *record;
+            void *payload;              /*!< Full frame with its rx_ctrl, NULL when it was not copied */
+            uint32_t length;
+        } packet;
+        const burst_t *burst;
+        const record_sink_marker_t *marker;
+    };
+} record_sink_item_t;
+
+typedef struct record_sink record_sink_t;
+
+/**
+ * @brief Operations of a sink, all but write_batch may be NULL
+ */
+typedef struct {
+    esp_err_t (*open)(record_sink_t *sink);                 /*!< Capture start, an error stops the start */
+    uint32_t (*write_batch)(record_sink_t *sink, const record_sink_item_t *items, uint32_t count);
+                                                            /*!< Items in capture order, returns how many were written */
+    void (*flush)(record_sink_t *sink, int64_t now_us);     /*!< Periodic from the task of the sink, esp_timer time */
+    void (*close)(record_sink_t *sink);                     /*!< Capture stop, after the last batch */
+} record_sink_ops_t;
+
+/**
+ * @brief One output of the capture
+ *
+ * Sinks with RECORD_SINK_CAP_STORAGE run on the writer task, the others on
+ * the stats stage with every accepted record whatever the output mode. Items
+ * handed to write_batch are only valid during the call.
+ */
+struct record_sink {
+    const char *name;                   /*!< Name in the "sinks" list of settings.json */
+    uint32_t caps;                      /*!< record_sink_cap_t bits */
+    const record_sink_ops_t *ops;
+    void *ctx;                          /*!< Owned by the sink */
+    uint32_t items;                     /*!< Items written since the sink was opened */
+    uint32_t errors;                    /*!< Items write_batch did not write */
+};
+
+/**
+ * @brief Add a sink to the registry, its id is the number of sinks registered before it
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE for a name already registered, ESP_ERR_NO_MEM when RECORD_SINK_MAX are
+ */
+esp_err_t record_sink_register(record_sink_t *sink);
+
+/**
+ * @brief Registered sink by id, NULL past the last one
+ */
+record_sink_t *record_sink_get(uint32_t id);
+
+/**
+ * @brief Mask bit of a registered sink, 0 for an unknown name
+ */
+uint32_t record_sink_bit(const char *name);
+
+/**
+ * @brief Choose the sinks of the next captures by name, from the "sinks" list of settings.json
+ *
+ * Names are kept until the next call and resolved when a capture starts,
+ * so sinks registered later can be selected. count 0 clears the selection.
+ */
+void record_sink_select(const char *const *names, uint32_t count);
+
+/**
+ * @brief Names given to record_sink_select()
+ *
+ * @return number of names, 0 when nothing was selected
+ */
+uint32_t record_sink_selection(const char **names, uint32_t max);
+
+/**
+ * @brief Mask of the selected sinks that are registered, unknown names are logged
+ *
+ * @param[out] mask selected sinks
+ * @return false when nothing was selected, mask is then left alone
+ */
+bool record_sink_selected(uint32_t *mask);
+
+/**
+ * @brief Sinks of mask having all the caps of with and none of without
+ */
+uint32_t record_sink_filter(uint32_t mask, uint32_t with, uint32_t without);
+
+/**
+ * @brief Open the sinks of mask in registration order and reset their counters
+ *
+ * @return ESP_OK or the error of the first sink that failed, the ones opened before it are closed again
+ */
+esp_err_t record_sink_open(uint32_t mask);
+
+/**
+ * @brief Hand items to one sink and count them
+ */
+void record_sink_write(record_sink_t *sink, const record_sink_item_t *items, uint32_t count);
+
+/**
+ * @brief Flush the sinks of mask
+ */
+void record_sink_flush(uint32_t mask, int64_t now_us);
+
+/**
+ * @brief Close the sinks of mask in registration order
+ */
+void record_sink_close(uint32_t mask);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,142 @@
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "reduced_record.h"
+
+static const char *REDUCED_TAG = "reduced";
+
+int32_t reduced_record_utc_offset(time_t when)
+{
+    struct tm local, utc;
+
+    localtime_r(&when, &local);
+    gmtime_r(&when, &utc);
+    int32_t days = local.tm_yday - utc.tm_yday;
+    // Across a year boundary the day of year wraps
+    if (local.tm_year != utc.tm_year) {
+        days = local.tm_year > utc.tm_year ? 1 : -1;
+    }
+    return ((days * 24 + local.tm_hour - utc.tm_hour) * 60 + local.tm_min - utc.tm_min) * 60 +
+           local.tm_sec - utc.tm_sec;
+}
+
+static bool header_valid(const reduced_file_header_t *header)
+{
+    return memcmp(header->magic, REDUCED_RECORD_MAGIC, sizeof(header->magic)) == 0 &&
+           header->version == REDUCED_RECORD_VERSION && header->header_size == sizeof(reduced_file_header_t) &&
+           header->record_size == sizeof(reduced_record_t);
+}
+
+// Returns the usable length of an existing file, 0 if it has to be started over, -1 if it cannot be read
+static long check_existing(const char *path, long size)
+{
+    reduced_file_header_t header;
+
+    if (size < (long)sizeof(header)) {
+        // Reset while the header was written, there are no records to keep
+        ESP_LOGW(REDUCED_TAG, "%s has a cut off header, started over", path);
+        return 0;
+    }
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        ESP_LOGE(REDUCED_TAG, "Cannot open %s to check its header", path);
+        return -1;
+    }
+    bool read = fread(&header, sizeof(header), 1, fp) == 1;
+    fclose(fp);
+    if (!read) {
+        ESP_LOGE(REDUCED_TAG, "Cannot read the header of %s", path);
+        return -1;
+    }
+    if (!header_valid(&header)) {
+        // Only a complete header of another format moves the file away
+        char old[CONFIG_FATFS_MAX_LFN];
+        snprintf(old, sizeof(old), "%s.old", path);
+        remove(old);
+        ESP_LOGW(REDUCED_TAG, "%s has another format, moved to %s", path, old);
+        return rename(path, old) == 0 ? 0 : -1;
+    }
+    return sizeof(header) + (size - (long)sizeof(header)) / sizeof(reduced_record_t) * sizeof(reduced_record_t);
+}
+
+FILE *reduced_record_open(const char *path, uint64_t now_us)
+{
+    struct stat st;
+    long length = 0;
+
+    if (stat(path, &st) == 0 && st.st_size > 0) {
+        length = check_existing(path, st.st_size);
+        if (length < 0) {
+            return NULL;
+        }
+        if (length > 0 && length != st.st_size) {
+            FILE *fp = fopen(path, "r+b");
+            bool cut = fp && ftruncate(fileno(fp), length) == 0;
+            if (fp) {
+                fclose(fp);
+            }
+            if (!cut) {
+                return NULL;
+            }
+            ESP_LOGW(REDUCED_TAG, "Dropped %ld bytes of a cut off record at the end of %s", st.st_size - length, path);
+        }
+    }
+    if (length == 0) {
+        reduced_file_header_t header = {
+            .magic = REDUCED_RECORD_MAGIC,
+            .version = REDUCED_RECORD_VERSION,
+            .header_size = sizeof(reduced_file_header_t),
+            .record_size = sizeof(reduced_record_t),
+            .utc_offset_s = reduced_record_utc_offset(now_us / 1000000),
+            .created_us = now_us,
+        };
+        // Written on its own so the caller can still choose the buffering of the returned stream
+        FILE *fp = fopen(path, "wb");
+        bool ok = fp && fwrite(&header, sizeof(header), 1, fp) == 1;
+        if (fp && fclose(fp) != 0) {
+            ok = false;
+        }
+        if (!ok) {
+            return NULL;
+        }
+    }
+    return fopen(path, "ab");
+}
+
+void reduced_record_from_probe(reduced_record_t *out, const probe_record_t *record)
+{
+    out->timestamp_us = record->timestamp_us;
+    out->ie_hash = record->ie_hash;
+    memcpy(out->mac, record->addr2, sizeof(out->mac));
+    out->seq = record->seq;
+    out->rssi = record->rssi;
+    out->channel = record->channel;
+    out->type = REDUCED_RECORD_PROBE;
+    out->count = 1;
+}
+
+void reduced_record_from_burst(reduced_record_t *out, const burst_t *burst)
+{
+    uint64_t span_ms = (burst->last_us - burst->first.timestamp_us) / 1000;
+
+    reduced_record_from_probe(out, &burst->first);
+    out->seq = span_ms > UINT16_MAX ? UINT16_MAX : span_ms;
+    out->rssi = burst->rssi_max;
+    out->type = REDUCED_RECORD_BURST;
+    out->count = burst->count > UINT8_MAX ? UINT8_MAX : burst->count;
+}
+
+void reduced_record_marker(reduced_record_t *out, reduced_record_type_t type, const uint8_t mac[6],
+                           uint64_t timestamp_us, uint16_t arg)
+{
+    out->timestamp_us = timestamp_us;
+    out->ie_hash = (uint32_t)reduced_record_utc_offset(timestamp_us / 1000000);
+    memcpy(out->mac, mac, sizeof(out->mac));
+    out->seq = arg;
+    out->rssi = -1;
+    out->channel = 0;
+    out->type = type;
+    out->count = 1;
+}
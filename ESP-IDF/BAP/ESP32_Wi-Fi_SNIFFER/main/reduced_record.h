@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "probe_record.h"
+#include "burst_coalescer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REDUCED_RECORD_MAGIC        "PRRB"
+#define REDUCED_RECORD_VERSION      1
+
+/**
+ * @brief Kind of a binary reduced record
+ */
+typedef enum {
+    REDUCED_RECORD_PROBE = 0,       /*!< One probe request, as a reduced CSV line */
+    REDUCED_RECORD_BURST = 1,       /*!< Coalesced burst: strongest RSSI, count and span in ms in seq */
+    REDUCED_RECORD_HEARTBEAT = 2,   /*!< Heartbeat, rssi -1 */
+    REDUCED_RECORD_MODE = 3,        /*!< Output mode change, seq holds from << 8 | to as load_shed_mode_t */
+} reduced_record_type_t;
+
+/**
+ * @brief File header, little endian, written once when the file is created
+ */
+typedef struct {
+    char magic[4];                  /*!< REDUCED_RECORD_MAGIC */
+    uint16_t version;               /*!< REDUCED_RECORD_VERSION */
+    uint16_t header_size;           /*!< sizeof(reduced_file_header_t), records start here */
+    uint16_t record_size;           /*!< sizeof(reduced_record_t) */
+    uint16_t reserved;
+    int32_t utc_offset_s;           /*!< Local time minus UTC when the file was created */
+    uint64_t created_us;            /*!< Wall clock time of creation, microseconds since epoch */
+    uint8_t reserved2[8];
+} reduced_file_header_t;
+
+/**
+ * @brief Fixed width replacement of a reduced CSV line, little endian
+ *
+ * The timestamp is UTC, the CSV had local time. Sniffer records (heartbeat,
+ * mode change) carry the heartbeat MAC and the local time offset of the
+ * moment in ie_hash, so a reader follows DST changes during a capture.
+ */
+typedef struct {
+    uint64_t timestamp_us;          /*!< Microseconds since epoch, UTC, first frame of a burst */
+    uint32_t ie_hash;               /*!< IE signature, utc offset in seconds (int32) for sniffer records */
+    uint8_t mac[6];                 /*!< Transmitter MAC address */
+    uint16_t seq;                   /*!< 802.11 sequence number, see reduced_record_type_t for the others */
+    int8_t rssi;                    /*!< RSSI in dBm */
+    uint8_t channel;                /*!< Primary channel, 0 for sniffer records */
+    uint8_t type;                   /*!< reduced_record_type_t */
+    uint8_t count;                  /*!< Frames in a burst (saturates at 255), 1 otherwise */
+} reduced_record_t;
+
+_Static_assert(sizeof(reduced_file_header_t) == 32, "reduced file header layout");
+_Static_assert(sizeof(reduced_record_t) == 24, "reduced record layout");
+
+/**
+ * @brief Local time minus UTC at the given time, as localtime() applies it
+ */
+int32_t reduced_record_utc_offset(time_t when);
+
+/**
+ * @brief Open a binary reduced file for appending
+ *
+ * A new or empty file gets the header. An existing file has to carry the
+ * same version and record size, otherwise it is renamed to path.old and a new
+ * one started. A record cut short by a reset is dropped, so every record
+ * written afterwards stays aligned. A file whose header cannot be read is
+ * left alone.
+ *
+ * @return the file positioned at its end, NULL on error
+ */
+FILE *reduced_record_open(const char *path, uint64_t now_us);
+
+/**
+ * @brief Record of one probe request
+ */
+void reduced_record_from_probe(reduced_record_t *out, const probe_record_t *record);
+
+/**
+ * @brief Record of a closed burst
+ *
+ * The weakest RSSI and the sequence number of the first frame have no field,
+ * the span from the first to the last frame goes into seq in milliseconds
+ * (saturating at 65535).
+ */
+void reduced_record_from_burst(reduced_record_t *out, const burst_t *burst);
+
+/**
+ * @brief Record of a heartbeat or mode change
+ *
+ * @param type REDUCED_RECORD_HEARTBEAT or REDUCED_RECORD_MODE
+ * @param mac heartbeat MAC
+ * @param arg seq value, from << 8 | to for a mode change
+ */
+void reduced_record_marker(reduced_record_t *out, reduced_record_type_t type, const uint8_t mac[6],
+                           uint64_t timestamp_us, uint16_t arg);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,85 @@
+#include <string.h>
+#include "rx_clock.h"
+
+#define WRAP_HALF (1ULL << 31)
+
+void rx_clock_reset(rx_clock_t *clock)
+{
+    memset(clock, 0, sizeof(*clock));
+}
+
+uint64_t rx_clock_extend(rx_clock_t *clock, uint32_t raw, uint64_t mono_us)
+{
+    if (!clock->started) {
+        clock->started = true;
+        clock->last_raw = raw;
+        clock->last_mono_us = mono_us;
+        clock->local_us = raw;
+        return clock->local_us;
+    }
+
+    uint32_t forward = raw - clock->last_raw;
+    uint64_t elapsed = mono_us - clock->last_mono_us;
+    int64_t step;
+
+    if (elapsed >= WRAP_HALF) {
+        // Long silence, the counter may have wrapped more than once: the monotonic clock picks the wrap count
+        int64_t missing = (int64_t)elapsed - forward;
+        uint64_t wraps = missing > 0 ? ((uint64_t)missing + WRAP_HALF) >> 32 : 0;
+        step = forward + (int64_t)(wraps << 32);
+    } else {
+        // Nearest interpretation, a small step back is a frame delivered out of order
+        step = (int32_t)forward;
+    }
+
+    if (step < 0) {
+        return clock->local_us + step;
+    }
+
+    clock->local_us += step;
+    clock->last_raw = raw;
+    clock->last_mono_us = mono_us;
+    return clock->local_us;
+}
+
+void rx_clock_sync(rx_clock_t *clock, uint64_t local_us, int64_t wall_us, bool step)
+{
+    if (!step && clock->synced) {
+        int64_t span = (int64_t)(local_us - clock->anchor_local_us);
+        clock->last_error_us = wall_us - rx_clock_to_wall(clock, local_us);
+
+        if (span < RX_CLOCK_MIN_DRIFT_SPAN_US) {
+            // Too close to the anchor for a useful drift sample, keep the older anchor
+            return;
+        }
+
+        int64_t gain = (wall_us - clock->anchor_wall_us) - span;
+        int64_t limit = span / (1000000000LL / RX_CLOCK_MAX_DRIFT_PPB);
+        // No oscillator is further off than the limit, a bigger gain means the wall clock was set
+        // behind our back and the pair only moves the anchor
+        if (gain <= limit && gain >= -limit) {
+            int64_t sample_ppb = gain * 1000000000LL / span;
+            // The first sample is taken as is, later ones only smooth out the sync jitter
+            if (clock->drift_samples++ == 0) {
+                clock->drift_ppb = sample_ppb;
+            } else {
+                clock->drift_ppb += (sample_ppb - clock->drift_ppb) / RX_CLOCK_DRIFT_WEIGHT;
+            }
+        }
+    }
+
+    clock->anchor_local_us = local_us;
+    clock->anchor_wall_us = wall_us;
+    clock->synced = true;
+    clock->syncs++;
+}
+
+int64_t rx_clock_to_wall(const rx_clock_t *clock, uint64_t local_us)
+{
+    if (!clock->synced) {
+        return 0;
+    }
+
+    int64_t elapsed = (int64_t)(local_us - clock->anchor_local_us);
+    return clock->anchor_wall_us + elapsed + elapsed * clock->drift_ppb / 1000000000LL;
+}
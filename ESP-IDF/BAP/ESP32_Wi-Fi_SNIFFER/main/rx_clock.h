@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RX_CLOCK_MIN_DRIFT_SPAN_US  10000000    /*!< Soft syncs closer than this to the anchor do not update the drift */
+#define RX_CLOCK_MAX_DRIFT_PPB      500000      /*!< Drift samples beyond 500 ppm are taken as a wall clock step */
+#define RX_CLOCK_DRIFT_WEIGHT       4           /*!< After the first sample, a new one moves the estimate by 1/4 of the difference */
+
+/**
+ * @brief Wall clock derived from the radio's 32 bit microsecond rx timestamp
+ *
+ * rx_ctrl.timestamp wraps every ~71.6 minutes. rx_clock_extend() turns it
+ * into a 64 bit local time, using a monotonic clock read next to it to count
+ * wraps across long silences. Wall time is an anchor (local, wall) pair taken
+ * at the last sync plus the elapsed local time, corrected by the estimated
+ * drift of the local counter against the wall clock.
+ *
+ * All functions except rx_clock_to_wall() modify the clock and must be called
+ * from a single task, the Wi-Fi driver callback in the sniffer.
+ */
+typedef struct {
+    bool started;               /*!< A raw timestamp has been seen */
+    bool synced;                /*!< An anchor has been set */
+    uint32_t last_raw;          /*!< Latest raw timestamp that moved the clock */
+    uint64_t last_mono_us;      /*!< Monotonic time read with last_raw */
+    uint64_t local_us;          /*!< Extended local time of last_raw */
+    uint64_t anchor_local_us;   /*!< Local time of the last sync */
+    int64_t anchor_wall_us;     /*!< Wall time of the last sync, microseconds since epoch */
+    int32_t drift_ppb;          /*!< Wall clock gain over the local counter, parts per billion */
+    int32_t last_error_us;      /*!< Wall minus predicted time at the last soft sync */
+    uint32_t drift_samples;     /*!< Soft syncs that updated drift_ppb */
+    uint32_t syncs;             /*!< Number of syncs applied */
+} rx_clock_t;
+
+/**
+ * @brief Forget the local time, the anchor and the drift estimate
+ */
+void rx_clock_reset(rx_clock_t *clock);
+
+/**
+ * @brief Extend a raw rx timestamp to 64 bit local time
+ *
+ * A frame older than the latest one (reordered by the driver) gets its own
+ * earlier time without moving the clock back.
+ *
+ * @param clock clock object
+ * @param raw rx_ctrl.timestamp of the frame
+ * @param mono_us any monotonic microsecond clock read close to reception, esp_timer_get_time() on target
+ * @return local time of the frame in microseconds
+ */
+uint64_t rx_clock_extend(rx_clock_t *clock, uint32_t raw, uint64_t mono_us);
+
+/**
+ * @brief Re-anchor the clock on a (local, wall) pair
+ *
+ * @param clock clock object
+ * @param local_us local time returned by rx_clock_extend()
+ * @param wall_us wall time read at the same moment, microseconds since epoch
+ * @param step true when the wall clock may have jumped (capture start, SNTP, RTC or manual set),
+ *             the pair then only moves the anchor. A soft sync also updates the drift estimate.
+ */
+void rx_clock_sync(rx_clock_t *clock, uint64_t local_us, int64_t wall_us, bool step);
+
+/**
+ * @brief Convert local time to wall time
+ *
+ * @return microseconds since epoch, 0 before the first sync
+ */
+int64_t rx_clock_to_wall(const rx_clock_t *clock, uint64_t local_us);
+
+#ifdef __cplusplus
+}
+#endif
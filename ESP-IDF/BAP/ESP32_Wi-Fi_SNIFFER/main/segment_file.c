@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "esp_log.h"
+#include "esp_vfs_fat.h"
+#include "segment_file.h"
+
+static const char *SEGMENT_TAG = "segment";
+
+/* Sidecar of path: same name, extension replaced */
+static void segment_sidecar_path(char *sidecar, size_t sidecar_size, const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(path, '.');
+    size_t stem = (dot && (!slash || dot > slash)) ? (size_t)(dot - path) : strlen(path);
+
+    snprintf(sidecar, sidecar_size, "%.*s%s", (int)stem, path, SEGMENT_FILE_SIDECAR_EXT);
+}
+
+/* Fixed width, so a commit overwrites the same bytes and never reallocates the sidecar */
+static bool segment_write_sidecar(const segment_file_t *seg, const char *mode, uint64_t size, uint64_t committed)
+{
+    FILE *fp = fopen(seg->sidecar, mode);
+    if (fp == NULL) {
+        return false;
+    }
+    bool ok = fprintf(fp, "%020" PRIu64 " %020" PRIu64 "\n", size, committed) > 0;
+    return fclose(fp) == 0 && ok;
+}
+
+static bool segment_read_sidecar(const char *sidecar, uint64_t *size, uint64_t *committed)
+{
+    FILE *fp = fopen(sidecar, "r");
+    if (fp == NULL) {
+        return false;
+    }
+    bool ok = fscanf(fp, "%" SCNu64 " %" SCNu64, size, committed) == 2;
+    fclose(fp);
+    return ok;
+}
+
+FILE *segment_file_open(segment_file_t *seg, const char *base_path, const char *path, uint64_t size)
+{
+    FILE *fp = NULL;
+
+    memset(seg, 0, sizeof(*seg));
+    segment_sidecar_path(seg->sidecar, sizeof(seg->sidecar), path);
+    // The sidecar goes first, a reset during the preallocation or before the first commit still leaves the file to recovery
+    remove(path);
+    if (!segment_write_sidecar(seg, "w", size, 0)) {
+        ESP_LOGW(SEGMENT_TAG, "Cannot create %s, %s is not recovered after a reset", seg->sidecar, path);
+        return fopen(path, "wb+");
+    }
+    seg->tracked = true;
+    if (size) {
+        if (esp_vfs_fat_create_contiguous_file(base_path, path, size, true) == ESP_OK &&
+            (fp = fopen(path, "rb+")) != NULL) {
+            // Clusters are not zeroed, the file header and the first records until a commit get a terminator too
+            static const uint8_t zeros[SEGMENT_FILE_HEAD_LEN];
+            fwrite(zeros, 1, size < sizeof(zeros) ? size : sizeof(zeros), fp);
+            fflush(fp);
+            fsync(fileno(fp));
+            rewind(fp);
+            seg->size = size;
+            return fp;
+        }
+        ESP_LOGW(SEGMENT_TAG, "No contiguous %" PRIu64 " MB for %s, writing a plain file", size >> 20, path);
+        segment_write_sidecar(seg, "r+", 0, 0);
+    }
+    return fopen(path, "wb+");
+}
+
+void segment_file_commit(segment_file_t *seg, FILE *fp)
+{
+    if (!seg->tracked) {
+        return;
+    }
+    // f_sync also writes the file size to the directory entry, a growing file then ends on a record after a reset
+    fflush(fp);
+    long length = ftell(fp);
+    if (seg->size && length > 0 && (uint64_t)length + SEGMENT_FILE_TERMINATOR_LEN <= seg->size) {
+        // Without a terminator a scan could go on into an old capture deleted from the same clusters
+        static const uint8_t zeros[SEGMENT_FILE_TERMINATOR_LEN];
+        fwrite(zeros, 1, sizeof(zeros), fp);
+        fflush(fp);
+        fseek(fp, length, SEEK_SET);
+    }
+    fsync(fileno(fp));
+    if (length > 0 && segment_write_sidecar(seg, "r+", seg->size, length)) {
+        seg->committed = length;
+    }
+}
+
+void segment_file_finish(segment_file_t *seg, FILE *fp)
+{
+    if (seg->size == 0) {
+        return;
+    }
+    fflush(fp);
+    long length = ftell(fp);
+    if (length < 0 || ftruncate(fileno(fp), length) != 0) {
+        ESP_LOGW(SEGMENT_TAG, "Cannot cut the segment down, %s is left for recovery", seg->sidecar);
+    }
+}
+
+void segment_file_remove_sidecar(segment_file_t *seg)
+{
+    if (seg->tracked) {
+        remove(seg->sidecar);
+        seg->tracked = false;
+        seg->size = 0;
+    }
+}
+
+bool segment_file_has_sidecar(const char *path)
+{
+    char sidecar[CONFIG_FATFS_MAX_LFN];
+
+    segment_sidecar_path(sidecar, sizeof(sidecar), path);
+    return access(sidecar, F_OK) == 0;
+}
+
+bool segment_file_full(const segment_file_t *seg, uint64_t length, uint64_t headroom)
+{
+    return seg->size && length + headroom >= seg->size;
+}
+
+/* Cut one unclosed segment after its last complete record */
+static bool segment_recover_one(const char *sidecar, const char *path, segment_scan_t scan)
+{
+    uint64_t size = 0, committed = 0;
+    if (!segment_read_sidecar(sidecar, &size, &committed)) {
+        committed = 0;
+    }
+
+    FILE *fp = fopen(path, "rb+");
+    if (fp == NULL) {
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long file_size = ftell(fp);
+    if (file_size < 0 || committed > (uint64_t)file_size) {
+        committed = 0;
+    }
+    // Only what was written after the last commit is read, at most one commit interval of records
+    uint64_t length = scan(fp, committed, file_size > 0 ? file_size : 0);
+    fflush(fp);
+    bool ok = ftruncate(fileno(fp), length) == 0;
+    ok = fclose(fp) == 0 && ok;
+    if (length == 0) {
+        // Not even a file header made it to the card, the index is free again
+        ok = remove(path) == 0;
+    }
+    ESP_LOGW(SEGMENT_TAG, "Recovered %s: %" PRIu64 " bytes kept of %ld, %" PRIu64 " were committed",
+             path, length, file_size, committed);
+    return ok;
+}
+
+uint32_t segment_file_recover(const char *dir, const char *const *ext, uint32_t ext_count, segment_scan_t scan)
+{
+    char sidecar[CONFIG_FATFS_MAX_LFN];
+    char path[CONFIG_FATFS_MAX_LFN];
+    uint32_t recovered = 0;
+    const size_t ext_len = strlen(SEGMENT_FILE_SIDECAR_EXT);
+
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        return 0;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        size_t name_len = strlen(entry->d_name);
+        if (name_len <= ext_len || strcmp(entry->d_name + name_len - ext_len, SEGMENT_FILE_SIDECAR_EXT) != 0) {
+            continue;
+        }
+        snprintf(sidecar, sizeof(sidecar), "%s/%s", dir, entry->d_name);
+        // A sidecar without its file is left over from a reset before the preallocation
+        bool keep = false;
+        for (uint32_t i = 0; i < ext_count; i++) {
+            snprintf(path, sizeof(path), "%s/%.*s%s", dir, (int)(name_len - ext_len), entry->d_name, ext[i]);
+            if (access(path, F_OK) == 0) {
+                keep = !segment_recover_one(sidecar, path, scan);
+                recovered += !keep;
+                break;
+            }
+        }
+        if (!keep) {
+            remove(sidecar);
+        }
+    }
+    closedir(d);
+    return recovered;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SEGMENT_FILE_SIDECAR_EXT ".seg"
+#define SEGMENT_FILE_TERMINATOR_LEN 16      /*!< Zero bytes after the committed length, ends a scan of pcap and pcapng records */
+#define SEGMENT_FILE_HEAD_LEN 512           /*!< Zero bytes at the start of a preallocated file, room for its header and a terminator */
+
+/**
+ * @brief End of the valid data in a file, scanned forward from a known good offset
+ *
+ * @param fp file opened for reading
+ * @param from offset known to end a record, 0 to start with the file header
+ * @param size bytes in the file
+ * @return offset after the last complete record
+ */
+typedef uint64_t (*segment_scan_t)(FILE *fp, uint64_t from, uint64_t size);
+
+/**
+ * @brief Capture file with a sidecar recording its committed length
+ *
+ * A sidecar next to the file (same name, SEGMENT_FILE_SIDECAR_EXT) holds the
+ * preallocated size and the length known to be on the card, it is rewritten
+ * in place by segment_file_commit() and removed once the file is closed, so a
+ * sidecar found at boot marks a file that was never closed. Recovery then only
+ * reads the records written after the last commit.
+ *
+ * With a size the file is also preallocated as one contiguous run of clusters,
+ * so FatFs never walks or extends the cluster chain while it is written. The
+ * clusters keep what was deleted there before, only the first
+ * SEGMENT_FILE_HEAD_LEN bytes are zeroed at the open.
+ * segment_file_finish() cuts it to the bytes written before the close.
+ */
+typedef struct {
+    char sidecar[CONFIG_FATFS_MAX_LFN];
+    uint64_t size;              /*!< Preallocated bytes, 0 for a plain file */
+    uint64_t committed;         /*!< Bytes flushed to the card and recorded in the sidecar */
+    bool tracked;               /*!< The sidecar exists */
+} segment_file_t;
+
+/**
+ * @brief Create the sidecar and the file with size bytes allocated, open it for writing
+ *
+ * Falls back to a plain growing file when no contiguous run of that size is
+ * free, and to a file without sidecar when the sidecar cannot be created.
+ *
+ * @param seg segment state, size is 0 afterwards for a plain file
+ * @param base_path mount point of the FAT volume
+ * @param path file to create, an existing one is replaced
+ * @param size bytes to preallocate, 0 for a plain file
+ * @return open file positioned at 0, NULL on error
+ */
+FILE *segment_file_open(segment_file_t *seg, const char *base_path, const char *path, uint64_t size);
+
+/**
+ * @brief Write the data of fp to the card and record its current length in the sidecar
+ *
+ * Runs on the task writing fp, with every byte written so far ending a record.
+ * A preallocated file gets SEGMENT_FILE_TERMINATOR_LEN zero bytes after the
+ * committed length, which the next records overwrite, so a recovery scan does
+ * not take data deleted from the same clusters for records. The fsync also
+ * updates the size in the directory entry, so a growing file ends on a record
+ * after a reset too.
+ */
+void segment_file_commit(segment_file_t *seg, FILE *fp);
+
+/**
+ * @brief Cut the preallocated file to its current position, fp stays open
+ */
+void segment_file_finish(segment_file_t *seg, FILE *fp);
+
+/**
+ * @brief Remove the sidecar of a closed file
+ */
+void segment_file_remove_sidecar(segment_file_t *seg);
+
+/**
+ * @brief Whether path has a sidecar, i.e. is open or was never closed
+ */
+bool segment_file_has_sidecar(const char *path);
+
+/**
+ * @brief Whether fewer than headroom preallocated bytes are left after length
+ */
+bool segment_file_full(const segment_file_t *seg, uint64_t length, uint64_t headroom);
+
+/**
+ * @brief Cut every file that was never closed down to its valid data
+ *
+ * Every sidecar in dir names a data file with the given extension. Data from
+ * the committed length on is checked with scan, the file is truncated after
+ * the last complete record and the sidecar removed. A file without a single
+ * complete header is removed as well.
+ *
+ * @param dir directory holding the capture files
+ * @param ext data file extensions to try, e.g. {".pcap", ".pcapng"}
+ * @param ext_count number of extensions
+ * @param scan format aware check of the records
+ * @return number of files recovered
+ */
+uint32_t segment_file_recover(const char *dir, const char *const *ext, uint32_t ext_count, segment_scan_t scan);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,6 +1,7 @@
 #include "server.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include "esp_log.h"
 #include "esp_http_server.h"
 #include "mdns.h"
@@ -19,6 +20,10 @@
 #include "miniz.h" 
 #include "i2c_oled.h"
 #include "cJSON.h"
+#include "load_shed.h"
+#include "pcap_lib.h"
+#include "record_sink.h"
+#include "text_format.h"
 
 #define TAG "Captive_Portal"
 #define HOSTNAME "esp32.local"
@@ -91,7 +96,7 @@ static char* generate_top_requests_table(void) {
     // First, check if we have any valid data to display
     bool has_data = false;
     for (int i = 0; i < TOP_REQUESTS_COUNT && i <= 20; i++) {
-        if (top_requests[i].mac_address[0] != '\0' && top_requests[i].rssi != 0) {
+        if (top_requests[i].timestamp != 0 && top_requests[i].rssi != 0) {
             has_data = true;
             break;
         }
@@ -120,8 +125,10 @@ static char* generate_top_requests_table(void) {
     int len = 0;
 
     for (int i = 0; i < TOP_REQUESTS_COUNT && i <= 20; i++) {
-        if (top_requests[i].mac_address[0] != '\0' && top_requests[i].rssi != 0) {
+        if (top_requests[i].timestamp != 0 && top_requests[i].rssi != 0) {
             char timestamp_str[32];
+            char mac_str[TEXT_FORMAT_MAC_LEN + 1];
+            mac_str[text_format_mac(mac_str, top_requests[i].mac)] = '\0';
             struct tm timeinfo;
             localtime_r(&top_requests[i].timestamp, &timeinfo);
             strftime(timestamp_str, sizeof(timestamp_str), "%Y-%m-%d %H:%M:%S", &timeinfo);
@@ -141,7 +148,7 @@ static char* generate_top_requests_table(void) {
 
             len += snprintf(table_rows + len, buffer_size - len,
                             "<tr><td>%d</td><td>%s</td><td>%s</td><td>%d</td></tr>", 
-                            i + 1, timestamp_str, top_requests[i].mac_address, top_requests[i].rssi);
+                            i + 1, timestamp_str, mac_str, top_requests[i].rssi);
         }
     }
 
@@ -786,6 +793,167 @@ esp_err_t set_period_handler(httpd_req_t *req) {
     return ESP_FAIL;
 }
 
+static const char *random_mac_modes[] = {"any", "only", "exclude"};
+
+static void add_filter_addresses(cJSON *array, const uint64_t *macs, uint16_t mac_count,
+                                 const uint32_t *ouis, uint16_t oui_count) {
+    char addr[18];
+    for (uint16_t i = 0; i < mac_count; i++) {
+        snprintf(addr, sizeof(addr), "%02X:%02X:%02X:%02X:%02X:%02X",
+                 (unsigned)(macs[i] >> 40) & 0xFF, (unsigned)(macs[i] >> 32) & 0xFF, (unsigned)(macs[i] >> 24) & 0xFF,
+                 (unsigned)(macs[i] >> 16) & 0xFF, (unsigned)(macs[i] >> 8) & 0xFF, (unsigned)macs[i] & 0xFF);
+        cJSON_AddItemToArray(array, cJSON_CreateString(addr));
+    }
+    for (uint16_t i = 0; i < oui_count; i++) {
+        snprintf(addr, sizeof(addr), "%02X:%02X:%02X",
+                 (unsigned)(ouis[i] >> 16) & 0xFF, (unsigned)(ouis[i] >> 8) & 0xFF, (unsigned)ouis[i] & 0xFF);
+        cJSON_AddItemToArray(array, cJSON_CreateString(addr));
+    }
+}
+
+static void add_filter_subtypes(cJSON *filter_json, const char *name, uint16_t mask) {
+    cJSON *array = cJSON_AddArrayToObject(filter_json, name);
+    for (int subtype = 0; subtype < 16; subtype++) {
+        if (mask & (1 << subtype)) {
+            cJSON_AddItemToArray(array, cJSON_CreateNumber(subtype));
+        }
+    }
+}
+
+static void add_filter_to_json(cJSON *root) {
+    packet_filter_t *filter = sniffer_filter();
+    cJSON *filter_json = cJSON_AddObjectToObject(root, "filter");
+    char ssid[PACKET_FILTER_MAX_SSID_LEN + 1];
+
+    add_filter_addresses(cJSON_AddArrayToObject(filter_json, "allow"), filter->allow_mac, filter->allow_mac_count,
+                         filter->allow_oui, filter->allow_oui_count);
+    add_filter_addresses(cJSON_AddArrayToObject(filter_json, "deny"), filter->deny_mac, filter->deny_mac_count,
+                         filter->deny_oui, filter->deny_oui_count);
+    if (filter->rssi_floor != PACKET_FILTER_RSSI_OFF) {
+        cJSON_AddNumberToObject(filter_json, "rssi_floor", filter->rssi_floor);
+    }
+    cJSON_AddStringToObject(filter_json, "random_mac", random_mac_modes[filter->random_mac]);
+    memcpy(ssid, filter->ssid, filter->ssid_len);
+    ssid[filter->ssid_len] = '\0';
+    cJSON_AddStringToObject(filter_json, "ssid", ssid);
+    add_filter_subtypes(filter_json, "mgmt_subtypes", filter->subtype_mask[PACKET_FILTER_TYPE_MGMT]);
+    add_filter_subtypes(filter_json, "data_subtypes", filter->subtype_mask[PACKET_FILTER_TYPE_DATA]);
+}
+
+// Only written once a "sinks" list was loaded, save_pcap and reduced_binary choose the sinks otherwise
+static void add_sinks_to_json(cJSON *root) {
+    const char *names[RECORD_SINK_MAX];
+    uint32_t count = record_sink_selection(names, RECORD_SINK_MAX);
+
+    if (count) {
+        cJSON_AddItemToObject(root, "sinks", cJSON_CreateStringArray(names, count));
+    }
+}
+
+// The list replaces save_pcap and reduced_binary, which are kept in line with it
+static void load_sinks_from_json(cJSON *root) {
+    cJSON *sinks = cJSON_GetObjectItem(root, "sinks");
+    const char *names[RECORD_SINK_MAX];
+    uint32_t count = 0;
+    bool csv = false;
+    cJSON *item;
+
+    if (!cJSON_IsArray(sinks)) {
+        return;
+    }
+    cJSON_ArrayForEach(item, sinks) {
+        if (!cJSON_IsString(item) || count == RECORD_SINK_MAX) {
+            ESP_LOGW(TAG, "Ignoring sink entry");
+            continue;
+        }
+        names[count++] = item->valuestring;
+        csv |= strcmp(item->valuestring, "csv") == 0;
+    }
+    record_sink_select(names, count);
+    save_pcap = false;
+    reduced_binary = false;
+    for (uint32_t i = 0; i < count; i++) {
+        save_pcap |= strcmp(names[i], "pcap") == 0;
+        reduced_binary |= !csv && strcmp(names[i], "binary") == 0;
+        ESP_LOGI(TAG, "Loaded sink %s", names[i]);
+    }
+}
+
+static void load_filter_addresses(packet_filter_t *filter, cJSON *array, bool allow) {
+    cJSON *item;
+    uint8_t addr[6];
+    bool oui;
+
+    cJSON_ArrayForEach(item, array) {
+        if (!cJSON_IsString(item) || !packet_filter_parse_addr(item->valuestring, addr, &oui)) {
+            ESP_LOGW(TAG, "Ignoring invalid filter address");
+            continue;
+        }
+        if (!packet_filter_add(filter, addr, oui, allow)) {
+            ESP_LOGW(TAG, "Filter %s list full, ignoring %s", allow ? "allow" : "deny", item->valuestring);
+        }
+    }
+}
+
+static uint16_t load_filter_subtypes(cJSON *array, uint16_t mask) {
+    cJSON *item;
+
+    if (!cJSON_IsArray(array)) {
+        return mask;
+    }
+
+    mask = 0;
+    cJSON_ArrayForEach(item, array) {
+        if (cJSON_IsNumber(item) && item->valueint >= 0 && item->valueint < 16) {
+            mask |= 1 << item->valueint;
+        }
+    }
+    return mask;
+}
+
+static void load_filter_from_json(cJSON *root) {
+    cJSON *filter_json = cJSON_GetObjectItem(root, "filter");
+    if (!cJSON_IsObject(filter_json)) {
+        return;
+    }
+
+    // The section replaces the default filter, including CONFIG_SNIFFER_USE_MAC_FILTER
+    packet_filter_t *filter = sniffer_filter();
+    packet_filter_reset(filter);
+
+    load_filter_addresses(filter, cJSON_GetObjectItem(filter_json, "allow"), true);
+    load_filter_addresses(filter, cJSON_GetObjectItem(filter_json, "deny"), false);
+
+    cJSON *rssi_floor = cJSON_GetObjectItem(filter_json, "rssi_floor");
+    if (cJSON_IsNumber(rssi_floor)) {
+        filter->rssi_floor = rssi_floor->valueint;
+    }
+
+    cJSON *random_mac = cJSON_GetObjectItem(filter_json, "random_mac");
+    if (cJSON_IsString(random_mac)) {
+        for (int i = 0; i < sizeof(random_mac_modes) / sizeof(random_mac_modes[0]); i++) {
+            if (strcmp(random_mac->valuestring, random_mac_modes[i]) == 0) {
+                filter->random_mac = i;
+            }
+        }
+    }
+
+    cJSON *ssid = cJSON_GetObjectItem(filter_json, "ssid");
+    if (cJSON_IsString(ssid) && !packet_filter_set_ssid(filter, ssid->valuestring)) {
+        ESP_LOGW(TAG, "Filter SSID too long, ignored");
+    }
+
+    filter->subtype_mask[PACKET_FILTER_TYPE_MGMT] =
+        load_filter_subtypes(cJSON_GetObjectItem(filter_json, "mgmt_subtypes"), filter->subtype_mask[PACKET_FILTER_TYPE_MGMT]);
+    filter->subtype_mask[PACKET_FILTER_TYPE_DATA] =
+        load_filter_subtypes(cJSON_GetObjectItem(filter_json, "data_subtypes"), filter->subtype_mask[PACKET_FILTER_TYPE_DATA]);
+
+    packet_filter_compile(filter);
+    ESP_LOGI(TAG, "Loaded filter: %u+%u allowed, %u+%u denied MACs/OUIs, RSSI floor %d, random %s, SSID %s",
+             filter->allow_mac_count, filter->allow_oui_count, filter->deny_mac_count, filter->deny_oui_count,
+             filter->rssi_floor, random_mac_modes[filter->random_mac], filter->ssid_len ? "set" : "any");
+}
+
 esp_err_t save_settings_to_sd(const char *path) {
     FILE *f = fopen(path, "w");
     if (!f) {
@@ -807,6 +975,23 @@ esp_err_t save_settings_to_sd(const char *path) {
     cJSON_AddBoolToObject(root, "display_battery_data", display_battery_data);
     cJSON_AddBoolToObject(root, "current_rotation", flip_oled);
 
+    // Add capture settings
+    cJSON_AddBoolToObject(root, "save_pcap", save_pcap);
+    cJSON_AddNumberToObject(root, "pcap_snaplen", pcap_snaplen);
+    cJSON_AddBoolToObject(root, "pcap_ies_only", pcap_ies_only);
+    cJSON_AddNumberToObject(root, "pcap_flush_ms", pcap_flush_ms);
+    cJSON_AddBoolToObject(root, "pcapng", pcapng);
+    cJSON_AddNumberToObject(root, "pcap_segment_mb", pcap_segment_mb);
+    cJSON_AddBoolToObject(root, "pcap_index", pcap_index);
+    cJSON_AddBoolToObject(root, "archive_pcap", archive_pcap);
+    cJSON_AddBoolToObject(root, "coalesce_bursts", coalesce_bursts);
+    cJSON_AddBoolToObject(root, "reduced_binary", reduced_binary);
+    cJSON_AddNumberToObject(root, "csv_flush_records", csv_flush_records);
+    cJSON_AddNumberToObject(root, "csv_flush_ms", csv_flush_ms);
+    cJSON_AddNumberToObject(root, "live_max_per_s", live_max_per_s);
+    add_sinks_to_json(root);
+    add_filter_to_json(root);
+
     char *json_str = cJSON_Print(root);
     fwrite(json_str, 1, strlen(json_str), f);
 
@@ -894,6 +1079,89 @@ esp_err_t load_settings_from_sd(const char *path) {
             ESP_LOGI(TAG, "Loaded and applied flip_oled = %d", flip_oled);
 
         }
+
+        // Load capture settings
+        cJSON *pcap = cJSON_GetObjectItem(root, "save_pcap");
+        if (cJSON_IsBool(pcap)) {
+            save_pcap = cJSON_IsTrue(pcap);
+            ESP_LOGI(TAG, "Loaded save_pcap = %s", save_pcap ? "true" : "false");
+        }
+
+        cJSON *snaplen = cJSON_GetObjectItem(root, "pcap_snaplen");
+        if (cJSON_IsNumber(snaplen) && snaplen->valueint >= 0) {
+            pcap_snaplen = snaplen->valueint;
+            ESP_LOGI(TAG, "Loaded pcap_snaplen = %lu", pcap_snaplen);
+        }
+
+        cJSON *ies_only = cJSON_GetObjectItem(root, "pcap_ies_only");
+        if (cJSON_IsBool(ies_only)) {
+            pcap_ies_only = cJSON_IsTrue(ies_only);
+            ESP_LOGI(TAG, "Loaded pcap_ies_only = %s", pcap_ies_only ? "true" : "false");
+        }
+
+        cJSON *flush_ms = cJSON_GetObjectItem(root, "pcap_flush_ms");
+        if (cJSON_IsNumber(flush_ms) && flush_ms->valueint >= 0) {
+            pcap_flush_ms = flush_ms->valueint;
+            ESP_LOGI(TAG, "Loaded pcap_flush_ms = %lu", pcap_flush_ms);
+        }
+
+        cJSON *ng = cJSON_GetObjectItem(root, "pcapng");
+        if (cJSON_IsBool(ng)) {
+            pcapng = cJSON_IsTrue(ng);
+            ESP_LOGI(TAG, "Loaded pcapng = %s", pcapng ? "true" : "false");
+        }
+
+        cJSON *segment_mb = cJSON_GetObjectItem(root, "pcap_segment_mb");
+        if (cJSON_IsNumber(segment_mb) && segment_mb->valueint >= 0) {
+            pcap_segment_mb = segment_mb->valueint;
+            ESP_LOGI(TAG, "Loaded pcap_segment_mb = %lu", pcap_segment_mb);
+        }
+
+        cJSON *index = cJSON_GetObjectItem(root, "pcap_index");
+        if (cJSON_IsBool(index)) {
+            pcap_index = cJSON_IsTrue(index);
+            ESP_LOGI(TAG, "Loaded pcap_index = %s", pcap_index ? "true" : "false");
+        }
+
+        cJSON *archive = cJSON_GetObjectItem(root, "archive_pcap");
+        if (cJSON_IsBool(archive)) {
+            archive_pcap = cJSON_IsTrue(archive);
+            ESP_LOGI(TAG, "Loaded archive_pcap = %s", archive_pcap ? "true" : "false");
+        }
+
+        cJSON *coalesce = cJSON_GetObjectItem(root, "coalesce_bursts");
+        if (cJSON_IsBool(coalesce)) {
+            coalesce_bursts = cJSON_IsTrue(coalesce);
+            ESP_LOGI(TAG, "Loaded coalesce_bursts = %s", coalesce_bursts ? "true" : "false");
+        }
+
+        cJSON *binary = cJSON_GetObjectItem(root, "reduced_binary");
+        if (cJSON_IsBool(binary)) {
+            reduced_binary = cJSON_IsTrue(binary);
+            ESP_LOGI(TAG, "Loaded reduced_binary = %s", reduced_binary ? "true" : "false");
+        }
+
+        cJSON *csv_records = cJSON_GetObjectItem(root, "csv_flush_records");
+        if (cJSON_IsNumber(csv_records) && csv_records->valueint >= 0) {
+            csv_flush_records = csv_records->valueint;
+            ESP_LOGI(TAG, "Loaded csv_flush_records = %lu", csv_flush_records);
+        }
+
+        cJSON *csv_ms = cJSON_GetObjectItem(root, "csv_flush_ms");
+        if (cJSON_IsNumber(csv_ms) && csv_ms->valueint >= 0) {
+            csv_flush_ms = csv_ms->valueint;
+            ESP_LOGI(TAG, "Loaded csv_flush_ms = %lu", csv_flush_ms);
+        }
+
+        cJSON *live_rate = cJSON_GetObjectItem(root, "live_max_per_s");
+        if (cJSON_IsNumber(live_rate) && live_rate->valueint >= 0) {
+            live_max_per_s = live_rate->valueint;
+            ESP_LOGI(TAG, "Loaded live_max_per_s = %lu", live_max_per_s);
+        }
+
+        load_sinks_from_json(root);
+
+        load_filter_from_json(root);
         
         cJSON_Delete(root);
     }
@@ -917,6 +1185,7 @@ esp_err_t sync_time_handler(httpd_req_t *req) {
             tv.tv_sec = timestamp;
             tv.tv_usec = 0;
             settimeofday(&tv, NULL);
+            sniffer_clock_resync(true);
             
             // Log the time synchronization
             struct tm timeinfo;
@@ -1043,6 +1312,13 @@ esp_err_t delete_file_handler(httpd_req_t *req) {
     // Delete the file
     if (unlink(filepath) == 0) {
         ESP_LOGI(TAG, "File deleted successfully: %s", decoded_filename);
+
+        // The index of a capture file goes with it
+        if (strstr(decoded_filename, ".pcap")) {
+            char index_path[256];
+            pcap_index_path(index_path, sizeof(index_path), filepath);
+            unlink(index_path);
+        }
         
         // Redirect back to browse page with cache control headers
         httpd_resp_set_status(req, "302 Found");
@@ -1329,6 +1605,74 @@ esp_err_t download_file_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+static esp_err_t send_file_range(httpd_req_t *req, FILE *file, uint64_t start, uint64_t end) {
+    char buffer[512];
+
+    if (fseek(file, start, SEEK_SET) != 0) {
+        return ESP_FAIL;
+    }
+    while (start < end) {
+        size_t want = end - start < sizeof(buffer) ? end - start : sizeof(buffer);
+        size_t read_bytes = fread(buffer, 1, want, file);
+        if (read_bytes == 0 || httpd_resp_send_chunk(req, buffer, read_bytes) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        start += read_bytes;
+    }
+    return ESP_OK;
+}
+
+// /pcap_range?file=file_000001.pcap&from=<epoch s>&to=<epoch s>: file header and the records of the window, from the index
+esp_err_t pcap_range_handler(httpd_req_t *req) {
+    char query[160], filename[64], from_str[24], to_str[24];
+    char filepath[128];
+    pcap_index_range_t range;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "file", filename, sizeof(filename)) != ESP_OK ||
+        httpd_query_key_value(query, "from", from_str, sizeof(from_str)) != ESP_OK ||
+        httpd_query_key_value(query, "to", to_str, sizeof(to_str)) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing file, from or to");
+        return ESP_FAIL;
+    }
+    // Offsets in the index are those of the raw file
+    if (strstr(filename, ".gz") || strchr(filename, '/')) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Only uncompressed capture files on the card");
+        return ESP_FAIL;
+    }
+    snprintf(filepath, sizeof(filepath), "%s/%s", CONFIG_SD_MOUNT_POINT, filename);
+    esp_err_t err = packet_capture_find_range(filepath, strtoull(from_str, NULL, 10) * 1000000,
+                                              strtoull(to_str, NULL, 10) * 1000000 + 999999, &range);
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, err == ESP_ERR_NOT_FOUND ? "No index or nothing in the window" :
+                            esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+    FILE *file = fopen(filepath, "rb");
+    if (!file) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+
+    char content_disposition[128];
+    snprintf(content_disposition, sizeof(content_disposition), "attachment; filename=\"%s_%s\"", from_str, filename);
+    httpd_resp_set_type(req, get_content_type(filename));
+    httpd_resp_set_hdr(req, "Content-Disposition", content_disposition);
+    err = send_file_range(req, file, 0, range.header_len);
+    if (err == ESP_OK) {
+        err = send_file_range(req, file, range.start, range.end);
+    }
+    fclose(file);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Range of %s not sent", filename);
+        return ESP_FAIL;
+    }
+    httpd_resp_send_chunk(req, NULL, 0);
+    ESP_LOGI(TAG, "Sent %llu of %s from record %lu", range.header_len + range.end - range.start, filename,
+             range.first_record);
+    return ESP_OK;
+}
+
 esp_err_t get_esp32_time_handler(httpd_req_t *req) {
     time_t now;
     struct tm timeinfo;
@@ -1343,6 +1687,106 @@ esp_err_t get_esp32_time_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+esp_err_t trace_get_handler(httpd_req_t *req) {
+    httpd_resp_set_type(req, "text/csv");
+    if (CONFIG_SNIFFER_TRACE_LEN == 0) {
+        // Tracing compiled out, only the header
+        return httpd_resp_sendstr(req, "timestamp_us,event,arg0,arg1\n");
+    }
+
+    trace_entry_t *entries = malloc(CONFIG_SNIFFER_TRACE_LEN * sizeof(trace_entry_t));
+    if (!entries) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    uint32_t count = sniffer_trace_snapshot(entries, CONFIG_SNIFFER_TRACE_LEN);
+
+    httpd_resp_sendstr_chunk(req, "timestamp_us,event,arg0,arg1\n");
+
+    char line[64];
+    for (uint32_t i = 0; i < count; i++) {
+        snprintf(line, sizeof(line), "%lu,%s,%ld,%lu\n", entries[i].timestamp,
+                 sniffer_trace_event_name(entries[i].event), (int32_t)entries[i].arg0, entries[i].arg1);
+        if (httpd_resp_sendstr_chunk(req, line) != ESP_OK) {
+            free(entries);
+            return ESP_FAIL;
+        }
+    }
+
+    free(entries);
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+static void add_latency_to_json(cJSON *parent, const latency_histogram_t *hist) {
+    cJSON *latency = cJSON_AddObjectToObject(parent, "sd_write_latency_us");
+    cJSON *buckets = cJSON_AddArrayToObject(latency, "buckets");
+
+    for (int i = 0; i < CAPTURE_STATS_LATENCY_BUCKETS; i++) {
+        cJSON *bucket = cJSON_CreateObject();
+        uint32_t bound = latency_histogram_bound_us(i);
+        if (bound == UINT32_MAX) {
+            cJSON_AddNullToObject(bucket, "lt");
+        } else {
+            cJSON_AddNumberToObject(bucket, "lt", bound);
+        }
+        cJSON_AddNumberToObject(bucket, "count", hist->counts[i]);
+        cJSON_AddItemToArray(buckets, bucket);
+    }
+    cJSON_AddNumberToObject(latency, "samples", hist->samples);
+    cJSON_AddNumberToObject(latency, "mean", hist->samples ? (double)hist->total_us / hist->samples : 0);
+    cJSON_AddNumberToObject(latency, "p50", latency_histogram_percentile(hist, 500));
+    cJSON_AddNumberToObject(latency, "p99", latency_histogram_percentile(hist, 990));
+    cJSON_AddNumberToObject(latency, "max", hist->max_us);
+}
+
+esp_err_t capture_stats_get_handler(httpd_req_t *req) {
+    capture_stats_t stats;
+    sniffer_get_capture_stats(&stats);
+
+    cJSON *root = cJSON_CreateObject();
+    if (!root) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    cJSON_AddNumberToObject(root, "duration_s", stats.duration_s);
+    cJSON_AddNumberToObject(root, "frames_seen", stats.frames_seen);
+    cJSON_AddNumberToObject(root, "filtered", stats.filtered);
+    cJSON_AddNumberToObject(root, "accepted", stats.accepted);
+    cJSON_AddNumberToObject(root, "queue_drops", stats.queue_drops);
+    cJSON_AddNumberToObject(root, "alloc_failures", stats.alloc_failures);
+    cJSON_AddNumberToObject(root, "csv_records", stats.csv_records);
+    cJSON_AddNumberToObject(root, "pcap_records", stats.pcap_records);
+    cJSON_AddNumberToObject(root, "write_errors", stats.write_errors);
+    cJSON_AddNumberToObject(root, "bytes_written", (double)stats.bytes_written);
+    cJSON_AddNumberToObject(root, "work_queue_max_depth", stats.work_queue_max_depth);
+    cJSON_AddNumberToObject(root, "work_queue_capacity", stats.work_queue_capacity);
+    cJSON_AddNumberToObject(root, "write_queue_max_depth", stats.write_queue_max_depth);
+    cJSON_AddNumberToObject(root, "write_queue_capacity", stats.write_queue_capacity);
+    cJSON_AddNumberToObject(root, "write_stalls", stats.write_stalls);
+    cJSON_AddStringToObject(root, "shed_mode", load_shed_mode_name(stats.shed_mode));
+    cJSON_AddNumberToObject(root, "shed_transitions", stats.shed_transitions);
+    cJSON_AddNumberToObject(root, "pcap_shed", stats.pcap_shed);
+    cJSON_AddNumberToObject(root, "csv_shed", stats.csv_shed);
+    cJSON_AddNumberToObject(root, "storage_stalls", stats.storage_stalls);
+    cJSON_AddNumberToObject(root, "storage_blocked_ms", (double)(stats.storage_blocked_us / 1000));
+    add_latency_to_json(root, &stats.sd_latency);
+
+    char *json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json_str) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, json_str);
+    free(json_str);
+    return ESP_OK;
+}
+
 esp_err_t stop_server_handler(httpd_req_t *req) {
     
     const char* response_html = 
@@ -1456,18 +1900,20 @@ const char *get_content_type(const char *filename) {
     if (strcmp(ext, ".pdf") == 0) return "application/pdf";
     if (strcmp(ext, ".csv") == 0) return "text/csv";
     if (strcmp(ext, ".zip") == 0) return "application/zip";
+    if (strcmp(ext, ".gz") == 0) return "application/gzip";
     return "application/octet-stream";
 }
 
 httpd_handle_t start_webserver(void) {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.stack_size = 8192;
-    config.max_uri_handlers = 18; // Increased from 17 to accommodate new handler
+    config.max_uri_handlers = 20; // Increased from 19 to accommodate new handler
 
     if (httpd_start(&server_handle, &config) == ESP_OK) {
         httpd_register_uri_handler(server_handle, &(httpd_uri_t){.uri = "/", .method = HTTP_GET, .handler = root_get_handler, .user_ctx = NULL});
         httpd_register_uri_handler(server_handle, &(httpd_uri_t){.uri = "/browse_sd", .method = HTTP_GET, .handler = browse_sd_get_handler, .user_ctx = NULL});
         httpd_register_uri_handler(server_handle, &(httpd_uri_t){.uri = "/download", .method = HTTP_GET, .handler = download_file_handler, .user_ctx = NULL});
+        httpd_register_uri_handler(server_handle, &(httpd_uri_t){.uri = "/pcap_range", .method = HTTP_GET, .handler = pcap_range_handler, .user_ctx = NULL});
         httpd_register_uri_handler(server_handle, &(httpd_uri_t){.uri = "/delete_file", .method = HTTP_GET, .handler = delete_file_handler, .user_ctx = NULL});
         httpd_register_uri_handler(server_handle, &(httpd_uri_t){.uri = "/settings", .method = HTTP_GET, .handler = settings_get_handler, .user_ctx = NULL});
         httpd_register_uri_handler(server_handle, &(httpd_uri_t){.uri = "/sync_time", .method = HTTP_GET, .handler = sync_time_handler, .user_ctx = NULL});
@@ -1481,6 +1927,8 @@ httpd_handle_t start_webserver(void) {
         httpd_register_uri_handler(server_handle, &(httpd_uri_t){.uri = "/battery_status", .method = HTTP_GET, .handler = battery_status_handler, .user_ctx = NULL});
         httpd_register_uri_handler(server_handle, &(httpd_uri_t){.uri = "/set_server_wifi", .method = HTTP_GET, .handler = set_server_wifi_handler, .user_ctx = NULL});
         httpd_register_uri_handler(server_handle, &(httpd_uri_t){.uri = "/create_zip", .method = HTTP_GET, .handler = create_zip_get_handler, .user_ctx = NULL});
+        httpd_register_uri_handler(server_handle, &(httpd_uri_t){.uri = "/trace", .method = HTTP_GET, .handler = trace_get_handler, .user_ctx = NULL});
+        httpd_register_uri_handler(server_handle, &(httpd_uri_t){.uri = "/api/capture_stats", .method = HTTP_GET, .handler = capture_stats_get_handler, .user_ctx = NULL});
 
         ESP_LOGI(TAG, "Webserver started successfully.");
         return server_handle;
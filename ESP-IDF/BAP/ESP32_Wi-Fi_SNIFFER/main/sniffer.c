@@ -30,6 +30,21 @@
 #include "display_queue.h"
 #include "driver/gpio.h"
 #include "battery.h"
+#include "packet_pool.h"
+#include "spsc_ring.h"
+#include "probe_record.h"
+#include "trace_ring.h"
+#include "packet_filter.h"
+#include "burst_coalescer.h"
+#include "rx_clock.h"
+#include "capture_stats.h"
+#include "reduced_record.h"
+#include "load_shed.h"
+#include "storage_writer.h"
+#include "text_format.h"
+#include "record_sink.h"
+#include "live_sink.h"
+#include "esp_timer.h"
 
 #define SNIFFER_PAYLOAD_FCS_LEN             (4)
 #define SNIFFER_PROCESS_PACKET_TIMEOUT_MS   (100)
@@ -38,18 +53,34 @@
 #define UPDATE_INTERVAL_MS                  1000
 
 #define HEARTBEAT_MAC_ADDR {0x00, 0x00, 0x00, 0x00, 0x00, 0x00}
+#define HEARTBEAT_STATS_IE_ID 221               // Vendor specific
+#define HEARTBEAT_STATS_IE_HEADER_LEN 6         // id, length, OUI, OUI type
+#define HEARTBEAT_STATS_MAX_LEN (255 - 4)
 #define HEARTBEAT_INTERVAL_MS 300000  // 5 minutes in milliseconds
 #define BATTERY_INTERVAL_MS 300000  //5 minutes in milliseconds
 
+// Per packet logging, compiled out unless CONFIG_SNIFFER_HOT_LOG_LEVEL asks for it
+#if CONFIG_SNIFFER_HOT_LOG_LEVEL >= 1
+#define HOT_LOGW(tag, format, ...) ESP_LOGW(tag, format, ##__VA_ARGS__)
+#else
+#define HOT_LOGW(tag, format, ...) do { } while (0)
+#endif
+
+#if CONFIG_SNIFFER_HOT_LOG_LEVEL >= 2
+#define HOT_LOGI(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+#else
+#define HOT_LOGI(tag, format, ...) do { } while (0)
+#endif
+
 static uint8_t heartbeat_mac[6] = HEARTBEAT_MAC_ADDR;
 static uint32_t heartbeat_interval_ms = HEARTBEAT_INTERVAL_MS;
 static TickType_t last_heartbeat_time = 0;
 static TickType_t last_battery_time = 0;
 
 static const char *SNIFFER_TAG = "sniffer";
-static char filename[CONFIG_FATFS_MAX_LFN];
 
 #if CONFIG_SNIFFER_USE_MAC_FILTER
+// Seeds the allow list of the default filter when settings.json has no "filter" section
 static const uint8_t filter_mac[6] = {CONFIG_SNIFFER_MAC_FILTER_B1, 
                                       CONFIG_SNIFFER_MAC_FILTER_B2, 
                                       CONFIG_SNIFFER_MAC_FILTER_B3, 
@@ -63,26 +94,110 @@ int max_request_rank = TOP_REQUESTS_COUNT/2;
 int rssi_ranges[10] = {0};
 int clear_time_threshold = 30;
 bool display_battery_data = true;
+bool save_pcap = CONFIG_SNIFFER_SAVE_PCAP;
+bool coalesce_bursts = CONFIG_SNIFFER_COALESCE_BURSTS;
+bool reduced_binary = CONFIG_REDUCED_BINARY;
+uint32_t csv_flush_records = CONFIG_CSV_FLUSH_RECORDS;
+uint32_t csv_flush_ms = CONFIG_CSV_FLUSH_MS;
+
+typedef struct {
+    uint32_t items;
+    uint64_t busy_us;
+} sniffer_stage_counter_t;
+
+// Owned by the writer task, other tasks only read them
+typedef struct {
+    uint32_t csv_records;
+    uint32_t pcap_records;
+    uint32_t write_errors;
+    uint64_t bytes_written;
+} sniffer_write_counters_t;
 
 typedef struct {
     bool is_running;
     sniffer_intf_t interf;
     uint32_t interf_num;
     uint32_t channel;
-    TaskHandle_t task;
-    QueueHandle_t work_queue;
+    TaskHandle_t task;              // Stats stage, drains work_ring
+    TaskHandle_t writer_task;       // Storage stage, drains write_ring
+    spsc_ring_t work_ring;          // Callback -> stats stage
+    spsc_ring_t write_ring;         // Stats stage -> storage stage
+    atomic_bool writer_stop;        // Set by the stats stage after its last push
     SemaphoreHandle_t sem_task_over;
+    packet_pool_t pool;
+    packet_pool_t large_pool;       // A few slots for frames that do not fit the pool
+    burst_coalescer_t coalescer;
+    sniffer_stage_counter_t stages[SNIFFER_STAGE_COUNT];
+    sniffer_write_counters_t written;
+    storage_writer_t *storage;      // Owns the files, the writer task only fills blocks
+    uint32_t sinks;                 // Opened for this capture, a bit per record_sink id
+    uint32_t stats_sinks;           // Run on the stats stage with every accepted record
+    uint32_t storage_sinks;         // Run on the writer task, shed under load
+    uint32_t payload_sinks;         // Storage sinks that need the full frame in a pool slot
+    uint32_t burst_sinks;           // Storage sinks that take closed bursts while coalescing
+    uint32_t marker_sinks;          // Storage sinks that take heartbeats and output mode changes
+    int64_t start_us;
+    load_shed_t shed;               // Output mode, updated by the stats stage
+    uint32_t pcap_shed;             // Counted by the stats stage, like csv_shed, so ring drops are not counted twice
+    uint32_t csv_shed;
 } sniffer_runtime_t;
 
 static sniffer_runtime_t snf_rt = {0};
+static capture_stats_t last_capture_stats;  // Counters of the last capture, served while the sniffer is stopped
+static void sniffer_collect_capture_stats(capture_stats_t *stats);
+static const load_shed_config_t shed_config = {
+    .csv_only_pct = CONFIG_SNIFFER_SHED_CSV_ONLY_PCT,
+    .stats_only_pct = CONFIG_SNIFFER_SHED_STATS_ONLY_PCT,
+    .resume_pct = CONFIG_SNIFFER_SHED_RESUME_PCT,
+    .hold_us = CONFIG_SNIFFER_SHED_HOLD_MS * 1000,
+};
+static trace_ring_t trace = {0};
+static packet_filter_t filter;
+static bool filter_initialized = false;
+static bool sinks_registered = false;
+
+typedef enum {
+    CLOCK_SYNC_NONE = 0,
+    CLOCK_SYNC_SOFT,        // Drift sample, the wall clock has not been set
+    CLOCK_SYNC_STEP,        // Capture start or the wall clock was set
+} clock_sync_t;
+
+// Only touched from the Wi-Fi callback, other tasks ask for a sync through clock_sync_request
+static rx_clock_t rx_clock;
+static atomic_int clock_sync_request = CLOCK_SYNC_STEP;
 
 typedef struct {
-    void *payload;
+    probe_record_t record;  // Parsed once by the callback, every sink is served from it
+    void *payload;          // Pool slot with the full frame, NULL without a sink that needs it
     uint32_t length;
-    uint32_t seconds;
-    uint32_t microseconds;
 } sniffer_packet_info_t;
 
+typedef enum {
+    WRITE_JOB_PACKET = 0,   // Record and frame of one accepted frame for the storage sinks
+    WRITE_JOB_BURST,        // A closed burst for the sinks with RECORD_SINK_CAP_BURSTS
+    WRITE_JOB_HEARTBEAT,
+    WRITE_JOB_BATTERY,
+    WRITE_JOB_MARKER,       // Output mode change for the sinks with RECORD_SINK_CAP_MARKERS
+} write_job_type_t;
+
+typedef struct {
+    uint8_t from;           // load_shed_mode_t
+    uint8_t to;
+    uint32_t depth;         // Queue occupancy that caused the change
+    uint32_t capacity;
+} mode_marker_t;
+
+// Work handed from the stats stage to the storage stage, which owns every SD write
+typedef struct {
+    uint8_t type;           // write_job_type_t
+    uint8_t sinks;          // WRITE_JOB_PACKET, WRITE_JOB_BURST: storage sinks to hand it to, the slot is released either way
+    union {
+        sniffer_packet_info_t packet;
+        burst_t burst;
+        mode_marker_t marker;
+    };
+} write_job_t;
+
 typedef struct {
 	int16_t frame_ctrl;
 	int16_t duration;
@@ -100,23 +215,27 @@ void init_top_requests() {
     
     for (int i = 0; i < TOP_REQUESTS_COUNT; i++) {
         top_requests[i].rssi = -101;  // Initialize with a very low RSSI value
-        memset(top_requests[i].mac_address, 0, sizeof(top_requests[i].mac_address));
+        memset(top_requests[i].mac, 0, sizeof(top_requests[i].mac));
         top_requests[i].timestamp = 0;
     }
 }
 
-static wifi_promiscuous_pkt_t* create_heartbeat_packet(void)
+static wifi_promiscuous_pkt_t* create_heartbeat_packet(const char *stats, uint32_t *length)
 {
-    // Allocate memory for a synthetic packet
-    wifi_promiscuous_pkt_t* pkt = malloc(sizeof(wifi_promiscuous_pkt_t) + sizeof(packet_control_header_t));
+    size_t stats_len = strnlen(stats, HEARTBEAT_STATS_MAX_LEN);
+    uint32_t frame_len = sizeof(packet_control_header_t) + HEARTBEAT_STATS_IE_HEADER_LEN + stats_len;
+
+    // Allocate memory for a synthetic packet, zeroed so unused header fields are stable
+    wifi_promiscuous_pkt_t* pkt = calloc(1, sizeof(wifi_promiscuous_pkt_t) + frame_len + SNIFFER_PAYLOAD_FCS_LEN);
     if (pkt == NULL) {
         ESP_LOGE(SNIFFER_TAG, "Failed to allocate memory for heartbeat packet");
         return NULL;
     }
     
-    // Fill the rx_ctrl structure
-    pkt->rx_ctrl.sig_len = sizeof(packet_control_header_t);
+    // Fill the rx_ctrl structure, sig_len counts the FCS like a received frame
+    pkt->rx_ctrl.sig_len = frame_len + SNIFFER_PAYLOAD_FCS_LEN;
     pkt->rx_ctrl.rssi = -1;  // Special RSSI value for heartbeat packets
+    pkt->rx_ctrl.channel = snf_rt.channel;
     
     // Create a fake probe request header
     packet_control_header_t* hdr = (packet_control_header_t*)pkt->payload;
@@ -126,59 +245,425 @@ static wifi_promiscuous_pkt_t* create_heartbeat_packet(void)
     
     // Set MAC address to the heartbeat MAC
     memcpy(hdr->addr2, heartbeat_mac, 6);
-    
+
+    // Capture counters as text in a vendor specific element, shown by Wireshark and kept by pcap_ies_only
+    uint8_t *ie = hdr->payload;
+    ie[0] = HEARTBEAT_STATS_IE_ID;
+    ie[1] = HEARTBEAT_STATS_IE_HEADER_LEN - 2 + stats_len;
+    ie[2] = PCAP_STATS_IE_OUI_0;
+    ie[3] = PCAP_STATS_IE_OUI_1;
+    ie[4] = PCAP_STATS_IE_OUI_2;
+    ie[5] = PCAP_STATS_IE_TYPE;
+    memcpy(ie + HEARTBEAT_STATS_IE_HEADER_LEN, stats, stats_len);
+
+    *length = sizeof(wifi_promiscuous_pkt_t) + frame_len;
     return pkt;
 }
 
-static esp_err_t write_heartbeat_packet(void)
+// pcapng note "label: text" in a Custom Block, takes the place of the heartbeat frame
+static void write_marker_note(const char *label, const char *text, const struct timeval *tv)
 {
-    esp_err_t ret = ESP_OK;
-    struct timeval tv;
-    time_t current_time;
-    struct tm* timeinfo;
-    char str_buf[64];
-    
-    FILE *file;
+    char note[HEARTBEAT_STATS_MAX_LEN + 32];
+
+    snprintf(note, sizeof(note), "%s: %s", label, text);
+    uint64_t pcap_bytes = packet_capture_bytes();
+    if (packet_capture_note(note, tv->tv_sec, tv->tv_usec) != ESP_OK) {
+        ESP_LOGW(SNIFFER_TAG, "Save %s note in pcapng failed", label);
+    }
+    snf_rt.written.bytes_written += packet_capture_bytes() - pcap_bytes;
+}
 
-    file = fopen(filename, "a");
-    if (file == NULL) {
-        ESP_LOGE(SNIFFER_TAG, "Failed to open file for writing heartbeat packet");
+// Interface Statistics Block with the counters since sniffer_start()
+static void write_interface_stats(const capture_stats_t *stats, const struct timeval *tv)
+{
+    uint64_t now_us = (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+    pcap_if_stats_t if_stats = {
+        .start_us = now_us - (esp_timer_get_time() - snf_rt.start_us),
+        .received = stats->frames_seen,
+        .dropped = stats->queue_drops + stats->alloc_failures,   // Pool failures are only missing from the pcap
+        .accepted = stats->accepted,
+        .shed = stats->pcap_shed,
+        .delivered = stats->pcap_records,
+    };
+    uint64_t pcap_bytes = packet_capture_bytes();
+    if (packet_capture_stats(&if_stats, tv->tv_sec, tv->tv_usec) != ESP_OK) {
+        ESP_LOGW(SNIFFER_TAG, "Save interface statistics in pcapng failed");
+    }
+    snf_rt.written.bytes_written += packet_capture_bytes() - pcap_bytes;
+}
+
+// Count one CSV or pcap record handed to the storage task, SD latency is measured there per block
+static esp_err_t sniffer_count_write(esp_err_t err, uint32_t *records)
+{
+    if (err == ESP_OK)
+    {
+        (*records)++;
+    }
+    else
+    {
+        snf_rt.written.write_errors++;
+    }
+    return err;
+}
+
+// Reduced file of the csv or binary sink, used by the writer task only
+typedef struct {
+    bool binary;                    // 24 byte records instead of CSV lines
+    const char *file;
+    storage_stream_t stream;        // Open for the whole capture, only the storage task writes and closes it
+    uint32_t unflushed;             // Records in stream not handed to the storage task
+    text_time_cache_t time;         // Time text of the last CSV line
+} reduced_output_t;
+
+static reduced_output_t csv_output = { .binary = false, .file = CONFIG_OUTPUT_FILE };
+static reduced_output_t bin_output = { .binary = true, .file = CONFIG_REDUCED_BIN_FILE };
+
+// One line or record of a reduced file, handed to the storage task every csv_flush_records records
+static esp_err_t reduced_output_write(reduced_output_t *out, const void *data, uint32_t len)
+{
+    if (storage_stream_write(&out->stream, data, len, esp_timer_get_time()) != ESP_OK)
+    {
         return ESP_FAIL;
     }
+    snf_rt.written.bytes_written += len;
+    if (csv_flush_records && ++out->unflushed >= csv_flush_records)
+    {
+        storage_stream_flush(&out->stream);
+        out->unflushed = 0;
+    }
+    return ESP_OK;
+}
 
-    gettimeofday(&tv, NULL);
-    current_time = tv.tv_sec;
-    timeinfo = localtime(&current_time);
-    strftime(str_buf, sizeof(str_buf), "%c", timeinfo);
+// Appends ", " and returns the new length
+static size_t put_separator(char *line, size_t len)
+{
+    line[len] = ',';
+    line[len + 1] = ' ';
+    return len + 2;
+}
+
+static esp_err_t reduced_output_packet(reduced_output_t *out, const probe_record_t *record)
+{
+    char line[96];
+
+    if (out->binary)
+    {
+        reduced_record_t binary;
+        reduced_record_from_probe(&binary, record);
+        return reduced_output_write(out, &binary, sizeof(binary));
+    }
+
+    // Time, MAC, RSSI, the time text is only rendered again when the second changes
+    size_t written = text_format_time(&out->time, record->timestamp_us, 0, line);
+    written = put_separator(line, written);
+    written += text_format_mac(line + written, record->addr2);
+    written = put_separator(line, written);
+    written += text_format_int(line + written, record->rssi);
+    line[written++] = '\n';
+    return reduced_output_write(out, line, written);
+}
 
-    // Write heartbeat packet: Time, MAC (00:00:00:00:00:00), RSSI (using -1 as a marker for heartbeat)
-    fprintf(file, "%s, %02X:%02X:%02X:%02X:%02X:%02X, %d [HEARTBEAT]\n", 
+static esp_err_t reduced_output_burst(reduced_output_t *out, const burst_t *burst)
+{
+    char line[160];
+
+    if (out->binary)
+    {
+        reduced_record_t binary;
+        reduced_record_from_burst(&binary, burst);
+        return reduced_output_write(out, &binary, sizeof(binary));
+    }
+
+    // Time, MAC, RSSI as in the per packet format (strongest RSSI), then count, weakest RSSI, first and last timestamp
+    size_t written = text_format_time(&out->time, burst->first.timestamp_us, 0, line);
+    written = put_separator(line, written);
+    written += text_format_mac(line + written, burst->first.addr2);
+    written = put_separator(line, written);
+    written += text_format_int(line + written, burst->rssi_max);
+    written = put_separator(line, written);
+    written += text_format_int(line + written, burst->count);
+    written = put_separator(line, written);
+    written += text_format_int(line + written, burst->rssi_min);
+    written = put_separator(line, written);
+    written += text_format_epoch_us(line + written, burst->first.timestamp_us);
+    written = put_separator(line, written);
+    written += text_format_epoch_us(line + written, burst->last_us);
+    line[written++] = '\n';
+    return reduced_output_write(out, line, written);
+}
+
+// CSV line from the heartbeat MAC with the label next to the -1 RSSI, the binary file gets a record of type with arg
+static esp_err_t reduced_output_marker(reduced_output_t *out, const record_sink_marker_t *marker)
+{
+    char str_buf[TEXT_FORMAT_TIME_MAX];
+    char line[128];
+
+    if (out->binary)
+    {
+        reduced_record_t record;
+        reduced_record_marker(&record, marker->type, heartbeat_mac, marker->timestamp_us, marker->arg);
+        return reduced_output_write(out, &record, sizeof(record));
+    }
+
+    text_format_time(&out->time, marker->timestamp_us, 0, str_buf);
+    // Time, MAC (00:00:00:00:00:00), RSSI (using -1 as a marker for sniffer records)
+    int written = snprintf(line, sizeof(line), "%s, %02X:%02X:%02X:%02X:%02X:%02X, %d [%s]\n", 
             str_buf, 
             heartbeat_mac[0], heartbeat_mac[1], heartbeat_mac[2],
             heartbeat_mac[3], heartbeat_mac[4], heartbeat_mac[5],
-            -1);
-    
-    fclose(file);
-    
+            -1, marker->label);
+    if (written >= (int)sizeof(line)) {
+        written = sizeof(line) - 1;
+        line[written - 1] = '\n';
+    }
+    return reduced_output_write(out, line, written);
+}
+
+static esp_err_t reduced_sink_open(record_sink_t *sink)
+{
+    reduced_output_t *out = sink->ctx;
+    char path[CONFIG_FATFS_MAX_LFN];
+    FILE *file;
+
+    snprintf(path, sizeof(path), CONFIG_SD_MOUNT_POINT "/%s", out->file);
+    out->unflushed = 0;
+    text_time_cache_init(&out->time);
+    if (out->binary)
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        file = reduced_record_open(path, (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec);
+    }
+    else
+    {
+        file = fopen(path, "a");
+    }
+    if (file == NULL)
+    {
+        /* Capture anyway, every record then counts as a write error */
+        ESP_LOGE(SNIFFER_TAG, "Failed to open %s for writing", path);
+        return ESP_OK;
+    }
+    setvbuf(file, NULL, _IONBF, 0);
+    storage_stream_open(&out->stream, snf_rt.storage, file);
+    return ESP_OK;
+}
+
+static uint32_t reduced_sink_write_batch(record_sink_t *sink, const record_sink_item_t *items, uint32_t count)
+{
+    reduced_output_t *out = sink->ctx;
+    uint32_t written = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const record_sink_item_t *item = &items[i];
+        esp_err_t err;
+
+        switch (item->type)
+        {
+            case RECORD_SINK_ITEM_PACKET:
+                err = sniffer_count_write(reduced_output_packet(out, item->packet.record),
+                                          &snf_rt.written.csv_records);
+                if (err != ESP_OK)
+                {
+                    sniffer_trace(SNIFFER_TRACE_WRITE_FAIL, 0, 0);
+                    HOT_LOGW(SNIFFER_TAG, "Save captured packet in reduced format failed");
+                }
+                break;
+            case RECORD_SINK_ITEM_BURST:
+                err = sniffer_count_write(reduced_output_burst(out, item->burst), &snf_rt.written.csv_records);
+                if (err != ESP_OK)
+                {
+                    sniffer_trace(SNIFFER_TRACE_WRITE_FAIL, 0, 0);
+                }
+                break;
+            default:
+                err = reduced_output_marker(out, item->marker);
+                if (err != ESP_OK)
+                {
+                    ESP_LOGE(SNIFFER_TAG, "No %s file for the %s marker", sink->name, item->marker->label);
+                }
+                break;
+        }
+        written += err == ESP_OK;
+    }
+    return written;
+}
+
+// Records wait in a RAM block until it fills, hand them to the storage task once the oldest is csv_flush_ms old
+static void reduced_sink_flush(record_sink_t *sink, int64_t now_us)
+{
+    reduced_output_t *out = sink->ctx;
+
+    if (storage_stream_flush_due(&out->stream, now_us, (int64_t)csv_flush_ms * 1000))
+    {
+        out->unflushed = 0;
+    }
+}
+
+// The file is complete once the storage task synced and closed it
+static void reduced_sink_close(record_sink_t *sink)
+{
+    reduced_output_t *out = sink->ctx;
+
+    storage_stream_sync(&out->stream);
+    storage_stream_close(&out->stream);
+}
+
+// pcapng note or a frame from the heartbeat MAC with the text in a vendor IE, a heartbeat adds the counters in pcapng
+static void pcap_sink_marker(const record_sink_marker_t *marker)
+{
+    struct timeval tv = {
+        .tv_sec = marker->timestamp_us / 1000000,
+        .tv_usec = marker->timestamp_us % 1000000,
+    };
+    uint32_t pkt_len;
+
+    if (packet_capture_is_pcapng()) {
+        write_marker_note(marker->label, marker->text, &tv);
+        if (marker->stats) {
+            write_interface_stats(marker->stats, &tv);
+        }
+        return;
+    }
+
     // Create a synthetic packet for PCAP capture
-    wifi_promiscuous_pkt_t* pkt = create_heartbeat_packet();
+    wifi_promiscuous_pkt_t* pkt = create_heartbeat_packet(marker->text, &pkt_len);
     if (pkt != NULL) {
-        // Create packet info for PCAP capture
-        sniffer_packet_info_t packet_info;
-        packet_info.seconds = tv.tv_sec;
-        packet_info.microseconds = tv.tv_usec;
-        packet_info.length = sizeof(wifi_promiscuous_pkt_t) + sizeof(packet_control_header_t);
-        packet_info.payload = pkt;
-        
         // Save to PCAP file
-        if (packet_capture(packet_info.payload, packet_info.length, packet_info.seconds, packet_info.microseconds) != ESP_OK) {
-            ESP_LOGW(SNIFFER_TAG, "Save heartbeat packet in pcap format failed");
+        uint64_t pcap_bytes = packet_capture_bytes();
+        if (packet_capture(pkt, pkt_len, tv.tv_sec, tv.tv_usec) != ESP_OK) {
+            ESP_LOGW(SNIFFER_TAG, "Save %s marker in pcap format failed", marker->label);
         }
+        snf_rt.written.bytes_written += packet_capture_bytes() - pcap_bytes;
         
         free(pkt);
     }
+}
+
+static uint32_t pcap_sink_write_batch(record_sink_t *sink, const record_sink_item_t *items, uint32_t count)
+{
+    uint32_t written = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const record_sink_item_t *item = &items[i];
+
+        if (item->type == RECORD_SINK_ITEM_MARKER)
+        {
+            pcap_sink_marker(item->marker);
+            written++;
+            continue;
+        }
+
+        // Only frames with a pool slot are handed to this sink
+        uint64_t timestamp_us = item->packet.record->timestamp_us;
+        uint64_t pcap_bytes = packet_capture_bytes();
+        esp_err_t err = packet_capture(item->packet.payload, item->packet.length,
+                                       timestamp_us / 1000000, timestamp_us % 1000000);
+        snf_rt.written.bytes_written += packet_capture_bytes() - pcap_bytes;
+        if (sniffer_count_write(err, &snf_rt.written.pcap_records) != ESP_OK)
+        {
+            sniffer_trace(SNIFFER_TRACE_WRITE_FAIL, 1, 0);
+            HOT_LOGW(SNIFFER_TAG, "Save captured packet in pcap format failed");
+            continue;
+        }
+        written++;
+    }
+    return written;
+}
+
+static void pcap_sink_flush(record_sink_t *sink, int64_t now_us)
+{
+    packet_capture_flush_due(now_us);
+}
+
+// Final counters close the pcapng file, the writer task no longer touches it
+static void pcap_sink_close(record_sink_t *sink)
+{
+    if (packet_capture_is_pcapng())
+    {
+        capture_stats_t stats;
+        struct timeval tv;
+        sniffer_collect_capture_stats(&stats);
+        gettimeofday(&tv, NULL);
+        write_interface_stats(&stats, &tv);
+    }
+}
+
+// Heartbeats and output mode changes go to every sink that takes markers, in order with the records
+static void sniffer_write_marker(const record_sink_marker_t *marker)
+{
+    record_sink_item_t item = { .type = RECORD_SINK_ITEM_MARKER, .marker = marker };
+
+    for (uint32_t id = 0; id < RECORD_SINK_MAX; id++)
+    {
+        if (snf_rt.marker_sinks & 1u << id)
+        {
+            record_sink_write(record_sink_get(id), &item, 1);
+        }
+    }
+}
+
+static esp_err_t write_heartbeat_packet(void)
+{
+    esp_err_t ret = ESP_OK;
+    char stats_buf[HEARTBEAT_STATS_MAX_LEN + 1];
+    capture_stats_t stats;
+    struct timeval tv;
+
+    // The CSV heartbeat keeps its three columns for plotting.py, the counters go into the pcap heartbeat
+    sniffer_get_capture_stats(&stats);
+    capture_stats_format(&stats, stats_buf, sizeof(stats_buf));
+    gettimeofday(&tv, NULL);
+    record_sink_marker_t marker = {
+        .label = "HEARTBEAT",
+        .text = stats_buf,
+        .type = REDUCED_RECORD_HEARTBEAT,
+        .timestamp_us = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec,
+        .stats = &stats,
+    };
+    sniffer_write_marker(&marker);
     
-    ESP_LOGI(SNIFFER_TAG, "Heartbeat packet written at %s", str_buf);
+    ESP_LOGI(SNIFFER_TAG, "Heartbeat packet written");
+    ESP_LOGI(SNIFFER_TAG, "Capture: %s", stats_buf);
+
+    uint32_t pool_exhausted = atomic_load(&snf_rt.pool.exhausted) + atomic_load(&snf_rt.large_pool.exhausted);
+    uint32_t pool_oversize = atomic_load(&snf_rt.large_pool.oversize);
+    sniffer_trace(SNIFFER_TRACE_HEARTBEAT, pool_exhausted, atomic_load(&snf_rt.work_ring.dropped));
+    if (pool_exhausted || pool_oversize) {
+        ESP_LOGW(SNIFFER_TAG, "Packet pool: %lu exhausted, %lu oversize, peak %lu/%u slots, %lu/%u large",
+                 pool_exhausted, pool_oversize, (uint32_t)atomic_load(&snf_rt.pool.in_use_peak), snf_rt.pool.slot_count,
+                 (uint32_t)atomic_load(&snf_rt.large_pool.in_use_peak), snf_rt.large_pool.slot_count);
+    }
+
+    ESP_LOGI(SNIFFER_TAG, "Filter: %lu passed, dropped %lu subtype, %lu short, %lu rssi, %lu deny_mac, %lu deny_oui, %lu allow, %lu random, %lu ssid",
+             (uint32_t)atomic_load(&filter.passed),
+             (uint32_t)atomic_load(&filter.hits[PACKET_FILTER_RULE_SUBTYPE]),
+             (uint32_t)atomic_load(&filter.hits[PACKET_FILTER_RULE_SHORT]),
+             (uint32_t)atomic_load(&filter.hits[PACKET_FILTER_RULE_RSSI]),
+             (uint32_t)atomic_load(&filter.hits[PACKET_FILTER_RULE_DENY_MAC]),
+             (uint32_t)atomic_load(&filter.hits[PACKET_FILTER_RULE_DENY_OUI]),
+             (uint32_t)atomic_load(&filter.hits[PACKET_FILTER_RULE_ALLOW]),
+             (uint32_t)atomic_load(&filter.hits[PACKET_FILTER_RULE_RANDOM_MAC]),
+             (uint32_t)atomic_load(&filter.hits[PACKET_FILTER_RULE_SSID]));
+
+    uint32_t ring_dropped = atomic_load(&snf_rt.work_ring.dropped);
+    if (ring_dropped) {
+        ESP_LOGW(SNIFFER_TAG, "Work ring: %lu dropped, high water %lu/%lu",
+                 ring_dropped, (uint32_t)atomic_load(&snf_rt.work_ring.high_water), snf_rt.work_ring.capacity);
+    }
+
+    ESP_LOGI(SNIFFER_TAG, "Clock: %lu syncs, drift %ld ppb, last error %ld us",
+             rx_clock.syncs, rx_clock.drift_ppb, rx_clock.last_error_us);
+
+    sniffer_stage_stats_t stages[SNIFFER_STAGE_COUNT];
+    sniffer_get_stage_stats(stages);
+    for (int i = 0; i < SNIFFER_STAGE_COUNT; i++) {
+        ESP_LOGI(SNIFFER_TAG, "Stage %s: %lu items, %llu us busy, depth %lu/%lu, high water %lu, %lu dropped",
+                 stages[i].name, stages[i].items, stages[i].busy_us, stages[i].depth, stages[i].capacity,
+                 stages[i].high_water, stages[i].dropped);
+    }
     
     return ret;
 }
@@ -225,11 +710,11 @@ void update_rssi_ranges(int rssi) {
     } else if (rssi >= -100 && rssi <= -91) {
         rssi_ranges[9]++;  // Weakest signal
     } else {
-        ESP_LOGW(SNIFFER_TAG, "Received RSSI out of expected range: %d", rssi);
+        HOT_LOGW(SNIFFER_TAG, "Received RSSI out of expected range: %d", rssi);
     }
     
     // Debugging line to check the RSSI value and range count updates
-    ESP_LOGI(SNIFFER_TAG, "Updated RSSI range for %d, Range counts: %d %d %d %d %d %d %d %d %d %d", 
+    HOT_LOGI(SNIFFER_TAG, "Updated RSSI range for %d, Range counts: %d %d %d %d %d %d %d %d %d %d", 
              rssi, rssi_ranges[0], rssi_ranges[1], rssi_ranges[2], rssi_ranges[3], 
              rssi_ranges[4], rssi_ranges[5], rssi_ranges[6], rssi_ranges[7], 
              rssi_ranges[8], rssi_ranges[9]);
@@ -249,7 +734,7 @@ void clear_top_requests() {
     for (int i = 0; i < TOP_REQUESTS_COUNT; i++) {
         if (top_requests[i].timestamp > 0 && (current_time - top_requests[i].timestamp) > clear_time_threshold) {
             top_requests[i].rssi = -101;  // Reset RSSI to mark as empty
-            memset(top_requests[i].mac_address, 0, sizeof(top_requests[i].mac_address));  // Clear MAC address
+            memset(top_requests[i].mac, 0, sizeof(top_requests[i].mac));  // Clear MAC address
             top_requests[i].timestamp = 0;  // Reset timestamp
             // Sort the top_requests array by RSSI in descending order
             qsort(top_requests, TOP_REQUESTS_COUNT, sizeof(top_request_t), compare_rssi);
@@ -265,16 +750,10 @@ void clear_top_requests() {
 static void update_top_requests(int rssi, const uint8_t *mac_address, time_t timestamp) {
     int min_rssi_idx = 0;
     int duplicate_idx = -1;
-    char mac_address_str[18];  // Temporary string to store the formatted MAC address
 
-    // Convert `mac_address` (uint8_t array) to a string in XX:XX:XX:XX:XX:XX format
-    snprintf(mac_address_str, sizeof(mac_address_str), "%02X:%02X:%02X:%02X:%02X:%02X",
-             mac_address[0], mac_address[1], mac_address[2],
-             mac_address[3], mac_address[4], mac_address[5]);
-
-    // Check if the MAC address is already in the top_requests list
+    // Check if the MAC address is already in the top_requests list, compared as bytes and formatted only for display
     for (int i = 0; i < TOP_REQUESTS_COUNT; i++) {
-        if (strcmp(top_requests[i].mac_address, mac_address_str) == 0) {
+        if (memcmp(top_requests[i].mac, mac_address, sizeof(top_requests[i].mac)) == 0) {
             duplicate_idx = i;
             break;
         }
@@ -293,8 +772,10 @@ static void update_top_requests(int rssi, const uint8_t *mac_address, time_t tim
             qsort(top_requests, TOP_REQUESTS_COUNT, sizeof(top_request_t), compare_rssi);
 
             // Debug print to confirm update
-            ESP_LOGI("UPDATE_TOP_REQUESTS", "Updated existing entry %d: MAC %s, RSSI %d",
-                     duplicate_idx, mac_address_str, rssi);
+            sniffer_trace(SNIFFER_TRACE_TOP_UPDATE, duplicate_idx, rssi);
+            HOT_LOGI("UPDATE_TOP_REQUESTS", "Updated existing entry %d: MAC %02X:%02X:%02X:%02X:%02X:%02X, RSSI %d",
+                     duplicate_idx, mac_address[0], mac_address[1], mac_address[2], mac_address[3], mac_address[4],
+                     mac_address[5], rssi);
         }
         // If the RSSI is not stronger, do nothing
         return;
@@ -303,16 +784,17 @@ static void update_top_requests(int rssi, const uint8_t *mac_address, time_t tim
     // If it's not a duplicate and the RSSI is stronger than the lowest, replace the lowest entry
     if (rssi > top_requests[min_rssi_idx].rssi) {
         top_requests[min_rssi_idx].rssi = rssi;
-        strncpy(top_requests[min_rssi_idx].mac_address, mac_address_str, sizeof(top_requests[min_rssi_idx].mac_address) - 1);
-        top_requests[min_rssi_idx].mac_address[sizeof(top_requests[min_rssi_idx].mac_address) - 1] = '\0';
+        memcpy(top_requests[min_rssi_idx].mac, mac_address, sizeof(top_requests[min_rssi_idx].mac));
         top_requests[min_rssi_idx].timestamp = timestamp;
 
         // Sort the top_requests array by RSSI in descending order
         qsort(top_requests, TOP_REQUESTS_COUNT, sizeof(top_request_t), compare_rssi);
 
         // Debug print to confirm update
-        ESP_LOGI("UPDATE_TOP_REQUESTS", "Added new entry %d: MAC %s, RSSI %d",
-                 min_rssi_idx, mac_address_str, rssi);
+        sniffer_trace(SNIFFER_TRACE_TOP_UPDATE, min_rssi_idx, rssi);
+        HOT_LOGI("UPDATE_TOP_REQUESTS", "Added new entry %d: MAC %02X:%02X:%02X:%02X:%02X:%02X, RSSI %d",
+                 min_rssi_idx, mac_address[0], mac_address[1], mac_address[2], mac_address[3], mac_address[4],
+                 mac_address[5], rssi);
     }
 }
 
@@ -321,6 +803,13 @@ void display_top_requests_oled() {
         return;
     } 
 
+    #if CONFIG_SNIFFER_STATS_OLED_PAGE
+    if (request_index == SNIFFER_STATS_PAGE_INDEX) {
+        display_capture_stats_oled();
+        return;
+    }
+    #endif
+
     // Check if request_index is within valid bounds
     if (request_index < 1 || request_index > max_request_rank) {
         printf("Invalid request index: %d, setting to default\n", request_index);
@@ -365,6 +854,8 @@ void display_top_requests_oled() {
             struct tm *timeinfo = localtime(&top_requests[index_to_display].timestamp);
             char time_buf[64];
             strftime(time_buf, sizeof(time_buf), "%H:%M:%S", timeinfo);
+            char mac_str[TEXT_FORMAT_MAC_LEN + 1];
+            mac_str[text_format_mac(mac_str, top_requests[index_to_display].mac)] = '\0';
 
             char display_text[256];
             
@@ -373,15 +864,13 @@ void display_top_requests_oled() {
                 snprintf(display_text, sizeof(display_text),
                          "%u mV  %d mA\n(%d/%d) Top RSSI [%s]\nRSSI: %d\nTime: %s\n%s", 
                          volts, current, request_index, max_request_rank, disp_delay, 
-                         top_requests[index_to_display].rssi, time_buf, 
-                         top_requests[index_to_display].mac_address);
+                         top_requests[index_to_display].rssi, time_buf, mac_str);
             } else {
                 // Omit battery data
                 snprintf(display_text, sizeof(display_text),
                          "(%d/%d) Top RSSI [%s]\nRSSI: %d\nTime: %s\n%s",
                          request_index, max_request_rank, disp_delay, 
-                         top_requests[index_to_display].rssi, time_buf, 
-                         top_requests[index_to_display].mac_address);
+                         top_requests[index_to_display].rssi, time_buf, mac_str);
             }
                                 
             // Display the selected top request on the OLED
@@ -416,99 +905,204 @@ static void display_top_requests() {
             struct tm *timeinfo = localtime(&top_requests[i].timestamp);
             char time_buf[64];
             strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", timeinfo);
-            printf("Time: %s, MAC: %s, RSSI: %d\n", time_buf, top_requests[i].mac_address, top_requests[i].rssi);
+            char mac_str[TEXT_FORMAT_MAC_LEN + 1];
+            mac_str[text_format_mac(mac_str, top_requests[i].mac)] = '\0';
+            printf("Time: %s, MAC: %s, RSSI: %d\n", time_buf, mac_str, top_requests[i].rssi);
         }
     }
 }
 
+// Top requests and RSSI ranges behind the OLED and the console
+static uint32_t stats_sink_write_batch(record_sink_t *sink, const record_sink_item_t *items, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const probe_record_t *record = items[i].packet.record;
+
+        // Update top requests
+        update_top_requests(record->rssi, record->addr2, record->timestamp_us / 1000000);
+        // Update RSSI range counters
+        update_rssi_ranges(record->rssi);
+    }
+    return count;
+}
+
+static const record_sink_ops_t reduced_sink_ops = {
+    .open = reduced_sink_open,
+    .write_batch = reduced_sink_write_batch,
+    .flush = reduced_sink_flush,
+    .close = reduced_sink_close,
+};
+
+static const record_sink_ops_t pcap_sink_ops = {
+    .write_batch = pcap_sink_write_batch,
+    .flush = pcap_sink_flush,
+    .close = pcap_sink_close,
+};
+
+static const record_sink_ops_t stats_sink_ops = {
+    .write_batch = stats_sink_write_batch,
+};
+
+// Registered in this order, the reduced files are closed before the final pcapng counters are written
+static record_sink_t builtin_sinks[] = {
+    { .name = "csv", .caps = RECORD_SINK_CAP_STORAGE | RECORD_SINK_CAP_BURSTS | RECORD_SINK_CAP_MARKERS,
+      .ops = &reduced_sink_ops, .ctx = &csv_output },
+    { .name = "binary", .caps = RECORD_SINK_CAP_STORAGE | RECORD_SINK_CAP_BURSTS | RECORD_SINK_CAP_MARKERS,
+      .ops = &reduced_sink_ops, .ctx = &bin_output },
+    { .name = "pcap", .caps = RECORD_SINK_CAP_PAYLOAD | RECORD_SINK_CAP_STORAGE | RECORD_SINK_CAP_MARKERS,
+      .ops = &pcap_sink_ops },
+    { .name = "stats", .ops = &stats_sink_ops },
+};
+
+static void sniffer_register_sinks(void)
+{
+    for (size_t i = 0; i < sizeof(builtin_sinks) / sizeof(builtin_sinks[0]); i++)
+    {
+        ESP_ERROR_CHECK(record_sink_register(&builtin_sinks[i]));
+    }
+    ESP_ERROR_CHECK(record_sink_register(live_sink()));
+}
+
+// Sinks of the "sinks" list, or the ones save_pcap and reduced_binary stand for when settings.json has none
+static uint32_t sniffer_select_sinks(void)
+{
+    uint32_t sinks;
+
+    if (record_sink_selected(&sinks))
+    {
+        return sinks;
+    }
+    sinks = record_sink_bit(reduced_binary ? "binary" : "csv") | record_sink_bit("stats");
+    if (save_pcap)
+    {
+        sinks |= record_sink_bit("pcap");
+    }
+    return sinks;
+}
+
+// Most frames fit the pool, probe requests with long vendor or WPS IEs take one of the few large slots
+static void *sniffer_claim_payload(size_t length)
+{
+    return packet_pool_claim(length <= snf_rt.pool.slot_size ? &snf_rt.pool : &snf_rt.large_pool, length);
+}
+
+static void sniffer_release_payload(void *payload)
+{
+    packet_pool_release(packet_pool_owns(&snf_rt.pool, payload) ? &snf_rt.pool : &snf_rt.large_pool, payload);
+}
+
 static void queue_packet(void *recv_packet, sniffer_packet_info_t *packet_info)
 {
-    /* Copy a packet from Link Layer driver and queue the copy to be processed by sniffer task */
-    void *packet_to_queue = malloc(packet_info->length);
-    if (packet_to_queue)
+    /* Copy the full frame into a pool slot only when a sink of this capture needs it.
+     * Only the sniffer task may release slots, so none is claimed for a frame the full
+     * work ring would drop: this callback is its only producer, the push below then succeeds. */
+    packet_info->payload = NULL;
+    if (snf_rt.payload_sinks && load_shed_mode(&snf_rt.shed) == LOAD_SHED_FULL &&
+        spsc_ring_count(&snf_rt.work_ring) < snf_rt.work_ring.capacity)
     {
-        memcpy(packet_to_queue, recv_packet, packet_info->length);
-        packet_info->payload = packet_to_queue;
-        if (snf_rt.work_queue)
+        packet_info->payload = sniffer_claim_payload(packet_info->length);
+        if (packet_info->payload == NULL)
         {
-            /* send packet_info */
-            if (xQueueSend(snf_rt.work_queue, packet_info, pdMS_TO_TICKS(SNIFFER_PROCESS_PACKET_TIMEOUT_MS)) != pdTRUE)
-            {
-                ESP_LOGE(SNIFFER_TAG, "sniffer work queue full");
-                free(packet_info->payload);
-            }
+            // No free or large enough slot: only the pcap copy is lost, the record is queued like a shed frame
+            sniffer_trace(SNIFFER_TRACE_DROP, 0, spsc_ring_count(&snf_rt.work_ring));
+        }
+        else
+        {
+            memcpy(packet_info->payload, recv_packet, packet_info->length);
         }
     }
-    else
+
+    /* send packet_info, never wait for the sniffer task */
+    bool drained;
+    if (spsc_ring_push(&snf_rt.work_ring, packet_info, &drained) == 0)
     {
-        ESP_LOGE(SNIFFER_TAG, "No enough memory for promiscuous packet");
+        sniffer_trace(SNIFFER_TRACE_DROP, 1, snf_rt.work_ring.capacity);
     }
+    else if (drained)
+    {
+        // The ring was empty, so the sniffer task may be waiting for work
+        xTaskNotifyGive(snf_rt.task);
+    }
+    // Pool exhaustion and ring drops are only counted here, write_heartbeat_packet() reports them
 }
 
 // Function to process packets from sniffer callback and update RSSI ranges
 static void wifi_sniffer_cb(void *recv_buf, wifi_promiscuous_pkt_type_t type)
 {
-    struct timeval tv;
+    int64_t start_us = esp_timer_get_time();
     sniffer_packet_info_t packet_info;
     wifi_promiscuous_pkt_t *pkt = (wifi_promiscuous_pkt_t *)recv_buf;
-    packet_control_header_t *hdr = (packet_control_header_t *)pkt->payload;
-
-    int32_t fc = ntohs(hdr->frame_ctrl);
+    uint32_t frame_len = pkt->rx_ctrl.sig_len > SNIFFER_PAYLOAD_FCS_LEN ? pkt->rx_ctrl.sig_len - SNIFFER_PAYLOAD_FCS_LEN : 0;
 
-    // Check only for Probe requests
-    #if CONFIG_SNIFFER_USE_MAC_FILTER
-        if ((fc & 0xFF00) == 0x4000 && memcmp(hdr->addr2, filter_mac, 6) == 0)
-    #else
-        if ((fc & 0xFF00) == 0x4000)
-    #endif
+    // Every frame keeps the clock extension current, esp_timer only resolves wraps across long silences
+    uint64_t local_us = rx_clock_extend(&rx_clock, pkt->rx_ctrl.timestamp, start_us);
+    if (atomic_load_explicit(&clock_sync_request, memory_order_relaxed) != CLOCK_SYNC_NONE)
     {
+        // The only wall clock read of the capture path, once per requested sync
+        struct timeval tv;
+        int sync = atomic_exchange(&clock_sync_request, CLOCK_SYNC_NONE);
         gettimeofday(&tv, NULL);
+        rx_clock_sync(&rx_clock, local_us, (int64_t)tv.tv_sec * 1000000 + tv.tv_usec, sync == CLOCK_SYNC_STEP);
+    }
 
-        packet_info.seconds = tv.tv_sec;
-        packet_info.microseconds = tv.tv_usec;
-        packet_info.length = pkt->rx_ctrl.sig_len + sizeof(wifi_pkt_rx_ctrl_t);
-        packet_info.length -= SNIFFER_PAYLOAD_FCS_LEN;
+    // Drop unwanted frames before anything is parsed or copied, probe requests only by default
+    if (packet_filter_accept(&filter, pkt->payload, frame_len, pkt->rx_ctrl.rssi) &&
+        probe_record_parse(&packet_info.record, pkt->payload, frame_len))
+    {
+        // Every sink and the bursts use this one timestamp
+        packet_info.record.timestamp_us = rx_clock_to_wall(&rx_clock, local_us);
+        packet_info.record.rx_timestamp = pkt->rx_ctrl.timestamp;
+        packet_info.record.rssi = pkt->rx_ctrl.rssi;
+        packet_info.record.channel = pkt->rx_ctrl.channel;
+        packet_info.length = frame_len + sizeof(wifi_pkt_rx_ctrl_t);
+
+        sniffer_trace(SNIFFER_TRACE_RX, (uint32_t)packet_info.record.rssi, packet_info.record.seq);
+        HOT_LOGI("SNIFFER_CB", "Captured request with RSSI %d from MAC %02X:%02X:%02X:%02X:%02X:%02X",
+                 packet_info.record.rssi, packet_info.record.addr2[0], packet_info.record.addr2[1],
+                 packet_info.record.addr2[2], packet_info.record.addr2[3], packet_info.record.addr2[4],
+                 packet_info.record.addr2[5]);
 
-        int rssi = pkt->rx_ctrl.rssi;
-        
-        ESP_LOGI("SNIFFER_CB", "Captured request with RSSI %d from MAC %02X:%02X:%02X:%02X:%02X:%02X",
-                 rssi, hdr->addr2[0], hdr->addr2[1], hdr->addr2[2],
-                 hdr->addr2[3], hdr->addr2[4], hdr->addr2[5]);
-        
         queue_packet(pkt, &packet_info);  // Queue the packet for processing
     }
+
+    // Only the driver task calls back, so plain increments are enough
+    snf_rt.stages[SNIFFER_STAGE_CALLBACK].items++;
+    snf_rt.stages[SNIFFER_STAGE_CALLBACK].busy_us += esp_timer_get_time() - start_us;
 }
 
-static esp_err_t sniffer_write_reduced_data(void *payload, uint32_t length)
+static void sniffer_submit_write(const write_job_t *job)
 {
-    esp_err_t ret = ESP_OK;
-    wifi_promiscuous_pkt_t *pkt = (wifi_promiscuous_pkt_t *)payload;
-    packet_control_header_t *hdr = (packet_control_header_t *)pkt->payload;
-    struct timeval tv;
-    time_t current_time;
-    struct tm* timeinfo;
-    char str_buf[64];
-    
-    FILE *file;
+    bool drained;
 
-    file = fopen(filename, "a");
-    if (file == NULL)
+    // A slow SD card backs up here rather than in the callback ring, wait for the writer instead of dropping
+    if (spsc_ring_push(&snf_rt.write_ring, job, &drained) == 0)
+    {
+        // The failed push counted one write stall, wait for room without counting every retry.
+        // This task is the only producer, so the push after the wait succeeds.
+        while (spsc_ring_count(&snf_rt.write_ring) >= snf_rt.write_ring.capacity)
+        {
+            vTaskDelay(1);
+        }
+        spsc_ring_push(&snf_rt.write_ring, job, &drained);
+    }
+    if (drained)
     {
-        ESP_LOGE(SNIFFER_TAG, "Failed to open file for writing");
-        return -1;
+        xTaskNotifyGive(snf_rt.writer_task);
     }
+}
 
-    gettimeofday(&tv, NULL);
-
-    current_time = tv.tv_sec;
-    timeinfo = localtime(&current_time);
-    strftime(str_buf, sizeof(str_buf), "%c", timeinfo);
-
-    // Time, MAC, RSSI
-    fprintf(file, "%s, %02X:%02X:%02X:%02X:%02X:%02X, %d\n", str_buf, hdr->addr2[0], hdr->addr2[1], hdr->addr2[2], hdr->addr2[3], hdr->addr2[4], hdr->addr2[5], pkt->rx_ctrl.rssi);
-    fclose(file);
+static void sniffer_flush_bursts(uint64_t now_us)
+{
+    write_job_t job = { .type = WRITE_JOB_BURST, .sinks = snf_rt.burst_sinks };
 
-    return ret;
+    while (burst_coalescer_expire(&snf_rt.coalescer, now_us, &job.burst, 1) > 0)
+    {
+        if (job.sinks)
+        {
+            sniffer_submit_write(&job);
+        }
+    }
 }
 
 esp_err_t sniffer_write_battery_data(void)
@@ -539,66 +1133,323 @@ esp_err_t sniffer_write_battery_data(void)
 
     return ret;
 }
-static void sniffer_task(void *parameters)
+static void sniffer_process_packet(sniffer_packet_info_t *packet_info)
 {
-    sniffer_packet_info_t packet_info;
-    sniffer_runtime_t *sniffer = (sniffer_runtime_t *)parameters;
-    TickType_t last_update_time = xTaskGetTickCount();
-    last_heartbeat_time = xTaskGetTickCount();  // Initialize heartbeat timer
+    const probe_record_t *record = &packet_info->record;
+    load_shed_mode_t mode = load_shed_mode(&snf_rt.shed);
+    write_job_t job = {
+        .type = WRITE_JOB_PACKET,
+        .sinks = 0,
+        .packet = *packet_info,
+    };
 
-    init_top_requests();
+    HOT_LOGI("SNIFFER_TASK", "Processing packet with RSSI %d", record->rssi);
 
-    snprintf(filename, sizeof(filename), CONFIG_SD_MOUNT_POINT "/" CONFIG_OUTPUT_FILE);
+    if (snf_rt.payload_sinks && mode != LOAD_SHED_FULL)
+    {
+        snf_rt.pcap_shed++;
+    }
+    if (mode == LOAD_SHED_STATS_ONLY)
+    {
+        // Frames copied before the switch still go to the writer, which releases their slots
+        snf_rt.csv_shed++;
+    }
+    else
+    {
+        uint32_t sinks = snf_rt.storage_sinks;
+        if (mode != LOAD_SHED_FULL || packet_info->payload == NULL)
+        {
+            sinks &= ~snf_rt.payload_sinks;
+        }
+        if (coalesce_bursts)
+        {
+            // Burst sinks get one item when the burst closes, the others only the first frame of a burst
+            write_job_t evicted = { .type = WRITE_JOB_BURST, .sinks = snf_rt.burst_sinks };
+            bool evicted_valid;
+            bool first = burst_coalescer_add(&snf_rt.coalescer, record, &evicted.burst, &evicted_valid);
+            sinks &= first ? ~snf_rt.burst_sinks : 0;
+            if (evicted_valid && evicted.sinks)
+            {
+                sniffer_submit_write(&evicted);
+            }
+        }
+        job.sinks = sinks;
+    }
 
-    // Write initial heartbeat packet when starting the sniffer
-    write_heartbeat_packet();
+    // The pool slot travels with the job, only the writer releases slots
+    if (job.sinks || job.packet.payload)
+    {
+        sniffer_submit_write(&job);
+    }
+}
 
-    while (sniffer->is_running)
+// Sinks without storage see every accepted record of the batch, whatever the output mode
+static void sniffer_write_stats_sinks(const sniffer_packet_info_t *packets, uint32_t count)
+{
+    static record_sink_item_t items[CONFIG_SNIFFER_DRAIN_BATCH];
+
+    for (uint32_t i = 0; i < count; i++)
     {
-        // Receive packet info from queue
-        if (xQueueReceive(sniffer->work_queue, &packet_info, pdMS_TO_TICKS(SNIFFER_PROCESS_PACKET_TIMEOUT_MS)) == pdTRUE)
+        // The slot may already be back in the pool, these sinks only get the record
+        items[i] = (record_sink_item_t) {
+            .type = RECORD_SINK_ITEM_PACKET,
+            .packet = { .record = &packets[i].record },
+        };
+    }
+    for (uint32_t id = 0; id < RECORD_SINK_MAX; id++)
+    {
+        if (snf_rt.stats_sinks & 1u << id)
         {
-            wifi_promiscuous_pkt_t *pkt = (wifi_promiscuous_pkt_t *)packet_info.payload;
-            packet_control_header_t *hdr = (packet_control_header_t *)pkt->payload;
+            record_sink_write(record_sink_get(id), items, count);
+        }
+    }
+}
+
+static void write_mode_marker(const mode_marker_t *marker)
+{
+    char label[32];
+    char text[64];
+    struct timeval tv;
+
+    snprintf(label, sizeof(label), "MODE %s", load_shed_mode_name(marker->to));
+    snprintf(text, sizeof(text), "mode=%s from=%s queue=%lu/%lu", load_shed_mode_name(marker->to),
+             load_shed_mode_name(marker->from), marker->depth, marker->capacity);
+    gettimeofday(&tv, NULL);
+    record_sink_marker_t sink_marker = {
+        .label = label,
+        .text = text,
+        .type = REDUCED_RECORD_MODE,
+        .arg = marker->from << 8 | marker->to,
+        .timestamp_us = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec,
+    };
+    sniffer_write_marker(&sink_marker);
+}
+
+// Step the output mode on the occupancy of the fuller queue, a slow card backs up the write ring first
+static void sniffer_update_load_shed(sniffer_runtime_t *sniffer)
+{
+    spsc_ring_t *ring = &sniffer->work_ring;
+    uint32_t depth = spsc_ring_count(&sniffer->work_ring);
+    uint32_t write_depth = spsc_ring_count(&sniffer->write_ring);
+    write_job_t job = { .type = WRITE_JOB_MARKER };
+
+    if ((uint64_t)write_depth * ring->capacity > (uint64_t)depth * sniffer->write_ring.capacity)
+    {
+        ring = &sniffer->write_ring;
+        depth = write_depth;
+    }
+
+    job.marker.from = load_shed_mode(&sniffer->shed);
+    if (!load_shed_update(&sniffer->shed, depth, ring->capacity, esp_timer_get_time()))
+    {
+        return;
+    }
+    job.marker.to = load_shed_mode(&sniffer->shed);
+    job.marker.depth = depth;
+    job.marker.capacity = ring->capacity;
+
+    sniffer_trace(SNIFFER_TRACE_SHED, job.marker.to, depth);
+    ESP_LOGW(SNIFFER_TAG, "Output mode %s -> %s, queue %lu/%lu", load_shed_mode_name(job.marker.from),
+             load_shed_mode_name(job.marker.to), depth, ring->capacity);
+    // Markers are written in every mode so the CSV and pcap show where records are missing
+    sniffer_submit_write(&job);
+}
 
-            ESP_LOGI("SNIFFER_TASK", "Processing packet with RSSI %d", pkt->rx_ctrl.rssi);
+// Packet and burst jobs of a run go out as one batch per storage sink, in capture order, then their slots are released
+static void sniffer_write_records(write_job_t *jobs, uint32_t count)
+{
+    static record_sink_item_t items[CONFIG_SNIFFER_DRAIN_BATCH];
+
+    for (uint32_t id = 0; count && id < RECORD_SINK_MAX; id++)
+    {
+        uint32_t filled = 0;
 
-            // Save captured data in reduced format
-            if (sniffer_write_reduced_data(packet_info.payload, packet_info.length) != ESP_OK)
+        if (!(snf_rt.storage_sinks & 1u << id))
+        {
+            continue;
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const write_job_t *job = &jobs[i];
+            if (!(job->sinks & 1u << id))
             {
-                ESP_LOGW(SNIFFER_TAG, "Save captured packet in reduced format failed");
+                continue;
             }
-
-            // Save captured data in pcap format
-            if (packet_capture(packet_info.payload, packet_info.length, packet_info.seconds, packet_info.microseconds) != ESP_OK)
+            if (job->type == WRITE_JOB_PACKET)
             {
-                ESP_LOGW(SNIFFER_TAG, "Save captured packet in pcap format failed");
+                items[filled++] = (record_sink_item_t) {
+                    .type = RECORD_SINK_ITEM_PACKET,
+                    .packet = { &job->packet.record, job->packet.payload, job->packet.length },
+                };
             }
+            else
+            {
+                items[filled++] = (record_sink_item_t) { .type = RECORD_SINK_ITEM_BURST, .burst = &job->burst };
+            }
+        }
+        record_sink_write(record_sink_get(id), items, filled);
+    }
+
+    // Return the slots to the packet pool
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (jobs[i].type == WRITE_JOB_PACKET)
+        {
+            sniffer_release_payload(jobs[i].packet.payload);
+            jobs[i].packet.payload = NULL;
+        }
+    }
+}
+
+static void sniffer_write_job(write_job_t *job)
+{
+    switch (job->type)
+    {
+        case WRITE_JOB_HEARTBEAT:
+            write_heartbeat_packet();
+            break;
+        case WRITE_JOB_BATTERY:
+            sniffer_write_battery_data();
+            break;
+        case WRITE_JOB_MARKER:
+            write_mode_marker(&job->marker);
+            break;
+        default:
+            break;
+    }
+}
+
+// Records wait in RAM blocks until they fill, the sinks hand them to the storage task once the oldest is
+// csv_flush_ms or pcap_flush_ms old
+static void sniffer_flush_due(void)
+{
+    record_sink_flush(snf_rt.storage_sinks, esp_timer_get_time());
+}
+
+static void sniffer_writer_task(void *parameters)
+{
+    // Kept off the task stack, as are the item arrays of the sink writers, each has a single task using it
+    static write_job_t batch[CONFIG_SNIFFER_DRAIN_BATCH];
+    sniffer_runtime_t *sniffer = (sniffer_runtime_t *)parameters;
+    sniffer_stage_counter_t *stage = &sniffer->stages[SNIFFER_STAGE_WRITER];
 
-            // Update top requests
-            update_top_requests(pkt->rx_ctrl.rssi, hdr->addr2, packet_info.seconds);
-            // Update RSSI range counters
-            update_rssi_ranges(pkt->rx_ctrl.rssi);
+    // Write initial heartbeat packet when starting the sniffer
+    write_heartbeat_packet();
+
+    while (true)
+    {
+        // Read the stop flag before popping, a job pushed before the flag was set is then always seen
+        bool stopping = atomic_load(&sniffer->writer_stop);
+        uint32_t count = spsc_ring_pop_batch(&sniffer->write_ring, batch, CONFIG_SNIFFER_DRAIN_BATCH);
+        if (count == 0)
+        {
+            if (stopping)
+            {
+                break;
+            }
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SNIFFER_PROCESS_PACKET_TIMEOUT_MS));
+            sniffer_flush_due();
+            continue;
+        }
 
-            // Free the payload memory
-            if (packet_info.payload != NULL)
+        int64_t start_us = esp_timer_get_time();
+        uint32_t first = 0;
+        for (uint32_t i = 0; i <= count; i++)
+        {
+            if (i < count && (batch[i].type == WRITE_JOB_PACKET || batch[i].type == WRITE_JOB_BURST))
+            {
+                continue;
+            }
+            // Records before a heartbeat, battery or marker job are written first, files keep the job order
+            sniffer_write_records(&batch[first], i - first);
+            if (i < count)
             {
-                free(packet_info.payload);
-                packet_info.payload = NULL;  // Set it to NULL after freeing
+                sniffer_write_job(&batch[i]);
             }
+            first = i + 1;
         }
+        sniffer_flush_due();
+        stage->items += count;
+        stage->busy_us += esp_timer_get_time() - start_us;
+    }
+
+    // Notify that writer task is over
+    xSemaphoreGive(sniffer->sem_task_over);
+    vTaskDelete(NULL);
+    vTaskDelay(pdMS_TO_TICKS(100));
+}
+
+static void sniffer_task(void *parameters)
+{
+    sniffer_packet_info_t batch[CONFIG_SNIFFER_DRAIN_BATCH];
+    sniffer_runtime_t *sniffer = (sniffer_runtime_t *)parameters;
+    sniffer_stage_counter_t *stage = &sniffer->stages[SNIFFER_STAGE_STATS];
+    const write_job_t heartbeat_job = { .type = WRITE_JOB_HEARTBEAT };
+    const write_job_t battery_job = { .type = WRITE_JOB_BATTERY };
+    TickType_t last_update_time = xTaskGetTickCount();
+    TickType_t last_clock_sync_time = xTaskGetTickCount();
+    // Latest record time and the esp_timer time it was seen at, so bursts expire on the record clock
+    uint64_t clock_ref_us = 0;
+    int64_t clock_ref_mono_us = 0;
+    last_heartbeat_time = xTaskGetTickCount();  // Initialize heartbeat timer
+
+    init_top_requests();
+
+    while (sniffer->is_running)
+    {
+        #if CONFIG_SNIFFER_LOAD_SHEDDING
+        sniffer_update_load_shed(sniffer);
+        #endif
+
+        // Drain up to one batch per wakeup, sleep only when the ring ran dry
+        uint32_t count = spsc_ring_pop_batch(&sniffer->work_ring, batch, CONFIG_SNIFFER_DRAIN_BATCH);
+        if (count == 0)
+        {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SNIFFER_PROCESS_PACKET_TIMEOUT_MS));
+        }
+
+        int64_t start_us = esp_timer_get_time();
+        if (count)
+        {
+            sniffer_trace(SNIFFER_TRACE_BATCH, count, spsc_ring_count(&sniffer->work_ring));
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            sniffer_process_packet(&batch[i]);
+        }
+        sniffer_write_stats_sinks(batch, count);
+        record_sink_flush(sniffer->stats_sinks, esp_timer_get_time());
+
+        if (count)
+        {
+            clock_ref_us = batch[count - 1].record.timestamp_us;
+            clock_ref_mono_us = start_us;
+        }
+        if (coalesce_bursts && clock_ref_us)
+        {
+            sniffer_flush_bursts(clock_ref_us + (esp_timer_get_time() - clock_ref_mono_us));
+        }
+        stage->items += count;
+        stage->busy_us += esp_timer_get_time() - start_us;
 
         // Check if heartbeat interval has elapsed
         if (xTaskGetTickCount() - last_heartbeat_time >= pdMS_TO_TICKS(heartbeat_interval_ms))
         {
-            write_heartbeat_packet();
+            sniffer_submit_write(&heartbeat_job);
             last_heartbeat_time = xTaskGetTickCount();  // Reset heartbeat timer
         }
 
+        // Give the callback a drift sample
+        if (xTaskGetTickCount() - last_clock_sync_time >= pdMS_TO_TICKS(CONFIG_SNIFFER_CLOCK_SYNC_INTERVAL_MS))
+        {
+            sniffer_clock_resync(false);
+            last_clock_sync_time = xTaskGetTickCount();
+        }
+
         // Check if heartbeat interval has elapsed
         if (xTaskGetTickCount() - last_battery_time >= pdMS_TO_TICKS(BATTERY_INTERVAL_MS))
         {
-            sniffer_write_battery_data();
+            sniffer_submit_write(&battery_job);
             last_battery_time = xTaskGetTickCount();  // Reset heartbeat timer
         }
         
@@ -628,6 +1479,15 @@ static void sniffer_task(void *parameters)
      
     }
 
+    if (coalesce_bursts)
+    {
+        sniffer_flush_bursts(UINT64_MAX);
+    }
+
+    // Nothing is pushed after this, let the writer drain the ring and exit
+    atomic_store(&sniffer->writer_stop, true);
+    xTaskNotifyGive(sniffer->writer_task);
+
     // Notify that sniffer task is over
     xSemaphoreGive(sniffer->sem_task_over);
     vTaskDelete(NULL);
@@ -647,25 +1507,52 @@ esp_err_t sniffer_stop(void)
 
     /* stop sniffer local task */
     snf_rt.is_running = false;
-    /* wait for task over */
+    /* wait for both tasks over, the writer finishes after the stats task */
+    xSemaphoreTake(snf_rt.sem_task_over, portMAX_DELAY);
     xSemaphoreTake(snf_rt.sem_task_over, portMAX_DELAY);
 
     vSemaphoreDelete(snf_rt.sem_task_over);
     snf_rt.sem_task_over = NULL;
-    /* make sure to free all resources in the left items */
-    UBaseType_t left_items = uxQueueMessagesWaiting(snf_rt.work_queue);
+    /* the reduced files are complete once the storage task synced and closed them, pcap_close() waits for the
+       pcap file, which gets its final counters here */
+    record_sink_close(snf_rt.sinks);
+    if (!storage_writer_sync(snf_rt.storage, CONFIG_STORAGE_SYNC_TIMEOUT_MS))
+    {
+        ESP_LOGW(SNIFFER_TAG, "Storage task still busy after %d ms", CONFIG_STORAGE_SYNC_TIMEOUT_MS);
+    }
+    /* keep the counters of this capture readable once the rings are gone */
+    sniffer_collect_capture_stats(&last_capture_stats);
+    ESP_LOGI(SNIFFER_TAG, "Capture stopped after %lu s: %lu frames seen, %lu dropped, %lu CSV and %lu pcap records, "
+             "%lu pcap copies lost to the pool",
+             last_capture_stats.duration_s, last_capture_stats.frames_seen, last_capture_stats.queue_drops,
+             last_capture_stats.csv_records, last_capture_stats.pcap_records, last_capture_stats.alloc_failures);
+    for (uint32_t id = 0; id < RECORD_SINK_MAX; id++)
+    {
+        record_sink_t *sink = record_sink_get(id);
+        if (snf_rt.sinks & 1u << id)
+        {
+            ESP_LOGI(SNIFFER_TAG, "Sink %s: %lu items, %lu not written", sink->name, sink->items, sink->errors);
+        }
+    }
 
+    /* make sure to free all resources in the left items */
     sniffer_packet_info_t packet_info;
-    while (left_items--)
+    while (spsc_ring_pop_batch(&snf_rt.work_ring, &packet_info, 1))
     {
-        xQueueReceive(snf_rt.work_queue, &packet_info, pdMS_TO_TICKS(SNIFFER_PROCESS_PACKET_TIMEOUT_MS));
-        free(packet_info.payload);
+        sniffer_release_payload(packet_info.payload);
     }
-    vQueueDelete(snf_rt.work_queue);
-    snf_rt.work_queue = NULL;
+    spsc_ring_deinit(&snf_rt.work_ring);
+    spsc_ring_deinit(&snf_rt.write_ring);
+    packet_pool_deinit(&snf_rt.pool);
+    packet_pool_deinit(&snf_rt.large_pool);
+    burst_coalescer_deinit(&snf_rt.coalescer);
 
     /* stop pcap session */
     sniff_packet_stop();
+
+    #if SHOW_SNIFFER_DEBUG
+    sniffer_trace_dump();
+    #endif
 err:
     return ret;
 }
@@ -674,22 +1561,87 @@ esp_err_t sniffer_start(void)
 {
     esp_err_t ret = ESP_OK;
     pcap_link_type_t link_type = PCAP_LINK_TYPE_802_11_RADIOTAP;
+    packet_filter_t *active_filter = sniffer_filter();
     wifi_promiscuous_filter_t wifi_filter = {
-        .filter_mask = WIFI_EVENT_MASK_AP_PROBEREQRECVED
+        .filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT
 	};
+    if (active_filter->subtype_mask[PACKET_FILTER_TYPE_DATA])
+    {
+        wifi_filter.filter_mask |= WIFI_PROMIS_FILTER_MASK_DATA;
+    }
     ESP_GOTO_ON_FALSE(!(snf_rt.is_running), ESP_ERR_INVALID_STATE, err, SNIFFER_TAG, "sniffer is already running");
+    snf_rt.storage = storage_writer_default();
+    ESP_GOTO_ON_FALSE(snf_rt.storage, ESP_ERR_NO_MEM, err, SNIFFER_TAG, "no storage task");
+
+    /* Count filter hits per capture session */
+    for (int i = 0; i < PACKET_FILTER_RULE_COUNT; i++)
+    {
+        atomic_store(&active_filter->hits[i], 0);
+    }
+    atomic_store(&active_filter->passed, 0);
+
+    /* Re-anchor packet times on the first frame, the drift estimate is kept */
+    sniffer_clock_resync(true);
 
     /* init a pcap session */
     ESP_GOTO_ON_ERROR(sniff_packet_start(link_type), err, SNIFFER_TAG, "init pcap session failed");
 
+    /* Sinks of this capture, the capture path only pays for what they need */
+    snf_rt.sinks = sniffer_select_sinks();
+    snf_rt.stats_sinks = record_sink_filter(snf_rt.sinks, 0, RECORD_SINK_CAP_STORAGE);
+    snf_rt.storage_sinks = record_sink_filter(snf_rt.sinks, RECORD_SINK_CAP_STORAGE, 0);
+    snf_rt.payload_sinks = record_sink_filter(snf_rt.storage_sinks, RECORD_SINK_CAP_PAYLOAD, 0);
+    snf_rt.burst_sinks = record_sink_filter(snf_rt.storage_sinks, RECORD_SINK_CAP_BURSTS, 0);
+    snf_rt.marker_sinks = record_sink_filter(snf_rt.storage_sinks, RECORD_SINK_CAP_MARKERS, 0);
+
     snf_rt.is_running = true;
-    snf_rt.work_queue = xQueueCreate(CONFIG_SNIFFER_WORK_QUEUE_LEN, sizeof(sniffer_packet_info_t));
-    ESP_GOTO_ON_FALSE(snf_rt.work_queue, ESP_FAIL, err_queue, SNIFFER_TAG, "create work queue failed");
-    snf_rt.sem_task_over = xSemaphoreCreateBinary();
+    if (snf_rt.payload_sinks)
+    {
+        ESP_GOTO_ON_FALSE(packet_pool_init(&snf_rt.pool, CONFIG_SNIFFER_WORK_QUEUE_LEN, CONFIG_SNIFFER_POOL_SLOT_SIZE),
+                          ESP_ERR_NO_MEM, err_pool, SNIFFER_TAG, "create packet pool failed");
+        #if CONFIG_SNIFFER_POOL_LARGE_SLOTS
+        ESP_GOTO_ON_FALSE(packet_pool_init(&snf_rt.large_pool, CONFIG_SNIFFER_POOL_LARGE_SLOTS,
+                                           CONFIG_SNIFFER_POOL_LARGE_SLOT_SIZE),
+                          ESP_ERR_NO_MEM, err_queue, SNIFFER_TAG, "create large packet pool failed");
+        #endif
+    }
+    /* Without frames only records are queued, so the same memory holds a much deeper ring */
+    ESP_GOTO_ON_FALSE(spsc_ring_init(&snf_rt.work_ring,
+                                     snf_rt.payload_sinks ? CONFIG_SNIFFER_WORK_QUEUE_LEN :
+                                     CONFIG_SNIFFER_RECORD_QUEUE_LEN,
+                                     sizeof(sniffer_packet_info_t)),
+                      ESP_ERR_NO_MEM, err_queue, SNIFFER_TAG, "create work ring failed");
+    if (coalesce_bursts)
+    {
+        ESP_GOTO_ON_FALSE(burst_coalescer_init(&snf_rt.coalescer, CONFIG_SNIFFER_COALESCE_SLOTS,
+                                               CONFIG_SNIFFER_COALESCE_WINDOW_MS * 1000),
+                          ESP_ERR_NO_MEM, err_coalescer, SNIFFER_TAG, "create burst coalescer failed");
+    }
+    ESP_GOTO_ON_FALSE(spsc_ring_init(&snf_rt.write_ring, CONFIG_SNIFFER_WRITE_QUEUE_LEN, sizeof(write_job_t)),
+                      ESP_ERR_NO_MEM, err_write_ring, SNIFFER_TAG, "create write ring failed");
+    atomic_store(&snf_rt.writer_stop, false);
+    memset(snf_rt.stages, 0, sizeof(snf_rt.stages));
+    memset(&snf_rt.written, 0, sizeof(snf_rt.written));
+    snf_rt.start_us = esp_timer_get_time();
+    load_shed_init(&snf_rt.shed, &shed_config);
+    snf_rt.pcap_shed = 0;
+    snf_rt.csv_shed = 0;
+    /* The reduced files stay open for the whole capture, only the storage task writes and closes them */
+    storage_writer_reset_stats(snf_rt.storage);
+    ESP_GOTO_ON_ERROR(record_sink_open(snf_rt.sinks), err_sinks, SNIFFER_TAG, "open sinks failed");
+
+    /* One semaphore count per task */
+    snf_rt.sem_task_over = xSemaphoreCreateCounting(2, 0);
     ESP_GOTO_ON_FALSE(snf_rt.sem_task_over, ESP_FAIL, err_sem, SNIFFER_TAG, "create work queue failed");
-    ESP_GOTO_ON_FALSE(xTaskCreate(sniffer_task, "snifferT", CONFIG_SNIFFER_TASK_STACK_SIZE,
-                                  &snf_rt, CONFIG_SNIFFER_TASK_PRIORITY, &snf_rt.task), ESP_FAIL,
+    /* Stats next to the Wi-Fi driver, SD writes alone on the other core */
+    ESP_GOTO_ON_FALSE(xTaskCreatePinnedToCore(sniffer_task, "snifferT", CONFIG_SNIFFER_TASK_STACK_SIZE,
+                                              &snf_rt, CONFIG_SNIFFER_TASK_PRIORITY, &snf_rt.task,
+                                              CONFIG_SNIFFER_TASK_CORE), ESP_FAIL,
                       err_task, SNIFFER_TAG, "create task failed");
+    ESP_GOTO_ON_FALSE(xTaskCreatePinnedToCore(sniffer_writer_task, "writerT", CONFIG_SNIFFER_WRITER_TASK_STACK_SIZE,
+                                              &snf_rt, CONFIG_SNIFFER_WRITER_TASK_PRIORITY, &snf_rt.writer_task,
+                                              CONFIG_SNIFFER_WRITER_TASK_CORE), ESP_FAIL,
+                      err_writer, SNIFFER_TAG, "create writer task failed");
 
     /* Start WiFi Promiscuous Mode */
     esp_wifi_set_promiscuous_filter(&wifi_filter);
@@ -700,22 +1652,209 @@ esp_err_t sniffer_start(void)
 
     return ret;
 err_start:
+    vTaskDelete(snf_rt.writer_task);
+    snf_rt.writer_task = NULL;
+err_writer:
     vTaskDelete(snf_rt.task);
     snf_rt.task = NULL;
 err_task:
     vSemaphoreDelete(snf_rt.sem_task_over);
     snf_rt.sem_task_over = NULL;
 err_sem:
-    vQueueDelete(snf_rt.work_queue);
-    snf_rt.work_queue = NULL;
+    record_sink_close(snf_rt.sinks);
+err_sinks:
+    spsc_ring_deinit(&snf_rt.write_ring);
+err_write_ring:
+    burst_coalescer_deinit(&snf_rt.coalescer);
+err_coalescer:
+    spsc_ring_deinit(&snf_rt.work_ring);
 err_queue:
+    packet_pool_deinit(&snf_rt.large_pool);
+    packet_pool_deinit(&snf_rt.pool);
+err_pool:
     snf_rt.is_running = false;
 err:
     return ret;
 }
 
+packet_filter_t *sniffer_filter(void)
+{
+    if (!filter_initialized)
+    {
+        packet_filter_reset(&filter);
+        #if CONFIG_SNIFFER_USE_MAC_FILTER
+        packet_filter_add(&filter, filter_mac, false, true);
+        #endif
+        packet_filter_compile(&filter);
+        filter_initialized = true;
+    }
+    return &filter;
+}
+
 void initialize_sniffer(void)
 {
     snf_rt.interf = SNIFFER_INTF_WLAN;
     snf_rt.channel = CONFIG_SNIFFER_DEFAULT_CHANNEL;
+    sniffer_filter();
+    if (!sinks_registered)
+    {
+        sniffer_register_sinks();
+        sinks_registered = true;
+    }
+
+    #if CONFIG_SNIFFER_TRACE_LEN
+    // Kept across sniffer restarts so the trace can be read from the server afterwards
+    if (trace.entries == NULL && !trace_ring_init(&trace, CONFIG_SNIFFER_TRACE_LEN))
+    {
+        ESP_LOGW(SNIFFER_TAG, "Trace ring allocation failed, tracing disabled");
+    }
+    #endif
+}
+
+void sniffer_clock_resync(bool step)
+{
+    if (step)
+    {
+        atomic_store(&clock_sync_request, CLOCK_SYNC_STEP);
+    }
+    else
+    {
+        // Never downgrade a pending step
+        int expected = CLOCK_SYNC_NONE;
+        atomic_compare_exchange_strong(&clock_sync_request, &expected, CLOCK_SYNC_SOFT);
+    }
+}
+
+static void sniffer_collect_capture_stats(capture_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->duration_s = (esp_timer_get_time() - snf_rt.start_us) / 1000000;
+    stats->frames_seen = snf_rt.stages[SNIFFER_STAGE_CALLBACK].items;
+    for (int i = 0; i < PACKET_FILTER_RULE_COUNT; i++)
+    {
+        stats->filtered += atomic_load(&filter.hits[i]);
+    }
+    stats->accepted = atomic_load(&filter.passed);
+    stats->queue_drops = atomic_load(&snf_rt.work_ring.dropped);
+    stats->alloc_failures = atomic_load(&snf_rt.pool.exhausted) + atomic_load(&snf_rt.large_pool.exhausted) +
+                            atomic_load(&snf_rt.large_pool.oversize);
+    stats->csv_records = snf_rt.written.csv_records;
+    stats->pcap_records = snf_rt.written.pcap_records;
+    stats->write_errors = snf_rt.written.write_errors + snf_rt.storage->errors;
+    stats->bytes_written = snf_rt.written.bytes_written;
+    stats->work_queue_max_depth = atomic_load(&snf_rt.work_ring.high_water);
+    stats->work_queue_capacity = snf_rt.work_ring.capacity;
+    stats->write_queue_max_depth = atomic_load(&snf_rt.write_ring.high_water);
+    stats->write_queue_capacity = snf_rt.write_ring.capacity;
+    stats->write_stalls = atomic_load(&snf_rt.write_ring.dropped);
+    stats->sd_latency = snf_rt.storage->latency;
+    stats->storage_stalls = snf_rt.storage->stalls;
+    stats->storage_blocked_us = snf_rt.storage->blocked_us;
+    stats->shed_mode = load_shed_mode(&snf_rt.shed);
+    stats->shed_transitions = snf_rt.shed.transitions;
+    stats->pcap_shed = snf_rt.pcap_shed;
+    stats->csv_shed = snf_rt.csv_shed;
+}
+
+void sniffer_get_capture_stats(capture_stats_t *stats)
+{
+    if (!snf_rt.is_running)
+    {
+        *stats = last_capture_stats;
+        return;
+    }
+    sniffer_collect_capture_stats(stats);
+}
+
+void display_capture_stats_oled(void)
+{
+    capture_stats_t stats;
+    char display_text[160];
+
+    sniffer_get_capture_stats(&stats);
+    snprintf(display_text, sizeof(display_text),
+             "Capture %lum\nSeen %lu\nDrop %lu Err %lu\nCSV %lu PCAP %lu\nQ %lu/%lu SD p99 %lums\nMode %s",
+             stats.duration_s / 60, stats.frames_seen, stats.queue_drops,
+             stats.write_errors, stats.csv_records, stats.pcap_records, stats.work_queue_max_depth,
+             stats.work_queue_capacity, latency_histogram_percentile(&stats.sd_latency, 990) / 1000,
+             load_shed_mode_name(stats.shed_mode));
+    i2c_task_send_display_text(display_text);
+}
+
+void sniffer_get_stage_stats(sniffer_stage_stats_t *stats)
+{
+    static const char *names[SNIFFER_STAGE_COUNT] = {"callback", "stats", "writer", "storage"};
+    spsc_ring_t *inputs[SNIFFER_STAGE_COUNT] = {NULL, &snf_rt.work_ring, &snf_rt.write_ring,
+                                                snf_rt.storage ? &snf_rt.storage->requests : NULL};
+
+    for (int i = 0; i < SNIFFER_STAGE_COUNT; i++)
+    {
+        stats[i] = (sniffer_stage_stats_t) {
+            .name = names[i],
+            .items = snf_rt.stages[i].items,
+            .busy_us = snf_rt.stages[i].busy_us,
+        };
+        if (inputs[i] != NULL && inputs[i]->capacity)
+        {
+            stats[i].depth = spsc_ring_count(inputs[i]);
+            stats[i].high_water = atomic_load(&inputs[i]->high_water);
+            stats[i].capacity = inputs[i]->capacity;
+            stats[i].dropped = atomic_load(&inputs[i]->dropped);
+        }
+    }
+    if (snf_rt.storage)
+    {
+        stats[SNIFFER_STAGE_STORAGE].items = snf_rt.storage->writes;
+        stats[SNIFFER_STAGE_STORAGE].busy_us = snf_rt.storage->write_us;
+    }
+}
+
+void sniffer_trace(uint16_t event, uint32_t arg0, uint32_t arg1)
+{
+    #if CONFIG_SNIFFER_TRACE_LEN
+    trace_ring_record(&trace, event, (uint32_t)esp_timer_get_time(), arg0, arg1);
+    #endif
+}
+
+uint32_t sniffer_trace_snapshot(trace_entry_t *out, uint32_t max)
+{
+    return trace_ring_snapshot(&trace, out, max);
+}
+
+const char *sniffer_trace_event_name(uint16_t event)
+{
+    switch (event) {
+        case SNIFFER_TRACE_RX:          return "rx";
+        case SNIFFER_TRACE_DROP:        return "drop";
+        case SNIFFER_TRACE_BATCH:       return "batch";
+        case SNIFFER_TRACE_TOP_UPDATE:  return "top_update";
+        case SNIFFER_TRACE_WRITE_FAIL:  return "write_fail";
+        case SNIFFER_TRACE_HEARTBEAT:   return "heartbeat";
+        case SNIFFER_TRACE_SHED:        return "shed";
+        default:                        return "unknown";
+    }
+}
+
+void sniffer_trace_dump(void)
+{
+    if (trace.capacity == 0)
+    {
+        return;
+    }
+
+    trace_entry_t *entries = malloc(trace.capacity * sizeof(trace_entry_t));
+    if (entries == NULL)
+    {
+        ESP_LOGE(SNIFFER_TAG, "Failed to allocate memory for trace dump");
+        return;
+    }
+
+    uint32_t count = sniffer_trace_snapshot(entries, trace.capacity);
+    printf("\n--- Trace (%lu events) ---\n", count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        printf("%10lu %-10s %ld %lu\n", entries[i].timestamp, sniffer_trace_event_name(entries[i].event),
+               (int32_t)entries[i].arg0, entries[i].arg1);
+    }
+    free(entries);
 }
@@ -14,6 +14,9 @@ extern "C" {
 
 #include "i2c_oled.h"  // Include LVGL or any necessary headers for your OLED functions
 #include "config.h"
+#include "trace_ring.h"
+#include "packet_filter.h"
+#include "capture_stats.h"
 
 /**
  * @brief Supported Sniffer Interface
@@ -40,8 +43,57 @@ typedef enum {
     SNIFFER_WLAN_FILTER_MAX
 } sniffer_wlan_filter_t;
 
+/**
+ * @brief Binary trace events recorded on the capture path
+ *
+ */
+typedef enum {
+    SNIFFER_TRACE_RX = 1,       /*!< Probe request accepted in the callback, arg0 RSSI, arg1 sequence number */
+    SNIFFER_TRACE_DROP,         /*!< Packet lost before the sniffer task, arg0 reason (0 pool, 1 ring), arg1 ring count */
+    SNIFFER_TRACE_BATCH,        /*!< Sniffer task drained a batch, arg0 batch size, arg1 packets left in the ring */
+    SNIFFER_TRACE_TOP_UPDATE,   /*!< Top requests table changed, arg0 slot, arg1 RSSI */
+    SNIFFER_TRACE_WRITE_FAIL,   /*!< SD write failed, arg0 sink (0 reduced CSV, 1 pcap) */
+    SNIFFER_TRACE_HEARTBEAT,    /*!< Heartbeat written, arg0 pool exhausted count, arg1 ring dropped count */
+    SNIFFER_TRACE_SHED,         /*!< Output mode changed, arg0 new load_shed_mode_t, arg1 queue depth */
+} sniffer_trace_event_t;
+
+/**
+ * @brief Stages of the capture pipeline
+ *
+ */
+typedef enum {
+    SNIFFER_STAGE_CALLBACK = 0, /*!< Wi-Fi callback: filter, parse, copy into the pool */
+    SNIFFER_STAGE_STATS,        /*!< snifferT: top requests, RSSI ranges, bursts, display */
+    SNIFFER_STAGE_WRITER,       /*!< writerT: formats reduced CSV and pcap records into blocks, battery file */
+    SNIFFER_STAGE_STORAGE,      /*!< storageT: fwrite of full blocks, items are write calls, busy is time in fwrite */
+    SNIFFER_STAGE_COUNT
+} sniffer_stage_t;
+
+/**
+ * @brief Load of one pipeline stage since the sniffer started
+ *
+ */
+typedef struct {
+    const char *name;
+    uint32_t items;         /*!< Frames (callback) or queue items (tasks) handled */
+    uint64_t busy_us;       /*!< CPU time spent handling them */
+    uint32_t depth;         /*!< Items waiting in the input queue of the stage */
+    uint32_t high_water;    /*!< Deepest the input queue has been */
+    uint32_t capacity;      /*!< Size of the input queue */
+    uint32_t dropped;       /*!< Failed pushes into the input queue (drops, or stalls of the producer for writer and storage) */
+} sniffer_stage_stats_t;
+
+/* OLED page index of the capture stats, the top request pages are 1..max_request_rank */
+#define SNIFFER_STATS_PAGE_INDEX 0
+#if CONFIG_SNIFFER_STATS_OLED_PAGE
+#define SNIFFER_FIRST_PAGE_INDEX SNIFFER_STATS_PAGE_INDEX
+#else
+#define SNIFFER_FIRST_PAGE_INDEX 1
+#endif
+
 // Function declaration
 void display_top_requests_oled(void);
+void display_capture_stats_oled(void);
 
 void initialize_sniffer(void);
 void clear_top_requests(void);
@@ -49,6 +101,63 @@ esp_err_t sniffer_stop(void);
 esp_err_t sniffer_start(void);
 esp_err_t sniffer_set_heartbeat_interval(uint32_t interval_ms);
 
+/**
+ * @brief Filter applied in the Wi-Fi callback
+ *
+ * Initialized with the default rules on first use. Only modify it while the
+ * sniffer is stopped and call packet_filter_compile() afterwards.
+ */
+packet_filter_t *sniffer_filter(void);
+
+/**
+ * @brief Re-anchor packet timestamps on the wall clock at the next received frame
+ *
+ * Packet times are derived from the radio's rx timestamp and only read the
+ * wall clock when a sync is requested. Call with step set after the wall
+ * clock was set (SNTP, RTC, manual), the sniffer itself asks for a soft sync
+ * every CONFIG_SNIFFER_CLOCK_SYNC_INTERVAL_MS to track drift.
+ *
+ * @param step true if the wall clock may have jumped since the last sync
+ */
+void sniffer_clock_resync(bool step);
+
+/**
+ * @brief Snapshot the capture counters
+ *
+ * While the sniffer runs the counters are live, afterwards those of the last
+ * capture are returned until the next sniffer_start().
+ */
+void sniffer_get_capture_stats(capture_stats_t *stats);
+
+/**
+ * @brief Copy the per stage counters, indexed by sniffer_stage_t
+ *
+ * @param[out] stats array of SNIFFER_STAGE_COUNT entries
+ */
+void sniffer_get_stage_stats(sniffer_stage_stats_t *stats);
+
+/**
+ * @brief Record a binary trace event, safe to call from the Wi-Fi callback
+ */
+void sniffer_trace(uint16_t event, uint32_t arg0, uint32_t arg1);
+
+/**
+ * @brief Copy the retained trace events, oldest first
+ *
+ * @return number of events copied
+ */
+uint32_t sniffer_trace_snapshot(trace_entry_t *out, uint32_t max);
+
+/**
+ * @brief Name of a sniffer_trace_event_t for dumps
+ */
+const char *sniffer_trace_event_name(uint16_t event);
+
+/**
+ * @brief Print the retained trace events to the serial console
+ */
+void sniffer_trace_dump(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <string.h>
+#include "spsc_ring.h"
+
+bool spsc_ring_init(spsc_ring_t *ring, uint32_t capacity, uint32_t item_size)
+{
+    if (ring == NULL || capacity == 0 || item_size == 0) {
+        return false;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+
+    uint32_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    ring->buffer = malloc((size_t)size * item_size);
+    if (ring->buffer == NULL) {
+        return false;
+    }
+
+    ring->item_size = item_size;
+    ring->capacity = size;
+    ring->mask = size - 1;
+    return true;
+}
+
+void spsc_ring_deinit(spsc_ring_t *ring)
+{
+    if (ring == NULL) {
+        return;
+    }
+    free(ring->buffer);
+    ring->buffer = NULL;
+    ring->capacity = 0;
+}
+
+uint32_t spsc_ring_push(spsc_ring_t *ring, const void *item, bool *drained)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail >= ring->capacity) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return 0;
+    }
+
+    memcpy(ring->buffer + (size_t)(head & ring->mask) * ring->item_size, item, ring->item_size);
+    atomic_store(&ring->head, head + 1);
+
+    uint32_t count = head - tail + 1;
+    if (drained) {
+        // Re-read the tail after publishing, the consumer may have run dry since the first read
+        *drained = atomic_load(&ring->tail) == head;
+    }
+    if (count > atomic_load_explicit(&ring->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&ring->high_water, count, memory_order_relaxed);
+    }
+    return count;
+}
+
+uint32_t spsc_ring_pop_batch(spsc_ring_t *ring, void *items, uint32_t max_items)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t count = head - tail;
+
+    if (count > max_items) {
+        count = max_items;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy((uint8_t *)items + (size_t)i * ring->item_size,
+               ring->buffer + (size_t)((tail + i) & ring->mask) * ring->item_size,
+               ring->item_size);
+    }
+
+    if (count) {
+        atomic_store(&ring->tail, tail + count);
+    }
+    return count;
+}
+
+uint32_t spsc_ring_count(spsc_ring_t *ring)
+{
+    return atomic_load(&ring->head) - atomic_load(&ring->tail);
+}
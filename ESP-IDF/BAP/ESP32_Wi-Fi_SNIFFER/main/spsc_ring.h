@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Lock-free single-producer/single-consumer ring of fixed-size items
+ *
+ * The producer never blocks, a push into a full ring is dropped and counted.
+ * Exactly one task may push and exactly one task may pop at a time.
+ */
+typedef struct {
+    uint8_t *buffer;            /*!< capacity * item_size bytes */
+    uint32_t item_size;         /*!< Size of one item in bytes */
+    uint32_t capacity;          /*!< Number of items, power of two */
+    uint32_t mask;              /*!< capacity - 1 */
+    atomic_uint head;           /*!< Next write position, only the producer stores it */
+    atomic_uint tail;           /*!< Next read position, only the consumer stores it */
+    atomic_uint dropped;        /*!< Pushes rejected because the ring was full */
+    atomic_uint high_water;     /*!< Highest occupancy seen by the producer */
+} spsc_ring_t;
+
+/**
+ * @brief Allocate the ring storage
+ *
+ * @param ring ring object
+ * @param capacity requested number of items, rounded up to a power of two
+ * @param item_size size of one item in bytes
+ * @return true on success, false if out of memory or arguments are invalid
+ */
+bool spsc_ring_init(spsc_ring_t *ring, uint32_t capacity, uint32_t item_size);
+
+/**
+ * @brief Free the ring storage
+ */
+void spsc_ring_deinit(spsc_ring_t *ring);
+
+/**
+ * @brief Copy one item into the ring, never blocks
+ *
+ * @param ring ring object
+ * @param item item_size bytes to copy
+ * @param drained set to whether the consumer had taken every earlier item when this one was
+ *                published, i.e. it may be waiting for a notification, NULL if not needed
+ * @return occupancy after the push as seen before it, at least 1, 0 if the ring was full and the item dropped
+ */
+uint32_t spsc_ring_push(spsc_ring_t *ring, const void *item, bool *drained);
+
+/**
+ * @brief Copy up to max_items items out of the ring
+ *
+ * @param items destination array with room for max_items items
+ * @return number of items copied, 0 if the ring is empty
+ */
+uint32_t spsc_ring_pop_batch(spsc_ring_t *ring, void *items, uint32_t max_items);
+
+/**
+ * @brief Number of items waiting in the ring
+ */
+uint32_t spsc_ring_count(spsc_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,346 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "config.h"
+#include "storage_writer.h"
+
+#define STORAGE_WRITER_BATCH        8
+#define STORAGE_WRITER_IDLE_MS      100
+
+static const char *STORAGE_TAG = "storage";
+
+static void storage_writer_execute(storage_writer_t *writer, const storage_request_t *request)
+{
+    int64_t start_us = esp_timer_get_time();
+
+    switch (request->op) {
+        case STORAGE_OP_WRITE:
+            if (request->len) {
+                size_t written = fwrite(request->block + request->offset, 1, request->len, request->file);
+                uint32_t latency_us = esp_timer_get_time() - start_us;
+                latency_histogram_add(&writer->latency, latency_us);
+                writer->write_us += latency_us;
+                writer->writes++;
+                writer->bytes += written;
+                if (written != request->len) {
+                    writer->errors++;
+                }
+            }
+            if (request->release) {
+                spsc_ring_push(&writer->free_blocks, &request->block, NULL);
+            }
+            break;
+        case STORAGE_OP_CLOSE:
+            if (fclose(request->file) != 0) {
+                writer->errors++;
+            }
+            writer->write_us += esp_timer_get_time() - start_us;
+            break;
+        case STORAGE_OP_SYNC:
+            // Directory entry and FAT reach the card now, not only at fclose
+            if (fflush(request->file) != 0 || fsync(fileno(request->file)) != 0) {
+                writer->errors++;
+            }
+            writer->syncs++;
+            writer->write_us += esp_timer_get_time() - start_us;
+            break;
+        case STORAGE_OP_CALL:
+            request->call(request->ctx, request->file);
+            writer->write_us += esp_timer_get_time() - start_us;
+            break;
+        default:
+            break;
+    }
+}
+
+static void storage_writer_task(void *parameters)
+{
+    storage_writer_t *writer = (storage_writer_t *)parameters;
+    storage_request_t batch[STORAGE_WRITER_BATCH];
+
+    while (true) {
+        uint32_t count = spsc_ring_pop_batch(&writer->requests, batch, STORAGE_WRITER_BATCH);
+        if (count == 0) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STORAGE_WRITER_IDLE_MS));
+            continue;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            storage_writer_execute(writer, &batch[i]);
+            atomic_fetch_sub(&writer->pending, 1);
+        }
+    }
+}
+
+static void storage_writer_free(storage_writer_t *writer)
+{
+    if (writer->blocks) {
+        for (uint32_t i = 0; i < writer->block_count; i++) {
+            free(writer->blocks[i]);
+        }
+        free(writer->blocks);
+        writer->blocks = NULL;
+    }
+    spsc_ring_deinit(&writer->requests);
+    spsc_ring_deinit(&writer->free_blocks);
+}
+
+bool storage_writer_init(storage_writer_t *writer, const storage_writer_config_t *config)
+{
+    if (writer == NULL || config == NULL || config->block_size == 0 || config->block_count == 0) {
+        return false;
+    }
+
+    memset(writer, 0, sizeof(*writer));
+    writer->block_size = config->block_size;
+    writer->block_count = config->block_count;
+
+    // One allocation per block, a single large one rarely fits next to the Wi-Fi buffers
+    writer->blocks = calloc(config->block_count, sizeof(uint8_t *));
+    if (writer->blocks == NULL ||
+        !spsc_ring_init(&writer->requests, config->queue_len, sizeof(storage_request_t)) ||
+        !spsc_ring_init(&writer->free_blocks, config->block_count, sizeof(uint8_t *))) {
+        storage_writer_free(writer);
+        return false;
+    }
+    for (uint32_t i = 0; i < config->block_count; i++) {
+        writer->blocks[i] = malloc(config->block_size);
+        if (writer->blocks[i] == NULL) {
+            storage_writer_free(writer);
+            return false;
+        }
+        spsc_ring_push(&writer->free_blocks, &writer->blocks[i], NULL);
+    }
+
+    if (xTaskCreatePinnedToCore(storage_writer_task, "storageT", config->stack_size, writer, config->priority,
+                                &writer->task, config->core) != pdPASS) {
+        storage_writer_free(writer);
+        return false;
+    }
+    return true;
+}
+
+storage_writer_t *storage_writer_default(void)
+{
+    static storage_writer_t writer;
+    static bool started = false;
+    static const storage_writer_config_t config = {
+        .block_size = CONFIG_STORAGE_BLOCK_SIZE,
+        .block_count = CONFIG_STORAGE_BLOCK_COUNT,
+        .queue_len = CONFIG_STORAGE_QUEUE_LEN,
+        .stack_size = CONFIG_STORAGE_TASK_STACK_SIZE,
+        .priority = CONFIG_STORAGE_TASK_PRIORITY,
+        .core = CONFIG_STORAGE_TASK_CORE,
+    };
+
+    if (!started) {
+        if (!storage_writer_init(&writer, &config)) {
+            ESP_LOGE(STORAGE_TAG, "Failed to start the storage task with %u blocks of %u bytes",
+                     (unsigned)config.block_count, (unsigned)config.block_size);
+            return NULL;
+        }
+        started = true;
+    }
+    return &writer;
+}
+
+uint8_t *storage_writer_acquire(storage_writer_t *writer)
+{
+    uint8_t *block;
+
+    if (spsc_ring_pop_batch(&writer->free_blocks, &block, 1)) {
+        return block;
+    }
+
+    // Every block is full or queued, the SD card is behind
+    int64_t start_us = esp_timer_get_time();
+    writer->stalls++;
+    while (spsc_ring_pop_batch(&writer->free_blocks, &block, 1) == 0) {
+        vTaskDelay(1);
+    }
+    writer->blocked_us += esp_timer_get_time() - start_us;
+    return block;
+}
+
+void storage_writer_submit(storage_writer_t *writer, const storage_request_t *request)
+{
+    bool drained;
+
+    atomic_fetch_add(&writer->pending, 1);
+    if (spsc_ring_push(&writer->requests, request, &drained) == 0) {
+        // A request is pushed exactly once, a second copy would write or close twice and leave pending off by one.
+        // There is one producer at a time, so the push succeeds once the storage task has made room.
+        int64_t start_us = esp_timer_get_time();
+        writer->stalls++;
+        while (spsc_ring_count(&writer->requests) >= writer->requests.capacity) {
+            vTaskDelay(1);
+        }
+        spsc_ring_push(&writer->requests, request, &drained);
+        writer->blocked_us += esp_timer_get_time() - start_us;
+    }
+    if (drained) {
+        xTaskNotifyGive(writer->task);
+    }
+}
+
+bool storage_writer_sync(storage_writer_t *writer, uint32_t timeout_ms)
+{
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+
+    while (atomic_load(&writer->pending)) {
+        if (esp_timer_get_time() >= deadline_us) {
+            return false;
+        }
+        vTaskDelay(1);
+    }
+    return true;
+}
+
+void storage_writer_reset_stats(storage_writer_t *writer)
+{
+    writer->stalls = 0;
+    writer->blocked_us = 0;
+    writer->writes = 0;
+    writer->write_us = 0;
+    writer->bytes = 0;
+    writer->errors = 0;
+    writer->syncs = 0;
+    memset(&writer->latency, 0, sizeof(writer->latency));
+    atomic_store(&writer->requests.high_water, 0);
+    atomic_store(&writer->requests.dropped, 0);
+}
+
+uint32_t storage_writer_depth(storage_writer_t *writer)
+{
+    return spsc_ring_count(&writer->requests);
+}
+
+void storage_stream_open(storage_stream_t *stream, storage_writer_t *writer, FILE *file)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->writer = writer;
+    stream->file = file;
+}
+
+esp_err_t storage_stream_write(storage_stream_t *stream, const void *data, uint32_t len, int64_t now_us)
+{
+    const uint8_t *src = data;
+    storage_writer_t *writer = stream->writer;
+
+    if (writer == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len && stream->oldest_us == 0) {
+        stream->oldest_us = now_us ? now_us : 1;
+    }
+    while (len) {
+        if (stream->block == NULL) {
+            stream->block = storage_writer_acquire(writer);
+        }
+        uint32_t chunk = writer->block_size - stream->fill;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(stream->block + stream->fill, src, chunk);
+        stream->fill += chunk;
+        src += chunk;
+        len -= chunk;
+        if (stream->fill == writer->block_size) {
+            storage_request_t request = {
+                .file = stream->file,
+                .block = stream->block,
+                .offset = stream->sent,
+                .len = stream->fill - stream->sent,
+                .op = STORAGE_OP_WRITE,
+                .release = true,
+            };
+            storage_writer_submit(writer, &request);
+            stream->block = NULL;
+            stream->fill = 0;
+            stream->sent = 0;
+            // What is left of this write starts the next block
+            stream->oldest_us = len ? stream->oldest_us : 0;
+        }
+    }
+    return ESP_OK;
+}
+
+void storage_stream_flush(storage_stream_t *stream)
+{
+    if (stream->writer == NULL || stream->fill == stream->sent) {
+        return;
+    }
+    // The rest of the block is only appended to, the storage task may read the sent part meanwhile
+    storage_request_t request = {
+        .file = stream->file,
+        .block = stream->block,
+        .offset = stream->sent,
+        .len = stream->fill - stream->sent,
+        .op = STORAGE_OP_WRITE,
+        .release = false,
+    };
+    storage_writer_submit(stream->writer, &request);
+    stream->sent = stream->fill;
+    stream->oldest_us = 0;
+}
+
+bool storage_stream_flush_due(storage_stream_t *stream, int64_t now_us, int64_t max_age_us)
+{
+    if (stream->oldest_us == 0 || now_us - stream->oldest_us < max_age_us) {
+        return false;
+    }
+    storage_stream_flush(stream);
+    return true;
+}
+
+void storage_stream_call(storage_stream_t *stream, storage_call_t call, void *ctx)
+{
+    if (stream->writer == NULL) {
+        return;
+    }
+    storage_stream_flush(stream);
+    storage_request_t request = {
+        .file = stream->file,
+        .op = STORAGE_OP_CALL,
+        .call = call,
+        .ctx = ctx,
+    };
+    storage_writer_submit(stream->writer, &request);
+}
+
+void storage_stream_sync(storage_stream_t *stream)
+{
+    if (stream->writer == NULL) {
+        return;
+    }
+    storage_stream_flush(stream);
+    storage_request_t request = { .file = stream->file, .op = STORAGE_OP_SYNC };
+    storage_writer_submit(stream->writer, &request);
+}
+
+void storage_stream_close(storage_stream_t *stream)
+{
+    if (stream->writer == NULL) {
+        return;
+    }
+    storage_request_t request = {
+        .file = stream->file,
+        .block = stream->block,
+        .offset = stream->sent,
+        .len = stream->fill - stream->sent,
+        .op = STORAGE_OP_WRITE,
+        .release = true,
+    };
+    if (stream->block) {
+        storage_writer_submit(stream->writer, &request);
+    }
+    request = (storage_request_t) { .file = stream->file, .op = STORAGE_OP_CLOSE };
+    storage_writer_submit(stream->writer, &request);
+    memset(stream, 0, sizeof(*stream));
+}
+
+uint32_t storage_stream_pending(const storage_stream_t *stream)
+{
+    return stream->fill - stream->sent;
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "spsc_ring.h"
+#include "capture_stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Operations of the storage task
+ */
+typedef enum {
+    STORAGE_OP_WRITE = 0,       /*!< fwrite len bytes at block + offset */
+    STORAGE_OP_CLOSE,           /*!< fclose the file after everything queued before */
+    STORAGE_OP_CALL,            /*!< Run call(ctx, file) on the storage task after everything queued before */
+    STORAGE_OP_SYNC,            /*!< fflush and fsync the file after everything queued before */
+} storage_op_t;
+
+/**
+ * @brief Work run on the storage task in order with the writes of a file
+ */
+typedef void (*storage_call_t)(void *ctx, FILE *file);
+
+/**
+ * @brief One request from the producer to the storage task
+ */
+typedef struct {
+    FILE *file;
+    uint8_t *block;             /*!< Block holding the data */
+    uint32_t offset;
+    uint32_t len;
+    uint8_t op;                 /*!< storage_op_t */
+    bool release;               /*!< Return the block to the free list once written */
+    storage_call_t call;        /*!< STORAGE_OP_CALL only */
+    void *ctx;
+} storage_request_t;
+
+/**
+ * @brief Sizes and placement of the storage task
+ */
+typedef struct {
+    uint32_t block_size;        /*!< Bytes per block, ideally the FAT allocation unit */
+    uint32_t block_count;       /*!< Blocks shared by every open stream, two per stream for ping-pong */
+    uint32_t queue_len;         /*!< Requests in flight */
+    uint32_t stack_size;
+    UBaseType_t priority;
+    BaseType_t core;
+} storage_writer_config_t;
+
+/**
+ * @brief Storage task that owns every fwrite/fclose of the capture files
+ *
+ * A producer fills fixed-size blocks in RAM and hands them over together with
+ * the FILE they belong to, the storage task writes them out and puts the block
+ * back on the free list. The producer only waits when every block is full or
+ * queued, those waits are counted as stalls together with the time spent.
+ * One producer task at a time, the storage task is the only consumer.
+ */
+typedef struct {
+    spsc_ring_t requests;       /*!< Producer -> storage task, storage_request_t */
+    spsc_ring_t free_blocks;    /*!< Storage task -> producer, uint8_t * */
+    uint8_t **blocks;
+    uint32_t block_size;
+    uint32_t block_count;
+    TaskHandle_t task;
+    atomic_uint pending;        /*!< Requests pushed and not finished */
+    // Producer side
+    uint32_t stalls;            /*!< Waits for a free block or request slot */
+    uint64_t blocked_us;        /*!< Time spent in those waits */
+    // Storage task side
+    uint32_t writes;            /*!< fwrite calls */
+    uint64_t write_us;          /*!< Time spent in fwrite and fclose */
+    uint64_t bytes;
+    uint32_t errors;            /*!< Short writes, failed syncs and closes */
+    uint32_t syncs;             /*!< fsync calls */
+    latency_histogram_t latency;/*!< Per fwrite call */
+} storage_writer_t;
+
+/**
+ * @brief Block buffered output to one file through a storage writer
+ *
+ * Data is copied into the current block, a full block is handed over whole
+ * and a fresh one taken. storage_stream_flush() hands over the bytes not sent
+ * yet and keeps filling the same block, so full blocks still end on a block
+ * boundary of the file. Only the producer task touches a stream.
+ */
+typedef struct {
+    storage_writer_t *writer;   /*!< NULL while closed */
+    FILE *file;
+    uint8_t *block;             /*!< NULL until the first write */
+    uint32_t fill;              /*!< Bytes in block */
+    uint32_t sent;              /*!< Leading bytes of block already handed over */
+    int64_t oldest_us;          /*!< When the oldest byte not handed over was added, 0 for none */
+} storage_stream_t;
+
+/**
+ * @brief Allocate the blocks and queues and start the storage task
+ *
+ * @return true on success, false if out of memory or the task could not be created
+ */
+bool storage_writer_init(storage_writer_t *writer, const storage_writer_config_t *config);
+
+/**
+ * @brief Storage writer of the capture files, started with the config.h sizes on first use
+ *
+ * @return writer, NULL if it could not be started
+ */
+storage_writer_t *storage_writer_default(void);
+
+/**
+ * @brief Take an empty block, waits while none is free
+ */
+uint8_t *storage_writer_acquire(storage_writer_t *writer);
+
+/**
+ * @brief Queue a request, waits while the request queue is full
+ */
+void storage_writer_submit(storage_writer_t *writer, const storage_request_t *request);
+
+/**
+ * @brief Wait until every queued request is done
+ *
+ * @return true when idle, false on timeout
+ */
+bool storage_writer_sync(storage_writer_t *writer, uint32_t timeout_ms);
+
+/**
+ * @brief Zero the stall, write and latency counters, call while the writer is idle
+ */
+void storage_writer_reset_stats(storage_writer_t *writer);
+
+/**
+ * @brief Number of requests waiting for the storage task
+ */
+uint32_t storage_writer_depth(storage_writer_t *writer);
+
+/**
+ * @brief Start buffered output to an open file, the stream takes ownership of it
+ */
+void storage_stream_open(storage_stream_t *stream, storage_writer_t *writer, FILE *file);
+
+/**
+ * @brief Append data, hands over every block that fills up
+ *
+ * @param now_us esp_timer time, starts the flush timer of the data
+ * @return ESP_OK, ESP_ERR_INVALID_STATE when the stream is closed. Write errors are counted by the writer.
+ */
+esp_err_t storage_stream_write(storage_stream_t *stream, const void *data, uint32_t len, int64_t now_us);
+
+/**
+ * @brief Hand over the bytes of the current block not sent yet
+ */
+void storage_stream_flush(storage_stream_t *stream);
+
+/**
+ * @brief Flush once the oldest buffered byte is max_age_us old
+ *
+ * @return true if a flush was issued
+ */
+bool storage_stream_flush_due(storage_stream_t *stream, int64_t now_us, int64_t max_age_us);
+
+/**
+ * @brief Hand over the bytes not sent yet, then run call(ctx, file) on the storage task
+ *
+ * The file position seen by call is the end of everything written to the
+ * stream so far, ctx has to stay valid until the call ran.
+ */
+void storage_stream_call(storage_stream_t *stream, storage_call_t call, void *ctx);
+
+/**
+ * @brief Hand over the bytes not sent yet, then fsync the file on the storage task
+ *
+ * Everything written so far survives a power loss once the storage task got
+ * to it, use storage_writer_sync() to wait for that.
+ */
+void storage_stream_sync(storage_stream_t *stream);
+
+/**
+ * @brief Hand over the rest, release the block and queue the fclose
+ *
+ * The file is closed asynchronously, use storage_writer_sync() to wait for it.
+ */
+void storage_stream_close(storage_stream_t *stream);
+
+/**
+ * @brief Bytes added and not handed over yet
+ */
+uint32_t storage_stream_pending(const storage_stream_t *stream);
+
+#ifdef __cplusplus
+}
+#endif
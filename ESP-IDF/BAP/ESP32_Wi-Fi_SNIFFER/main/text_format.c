@@ -0,0 +1,104 @@
+#include <string.h>
+#include "text_format.h"
+
+#define HEX_ROW(h) \
+    {h, '0'}, {h, '1'}, {h, '2'}, {h, '3'}, {h, '4'}, {h, '5'}, {h, '6'}, {h, '7'}, \
+    {h, '8'}, {h, '9'}, {h, 'A'}, {h, 'B'}, {h, 'C'}, {h, 'D'}, {h, 'E'}, {h, 'F'}
+
+// Two upper case hex digits of every byte value
+static const char hex_pairs[256][2] = {
+    HEX_ROW('0'), HEX_ROW('1'), HEX_ROW('2'), HEX_ROW('3'), HEX_ROW('4'), HEX_ROW('5'), HEX_ROW('6'), HEX_ROW('7'),
+    HEX_ROW('8'), HEX_ROW('9'), HEX_ROW('A'), HEX_ROW('B'), HEX_ROW('C'), HEX_ROW('D'), HEX_ROW('E'), HEX_ROW('F'),
+};
+
+static const uint32_t pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+void text_time_cache_init(text_time_cache_t *cache)
+{
+    cache->second = -1;
+    cache->len = 0;
+    cache->text[0] = '\0';
+}
+
+/* value with exactly width digits, leading zeros included */
+static void put_digits(char *out, uint32_t value, uint8_t width)
+{
+    while (width) {
+        out[--width] = '0' + value % 10;
+        value /= 10;
+    }
+}
+
+size_t text_format_time(text_time_cache_t *cache, uint64_t timestamp_us, uint8_t digits, char *out)
+{
+    time_t second = timestamp_us / 1000000;
+
+    if (second != cache->second) {
+        struct tm timeinfo;
+        localtime_r(&second, &timeinfo);
+        size_t len = strftime(cache->text, sizeof(cache->text) - 8, "%c", &timeinfo);
+        cache->len = len;
+        cache->text[len] = '\0';
+        cache->second = second;
+    }
+    memcpy(out, cache->text, cache->len);
+    size_t len = cache->len;
+    if (digits > 6) {
+        digits = 6;
+    }
+    if (digits) {
+        out[len++] = '.';
+        put_digits(out + len, (uint32_t)(timestamp_us % 1000000) / pow10[6 - digits], digits);
+        len += digits;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+size_t text_format_mac(char *out, const uint8_t mac[6])
+{
+    for (int i = 0; i < 6; i++) {
+        memcpy(out + 3 * i, hex_pairs[mac[i]], 2);
+        if (i < 5) {
+            out[3 * i + 2] = ':';
+        }
+    }
+    return TEXT_FORMAT_MAC_LEN;
+}
+
+size_t text_format_int(char *out, int32_t value)
+{
+    char digits[10];
+    size_t len = 0, count = 0;
+    uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+
+    if (value < 0) {
+        out[len++] = '-';
+    }
+    do {
+        digits[count++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+    while (count) {
+        out[len++] = digits[--count];
+    }
+    return len;
+}
+
+size_t text_format_epoch_us(char *out, uint64_t timestamp_us)
+{
+    char digits[20];
+    uint64_t seconds = timestamp_us / 1000000;
+    size_t len = 0, count = 0;
+
+    do {
+        digits[count++] = '0' + seconds % 10;
+        seconds /= 10;
+    } while (seconds);
+    while (count) {
+        out[len++] = digits[--count];
+    }
+    out[len++] = '.';
+    put_digits(out + len, (uint32_t)(timestamp_us % 1000000), 6);
+    return len + 6;
+}
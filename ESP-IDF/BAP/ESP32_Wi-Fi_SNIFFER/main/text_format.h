@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TEXT_FORMAT_TIME_MAX        48      /*!< Longest text_format_time() output with 6 digits, NUL included */
+#define TEXT_FORMAT_MAC_LEN         17      /*!< "XX:XX:XX:XX:XX:XX" without NUL */
+#define TEXT_FORMAT_EPOCH_MAX       28      /*!< Longest text_format_epoch_us() output, NUL included */
+
+/**
+ * @brief Local time text of the last second seen
+ *
+ * localtime() and strftime("%c") only run when a record falls into another
+ * second than the one before, consecutive records copy the cached text. A
+ * time zone change shows from the next second on. One cache per task.
+ */
+typedef struct {
+    time_t second;                  /*!< Second the text belongs to, -1 for none */
+    uint8_t len;
+    char text[TEXT_FORMAT_TIME_MAX];
+} text_time_cache_t;
+
+/**
+ * @brief Start a cache with nothing in it
+ */
+void text_time_cache_init(text_time_cache_t *cache);
+
+/**
+ * @brief strftime("%c") of the local time, with digits (0-6) decimals of the second after a '.'
+ *
+ * @param out at least TEXT_FORMAT_TIME_MAX bytes, NUL terminated
+ * @return length without the NUL
+ */
+size_t text_format_time(text_time_cache_t *cache, uint64_t timestamp_us, uint8_t digits, char *out);
+
+/**
+ * @brief "XX:XX:XX:XX:XX:XX" in upper case hex from a 256 entry table, no NUL
+ *
+ * @return TEXT_FORMAT_MAC_LEN
+ */
+size_t text_format_mac(char *out, const uint8_t mac[6]);
+
+/**
+ * @brief Decimal text of a signed integer, no NUL
+ *
+ * @param out at least 11 bytes
+ * @return length
+ */
+size_t text_format_int(char *out, int32_t value);
+
+/**
+ * @brief "seconds.microseconds" since epoch with all 6 decimals, no NUL, like "%llu.%06lu"
+ *
+ * @param out at least TEXT_FORMAT_EPOCH_MAX bytes
+ * @return length
+ */
+size_t text_format_epoch_us(char *out, uint64_t timestamp_us);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,90 @@
+#include <stdlib.h>
+#include <string.h>
+#include "trace_ring.h"
+
+bool trace_ring_init(trace_ring_t *ring, uint32_t capacity)
+{
+    if (ring == NULL || capacity == 0) {
+        return false;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+
+    uint32_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    // calloc so never written entries fail the seq check in trace_ring_snapshot()
+    ring->entries = calloc(size, sizeof(trace_entry_t));
+    if (ring->entries == NULL) {
+        return false;
+    }
+
+    ring->capacity = size;
+    ring->mask = size - 1;
+    return true;
+}
+
+void trace_ring_deinit(trace_ring_t *ring)
+{
+    if (ring == NULL) {
+        return;
+    }
+    free(ring->entries);
+    ring->entries = NULL;
+    ring->capacity = 0;
+}
+
+void trace_ring_record(trace_ring_t *ring, uint16_t event, uint32_t timestamp, uint32_t arg0, uint32_t arg1)
+{
+    if (ring->entries == NULL) {
+        return;
+    }
+
+    uint32_t idx = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+    trace_entry_t *entry = &ring->entries[idx & ring->mask];
+
+    // Half a wrap away from any seq a reader can expect, a snapshot copying the old entry sees it changed
+    entry->seq = (uint16_t)(idx + 1 + 0x8000);
+    atomic_thread_fence(memory_order_release);
+    entry->timestamp = timestamp;
+    entry->event = event;
+    entry->arg0 = arg0;
+    entry->arg1 = arg1;
+    // seq is stored last, a reader seeing the new seq also sees the new fields
+    atomic_thread_fence(memory_order_release);
+    entry->seq = (uint16_t)(idx + 1);
+}
+
+uint32_t trace_ring_snapshot(trace_ring_t *ring, trace_entry_t *out, uint32_t max)
+{
+    if (ring->entries == NULL) {
+        return 0;
+    }
+
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t count = head < ring->capacity ? head : ring->capacity;
+    if (count > max) {
+        count = max;
+    }
+
+    uint32_t copied = 0;
+    for (uint32_t idx = head - count; idx != head; idx++) {
+        const trace_entry_t *slot = &ring->entries[idx & ring->mask];
+        uint16_t seq = (uint16_t)(idx + 1);
+        // Skip slots that were not written yet or already reused by a newer event
+        if (slot->seq != seq) {
+            continue;
+        }
+        atomic_thread_fence(memory_order_acquire);
+        trace_entry_t entry = *slot;
+        atomic_thread_fence(memory_order_acquire);
+        // and slots a writer started on during the copy, their fields may be torn
+        if (slot->seq == seq) {
+            out[copied++] = entry;
+        }
+    }
+
+    return copied;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief One binary trace event
+ */
+typedef struct {
+    uint32_t timestamp;     /*!< Microseconds, caller defined clock */
+    uint16_t event;         /*!< Event id */
+    uint16_t seq;           /*!< Low bits of the write index, used to skip entries being overwritten or torn */
+    uint32_t arg0;          /*!< Event specific argument */
+    uint32_t arg1;          /*!< Event specific argument */
+} trace_entry_t;
+
+/**
+ * @brief Fixed-size event ring that overwrites the oldest entries
+ *
+ * Any number of tasks (and the Wi-Fi driver callback) may record at the same
+ * time, a record costs one atomic increment and a 16 byte store. The ring is
+ * meant to be read after the fact with trace_ring_snapshot().
+ */
+typedef struct {
+    trace_entry_t *entries;     /*!< capacity entries */
+    uint32_t capacity;          /*!< Number of entries, power of two */
+    uint32_t mask;              /*!< capacity - 1 */
+    atomic_uint head;           /*!< Total number of events recorded */
+} trace_ring_t;
+
+/**
+ * @brief Allocate the ring storage
+ *
+ * @param ring ring object
+ * @param capacity requested number of entries, rounded up to a power of two
+ * @return true on success, false if out of memory or arguments are invalid
+ */
+bool trace_ring_init(trace_ring_t *ring, uint32_t capacity);
+
+/**
+ * @brief Free the ring storage
+ */
+void trace_ring_deinit(trace_ring_t *ring);
+
+/**
+ * @brief Record one event, never blocks
+ *
+ * Does nothing if the ring is not initialized.
+ */
+void trace_ring_record(trace_ring_t *ring, uint16_t event, uint32_t timestamp, uint32_t arg0, uint32_t arg1);
+
+/**
+ * @brief Copy the retained events, oldest first
+ *
+ * @param ring ring object
+ * @param out destination array
+ * @param max size of out in entries
+ * @return number of entries copied
+ */
+uint32_t trace_ring_snapshot(trace_ring_t *ring, trace_entry_t *out, uint32_t max);
+
+#ifdef __cplusplus
+}
+#endif
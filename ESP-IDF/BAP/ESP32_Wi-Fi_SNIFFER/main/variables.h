@@ -35,6 +35,19 @@ extern bool load_json;
 
 extern bool flip_oled;
 extern bool display_battery_data;
+extern bool save_pcap;
+extern bool coalesce_bursts;
+extern bool reduced_binary;
+extern uint32_t csv_flush_records;
+extern uint32_t csv_flush_ms;
+extern uint32_t live_max_per_s;
+extern uint32_t pcap_snaplen;
+extern bool pcap_ies_only;
+extern uint32_t pcap_flush_ms;
+extern bool pcapng;
+extern uint32_t pcap_segment_mb;
+extern bool pcap_index;
+extern bool archive_pcap;
 
 extern bool sniffer_running;
 extern bool server_running;
@@ -49,7 +62,7 @@ extern char server_wifi_password[64];
 
 typedef struct {
     int rssi;
-    char mac_address[18];
+    uint8_t mac[6];         // Formatted only where it is displayed
     time_t timestamp;
 } top_request_t;
 
@@ -1,7 +1,7 @@
 from scapy.all import rdpcap, wrpcap
 import os
 
-def combine_pcaps(pcap_files, output_file="concatenated_output.pcap", progress_callback=None):
+def combine_pcaps(pcap_files, output_file="concatenated_output.pcap", progress_callback=None, time_window=None):
     all_packets = []
 
     for count, file_path in enumerate(pcap_files, start=1):
@@ -14,6 +14,12 @@ def combine_pcaps(pcap_files, output_file="concatenated_output.pcap", progress_c
                 print(f"[DEBUG] Warning: {file_path} is empty or unreadable, skipping.")
                 continue
 
+            # Whole files are skipped by their index, packets near the window edges here
+            if time_window:
+                start, end = time_window
+                packets = [pkt for pkt in packets
+                           if (start is None or pkt.time >= start) and (end is None or pkt.time <= end)]
+
             all_packets.extend(packets)
 
         except Exception as e:
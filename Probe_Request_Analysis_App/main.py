@@ -60,7 +60,7 @@ This tool allows you to process .pcap and .csv files.
 
 To begin, use the Setup tab to select the input directory containing .pcap files 
 and REDUCED_DATA.csv file from your capture session.
-REDUCED_DATA.csv is only used for Reduced analysis, so it isn't mandatory.
+REDUCED_DATA.csv (or REDUCED_DATA.bin) is only used for Reduced analysis, so it isn't mandatory.
 
 If you already have these files preprocessed, you can select the Quick analysis option.
 
@@ -0,0 +1,135 @@
+import os
+import numpy as np
+
+# Layout of main/pcap_index.h in the sniffer firmware, little endian
+HEADER_DTYPE = np.dtype([
+    ('magic', 'S4'),
+    ('version', '<u2'),
+    ('header_size', '<u2'),
+    ('entry_size', '<u2'),
+    ('flags', '<u2'),
+    ('every_records', '<u4'),
+    ('every_ms', '<u4'),
+    ('reserved', '<u4'),
+])
+
+ENTRY_DTYPE = np.dtype([
+    ('timestamp_us', '<u8'),
+    ('offset', '<u4'),
+    ('count', '<u4'),
+])
+
+MAGIC = b'PIDX'
+VERSION = 1
+FLAG_PCAPNG = 0x0001
+
+
+def index_path(capture_path):
+    """file_000001.pcap, .pcapng and their .gz archives share file_000001.idx."""
+    directory, name = os.path.split(capture_path)
+    return os.path.join(directory, name.split('.', 1)[0] + '.idx')
+
+
+def load_index(path):
+    """Read an index sidecar, returns the header as a dict and the entries as a structured array.
+
+    Entries grow in offset and time. timestamp_us is the latest record time up
+    to the entry, so it never goes back even when the sniffer clock did.
+    """
+    header = np.fromfile(path, dtype=HEADER_DTYPE, count=1)
+    if len(header) != 1 or header['magic'][0] != MAGIC:
+        raise ValueError(f"{path} is not a pcap index")
+    header = {name: header[name][0] for name in HEADER_DTYPE.names}
+    if header['version'] != VERSION or header['entry_size'] != ENTRY_DTYPE.itemsize:
+        raise ValueError(f"{path}: unsupported version {header['version']}, entry size {header['entry_size']}")
+
+    with open(path, 'rb') as f:
+        f.seek(int(header['header_size']))
+        data = f.read()
+    count = len(data) // ENTRY_DTYPE.itemsize
+    return header, np.frombuffer(data[:count * ENTRY_DTYPE.itemsize], dtype=ENTRY_DTYPE)
+
+
+def _usable_entries(capture_path, entries):
+    """Entries of records that made it into the file and whether the file was closed.
+
+    After a reset the index can point past the recovered capture. A gzipped
+    file was closed before it was archived, its raw length is not known here.
+    """
+    if capture_path.endswith('.gz'):
+        return entries, True
+    size = os.path.getsize(capture_path)
+    entries = entries[entries['offset'] <= size]
+    return entries, len(entries) > 0 and int(entries['offset'][-1]) == size
+
+
+def capture_span(capture_path):
+    """First and last record time of a capture in microseconds since epoch.
+
+    The end is None for a file that was not closed (later records may follow
+    the last entry), the whole span is None without a usable index.
+    """
+    path = index_path(capture_path)
+    if not os.path.isfile(path):
+        return None
+    try:
+        _, entries = load_index(path)
+    except ValueError:
+        return None
+    entries, closed = _usable_entries(capture_path, entries)
+    if len(entries) == 0:
+        return None
+    return int(entries['timestamp_us'][0]), int(entries['timestamp_us'][-1]) if closed else None
+
+
+def files_in_window(capture_paths, start_s, end_s):
+    """Captures that may hold records between start_s and end_s (epoch seconds, None for open ends).
+
+    Files without an index are kept, they cannot be ruled out.
+    """
+    start_us = None if start_s is None else int(start_s * 1e6)
+    end_us = None if end_s is None else int(end_s * 1e6)
+    selected = []
+    for capture_path in capture_paths:
+        span = capture_span(capture_path)
+        if span is not None:
+            first_us, last_us = span
+            if end_us is not None and first_us > end_us:
+                continue
+            if start_us is not None and last_us is not None and last_us < start_us:
+                continue
+        selected.append(capture_path)
+    return selected
+
+
+def read_range(capture_path, start_s, end_s):
+    """Bytes of a raw capture holding its records between start_s and end_s, file header included.
+
+    The result is a valid pcap or pcapng file again. It may hold up to one
+    index interval of records outside the window on either side. None when
+    the file has no usable index or nothing in the window. Archived (.gz)
+    files are not seekable and have to be read whole.
+    """
+    if capture_path.endswith('.gz'):
+        return None
+    path = index_path(capture_path)
+    if not os.path.isfile(path):
+        return None
+    _, entries = load_index(path)
+    entries, closed = _usable_entries(capture_path, entries)
+    if len(entries) == 0:
+        return None
+    times = entries['timestamp_us']
+    start_us, end_us = int(start_s * 1e6), int(end_s * 1e6)
+    if end_us < times[0] or (closed and start_us > times[-1]):
+        return None
+
+    # Same search as pcap_index_lookup() on the sniffer
+    first = max(int(np.searchsorted(times, start_us, side='left')) - 1, 0)
+    last = int(np.searchsorted(times, end_us, side='right'))
+    begin = int(entries['offset'][first])
+    end = int(entries['offset'][last]) if last < len(entries) else os.path.getsize(capture_path)
+    with open(capture_path, 'rb') as f:
+        header = f.read(int(entries['offset'][0]))
+        f.seek(begin)
+        return header + f.read(end - begin)
@@ -22,13 +22,14 @@ def apply_common_theme():
 
 # Utility function to identify heartbeat packets
 def is_heartbeat(row):
-    """Check if a row represents a heartbeat packet"""
+    """Check if a row is a sniffer record (heartbeat or output mode marker) rather than a probe request"""
     # Strip whitespace from MAC address and RSSI for proper comparison
     mac_clean = str(row['MAC']).strip()
     rssi_clean = str(row['RSSI']).strip()
     
+    # "-1 [HEARTBEAT]", or "-1 [MODE csv_only]" when the sniffer sheds output under load
     return (mac_clean == '00:00:00:00:00:00' and 
-            rssi_clean == '-1 [HEARTBEAT]')
+            rssi_clean.startswith('-1 ['))
 
 
 def plot_packet_count(csv_file, plot_tab, time_resolution, save_figure, output_dir=None):
@@ -8,6 +8,8 @@ from relevant_data import extract_probe_requests
 from create_table import create_probe_requests_table
 from anonymize import anonymize_csv
 from reduced_match import rewrite_csv
+from reduced_bin import rewrite_bin
+from pcap_index import files_in_window
 from instances import extract_instances
 from devices import extract_devices
 
@@ -36,12 +38,14 @@ def check_required_files(input_dir, output_dir, quick_dir_var, anonymize, reduce
         if quick_dir_var:
             required_output_files.append("combined_output.pcap")
         elif reduced_analysis:
-            required_input_files.append("REDUCED_DATA.csv")
+            # Sniffers with "reduced_binary" set write REDUCED_DATA.bin instead
+            if not os.path.isfile(os.path.join(input_dir, "REDUCED_DATA.bin")):
+                required_input_files.append("REDUCED_DATA.csv")
             if create_table:
                 required_output_files.append("combined_output.pcap")
             if anonymize:
                 required_output_files.append("relevant_data.csv")
-        else:
+        elif not os.path.isfile(os.path.join(input_dir, "file_000000.pcapng")):
             required_input_files.append("file_000000.pcap")
 
     # Check for missing files
@@ -72,13 +76,24 @@ def update_progress_and_file_label(progress_callback, file_label_callback, progr
         file_label_callback(label_text)
 
 
-def process_pcap_files(input_dir, output_dir, progress_callback, file_label_callback, set_progress_max_callback):
-    """Process PCAP files from input directory."""
-    file_pattern = os.path.join(input_dir, "file_*.pcap")
-    pcap_files = sorted(glob(file_pattern))
+def process_pcap_files(input_dir, output_dir, progress_callback, file_label_callback, set_progress_max_callback,
+                       time_window=None):
+    """Process PCAP files from input directory, only packets within time_window (start, end in epoch seconds) if given."""
+    # The sniffer writes file_*.pcap or, with "pcapng" set, file_*.pcapng,
+    # with "archive_pcap" closed files are gzipped on the card (rdpcap reads them as they are)
+    pcap_files = sorted(glob(os.path.join(input_dir, "file_*.pcap")) +
+                        glob(os.path.join(input_dir, "file_*.pcapng")) +
+                        glob(os.path.join(input_dir, "file_*.pcap.gz")) +
+                        glob(os.path.join(input_dir, "file_*.pcapng.gz")))
     
     if not pcap_files:
         raise FileNotFoundError("No .pcap files found in the selected directory.")
+
+    # The .idx sidecars tell which files overlap the window without reading them
+    if time_window:
+        pcap_files = files_in_window(pcap_files, *time_window)
+        if not pcap_files:
+            raise FileNotFoundError("No .pcap files cover the selected time window.")
     
     total_files = len(pcap_files)
     total_steps = total_files + 3
@@ -90,6 +105,7 @@ def process_pcap_files(input_dir, output_dir, progress_callback, file_label_call
     combine_pcaps(
         pcap_files,
         output_file=f"{output_dir}/combined_output.pcap",
+        time_window=time_window,
         progress_callback=lambda count, file_name: (
             update_progress_and_file_label(progress_callback, file_label_callback, 
                                           count, f"Processing: {file_name} ({count}/{total_files})")
@@ -155,7 +171,7 @@ def plot_selected_data(data_file, selected_options, output_dir, reduced_analysis
 def process_files(input_dir, output_dir, selected_options, time_resolution, hours_apart, quick_dir_var, anonymize, reduced_analysis,
                   create_table, save_figure, progress_callback=None, file_label_callback=None, table_callback=None,
                   rssi_tab=None, packet_count_tab=None, mac_address_tab=None, ssid_tab=None, cdf_tab=None, 
-                  devices_tab=None, battery_tab=None, set_progress_max_callback=None):
+                  devices_tab=None, battery_tab=None, set_progress_max_callback=None, time_window=None):
     """
     Processes files based on the selected analysis options.
     """
@@ -178,9 +194,13 @@ def process_files(input_dir, output_dir, selected_options, time_resolution, hour
             elif reduced_analysis:
                 if set_progress_max_callback:
                     set_progress_max_callback(total_steps)
-                rewrite_csv(f"{input_dir}/REDUCED_DATA.csv", f"{output_dir}/REDUCED_DATA_MATCH.csv")
+                if os.path.isfile(f"{input_dir}/REDUCED_DATA.bin"):
+                    rewrite_bin(f"{input_dir}/REDUCED_DATA.bin", f"{output_dir}/REDUCED_DATA_MATCH.csv")
+                else:
+                    rewrite_csv(f"{input_dir}/REDUCED_DATA.csv", f"{output_dir}/REDUCED_DATA_MATCH.csv")
             else:
-                total_steps = process_pcap_files(input_dir, output_dir, progress_callback, file_label_callback, set_progress_max_callback)
+                total_steps = process_pcap_files(input_dir, output_dir, progress_callback, file_label_callback, set_progress_max_callback,
+                                                 time_window)
                 extract_and_process_data(output_dir, anonymize)
                 update_progress_and_file_label(progress_callback, file_label_callback, 
                                                None, "Finished extracting relevant data")
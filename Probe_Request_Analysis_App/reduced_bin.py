@@ -0,0 +1,136 @@
+import os
+import numpy as np
+
+# Layout of main/reduced_record.h in the sniffer firmware, little endian
+HEADER_DTYPE = np.dtype([
+    ('magic', 'S4'),
+    ('version', '<u2'),
+    ('header_size', '<u2'),
+    ('record_size', '<u2'),
+    ('reserved', '<u2'),
+    ('utc_offset_s', '<i4'),
+    ('created_us', '<u8'),
+    ('reserved2', 'u1', 8),
+])
+
+RECORD_DTYPE = np.dtype([
+    ('timestamp_us', '<u8'),
+    ('ie_hash', '<u4'),
+    ('mac', 'u1', 6),
+    ('seq', '<u2'),
+    ('rssi', 'i1'),
+    ('channel', 'u1'),
+    ('type', 'u1'),
+    ('count', 'u1'),
+])
+
+MAGIC = b'PRRB'
+VERSION = 1
+
+TYPE_PROBE = 0
+TYPE_BURST = 1
+TYPE_HEARTBEAT = 2
+TYPE_MODE = 3
+
+# load_shed_mode_t names, as in the "-1 [MODE ...]" CSV markers
+MODE_NAMES = ['full', 'csv_only', 'stats_only']
+
+CHUNK_ROWS = 1 << 20
+
+
+def load_reduced_bin(path):
+    """Map REDUCED_DATA.bin without parsing it.
+
+    Returns the header as a dict and the records as a read only structured
+    numpy.memmap. A record cut off at the end of the file is left out.
+    """
+    header = np.fromfile(path, dtype=HEADER_DTYPE, count=1)
+    if len(header) != 1 or header['magic'][0] != MAGIC:
+        raise ValueError(f"{path} is not a reduced binary file")
+    header = {name: header[name][0] for name in HEADER_DTYPE.names}
+    if header['version'] != VERSION or header['record_size'] != RECORD_DTYPE.itemsize:
+        raise ValueError(f"{path}: unsupported version {header['version']}, record size {header['record_size']}")
+
+    offset = int(header['header_size'])
+    count = (os.path.getsize(path) - offset) // RECORD_DTYPE.itemsize
+    if count <= 0:
+        return header, np.zeros(0, dtype=RECORD_DTYPE)
+    return header, np.memmap(path, dtype=RECORD_DTYPE, mode='r', offset=offset, shape=(count,))
+
+
+def local_offsets_s(records, previous):
+    """Local time minus UTC for every record.
+
+    Sniffer records (heartbeat, mode change) carry the offset of their moment
+    in ie_hash, it applies until the next one. previous is the offset in force
+    before the first record, the header one at the start of the file.
+    """
+    marker = records['type'] >= TYPE_HEARTBEAT
+    marker_offsets = records['ie_hash'].astype(np.uint32).view(np.int32).astype(np.int64)
+    last_marker = np.where(marker, np.arange(len(records)), -1)
+    np.maximum.accumulate(last_marker, out=last_marker)
+    return np.where(last_marker >= 0, marker_offsets[last_marker], previous)
+
+
+def _word_table(strings, words):
+    """Each string as a row of little endian uint32 words, NUL padded."""
+    width = 4 * words
+    return np.array([s.encode('ascii') for s in strings], dtype=f'S{width}').view('<u4').reshape(-1, words)
+
+
+def rewrite_bin(input_file, output_file):
+    """Write REDUCED_DATA_MATCH.csv from REDUCED_DATA.bin, as rewrite_csv does from the CSV.
+
+    Every line is put together from table lookups as a row of 32 bit words
+    with NUL padding, which is removed in one pass over the chunk, so no
+    Python code runs per record.
+    """
+    header, records = load_reduced_bin(input_file)
+
+    # "xx:" for the first five MAC bytes, "xx,," for the last one, which also closes the empty SSID column
+    mac_table = _word_table([f'{i:02x}:' for i in range(256)], 1)
+    mac_last_table = _word_table([f'{i:02x},,' for i in range(256)], 1)
+    time_table = _word_table([f'{i:02d}:' for i in range(60)], 1)
+    seconds_table = _word_table([f'{i:02d},' for i in range(60)], 1)
+    # Last column: RSSI -128..127, heartbeat, then one marker per mode
+    rssi_table = _word_table([f'{rssi}\n' for rssi in range(-128, 128)] + ['-1 [HEARTBEAT]\n'] +
+                             [f'-1 [MODE {name}]\n' for name in MODE_NAMES], 6)
+    offset = int(header['utc_offset_s'])
+
+    # Words: DATE, (3) TIME, (3) MAC, SSID (6), RSSI (6)
+    date, time, mac, rssi = 0, 3, 6, 12
+    width = 18
+
+    with open(output_file, 'wb') as outfile:
+        outfile.write(b'DATE,TIME,MAC,SSID,RSSI\n')
+        for start in range(0, len(records), CHUNK_ROWS):
+            chunk = records[start:start + CHUNK_ROWS]
+            rows = np.empty((len(chunk), width), dtype='<u4')
+
+            offsets = local_offsets_s(chunk, offset)
+            offset = int(offsets[-1])
+            local = (chunk['timestamp_us'] // 1000000).astype(np.int64) + offsets
+
+            # A capture spans few days, their dates are formatted once
+            days, seconds = np.divmod(local, 86400)
+            first_day = days.min()
+            day_range = np.arange(first_day, days.max() + 1).astype('datetime64[D]')
+            date_table = _word_table([f'{day},' for day in day_range.astype(str)], 3)
+            rows[:, date:date + 3] = date_table[days - first_day]
+            rows[:, time] = time_table[seconds // 3600, 0]
+            rows[:, time + 1] = time_table[seconds // 60 % 60, 0]
+            rows[:, time + 2] = seconds_table[seconds % 60, 0]
+
+            addresses = chunk['mac']
+            for k in range(5):
+                rows[:, mac + k] = mac_table[addresses[:, k], 0]
+            rows[:, mac + 5] = mac_last_table[addresses[:, 5], 0]
+
+            index = chunk['rssi'].astype(np.int64) + 128
+            index = np.where(chunk['type'] == TYPE_HEARTBEAT, 256, index)
+            mode = np.minimum(chunk['seq'] & 0xff, len(MODE_NAMES) - 1)
+            index = np.where(chunk['type'] == TYPE_MODE, 257 + mode, index)
+            rows[:, rssi:rssi + 6] = rssi_table[index]
+
+            data = rows.view(np.uint8).ravel()
+            outfile.write(data[data != 0].tobytes())